@@ -8,6 +8,8 @@
 #include <linux/if_addr.h>
 #include <linux/neighbour.h>
 
+typedef void (*rtnl_ack_err_t)(int tag, int error);
+
 struct rtnl_handle
 {
 	int			fd;
@@ -15,8 +17,28 @@ struct rtnl_handle
 	struct sockaddr_nl	peer;
 	__u32			seq;
 	__u32			dump;
+
+	/* Pipelined requests, see rtnl_set_window() */
+	int			window;
+	int			inflight;
+	int			tag;
+	int			*tags;
+	rtnl_ack_err_t		ack_err;
+
+	/* Receive buffers of rtnl_dump_filter_l() and rtnl_listen() */
+	char			*dumpbuf;
+	int			dumpsize;
+
+	int			flags;
 };
 
+/* rtnl_listen() reports lost notifications as NLMSG_OVERRUN messages */
+#define RTNL_HANDLE_F_OVERRUN	0x01
+/* The kernel filters dumps by their request, see rtnl_set_strict_dump() */
+#define RTNL_HANDLE_F_STRICT_CHK	0x02
+/* Dump errors are left to the caller to report, errno tells which */
+#define RTNL_HANDLE_F_SUPPRESS_NLERR	0x04
+
 extern int rcvbuf;
 
 extern int rtnl_open(struct rtnl_handle *rth, unsigned subscriptions);
@@ -24,6 +46,7 @@ extern int rtnl_open_byproto(struct rtnl_handle *rth, unsigned subscriptions, in
 extern void rtnl_close(struct rtnl_handle *rth);
 extern int rtnl_wilddump_request(struct rtnl_handle *rth, int fam, int type);
 extern int rtnl_dump_request(struct rtnl_handle *rth, int type, void *req, int len);
+extern int rtnl_set_strict_dump(struct rtnl_handle *rth);
 
 typedef int (*rtnl_filter_t)(const struct sockaddr_nl *,
 			     struct nlmsghdr *n, void *);
@@ -47,6 +70,9 @@ extern int rtnl_talk(struct rtnl_handle *rtnl, struct nlmsghdr *n, pid_t peer,
 		     unsigned groups, struct nlmsghdr *answer,
 		     rtnl_filter_t junk,
 		     void *jarg);
+extern int rtnl_set_window(struct rtnl_handle *rth, int window,
+			   rtnl_ack_err_t ack_err);
+extern int rtnl_wait_acks(struct rtnl_handle *rth, int limit);
 extern int rtnl_send(struct rtnl_handle *rth, const char *buf, int);
 extern int rtnl_send_check(struct rtnl_handle *rth, const char *buf, int);
 
@@ -73,6 +99,8 @@ extern int __parse_rtattr_nested_compat(struct rtattr *tb[], int max, struct rta
 
 extern int rtnl_listen(struct rtnl_handle *, rtnl_filter_t handler,
 		       void *jarg);
+extern int rtnl_listen_poll(struct rtnl_handle *, rtnl_filter_t handler,
+			    void *jarg, int timeout);
 extern int rtnl_from_file(FILE *, rtnl_filter_t handler,
 		       void *jarg);
 
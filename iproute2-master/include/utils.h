@@ -143,12 +143,22 @@ static inline __u32 nl_mgrp(__u32 group)
 
 int print_timestamp(FILE *fp);
 
+extern void output_init(FILE *fp);
+extern char *sprint_u32(char *buf, __u32 val);
+extern void fprint_field(FILE *fp, const char *name, const char *val);
+
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
 extern int cmdlineno;
 extern ssize_t getcmdline(char **line, size_t *len, FILE *in);
 extern int makeargs(char *line, char *argv[], int maxargs);
 
+/* Requests kept in flight by "-force -batch", see batch_ack_err() */
+#define BATCH_WINDOW	64
+extern const char *batch_name;
+extern int batch_errors;
+extern void batch_ack_err(int lineno, int error);
+
 struct iplink_req;
 int iplink_parse(int argc, char **argv, struct iplink_req *req,
 		char **name, char **type, char **link, char **dev,
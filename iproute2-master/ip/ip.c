@@ -33,6 +33,8 @@ char * _SL_ = NULL;
 char *batch_file = NULL;
 int force = 0;
 int max_flush_loops = 10;
+int do_all = 0;
+int netns_jobs = 0;
 
 struct rtnl_handle rth = { .fd = -1 };
 
@@ -50,7 +52,7 @@ static void usage(void)
 "                    -f[amily] { inet | inet6 | ipx | dnet | link } |\n"
 "                    -l[oops] { maximum-addr-flush-attempts } |\n"
 "                    -o[neline] | -t[imestamp] | -b[atch] [filename] |\n"
-"                    -rc[vbuf] [size]}\n");
+"                    -rc[vbuf] [size] | -a[ll] | -j[obs] [count] }\n");
 	exit(-1);
 }
 
@@ -99,11 +101,17 @@ static int do_cmd(const char *argv0, int argc, char **argv)
 	return -1;
 }
 
-static int batch(const char *name)
+/* Commands may exit(), requests still queued must not be lost */
+static void batch_drain(void)
+{
+	rtnl_wait_acks(&rth, 0);
+}
+
+int batch(const char *name)
 {
 	char *line = NULL;
 	size_t len = 0;
-	int ret = 0;
+	int ret = 0, ret2;
 
 	if (name && strcmp(name, "-") != 0) {
 		if (freopen(name, "r", stdin) == NULL) {
@@ -118,6 +126,13 @@ static int batch(const char *name)
 		return -1;
 	}
 
+	batch_name = name;
+	if (force) {
+		if (rtnl_set_window(&rth, BATCH_WINDOW, batch_ack_err) < 0)
+			return -1;
+		atexit(batch_drain);
+	}
+
 	cmdlineno = 0;
 	while (getcmdline(&line, &len, stdin) != -1) {
 		char *largv[100];
@@ -127,7 +142,10 @@ static int batch(const char *name)
 		if (largc == 0)
 			continue;	/* blank line */
 
-		if (do_cmd(largv[0], largc, largv)) {
+		rth.tag = cmdlineno;
+		ret2 = do_cmd(largv[0], largc, largv);
+		fflush(stdout);
+		if (ret2) {
 			fprintf(stderr, "Command failed %s:%d\n", name, cmdlineno);
 			ret = 1;
 			if (!force)
@@ -137,6 +155,9 @@ static int batch(const char *name)
 	if (line)
 		free(line);
 
+	if (rtnl_wait_acks(&rth, 0) < 0 || batch_errors)
+		ret = 1;
+
 	rtnl_close(&rth);
 	return ret;
 }
@@ -236,6 +257,19 @@ int main(int argc, char **argv)
 				exit(-1);
 			}
 			rcvbuf = size;
+		} else if (matches(opt, "-all") == 0) {
+			do_all = 1;
+		} else if (matches(opt, "-jobs") == 0) {
+			argc--;
+			argv++;
+			if (argc <= 1)
+				usage();
+			if (get_integer(&netns_jobs, argv[1], 0) ||
+			    netns_jobs <= 0) {
+				fprintf(stderr, "Invalid jobs count '%s'\n",
+					argv[1]);
+				exit(-1);
+			}
 		} else if (matches(opt, "-help") == 0) {
 			usage();
 		} else {
@@ -247,6 +281,8 @@ int main(int argc, char **argv)
 
 	_SL_ = oneline ? "\\" : "\n" ;
 
+	output_init(stdout);
+
 	if (batch_file)
 		return batch(batch_file);
 
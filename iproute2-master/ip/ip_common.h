@@ -50,6 +50,9 @@ static inline int rtm_get_table(struct rtmsg *r, struct rtattr **tb)
 }
 
 extern struct rtnl_handle rth;
+extern int do_all;
+extern int netns_jobs;
+extern int batch(const char *name);
 
 struct link_util
 {
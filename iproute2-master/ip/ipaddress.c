@@ -430,8 +430,7 @@ int print_linkinfo(const struct sockaddr_nl *who,
 			print_vfinfo(fp, i);
 	}
 
-	fprintf(fp, "\n");
-	fflush(fp);
+	fputc('\n', fp);
 	return 0;
 }
 
@@ -550,10 +549,10 @@ int print_addrinfo(const struct sockaddr_nl *who, struct nlmsghdr *n,
 		fprintf(fp, "    family %d ", ifa->ifa_family);
 
 	if (rta_tb[IFA_LOCAL]) {
-		fprintf(fp, "%s", rt_addr_n2a(ifa->ifa_family,
-					      RTA_PAYLOAD(rta_tb[IFA_LOCAL]),
-					      RTA_DATA(rta_tb[IFA_LOCAL]),
-					      abuf, sizeof(abuf)));
+		fputs(rt_addr_n2a(ifa->ifa_family,
+				  RTA_PAYLOAD(rta_tb[IFA_LOCAL]),
+				  RTA_DATA(rta_tb[IFA_LOCAL]),
+				  abuf, sizeof(abuf)), fp);
 
 		if (rta_tb[IFA_ADDRESS] == NULL ||
 		    memcmp(RTA_DATA(rta_tb[IFA_ADDRESS]), RTA_DATA(rta_tb[IFA_LOCAL]), 4) == 0) {
@@ -569,11 +568,11 @@ int print_addrinfo(const struct sockaddr_nl *who, struct nlmsghdr *n,
 	}
 
 	if (rta_tb[IFA_BROADCAST]) {
-		fprintf(fp, "brd %s ",
-			rt_addr_n2a(ifa->ifa_family,
-				    RTA_PAYLOAD(rta_tb[IFA_BROADCAST]),
-				    RTA_DATA(rta_tb[IFA_BROADCAST]),
-				    abuf, sizeof(abuf)));
+		fprint_field(fp, "brd ",
+			     rt_addr_n2a(ifa->ifa_family,
+					 RTA_PAYLOAD(rta_tb[IFA_BROADCAST]),
+					 RTA_DATA(rta_tb[IFA_BROADCAST]),
+					 abuf, sizeof(abuf)));
 	}
 	if (rta_tb[IFA_ANYCAST]) {
 		fprintf(fp, "any %s ",
@@ -582,7 +581,7 @@ int print_addrinfo(const struct sockaddr_nl *who, struct nlmsghdr *n,
 				    RTA_DATA(rta_tb[IFA_ANYCAST]),
 				    abuf, sizeof(abuf)));
 	}
-	fprintf(fp, "scope %s ", rtnl_rtscope_n2a(ifa->ifa_scope, b1, sizeof(b1)));
+	fprint_field(fp, "scope ", rtnl_rtscope_n2a(ifa->ifa_scope, b1, sizeof(b1)));
 	ifa_flags = ifa->ifa_flags;
 	if (ifa->ifa_flags&IFA_F_SECONDARY) {
 		ifa_flags &= ~IFA_F_SECONDARY;
@@ -619,7 +618,7 @@ int print_addrinfo(const struct sockaddr_nl *who, struct nlmsghdr *n,
 	if (ifa_flags)
 		fprintf(fp, "flags %02x ", ifa_flags);
 	if (rta_tb[IFA_LABEL])
-		fprintf(fp, "%s", (char*)RTA_DATA(rta_tb[IFA_LABEL]));
+		fputs((char*)RTA_DATA(rta_tb[IFA_LABEL]), fp);
 	if (rta_tb[IFA_CACHEINFO]) {
 		struct ifa_cacheinfo *ci = RTA_DATA(rta_tb[IFA_CACHEINFO]);
 		fprintf(fp, "%s", _SL_);
@@ -638,8 +637,7 @@ int print_addrinfo(const struct sockaddr_nl *who, struct nlmsghdr *n,
 				fprintf(fp, "%usec", ci->ifa_prefered);
 		}
 	}
-	fprintf(fp, "\n");
-	fflush(fp);
+	fputc('\n', fp);
 	return 0;
 }
 
@@ -671,6 +669,12 @@ struct nlmsg_list
 	struct nlmsghdr	  h;
 };
 
+struct nlmsg_chain
+{
+	struct nlmsg_list *head;
+	struct nlmsg_list *tail;
+};
+
 static int print_selected_addrinfo(int ifindex, struct nlmsg_list *ainfo, FILE *fp)
 {
 	for ( ;ainfo ;  ainfo = ainfo->next) {
@@ -696,9 +700,8 @@ static int print_selected_addrinfo(int ifindex, struct nlmsg_list *ainfo, FILE *
 static int store_nlmsg(const struct sockaddr_nl *who, struct nlmsghdr *n,
 		       void *arg)
 {
-	struct nlmsg_list **linfo = (struct nlmsg_list**)arg;
+	struct nlmsg_chain *lchain = (struct nlmsg_chain *)arg;
 	struct nlmsg_list *h;
-	struct nlmsg_list **lp;
 
 	h = malloc(n->nlmsg_len+sizeof(void*));
 	if (h == NULL)
@@ -707,18 +710,57 @@ static int store_nlmsg(const struct sockaddr_nl *who, struct nlmsghdr *n,
 	memcpy(&h->h, n, n->nlmsg_len);
 	h->next = NULL;
 
-	for (lp = linfo; *lp; lp = &(*lp)->next) /* NOTHING */;
-	*lp = h;
+	if (lchain->tail)
+		lchain->tail->next = h;
+	else
+		lchain->head = h;
+	lchain->tail = h;
 
 	ll_remember_index(who, n, NULL);
 	return 0;
 }
 
+/*
+ * Split the addresses into chains by interface index, so that finding
+ * the addresses of a link does not take a walk over all of them.
+ */
+static struct nlmsg_list **hash_addrinfo(struct nlmsg_list *ainfo,
+					 unsigned size)
+{
+	struct nlmsg_list **hash, **tail, *a, *n;
+
+	hash = calloc(2 * size, sizeof(*hash));
+	if (hash == NULL) {
+		perror("Cannot allocate address hash");
+		exit(1);
+	}
+	tail = hash + size;
+
+	for (a = ainfo; a; a = n) {
+		struct ifaddrmsg *ifa = NLMSG_DATA(&a->h);
+		unsigned h;
+
+		n = a->next;
+		if (a->h.nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+			continue;
+
+		h = ifa->ifa_index & (size - 1);
+		a->next = NULL;
+		if (tail[h])
+			tail[h]->next = a;
+		else
+			hash[h] = a;
+		tail[h] = a;
+	}
+	return hash;
+}
+
 static int ipaddr_list_or_flush(int argc, char **argv, int flush)
 {
-	struct nlmsg_list *linfo = NULL;
-	struct nlmsg_list *ainfo = NULL;
-	struct nlmsg_list *l, *n;
+	struct nlmsg_chain linfo = { NULL, NULL };
+	struct nlmsg_chain ainfo = { NULL, NULL };
+	struct nlmsg_list *l, *n, **ahash = NULL;
+	unsigned hsize = 16, nlinks = 0;
 	char *filter_dev = NULL;
 	int no_link = 0;
 
@@ -908,12 +950,18 @@ flush_done:
 			fprintf(stderr, "Dump terminated\n");
 			exit(1);
 		}
+
+		for (l = linfo.head; l; l = l->next)
+			nlinks++;
+		while (hsize < nlinks)
+			hsize <<= 1;
+		ahash = hash_addrinfo(ainfo.head, hsize);
 	}
 
 
 	if (filter.family && filter.family != AF_PACKET) {
 		struct nlmsg_list **lp;
-		lp=&linfo;
+		lp=&linfo.head;
 
 		if (filter.oneline)
 			no_link = 1;
@@ -923,7 +971,7 @@ flush_done:
 			struct ifinfomsg *ifi = NLMSG_DATA(&l->h);
 			struct nlmsg_list *a;
 
-			for (a=ainfo; a; a=a->next) {
+			for (a = ahash[ifi->ifi_index & (hsize - 1)]; a; a = a->next) {
 				struct nlmsghdr *n = &a->h;
 				struct ifaddrmsg *ifa = NLMSG_DATA(n);
 
@@ -970,16 +1018,18 @@ flush_done:
 		}
 	}
 
-	for (l=linfo; l; l = n) {
+	for (l=linfo.head; l; l = n) {
 		n = l->next;
 		if (no_link || print_linkinfo(NULL, &l->h, stdout) == 0) {
 			struct ifinfomsg *ifi = NLMSG_DATA(&l->h);
 			if (filter.family != AF_PACKET)
-				print_selected_addrinfo(ifi->ifi_index, ainfo, stdout);
+				print_selected_addrinfo(ifi->ifi_index,
+							ahash[ifi->ifi_index & (hsize - 1)],
+							stdout);
 		}
-		fflush(stdout);
 		free(l);
 	}
+	free(ahash);
 
 	return 0;
 }
@@ -16,10 +16,12 @@
 #include <syslog.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 
 #include "utils.h"
 #include "ip_common.h"
@@ -29,7 +31,9 @@ int prefix_banner;
 
 static void usage(void)
 {
-	fprintf(stderr, "Usage: ip monitor [ all | LISTofOBJECTS ]\n");
+	fprintf(stderr, "Usage: ip monitor [ all | LISTofOBJECTS ] [ coalesce MSEC ]\n");
+	fprintf(stderr, "                  [ journal FILE ]\n");
+	fprintf(stderr, "       ip monitor file FILE\n");
 	exit(-1);
 }
 
@@ -85,6 +89,10 @@ int accept_msg(const struct sockaddr_nl *who,
 		print_rule(who, n, arg);
 		return 0;
 	}
+	if (n->nlmsg_type == NLMSG_OVERRUN) {
+		fprintf(fp, "Overrun: events were lost\n");
+		return 0;
+	}
 	if (n->nlmsg_type == 15) {
 		char *tstr;
 		time_t secs = ((__u32*)NLMSG_DATA(n))[0];
@@ -109,6 +117,280 @@ int accept_msg(const struct sockaddr_nl *who,
 	return 0;
 }
 
+/* Monitors ask for a larger receive buffer, bursts overrun the default */
+#define MONITOR_RCVBUF	(8 * 1024 * 1024)
+
+static FILE *journal;
+static int journal_stamp;
+
+static void write_stamp(FILE *fp)
+{
+	char buf[128];
+	struct nlmsghdr *n1 = (void*)buf;
+	struct timeval tv;
+
+	n1->nlmsg_type = 15;
+	n1->nlmsg_flags = 0;
+	n1->nlmsg_seq = 0;
+	n1->nlmsg_pid = 0;
+	n1->nlmsg_len = NLMSG_LENGTH(4*2);
+	gettimeofday(&tv, NULL);
+	((__u32*)NLMSG_DATA(n1))[0] = tv.tv_sec;
+	((__u32*)NLMSG_DATA(n1))[1] = tv.tv_usec;
+	fwrite((void*)n1, 1, NLMSG_ALIGN(n1->nlmsg_len), fp);
+}
+
+static int emit_msg(const struct sockaddr_nl *who, struct nlmsghdr *n,
+		    void *arg)
+{
+	if (!journal)
+		return accept_msg(who, n, arg);
+
+	/* One stamp per batch of events, as rtmon does */
+	if (journal_stamp) {
+		write_stamp(journal);
+		journal_stamp = 0;
+	}
+	fwrite((void*)n, 1, NLMSG_ALIGN(n->nlmsg_len), journal);
+	return 0;
+}
+
+/*
+ * Coalescing: events are held back for a window and only the last one
+ * of each object is shown, in the order of those last events. During
+ * a route convergence most of the intermediate states never reach the
+ * output.
+ */
+#define MON_KEY_MAX	64
+
+struct mon_event
+{
+	struct mon_event	*next;
+	int			idx;
+	int			keylen;
+	char			key[MON_KEY_MAX];
+	struct nlmsghdr		*n;
+};
+
+static int coalesce_ms;
+static struct mon_event **mon_hash;
+static unsigned mon_hsize;
+static struct mon_event **mon_order;
+static int mon_cnt, mon_size;
+static double mon_deadline;
+
+static double mon_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000. + ts.tv_nsec / 1000000.;
+}
+
+static int key_put(char *key, int len, const void *data, int size)
+{
+	if (len < 0 || len + size > MON_KEY_MAX)
+		return -1;
+	memcpy(key + len, data, size);
+	return len + size;
+}
+
+static int key_put_rta(char *key, int len, const struct rtattr *rta)
+{
+	__u8 size = rta ? RTA_PAYLOAD(rta) : 0;
+
+	len = key_put(key, len, &size, 1);
+	return rta ? key_put(key, len, RTA_DATA(rta), size) : len;
+}
+
+/* Builds the identity of the object an event is about, 0 if it has none */
+static int mon_key(struct nlmsghdr *n, char *key)
+{
+	__u16 class = n->nlmsg_type & ~3;
+	int len = key_put(key, 0, &class, sizeof(class));
+
+	switch (class) {
+	case RTM_NEWLINK:
+	{
+		struct ifinfomsg *ifi = NLMSG_DATA(n);
+
+		if (n->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+			return 0;
+		len = key_put(key, len, &ifi->ifi_index, sizeof(ifi->ifi_index));
+		break;
+	}
+	case RTM_NEWADDR:
+	{
+		struct ifaddrmsg *ifa = NLMSG_DATA(n);
+		struct rtattr *tb[IFA_MAX+1];
+
+		if (n->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+			return 0;
+		parse_rtattr(tb, IFA_MAX, IFA_RTA(ifa),
+			     n->nlmsg_len - NLMSG_LENGTH(sizeof(*ifa)));
+		/* Not the flags, DAD completing changes them */
+		len = key_put(key, len, &ifa->ifa_family, 1);
+		len = key_put(key, len, &ifa->ifa_prefixlen, 1);
+		len = key_put(key, len, &ifa->ifa_index, sizeof(ifa->ifa_index));
+		len = key_put_rta(key, len, tb[IFA_LOCAL] ? : tb[IFA_ADDRESS]);
+		break;
+	}
+	case RTM_NEWROUTE:
+	{
+		struct rtmsg *r = NLMSG_DATA(n);
+		struct rtattr *tb[RTA_MAX+1];
+		__u32 table;
+
+		if (n->nlmsg_len < NLMSG_LENGTH(sizeof(*r)))
+			return 0;
+		parse_rtattr(tb, RTA_MAX, RTM_RTA(r),
+			     n->nlmsg_len - NLMSG_LENGTH(sizeof(*r)));
+		table = tb[RTA_TABLE] ? *(__u32*)RTA_DATA(tb[RTA_TABLE]) :
+			r->rtm_table;
+		len = key_put(key, len, r, 4);
+		len = key_put(key, len, &table, sizeof(table));
+		len = key_put_rta(key, len, tb[RTA_PRIORITY]);
+		len = key_put_rta(key, len, tb[RTA_DST]);
+		len = key_put_rta(key, len, tb[RTA_SRC]);
+		break;
+	}
+	case RTM_NEWNEIGH:
+	{
+		struct ndmsg *ndm = NLMSG_DATA(n);
+		struct rtattr *tb[NDA_MAX+1];
+
+		if (n->nlmsg_len < NLMSG_LENGTH(sizeof(*ndm)))
+			return 0;
+		parse_rtattr(tb, NDA_MAX, NDA_RTA(ndm),
+			     n->nlmsg_len - NLMSG_LENGTH(sizeof(*ndm)));
+		len = key_put(key, len, &ndm->ndm_family, 1);
+		len = key_put(key, len, &ndm->ndm_ifindex,
+			      sizeof(ndm->ndm_ifindex));
+		len = key_put_rta(key, len, tb[NDA_DST]);
+		break;
+	}
+	default:
+		return 0;
+	}
+
+	return len < 0 ? 0 : len;
+}
+
+static unsigned mon_hashfn(const char *key, int len)
+{
+	unsigned h = 2166136261U;
+
+	while (len--)
+		h = (h ^ (unsigned char)*key++) * 16777619U;
+	return h;
+}
+
+static void mon_hash_grow(void)
+{
+	struct mon_event **old = mon_hash, *e, *next;
+	unsigned i, old_size = mon_hsize;
+
+	mon_hsize = old_size ? 2 * old_size : 1024;
+	mon_hash = calloc(mon_hsize, sizeof(*mon_hash));
+	if (!mon_hash) {
+		perror("Cannot allocate event table");
+		exit(1);
+	}
+	for (i = 0; i < old_size; i++) {
+		for (e = old[i]; e; e = next) {
+			unsigned h = mon_hashfn(e->key, e->keylen) & (mon_hsize - 1);
+
+			next = e->next;
+			e->next = mon_hash[h];
+			mon_hash[h] = e;
+		}
+	}
+	free(old);
+}
+
+static int mon_store(const struct sockaddr_nl *who, struct nlmsghdr *n,
+		     void *arg)
+{
+	char key[MON_KEY_MAX];
+	struct mon_event *e = NULL;
+	int keylen;
+
+	if (!mon_cnt)
+		mon_deadline = mon_now() + coalesce_ms;
+
+	if (mon_cnt == mon_size) {
+		mon_size = mon_size ? 2 * mon_size : 1024;
+		mon_order = realloc(mon_order, mon_size * sizeof(*mon_order));
+		if (!mon_order) {
+			perror("Cannot allocate event list");
+			exit(1);
+		}
+		while (mon_hsize < mon_size)
+			mon_hash_grow();
+	}
+
+	keylen = mon_key(n, key);
+	if (keylen) {
+		unsigned h = mon_hashfn(key, keylen) & (mon_hsize - 1);
+
+		for (e = mon_hash[h]; e; e = e->next)
+			if (e->keylen == keylen && !memcmp(e->key, key, keylen))
+				break;
+		if (e) {
+			/* Superseded, it moves to the end of the output */
+			mon_order[e->idx] = NULL;
+			free(e->n);
+		} else {
+			e = malloc(sizeof(*e));
+			if (!e) {
+				perror("Cannot allocate event");
+				exit(1);
+			}
+			e->keylen = keylen;
+			memcpy(e->key, key, keylen);
+			e->next = mon_hash[h];
+			mon_hash[h] = e;
+		}
+	} else {
+		e = malloc(sizeof(*e));
+		if (!e) {
+			perror("Cannot allocate event");
+			exit(1);
+		}
+		e->keylen = 0;
+		e->next = NULL;
+	}
+
+	e->n = malloc(n->nlmsg_len);
+	if (!e->n) {
+		perror("Cannot allocate event");
+		exit(1);
+	}
+	memcpy(e->n, n, n->nlmsg_len);
+	e->idx = mon_cnt;
+	mon_order[mon_cnt++] = e;
+
+	return 0;
+}
+
+static void mon_flush(FILE *fp)
+{
+	struct sockaddr_nl who = { .nl_family = AF_NETLINK };
+	int i;
+
+	for (i = 0; i < mon_cnt; i++) {
+		struct mon_event *e = mon_order[i];
+
+		if (!e)
+			continue;
+		emit_msg(&who, e->n, fp);
+		free(e->n);
+		free(e);
+	}
+	mon_cnt = 0;
+	memset(mon_hash, 0, mon_hsize * sizeof(*mon_hash));
+}
+
 int do_ipmonitor(int argc, char **argv)
 {
 	char *file = NULL;
@@ -128,6 +410,18 @@ int do_ipmonitor(int argc, char **argv)
 		if (matches(*argv, "file") == 0) {
 			NEXT_ARG();
 			file = *argv;
+		} else if (matches(*argv, "coalesce") == 0) {
+			NEXT_ARG();
+			if (get_integer(&coalesce_ms, *argv, 0) ||
+			    coalesce_ms < 0)
+				invarg("invalid coalesce window", *argv);
+		} else if (matches(*argv, "journal") == 0) {
+			NEXT_ARG();
+			journal = fopen(*argv, "w");
+			if (journal == NULL) {
+				perror("Cannot fopen");
+				exit(-1);
+			}
 		} else if (matches(*argv, "link") == 0) {
 			llink=1;
 			groups = 0;
@@ -186,12 +480,41 @@ int do_ipmonitor(int argc, char **argv)
 		return rtnl_from_file(fp, accept_msg, stdout);
 	}
 
+	if (rcvbuf < MONITOR_RCVBUF)
+		rcvbuf = MONITOR_RCVBUF;
 	if (rtnl_open(&rth, groups) < 0)
 		exit(1);
+	/* Past net.core.rmem_max, if we are allowed to */
+	setsockopt(rth.fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+	rth.flags |= RTNL_HANDLE_F_OVERRUN;
 	ll_init_map(&rth);
 
-	if (rtnl_listen(&rth, accept_msg, stdout) < 0)
-		exit(2);
+	if (coalesce_ms)
+		mon_hash_grow();
+
+	/* Output goes out once per batch of events */
+	for (;;) {
+		int timeout = -1;
+
+		if (coalesce_ms && mon_cnt) {
+			timeout = mon_deadline - mon_now() + 1;
+			if (timeout < 0)
+				timeout = 0;
+		}
+
+		journal_stamp = 1;
+		if (rtnl_listen_poll(&rth, coalesce_ms ? mon_store : emit_msg,
+				     stdout, timeout) < 0)
+			exit(2);
+
+		if (coalesce_ms && mon_cnt && mon_now() >= mon_deadline)
+			mon_flush(stdout);
+
+		if (fflush(journal ? : stdout) == EOF) {
+			perror("Cannot write events");
+			exit(1);
+		}
+	}
 
 	return 0;
 }
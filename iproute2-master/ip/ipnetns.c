@@ -7,6 +7,7 @@
 #include <sys/param.h>
 #include <sys/syscall.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sched.h>
 #include <fcntl.h>
@@ -49,6 +50,8 @@ static void usage(void)
 	fprintf(stderr, "       ip netns add NAME\n");
 	fprintf(stderr, "       ip netns delete NAME\n");
 	fprintf(stderr, "       ip netns exec NAME cmd ...\n");
+	fprintf(stderr, "       ip [-j COUNT] -all netns exec cmd ...\n");
+	fprintf(stderr, "       ip [-force] [-j COUNT] netns batch FILE [ NAME ... ]\n");
 	fprintf(stderr, "       ip netns monitor\n");
 	exit(-1);
 }
@@ -171,6 +174,237 @@ static int netns_exec(int argc, char **argv)
 	exit(-1);
 }
 
+/*
+ * Commands run against many namespaces go to children, at most
+ * netns_jobs at a time. Their output is kept aside and printed in one
+ * piece as each of them completes, so that namespaces do not mix.
+ */
+struct netns_job
+{
+	pid_t		pid;
+	const char	*name;
+	FILE		*out;
+};
+
+static int netns_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int netns_all(char ***namesp)
+{
+	struct dirent *entry;
+	char **names = NULL;
+	int n = 0, size = 0;
+	DIR *dir;
+
+	dir = opendir(NETNS_RUN_DIR);
+	if (!dir)
+		goto out;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0)
+			continue;
+		if (strcmp(entry->d_name, "..") == 0)
+			continue;
+		if (n == size) {
+			size = size ? 2 * size : 64;
+			names = realloc(names, size * sizeof(*names));
+			if (!names) {
+				perror("realloc");
+				exit(-1);
+			}
+		}
+		names[n++] = strdup(entry->d_name);
+	}
+	closedir(dir);
+	qsort(names, n, sizeof(*names), netns_cmp);
+out:
+	*namesp = names;
+	return n;
+}
+
+static int netns_job_done(struct netns_job *job, int status)
+{
+	char buf[4096];
+	size_t len;
+
+	printf("\nnetns: %s\n", job->name);
+	rewind(job->out);
+	while ((len = fread(buf, 1, sizeof(buf), job->out)) > 0)
+		fwrite(buf, 1, len, stdout);
+	fflush(stdout);
+	fclose(job->out);
+	job->pid = 0;
+
+	return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+static int netns_foreach(char **names, int n,
+			 int (*fn)(const char *name, void *arg), void *arg)
+{
+	struct netns_job *jobs;
+	int njobs = netns_jobs, running = 0, failed = 0, i = 0, j;
+
+	if (njobs <= 0)
+		njobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (njobs > n)
+		njobs = n;
+	if (njobs < 1)
+		return 0;
+
+	jobs = calloc(njobs, sizeof(*jobs));
+	if (!jobs) {
+		perror("calloc");
+		return -1;
+	}
+
+	while (i < n || running) {
+		struct netns_job *job = NULL;
+		int status;
+		pid_t pid;
+
+		if (i < n && running < njobs) {
+			for (j = 0; j < njobs; j++)
+				if (!jobs[j].pid)
+					job = &jobs[j];
+			job->name = names[i++];
+			job->out = tmpfile();
+			if (!job->out) {
+				fprintf(stderr, "netns %s: cannot create output file: %s\n",
+					job->name, strerror(errno));
+				failed++;
+				continue;
+			}
+
+			fflush(stdout);
+			fflush(stderr);
+			job->pid = fork();
+			if (job->pid == 0) {
+				dup2(fileno(job->out), STDOUT_FILENO);
+				dup2(fileno(job->out), STDERR_FILENO);
+				exit(fn(job->name, arg) ? 1 : 0);
+			}
+			if (job->pid < 0) {
+				fprintf(stderr, "netns %s: fork failed: %s\n",
+					job->name, strerror(errno));
+				fclose(job->out);
+				job->pid = 0;
+				failed++;
+				continue;
+			}
+			running++;
+			continue;
+		}
+
+		pid = wait(&status);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("wait");
+			break;
+		}
+		for (j = 0; j < njobs; j++) {
+			if (jobs[j].pid == pid) {
+				failed += netns_job_done(&jobs[j], status);
+				running--;
+			}
+		}
+	}
+	free(jobs);
+
+	if (failed) {
+		fprintf(stderr, "Failed in %d of %d network namespaces\n",
+			failed, n);
+		return -1;
+	}
+	return 0;
+}
+
+static int netns_exec_one(const char *name, void *arg)
+{
+	char **argv = arg;
+	int argc = 0;
+
+	argv[0] = (char *)name;
+	while (argv[argc])
+		argc++;
+	return netns_exec(argc, argv);
+}
+
+static int netns_exec_all(int argc, char **argv)
+{
+	char **names, **cmd;
+	int n;
+
+	if (argc < 1) {
+		fprintf(stderr, "No cmd specified\n");
+		return -1;
+	}
+
+	/* Room for the name in front, netns_exec_one() fills it */
+	cmd = calloc(argc + 2, sizeof(*cmd));
+	if (!cmd) {
+		perror("calloc");
+		return -1;
+	}
+	memcpy(cmd + 1, argv, argc * sizeof(*cmd));
+
+	n = netns_all(&names);
+	return netns_foreach(names, n, netns_exec_one, cmd);
+}
+
+/*
+ * No exec and no mount namespace: the child switches to the namespace,
+ * opens its netlink socket there and runs the batch itself.
+ */
+static int netns_batch_one(const char *name, void *arg)
+{
+	int netns;
+
+	netns = get_netns_fd(name);
+	if (netns < 0) {
+		fprintf(stderr, "Cannot open network namespace: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	if (setns(netns, CLONE_NEWNET) < 0) {
+		fprintf(stderr, "seting the network namespace failed: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	close(netns);
+
+	/* Still bound to the namespace we came from */
+	rtnl_close(&rth);
+	return batch(arg);
+}
+
+static int netns_batch(int argc, char **argv)
+{
+	char **names = argv + 1;
+	int n = argc - 1;
+
+	if (argc < 1) {
+		fprintf(stderr, "No batch file specified\n");
+		return -1;
+	}
+	/* Every child reads it from the start */
+	if (strcmp(argv[0], "-") == 0) {
+		fprintf(stderr, "The batch file cannot be read from stdin\n");
+		return -1;
+	}
+	if (access(argv[0], R_OK) < 0) {
+		fprintf(stderr, "Cannot open file \"%s\" for reading: %s\n",
+			argv[0], strerror(errno));
+		return -1;
+	}
+
+	if (do_all || n == 0)
+		n = netns_all(&names);
+	return netns_foreach(names, n, netns_batch_one, argv[0]);
+}
+
 static int netns_delete(int argc, char **argv)
 {
 	const char *name;
@@ -298,8 +532,14 @@ int do_netns(int argc, char **argv)
 	if (matches(*argv, "delete") == 0)
 		return netns_delete(argc-1, argv+1);
 
-	if (matches(*argv, "exec") == 0)
+	if (matches(*argv, "exec") == 0) {
+		if (do_all)
+			return netns_exec_all(argc-1, argv+1);
 		return netns_exec(argc-1, argv+1);
+	}
+
+	if (matches(*argv, "batch") == 0)
+		return netns_batch(argc-1, argv+1);
 
 	if (matches(*argv, "monitor") == 0)
 		return netns_monitor(argc-1, argv+1);
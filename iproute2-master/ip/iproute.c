@@ -95,6 +95,8 @@ static struct
 	int tb;
 	int cloned;
 	int flushed;
+	int flushfail;
+	int flushgone;
 	char *flushb;
 	int flushp;
 	int flushe;
@@ -114,16 +116,126 @@ static struct
 	inet_prefix msrc;
 } filter;
 
-static int flush_update(void)
+/*
+ * Flushed routes are collected from a single dump and deleted once it
+ * is over: deleting under a running dump may make the kernel skip the
+ * routes following the deleted ones, which used to take more rounds.
+ * The deletes ask for no ack, the kernel only answers errors, and has
+ * done so by the time send() returns.
+ */
+#define FLUSH_CHUNK	16384
+
+static int flush_grow(int len)
 {
-	if (rtnl_send_check(&rth, filter.flushb, filter.flushp) < 0) {
-		perror("Failed to send flush request");
+	int size = filter.flushe;
+	char *b;
+
+	while (NLMSG_ALIGN(filter.flushp) + len > size)
+		size *= 2;
+	b = realloc(filter.flushb, size);
+	if (!b) {
+		perror("Cannot allocate flush requests");
 		return -1;
 	}
-	filter.flushp = 0;
+	filter.flushb = b;
+	filter.flushe = size;
+	return 0;
+}
+
+static void flush_errors(void)
+{
+	char buf[16384];
+	struct nlmsghdr *h;
+	int status;
+
+	while ((status = recv(rth.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, status);
+		     h = NLMSG_NEXT(h, status)) {
+			struct nlmsgerr *err = NLMSG_DATA(h);
+
+			if (h->nlmsg_type != NLMSG_ERROR ||
+			    h->nlmsg_len < NLMSG_LENGTH(sizeof(*err)) ||
+			    !err->error)
+				continue;
+			/* Went away along with something deleted before it */
+			if (err->error == -ESRCH) {
+				filter.flushgone++;
+				continue;
+			}
+			if (filter.flushfail++ == 0)
+				fprintf(stderr, "RTNETLINK answers: %s\n",
+					strerror(-err->error));
+		}
+	}
+}
+
+static int flush_send(void)
+{
+	char *p = filter.flushb, *end = filter.flushb + filter.flushp;
+	time_t last = time(NULL);
+	int sent = 0;
+
+	while (p < end) {
+		struct nlmsghdr *h = (struct nlmsghdr *)p;
+		int len = 0;
+
+		do {
+			len += NLMSG_ALIGN(h->nlmsg_len);
+			h = (struct nlmsghdr *)(p + len);
+			sent++;
+		} while (p + len < end &&
+			 len + NLMSG_ALIGN(h->nlmsg_len) <= FLUSH_CHUNK);
+		if (p + len > end)
+			len = end - p;
+
+		if (send(rth.fd, p, len, 0) < 0) {
+			perror("Failed to send flush request");
+			return -1;
+		}
+		p += len;
+		flush_errors();
+
+		if (show_stats && time(NULL) != last) {
+			printf("*** %d of %d entries deleted ***\n",
+			       sent - filter.flushfail - filter.flushgone,
+			       filter.flushed);
+			fflush(stdout);
+			last = time(NULL);
+		}
+	}
 	return 0;
 }
 
+/* Lets the kernel skip what it can of the flush filter itself */
+static int flush_dump_request(struct rtnl_handle *rth, int family)
+{
+	struct {
+		struct nlmsghdr		n;
+		struct rtmsg		r;
+		char			buf[64];
+	} req;
+
+	if (!(rth->flags & RTNL_HANDLE_F_STRICT_CHK))
+		return rtnl_wilddump_request(rth, family, RTM_GETROUTE);
+
+	memset(&req, 0, sizeof(req));
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+	req.r.rtm_family = family;
+	if (filter.protocolmask)
+		req.r.rtm_protocol = filter.protocol;
+	if (filter.typemask)
+		req.r.rtm_type = filter.type;
+	if (filter.tb > 0 && filter.tb < 256)
+		req.r.rtm_table = filter.tb;
+	else if (filter.tb > 0)
+		addattr32(&req.n, sizeof(req), RTA_TABLE, filter.tb);
+	if (filter.oifmask)
+		addattr32(&req.n, sizeof(req), RTA_OIF, filter.oif);
+
+	return rtnl_dump_request(rth, RTM_GETROUTE, &req.r,
+				 req.n.nlmsg_len - NLMSG_HDRLEN);
+}
+
 int filter_nlmsg(struct nlmsghdr *n, struct rtattr **tb, int host_len)
 {
 	struct rtmsg *r = NLMSG_DATA(n);
@@ -312,10 +424,9 @@ int print_route(const struct sockaddr_nl *who, struct nlmsghdr *n, void *arg)
 
 	if (filter.flushb) {
 		struct nlmsghdr *fn;
-		if (NLMSG_ALIGN(filter.flushp) + n->nlmsg_len > filter.flushe) {
-			if (flush_update())
-				return -1;
-		}
+		if (NLMSG_ALIGN(filter.flushp) + n->nlmsg_len > filter.flushe &&
+		    flush_grow(n->nlmsg_len) < 0)
+			return -1;
 		fn = (struct nlmsghdr*)(filter.flushb + NLMSG_ALIGN(filter.flushp));
 		memcpy(fn, n, n->nlmsg_len);
 		fn->nlmsg_type = RTM_DELROUTE;
@@ -328,9 +439,9 @@ int print_route(const struct sockaddr_nl *who, struct nlmsghdr *n, void *arg)
 	}
 
 	if (n->nlmsg_type == RTM_DELROUTE)
-		fprintf(fp, "Deleted ");
+		fputs("Deleted ", fp);
 	if (r->rtm_type != RTN_UNICAST && !filter.type)
-		fprintf(fp, "%s ", rtnl_rtntype_n2a(r->rtm_type, b1, sizeof(b1)));
+		fprint_field(fp, NULL, rtnl_rtntype_n2a(r->rtm_type, b1, sizeof(b1)));
 
 	if (tb[RTA_DST]) {
 		if (r->rtm_dst_len != host_len) {
@@ -341,16 +452,15 @@ int print_route(const struct sockaddr_nl *who, struct nlmsghdr *n, void *arg)
 				r->rtm_dst_len
 				);
 		} else {
-			fprintf(fp, "%s ", format_host(r->rtm_family,
-						       RTA_PAYLOAD(tb[RTA_DST]),
-						       RTA_DATA(tb[RTA_DST]),
-						       abuf, sizeof(abuf))
-				);
+			fprint_field(fp, NULL, format_host(r->rtm_family,
+							   RTA_PAYLOAD(tb[RTA_DST]),
+							   RTA_DATA(tb[RTA_DST]),
+							   abuf, sizeof(abuf)));
 		}
 	} else if (r->rtm_dst_len) {
 		fprintf(fp, "0/%d ", r->rtm_dst_len);
 	} else {
-		fprintf(fp, "default ");
+		fputs("default ", fp);
 	}
 	if (tb[RTA_SRC]) {
 		if (r->rtm_src_len != host_len) {
@@ -376,35 +486,36 @@ int print_route(const struct sockaddr_nl *who, struct nlmsghdr *n, void *arg)
 	}
 
 	if (tb[RTA_GATEWAY] && filter.rvia.bitlen != host_len) {
-		fprintf(fp, "via %s ",
-			format_host(r->rtm_family,
-				    RTA_PAYLOAD(tb[RTA_GATEWAY]),
-				    RTA_DATA(tb[RTA_GATEWAY]),
-				    abuf, sizeof(abuf)));
+		fprint_field(fp, "via ",
+			     format_host(r->rtm_family,
+					 RTA_PAYLOAD(tb[RTA_GATEWAY]),
+					 RTA_DATA(tb[RTA_GATEWAY]),
+					 abuf, sizeof(abuf)));
 	}
 	if (tb[RTA_OIF] && filter.oifmask != -1)
-		fprintf(fp, "dev %s ", ll_index_to_name(*(int*)RTA_DATA(tb[RTA_OIF])));
+		fprint_field(fp, "dev ", ll_index_to_name(*(int*)RTA_DATA(tb[RTA_OIF])));
 
 	if (!(r->rtm_flags&RTM_F_CLONED)) {
 		if (table != RT_TABLE_MAIN && !filter.tb)
-			fprintf(fp, " table %s ", rtnl_rttable_n2a(table, b1, sizeof(b1)));
+			fprint_field(fp, " table ", rtnl_rttable_n2a(table, b1, sizeof(b1)));
 		if (r->rtm_protocol != RTPROT_BOOT && filter.protocolmask != -1)
-			fprintf(fp, " proto %s ", rtnl_rtprot_n2a(r->rtm_protocol, b1, sizeof(b1)));
+			fprint_field(fp, " proto ", rtnl_rtprot_n2a(r->rtm_protocol, b1, sizeof(b1)));
 		if (r->rtm_scope != RT_SCOPE_UNIVERSE && filter.scopemask != -1)
-			fprintf(fp, " scope %s ", rtnl_rtscope_n2a(r->rtm_scope, b1, sizeof(b1)));
+			fprint_field(fp, " scope ", rtnl_rtscope_n2a(r->rtm_scope, b1, sizeof(b1)));
 	}
 	if (tb[RTA_PREFSRC] && filter.rprefsrc.bitlen != host_len) {
 		/* Do not use format_host(). It is our local addr
 		   and symbolic name will not be useful.
 		 */
-		fprintf(fp, " src %s ",
-			rt_addr_n2a(r->rtm_family,
-				    RTA_PAYLOAD(tb[RTA_PREFSRC]),
-				    RTA_DATA(tb[RTA_PREFSRC]),
-				    abuf, sizeof(abuf)));
+		fprint_field(fp, " src ",
+			     rt_addr_n2a(r->rtm_family,
+					 RTA_PAYLOAD(tb[RTA_PREFSRC]),
+					 RTA_DATA(tb[RTA_PREFSRC]),
+					 abuf, sizeof(abuf)));
 	}
 	if (tb[RTA_PRIORITY])
-		fprintf(fp, " metric %d ", *(__u32*)RTA_DATA(tb[RTA_PRIORITY]));
+		fprint_field(fp, " metric ",
+			     sprint_u32(b1, *(__u32*)RTA_DATA(tb[RTA_PRIORITY])));
 	if (r->rtm_flags & RTNH_F_DEAD)
 		fprintf(fp, "dead ");
 	if (r->rtm_flags & RTNH_F_ONLINK)
@@ -619,8 +730,7 @@ int print_route(const struct sockaddr_nl *who, struct nlmsghdr *n, void *arg)
 			nh = RTNH_NEXT(nh);
 		}
 	}
-	fprintf(fp, "\n");
-	fflush(fp);
+	fputc('\n', fp);
 	return 0;
 }
 
@@ -1265,9 +1375,7 @@ static int iproute_list_flush_or_save(int argc, char **argv, int action)
 	filter.mark = mark;
 
 	if (action == IPROUTE_FLUSH) {
-		int round = 0;
-		char flushb[4096-512];
-		time_t start = time(0);
+		struct rtnl_handle rth_dump;
 
 		if (filter.cloned) {
 			if (do_ipv6 != AF_INET6) {
@@ -1279,45 +1387,60 @@ static int iproute_list_flush_or_save(int argc, char **argv, int action)
 				return 0;
 		}
 
-		filter.flushb = flushb;
+		if (rtnl_open(&rth_dump, 0) < 0)
+			exit(1);
+		/* Without it the filter is applied here only */
+		if (!filter.cloned)
+			rtnl_set_strict_dump(&rth_dump);
+		rth_dump.flags |= RTNL_HANDLE_F_SUPPRESS_NLERR;
+		/* Batch requests before us may still have acks to come */
+		if (rth.inflight && rtnl_wait_acks(&rth, 0) < 0)
+			exit(1);
+
+		filter.flushb = malloc(FLUSH_CHUNK);
+		if (!filter.flushb) {
+			perror("Cannot allocate flush requests");
+			exit(1);
+		}
 		filter.flushp = 0;
-		filter.flushe = sizeof(flushb);
+		filter.flushe = FLUSH_CHUNK;
+		filter.flushed = filter.flushfail = filter.flushgone = 0;
 
-		for (;;) {
-			if (rtnl_wilddump_request(&rth, do_ipv6, RTM_GETROUTE) < 0) {
-				perror("Cannot send dump request");
-				exit(1);
-			}
-			filter.flushed = 0;
-			if (rtnl_dump_filter(&rth, filter_fn, stdout, NULL, NULL) < 0) {
+		if (flush_dump_request(&rth_dump, do_ipv6) < 0) {
+			perror("Cannot send dump request");
+			exit(1);
+		}
+		if (rtnl_dump_filter(&rth_dump, filter_fn, stdout, NULL, NULL) < 0) {
+			/* Strictly checked, a table that does not exist is an error */
+			if (errno != ENOENT || filter.tb <= 0 ||
+			    !(rth_dump.flags & RTNL_HANDLE_F_STRICT_CHK)) {
+				perror("RTNETLINK answers");
 				fprintf(stderr, "Flush terminated\n");
 				exit(1);
 			}
-			if (filter.flushed == 0) {
-				if (show_stats) {
-					if (round == 0 && (!filter.cloned || do_ipv6 == AF_INET6))
-						printf("Nothing to flush.\n");
-					else
-						printf("*** Flush is complete after %d round%s ***\n", round, round>1?"s":"");
-				}
-				fflush(stdout);
-				return 0;
-			}
-			round++;
-			if (flush_update() < 0)
-				exit(1);
+		}
+		rtnl_close(&rth_dump);
 
-			if (time(0) - start > 30) {
-				printf("\n*** Flush not completed after %ld seconds, %d entries remain ***\n",
-				       time(0) - start, filter.flushed);
+		if (filter.flushed == 0) {
+			if (show_stats && (!filter.cloned || do_ipv6 == AF_INET6))
+				printf("Nothing to flush.\n");
+		} else {
+			if (flush_send() < 0)
+				exit(1);
+			if (show_stats)
+				printf("*** Flush is complete, %d entries deleted ***\n",
+				       filter.flushed - filter.flushfail - filter.flushgone);
+			if (filter.flushfail) {
+				fprintf(stderr, "Failed to delete %d entries\n",
+					filter.flushfail);
 				exit(1);
-			}
-
-			if (show_stats) {
-				printf("\n*** Round %d, deleting %d entries ***\n", round, filter.flushed);
-				fflush(stdout);
 			}
 		}
+		fflush(stdout);
+
+		free(filter.flushb);
+		filter.flushb = NULL;
+		return 0;
 	}
 
 	if (!filter.cloned) {
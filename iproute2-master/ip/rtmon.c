@@ -26,7 +26,7 @@
 #include "libnetlink.h"
 
 int resolve_hosts = 0;
-static int init_phase = 1;
+static int stamp;
 
 static void write_stamp(FILE *fp)
 {
@@ -49,10 +49,11 @@ static int dump_msg(const struct sockaddr_nl *who, struct nlmsghdr *n,
 		    void *arg)
 {
 	FILE *fp = (FILE*)arg;
-	if (!init_phase)
+	if (stamp) {
 		write_stamp(fp);
+		stamp = 0;
+	}
 	fwrite((void*)n, 1, NLMSG_ALIGN(n->nlmsg_len), fp);
-	fflush(fp);
 	return 0;
 }
 
@@ -167,11 +168,17 @@ main(int argc, char **argv)
 		fprintf(stderr, "Dump terminated\n");
 		return 1;
 	}
+	fflush(fp);
 
-	init_phase = 0;
-
-	if (rtnl_listen(&rth, dump_msg, (void*)fp) < 0)
-		exit(2);
-
-	exit(0);
+	/* One stamp and one write per batch of events */
+	rth.flags |= RTNL_HANDLE_F_OVERRUN;
+	for (;;) {
+		stamp = 1;
+		if (rtnl_listen_poll(&rth, dump_msg, (void*)fp, -1) < 0)
+			exit(2);
+		if (fflush(fp) == EOF) {
+			perror("Cannot write events");
+			exit(1);
+		}
+	}
 }
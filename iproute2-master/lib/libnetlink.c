@@ -22,17 +22,33 @@
 #include <errno.h>
 #include <time.h>
 #include <sys/uio.h>
+#include <poll.h>
 
 #include "libnetlink.h"
 
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
+
 int rcvbuf = 1024 * 1024;
 
+#define RTNL_ACK_BATCH	16
+
+/* Dumps are read into RTNL_DUMP_VLEN buffers of at least RTNL_DUMP_BUF */
+#define RTNL_DUMP_BUF	32768
+#define RTNL_DUMP_VLEN	8
+
 void rtnl_close(struct rtnl_handle *rth)
 {
 	if (rth->fd >= 0) {
 		close(rth->fd);
 		rth->fd = -1;
 	}
+	free(rth->tags);
+	free(rth->dumpbuf);
+	rth->tags = NULL;
+	rth->dumpbuf = NULL;
+	rth->window = rth->inflight = rth->dumpsize = 0;
 }
 
 int rtnl_open_byproto(struct rtnl_handle *rth, unsigned subscriptions,
@@ -89,6 +105,145 @@ int rtnl_open(struct rtnl_handle *rth, unsigned subscriptions)
 	return rtnl_open_byproto(rth, subscriptions, NETLINK_ROUTE);
 }
 
+/* The acknowledgement of the oldest request in flight was dropped */
+static void rtnl_ack_lost(struct rtnl_handle *rth)
+{
+	__u32 seq = rth->seq - rth->inflight + 1;
+
+	if (rth->ack_err)
+		rth->ack_err(rth->tags[seq % rth->window], ENOBUFS);
+	rth->inflight--;
+}
+
+/*
+ * Wait until no more than limit pipelined requests are in flight.
+ * Failed requests are reported to the ack_err callback along with the
+ * tag the handle carried when the request was submitted. So are those
+ * whose acknowledgement the kernel dropped on a full receive queue,
+ * with ENOBUFS, their outcome is unknown.
+ */
+int rtnl_wait_acks(struct rtnl_handle *rth, int limit)
+{
+	struct mmsghdr msgs[RTNL_ACK_BATCH];
+	struct iovec iov[RTNL_ACK_BATCH];
+	char buf[RTNL_ACK_BATCH][1024];
+	int flags = MSG_WAITFORONE;
+	int lost = 0;
+	int i, n;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < RTNL_ACK_BATCH; i++) {
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = sizeof(buf[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	while (rth->inflight > limit || (lost && rth->inflight)) {
+		n = recvmmsg(rth->fd, msgs, RTNL_ACK_BATCH, flags, NULL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			/*
+			 * Requests are handled within send(), whatever is
+			 * not queued by now will never come: tell which of
+			 * them are missing from what is left.
+			 */
+			if (errno == ENOBUFS) {
+				lost = 1;
+				flags = MSG_DONTWAIT;
+				continue;
+			}
+			if (errno == EAGAIN && lost) {
+				while (rth->inflight)
+					rtnl_ack_lost(rth);
+				break;
+			}
+			if (errno == EAGAIN)
+				continue;
+			fprintf(stderr, "netlink receive error %s (%d)\n",
+				strerror(errno), errno);
+			return -1;
+		}
+
+		for (i = 0; i < n; i++) {
+			struct nlmsghdr *h = (struct nlmsghdr *)buf[i];
+			struct nlmsgerr *err = NLMSG_DATA(h);
+			__u32 seq = h->nlmsg_seq;
+
+			/* Acknowledgements arrive in order */
+			if (msgs[i].msg_len < NLMSG_LENGTH(sizeof(*err)) ||
+			    h->nlmsg_type != NLMSG_ERROR ||
+			    h->nlmsg_pid != rth->local.nl_pid ||
+			    rth->seq - seq >= rth->inflight)
+				continue;
+
+			/* Older ones still in flight were dropped */
+			while (rth->seq - seq < rth->inflight - 1)
+				rtnl_ack_lost(rth);
+
+			if (err->error && rth->ack_err)
+				rth->ack_err(rth->tags[seq % rth->window],
+					     -err->error);
+			rth->inflight--;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Let rtnl_talk() return right after sending requests which need no
+ * answer, keeping up to window requests in flight. Any other request
+ * on the handle waits for the outstanding ones first.
+ */
+int rtnl_set_window(struct rtnl_handle *rth, int window,
+		    rtnl_ack_err_t ack_err)
+{
+	if (rtnl_wait_acks(rth, 0) < 0)
+		return -1;
+
+	free(rth->tags);
+	rth->tags = NULL;
+	rth->window = 0;
+
+	if (window <= 1)
+		return 0;
+
+	rth->tags = calloc(window, sizeof(*rth->tags));
+	if (!rth->tags) {
+		perror("Cannot allocate request window");
+		return -1;
+	}
+
+	rth->window = window;
+	rth->ack_err = ack_err;
+	return 0;
+}
+
+/*
+ * Requests are sent right away rather than coalesced, the next command
+ * may well look up what this one created through another interface.
+ */
+static int rtnl_talk_pipelined(struct rtnl_handle *rtnl, struct nlmsghdr *n)
+{
+	if (rtnl->inflight >= rtnl->window &&
+	    rtnl_wait_acks(rtnl, rtnl->window - 1) < 0)
+		return -1;
+
+	n->nlmsg_seq = ++rtnl->seq;
+	n->nlmsg_flags |= NLM_F_ACK;
+
+	if (send(rtnl->fd, n, n->nlmsg_len, 0) < 0) {
+		perror("Cannot talk to rtnetlink");
+		return -1;
+	}
+
+	rtnl->tags[rtnl->seq % rtnl->window] = rtnl->tag;
+	rtnl->inflight++;
+	return 0;
+}
+
 int rtnl_wilddump_request(struct rtnl_handle *rth, int family, int type)
 {
 	struct {
@@ -96,6 +251,9 @@ int rtnl_wilddump_request(struct rtnl_handle *rth, int family, int type)
 		struct rtgenmsg g;
 	} req;
 
+	if (rth->inflight && rtnl_wait_acks(rth, 0) < 0)
+		return -1;
+
 	memset(&req, 0, sizeof(req));
 	req.nlh.nlmsg_len = sizeof(req);
 	req.nlh.nlmsg_type = type;
@@ -109,6 +267,9 @@ int rtnl_wilddump_request(struct rtnl_handle *rth, int family, int type)
 
 int rtnl_send(struct rtnl_handle *rth, const char *buf, int len)
 {
+	if (rth->inflight && rtnl_wait_acks(rth, 0) < 0)
+		return -1;
+
 	return send(rth->fd, buf, len, 0);
 }
 
@@ -118,6 +279,9 @@ int rtnl_send_check(struct rtnl_handle *rth, const char *buf, int len)
 	int status;
 	char resp[1024];
 
+	if (rth->inflight && rtnl_wait_acks(rth, 0) < 0)
+		return -1;
+
 	status = send(rth->fd, buf, len, 0);
 	if (status < 0)
 		return status;
@@ -145,6 +309,24 @@ int rtnl_send_check(struct rtnl_handle *rth, const char *buf, int len)
 	return 0;
 }
 
+/*
+ * Have the kernel check dump requests strictly and apply the filters
+ * they carry, instead of ignoring what follows the family. Requests on
+ * the handle must then carry the full header of their message type.
+ * Kernels before 4.20 do not know about it and keep dumping everything.
+ */
+int rtnl_set_strict_dump(struct rtnl_handle *rth)
+{
+	int one = 1;
+
+	if (setsockopt(rth->fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK,
+		       &one, sizeof(one)) < 0)
+		return -1;
+
+	rth->flags |= RTNL_HANDLE_F_STRICT_CHK;
+	return 0;
+}
+
 int rtnl_dump_request(struct rtnl_handle *rth, int type, void *req, int len)
 {
 	struct nlmsghdr nlh;
@@ -160,6 +342,9 @@ int rtnl_dump_request(struct rtnl_handle *rth, int type, void *req, int len)
 		.msg_iovlen = 2,
 	};
 
+	if (rth->inflight && rtnl_wait_acks(rth, 0) < 0)
+		return -1;
+
 	memset(&nladdr, 0, sizeof(nladdr));
 	nladdr.nl_family = AF_NETLINK;
 
@@ -172,95 +357,154 @@ int rtnl_dump_request(struct rtnl_handle *rth, int type, void *req, int len)
 	return sendmsg(rth->fd, &msg, 0);
 }
 
-int rtnl_dump_filter_l(struct rtnl_handle *rth,
-		       const struct rtnl_dump_filter_arg *arg)
+/*
+ * Size the dump buffers after the first reply of a dump. Later replies
+ * are no larger than the first one or the largest buffer the kernel
+ * has seen us receive into, so they can all be received with a single
+ * recvmmsg().
+ */
+static int rtnl_dump_recv(struct rtnl_handle *rth, struct mmsghdr *msgs,
+			  struct iovec *iov, struct sockaddr_nl *nladdr,
+			  int vlen, int peek, int flags)
 {
-	struct sockaddr_nl nladdr;
-	struct iovec iov;
-	struct msghdr msg = {
-		.msg_name = &nladdr,
-		.msg_namelen = sizeof(nladdr),
-		.msg_iov = &iov,
-		.msg_iovlen = 1,
-	};
-	char buf[16384];
+	int i, len;
+
+	if (peek) {
+		len = recv(rth->fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+		if (len < 0)
+			return len;
+		len = NLMSG_ALIGN(len < RTNL_DUMP_BUF ? RTNL_DUMP_BUF : len);
+
+		if (len > rth->dumpsize) {
+			free(rth->dumpbuf);
+			rth->dumpbuf = malloc(len * RTNL_DUMP_VLEN);
+			if (!rth->dumpbuf) {
+				perror("Cannot allocate dump buffer");
+				exit(1);
+			}
+			rth->dumpsize = len;
+		}
+	}
 
-	iov.iov_base = buf;
-	while (1) {
-		int status;
-		const struct rtnl_dump_filter_arg *a;
-		int found_done = 0;
-		int msglen = 0;
+	memset(msgs, 0, vlen * sizeof(*msgs));
+	for (i = 0; i < vlen; i++) {
+		iov[i].iov_base = rth->dumpbuf + i * rth->dumpsize;
+		iov[i].iov_len = rth->dumpsize;
+		msgs[i].msg_hdr.msg_name = &nladdr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(nladdr[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
 
-		iov.iov_len = sizeof(buf);
-		status = recvmsg(rth->fd, &msg, 0);
+	return recvmmsg(rth->fd, msgs, vlen, flags, NULL);
+}
 
-		if (status < 0) {
-			if (errno == EINTR || errno == EAGAIN)
-				continue;
-			fprintf(stderr, "netlink receive error %s (%d)\n",
-				strerror(errno), errno);
-			return -1;
-		}
+/* Returns 1 once the end of the dump is found */
+static int rtnl_dump_filter_msg(struct rtnl_handle *rth,
+				const struct rtnl_dump_filter_arg *arg,
+				struct sockaddr_nl *nladdr, char *buf,
+				int status, int flags)
+{
+	const struct rtnl_dump_filter_arg *a;
+	int found_done = 0;
+	int msglen = 0;
 
-		if (status == 0) {
-			fprintf(stderr, "EOF on netlink\n");
-			return -1;
-		}
+	if (status == 0) {
+		fprintf(stderr, "EOF on netlink\n");
+		return -1;
+	}
 
-		for (a = arg; a->filter; a++) {
-			struct nlmsghdr *h = (struct nlmsghdr*)buf;
-			msglen = status;
-
-			while (NLMSG_OK(h, msglen)) {
-				int err;
-
-				if (nladdr.nl_pid != 0 ||
-				    h->nlmsg_pid != rth->local.nl_pid ||
-				    h->nlmsg_seq != rth->dump) {
-					if (a->junk) {
-						err = a->junk(&nladdr, h,
-							      a->arg2);
-						if (err < 0)
-							return err;
-					}
-					goto skip_it;
-				}
+	for (a = arg; a->filter; a++) {
+		struct nlmsghdr *h = (struct nlmsghdr*)buf;
+		msglen = status;
+
+		while (NLMSG_OK(h, msglen)) {
+			int err;
 
-				if (h->nlmsg_type == NLMSG_DONE) {
-					found_done = 1;
-					break; /* process next filter */
+			if (nladdr->nl_pid != 0 ||
+			    h->nlmsg_pid != rth->local.nl_pid ||
+			    h->nlmsg_seq != rth->dump) {
+				if (a->junk) {
+					err = a->junk(nladdr, h, a->arg2);
+					if (err < 0)
+						return err;
 				}
-				if (h->nlmsg_type == NLMSG_ERROR) {
-					struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(h);
-					if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr))) {
-						fprintf(stderr,
-							"ERROR truncated\n");
-					} else {
-						errno = -err->error;
+				goto skip_it;
+			}
+
+			if (h->nlmsg_type == NLMSG_DONE) {
+				found_done = 1;
+				break; /* process next filter */
+			}
+			if (h->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(h);
+				if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr))) {
+					fprintf(stderr,
+						"ERROR truncated\n");
+				} else {
+					errno = -err->error;
+					if (!(rth->flags & RTNL_HANDLE_F_SUPPRESS_NLERR))
 						perror("RTNETLINK answers");
-					}
-					return -1;
 				}
-				err = a->filter(&nladdr, h, a->arg1);
-				if (err < 0)
-					return err;
+				return -1;
+			}
+			err = a->filter(nladdr, h, a->arg1);
+			if (err < 0)
+				return err;
 
 skip_it:
-				h = NLMSG_NEXT(h, msglen);
-			}
+			h = NLMSG_NEXT(h, msglen);
 		}
+	}
 
-		if (found_done)
-			return 0;
+	if (found_done)
+		return 1;
 
-		if (msg.msg_flags & MSG_TRUNC) {
-			fprintf(stderr, "Message truncated\n");
-			continue;
+	if (flags & MSG_TRUNC) {
+		fprintf(stderr, "Message truncated\n");
+		return 0;
+	}
+	if (msglen) {
+		fprintf(stderr, "!!!Remnant of size %d\n", msglen);
+		exit(1);
+	}
+	return 0;
+}
+
+int rtnl_dump_filter_l(struct rtnl_handle *rth,
+		       const struct rtnl_dump_filter_arg *arg)
+{
+	struct sockaddr_nl nladdr[RTNL_DUMP_VLEN];
+	struct iovec iov[RTNL_DUMP_VLEN];
+	struct mmsghdr msgs[RTNL_DUMP_VLEN];
+	int vlen = RTNL_DUMP_VLEN, peek = 1;
+
+	/* Don't read ahead into notifications meant for rtnl_listen() */
+	if (rth->local.nl_groups)
+		vlen = 1;
+
+	while (1) {
+		int i, n, err;
+
+		n = rtnl_dump_recv(rth, msgs, iov, nladdr, vlen, peek,
+				   MSG_WAITFORONE);
+
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			fprintf(stderr, "netlink receive error %s (%d)\n",
+				strerror(errno), errno);
+			return -1;
 		}
-		if (msglen) {
-			fprintf(stderr, "!!!Remnant of size %d\n", msglen);
-			exit(1);
+		peek = 0;
+
+		for (i = 0; i < n; i++) {
+			err = rtnl_dump_filter_msg(rth, arg, &nladdr[i],
+						   iov[i].iov_base,
+						   msgs[i].msg_len,
+						   msgs[i].msg_hdr.msg_flags);
+			if (err)
+				return err < 0 ? err : 0;
 		}
 	}
 }
@@ -300,6 +544,12 @@ int rtnl_talk(struct rtnl_handle *rtnl, struct nlmsghdr *n, pid_t peer,
 	};
 	char   buf[16384];
 
+	if (rtnl->window && !peer && !groups && !answer && !junk)
+		return rtnl_talk_pipelined(rtnl, n);
+
+	if (rtnl->inflight && rtnl_wait_acks(rtnl, 0) < 0)
+		return -1;
+
 	memset(&nladdr, 0, sizeof(nladdr));
 	nladdr.nl_family = AF_NETLINK;
 	nladdr.nl_pid = peer;
@@ -404,78 +654,146 @@ int rtnl_talk(struct rtnl_handle *rtnl, struct nlmsghdr *n, pid_t peer,
 	}
 }
 
-int rtnl_listen(struct rtnl_handle *rtnl,
-		rtnl_filter_t handler,
-		void *jarg)
+static int rtnl_listen_msg(const struct sockaddr_nl *nladdr, char *buf,
+			   int status, int flags,
+			   rtnl_filter_t handler, void *jarg)
 {
-	int status;
 	struct nlmsghdr *h;
-	struct sockaddr_nl nladdr;
-	struct iovec iov;
-	struct msghdr msg = {
-		.msg_name = &nladdr,
-		.msg_namelen = sizeof(nladdr),
-		.msg_iov = &iov,
-		.msg_iovlen = 1,
+
+	if (status == 0) {
+		fprintf(stderr, "EOF on netlink\n");
+		return -1;
+	}
+
+	for (h = (struct nlmsghdr*)buf; status >= sizeof(*h); ) {
+		int err;
+		int len = h->nlmsg_len;
+		int l = len - sizeof(*h);
+
+		if (l<0 || len>status) {
+			if (flags & MSG_TRUNC) {
+				fprintf(stderr, "Truncated message\n");
+				return -1;
+			}
+			fprintf(stderr, "!!!malformed message: len=%d\n", len);
+			exit(1);
+		}
+
+		err = handler(nladdr, h, jarg);
+		if (err < 0)
+			return err;
+
+		status -= NLMSG_ALIGN(len);
+		h = (struct nlmsghdr*)((char*)h + NLMSG_ALIGN(len));
+	}
+	if (flags & MSG_TRUNC) {
+		fprintf(stderr, "Message truncated\n");
+		return 0;
+	}
+	if (status) {
+		fprintf(stderr, "!!!Remnant of size %d\n", status);
+		exit(1);
+	}
+	return 0;
+}
+
+/* Hand the loss of notifications to the handler as an NLMSG_OVERRUN */
+static int rtnl_listen_overrun(struct rtnl_handle *rtnl,
+			       rtnl_filter_t handler, void *jarg)
+{
+	struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
+	struct nlmsghdr n = {
+		.nlmsg_len = NLMSG_LENGTH(0),
+		.nlmsg_type = NLMSG_OVERRUN,
 	};
-	char   buf[8192];
 
-	memset(&nladdr, 0, sizeof(nladdr));
-	nladdr.nl_family = AF_NETLINK;
-	nladdr.nl_pid = 0;
-	nladdr.nl_groups = 0;
+	if (!(rtnl->flags & RTNL_HANDLE_F_OVERRUN))
+		return 0;
+	return handler(&nladdr, &n, jarg);
+}
+
+/*
+ * Wait up to timeout milliseconds, or forever if it is negative, for
+ * notifications and handle everything that has queued up meanwhile,
+ * several datagrams per receive.
+ */
+int rtnl_listen_poll(struct rtnl_handle *rtnl,
+		     rtnl_filter_t handler,
+		     void *jarg, int timeout)
+{
+	struct sockaddr_nl nladdr[RTNL_DUMP_VLEN];
+	struct iovec iov[RTNL_DUMP_VLEN];
+	struct mmsghdr msgs[RTNL_DUMP_VLEN];
+	int flags = MSG_WAITFORONE;
+
+	if (timeout >= 0) {
+		struct pollfd pfd = { .fd = rtnl->fd, .events = POLLIN };
+		int n;
+
+		n = poll(&pfd, 1, timeout);
+		if (n < 0 && errno != EINTR)
+			return -1;
+		if (n <= 0)
+			return 0;
+		flags = MSG_DONTWAIT;
+	}
 
-	iov.iov_base = buf;
 	while (1) {
-		iov.iov_len = sizeof(buf);
-		status = recvmsg(rtnl->fd, &msg, 0);
+		int i, n, err;
 
-		if (status < 0) {
+		n = rtnl_dump_recv(rtnl, msgs, iov, nladdr, RTNL_DUMP_VLEN,
+				   !rtnl->dumpbuf, flags);
+
+		if (n < 0) {
+			if (errno == EAGAIN && (flags & MSG_DONTWAIT))
+				return 0;
 			if (errno == EINTR || errno == EAGAIN)
 				continue;
+			if (errno == ENOBUFS) {
+				if (!(rtnl->flags & RTNL_HANDLE_F_OVERRUN))
+					fprintf(stderr, "netlink receive error %s (%d)\n",
+						strerror(errno), errno);
+				err = rtnl_listen_overrun(rtnl, handler, jarg);
+				if (err < 0)
+					return err;
+				continue;
+			}
 			fprintf(stderr, "netlink receive error %s (%d)\n",
 				strerror(errno), errno);
-			if (errno == ENOBUFS)
-				continue;
-			return -1;
-		}
-		if (status == 0) {
-			fprintf(stderr, "EOF on netlink\n");
 			return -1;
 		}
-		if (msg.msg_namelen != sizeof(nladdr)) {
-			fprintf(stderr, "Sender address length == %d\n", msg.msg_namelen);
-			exit(1);
-		}
-		for (h = (struct nlmsghdr*)buf; status >= sizeof(*h); ) {
-			int err;
-			int len = h->nlmsg_len;
-			int l = len - sizeof(*h);
 
-			if (l<0 || len>status) {
-				if (msg.msg_flags & MSG_TRUNC) {
-					fprintf(stderr, "Truncated message\n");
-					return -1;
-				}
-				fprintf(stderr, "!!!malformed message: len=%d\n", len);
+		for (i = 0; i < n; i++) {
+			if (msgs[i].msg_hdr.msg_namelen != sizeof(nladdr[i])) {
+				fprintf(stderr, "Sender address length == %d\n",
+					msgs[i].msg_hdr.msg_namelen);
 				exit(1);
 			}
-
-			err = handler(&nladdr, h, jarg);
+			err = rtnl_listen_msg(&nladdr[i], iov[i].iov_base,
+					      msgs[i].msg_len,
+					      msgs[i].msg_hdr.msg_flags,
+					      handler, jarg);
 			if (err < 0)
 				return err;
-
-			status -= NLMSG_ALIGN(len);
-			h = (struct nlmsghdr*)((char*)h + NLMSG_ALIGN(len));
-		}
-		if (msg.msg_flags & MSG_TRUNC) {
-			fprintf(stderr, "Message truncated\n");
-			continue;
-		}
-		if (status) {
-			fprintf(stderr, "!!!Remnant of size %d\n", status);
-			exit(1);
 		}
+
+		/* A short batch means the queue is drained */
+		if (n < RTNL_DUMP_VLEN)
+			return 0;
+		flags = MSG_DONTWAIT;
+	}
+}
+
+int rtnl_listen(struct rtnl_handle *rtnl,
+		rtnl_filter_t handler,
+		void *jarg)
+{
+	int err;
+
+	while (1) {
+		err = rtnl_listen_poll(rtnl, handler, jarg, -1);
+		if (err < 0)
+			return err;
 	}
 }
 
@@ -28,6 +28,8 @@ extern unsigned int if_nametoindex (const char *);
 struct ll_cache
 {
 	struct ll_cache   *idx_next;
+	struct ll_cache   *name_next;
+	unsigned	name_hash;
 	unsigned	flags;
 	int		index;
 	unsigned short	type;
@@ -36,12 +38,99 @@ struct ll_cache
 	unsigned char	addr[20];
 };
 
-#define IDXMAP_SIZE	1024
-static struct ll_cache *idx_head[IDXMAP_SIZE];
+/* Both tables grow with the number of interfaces, keeping chains short */
+#define LL_HASH_MIN	1024
+
+static struct ll_cache **idx_head;
+static struct ll_cache **name_head;
+static unsigned ll_hsize;
+static unsigned ll_count;
+
+static unsigned namehash(const char *str)
+{
+	unsigned hash = 5381;
+
+	while (*str)
+		hash = hash * 33 + (unsigned char)*str++;
+	return hash;
+}
 
 static inline struct ll_cache *idxhead(int idx)
 {
-	return idx_head[idx & (IDXMAP_SIZE - 1)];
+	if (!ll_hsize)
+		return NULL;
+	return idx_head[idx & (ll_hsize - 1)];
+}
+
+static int ll_hash_resize(unsigned size)
+{
+	struct ll_cache **idx, **name, *im, *next;
+	unsigned i;
+
+	idx = calloc(2 * size, sizeof(*idx));
+	if (idx == NULL)
+		return -1;
+	name = idx + size;
+
+	for (i = 0; i < ll_hsize; i++) {
+		for (im = idx_head[i]; im; im = next) {
+			next = im->idx_next;
+			im->idx_next = idx[im->index & (size - 1)];
+			idx[im->index & (size - 1)] = im;
+			im->name_next = name[im->name_hash & (size - 1)];
+			name[im->name_hash & (size - 1)] = im;
+		}
+	}
+
+	free(idx_head);
+	idx_head = idx;
+	name_head = name;
+	ll_hsize = size;
+	return 0;
+}
+
+static void ll_name_unlink(struct ll_cache *im)
+{
+	struct ll_cache **imp;
+
+	for (imp = &name_head[im->name_hash & (ll_hsize - 1)]; *imp;
+	     imp = &(*imp)->name_next) {
+		if (*imp == im) {
+			*imp = im->name_next;
+			break;
+		}
+	}
+}
+
+static void ll_forget(struct ll_cache *im)
+{
+	struct ll_cache **imp;
+
+	for (imp = &idx_head[im->index & (ll_hsize - 1)]; *imp;
+	     imp = &(*imp)->idx_next) {
+		if (*imp == im) {
+			*imp = im->idx_next;
+			break;
+		}
+	}
+	ll_name_unlink(im);
+	ll_count--;
+	free(im);
+}
+
+static struct ll_cache *ll_get_by_name(const char *name)
+{
+	struct ll_cache *im;
+	unsigned hash;
+
+	if (!ll_hsize)
+		return NULL;
+
+	hash = namehash(name);
+	for (im = name_head[hash & (ll_hsize - 1)]; im; im = im->name_next)
+		if (im->name_hash == hash && strcmp(im->name, name) == 0)
+			return im;
+	return NULL;
 }
 
 int ll_remember_index(const struct sockaddr_nl *who,
@@ -49,32 +138,56 @@ int ll_remember_index(const struct sockaddr_nl *who,
 {
 	int h;
 	struct ifinfomsg *ifi = NLMSG_DATA(n);
-	struct ll_cache *im, **imp;
+	struct ll_cache *im, *old, **imp;
 	struct rtattr *tb[IFLA_MAX+1];
+	const char *name;
 
-	if (n->nlmsg_type != RTM_NEWLINK)
+	if (n->nlmsg_type != RTM_NEWLINK && n->nlmsg_type != RTM_DELLINK)
 		return 0;
 
 	if (n->nlmsg_len < NLMSG_LENGTH(sizeof(ifi)))
 		return -1;
 
-	memset(tb, 0, sizeof(tb));
-	parse_rtattr(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(n));
-	if (tb[IFLA_IFNAME] == NULL)
+	if (!ll_hsize && ll_hash_resize(LL_HASH_MIN) < 0)
 		return 0;
 
-	h = ifi->ifi_index & (IDXMAP_SIZE - 1);
+	h = ifi->ifi_index & (ll_hsize - 1);
 	for (imp = &idx_head[h]; (im=*imp)!=NULL; imp = &im->idx_next)
 		if (im->index == ifi->ifi_index)
 			break;
 
+	if (n->nlmsg_type == RTM_DELLINK) {
+		if (im)
+			ll_forget(im);
+		return 0;
+	}
+
+	memset(tb, 0, sizeof(tb));
+	parse_rtattr(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(n));
+	if (tb[IFLA_IFNAME] == NULL)
+		return 0;
+	name = RTA_DATA(tb[IFLA_IFNAME]);
+
+	/* Names are unique, whoever had this one before is gone or renamed */
+	old = ll_get_by_name(name);
+	if (old && old != im)
+		ll_forget(old);
+
 	if (im == NULL) {
+		if (ll_count >= ll_hsize)
+			ll_hash_resize(2 * ll_hsize);
+
 		im = malloc(sizeof(*im));
 		if (im == NULL)
 			return 0;
-		im->idx_next = *imp;
+		h = ifi->ifi_index & (ll_hsize - 1);
+		im->idx_next = idx_head[h];
 		im->index = ifi->ifi_index;
-		*imp = im;
+		idx_head[h] = im;
+		im->name_next = NULL;
+		im->name_hash = 0;
+		im->name[0] = 0;
+		ll_count++;
 	}
 
 	im->type = ifi->ifi_type;
@@ -89,7 +202,14 @@ int ll_remember_index(const struct sockaddr_nl *who,
 		im->alen = 0;
 		memset(im->addr, 0, sizeof(im->addr));
 	}
-	strcpy(im->name, RTA_DATA(tb[IFLA_IFNAME]));
+
+	if (strcmp(im->name, name) != 0) {
+		ll_name_unlink(im);
+		strcpy(im->name, name);
+		im->name_hash = namehash(name);
+		im->name_next = name_head[im->name_hash & (ll_hsize - 1)];
+		name_head[im->name_hash & (ll_hsize - 1)] = im;
+	}
 	return 0;
 }
 
@@ -164,27 +284,15 @@ unsigned ll_index_to_addr(unsigned idx, unsigned char *addr,
 
 unsigned ll_name_to_index(const char *name)
 {
-	static char ncache[IFNAMSIZ];
-	static int icache;
 	struct ll_cache *im;
-	int i;
 	unsigned idx;
 
 	if (name == NULL)
 		return 0;
 
-	if (icache && strcmp(name, ncache) == 0)
-		return icache;
-
-	for (i=0; i<IDXMAP_SIZE; i++) {
-		for (im = idx_head[i]; im; im = im->idx_next) {
-			if (strcmp(im->name, name) == 0) {
-				icache = im->index;
-				strcpy(ncache, name);
-				return im->index;
-			}
-		}
-	}
+	im = ll_get_by_name(name);
+	if (im)
+		return im->index;
 
 	idx = if_nametoindex(name);
 	if (idx == 0)
@@ -499,10 +499,37 @@ int __get_user_hz(void)
 	return sysconf(_SC_CLK_TCK);
 }
 
+/* inet_ntop() goes through sprintf(), too slow for dumps of whole tables */
+static const char *inet4_n2a(const void *addr, char *buf, int buflen)
+{
+	const __u8 *a = addr;
+	char *p = buf;
+	int i;
+
+	if (buflen < INET_ADDRSTRLEN)
+		return inet_ntop(AF_INET, addr, buf, buflen);
+
+	for (i = 0; i < 4; i++) {
+		unsigned v = a[i];
+
+		if (v >= 100) {
+			*p++ = '0' + v / 100;
+			v %= 100;
+			*p++ = '0' + v / 10;
+		} else if (v >= 10)
+			*p++ = '0' + v / 10;
+		*p++ = '0' + v % 10;
+		*p++ = '.';
+	}
+	p[-1] = 0;
+	return buf;
+}
+
 const char *rt_addr_n2a(int af, int len, const void *addr, char *buf, int buflen)
 {
 	switch (af) {
 	case AF_INET:
+		return inet4_n2a(addr, buf, buflen);
 	case AF_INET6:
 		return inet_ntop(af, addr, buf, buflen);
 	case AF_IPX:
@@ -681,6 +708,37 @@ int print_timestamp(FILE *fp)
 	return 0;
 }
 
+/* Output of dumps is only flushed when a terminal is waiting for it */
+#define OUTPUT_BUF	65536
+
+void output_init(FILE *fp)
+{
+	if (!isatty(fileno(fp)))
+		setvbuf(fp, NULL, _IOFBF, OUTPUT_BUF);
+}
+
+/* Returns a pointer into buf, which must hold at least 11 bytes */
+char *sprint_u32(char *buf, __u32 val)
+{
+	char *p = buf + 10;
+
+	*p = 0;
+	do {
+		*--p = '0' + val % 10;
+		val /= 10;
+	} while (val);
+	return p;
+}
+
+/* Same as fprintf(fp, "%s%s ", name, val) without parsing a format */
+void fprint_field(FILE *fp, const char *name, const char *val)
+{
+	if (name)
+		fputs(name, fp);
+	fputs(val, fp);
+	putc(' ', fp);
+}
+
 int cmdlineno;
 
 /* Like glibc getline but handle continuation lines and comments */
@@ -728,6 +786,21 @@ ssize_t getcmdline(char **linep, size_t *lenp, FILE *in)
 	return cc;
 }
 
+/*
+ * With -force, requests of a batch which only need an acknowledgement
+ * are pipelined, and their failures reported here as the
+ * acknowledgements come in, tagged with the line they came from.
+ */
+const char *batch_name;
+int batch_errors;
+
+void batch_ack_err(int lineno, int error)
+{
+	fprintf(stderr, "RTNETLINK answers: %s\n", strerror(error));
+	fprintf(stderr, "Command failed %s:%d\n", batch_name, lineno);
+	batch_errors++;
+}
+
 /* split command line into argument vector */
 int makeargs(char *line, char *argv[], int maxargs)
 {
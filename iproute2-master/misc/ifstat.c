@@ -24,6 +24,7 @@
 #include <sys/poll.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <signal.h>
 #include <math.h>
 #include <getopt.h>
@@ -34,6 +35,8 @@
 
 #include <SNAPSHOT.h>
 
+#include "statshm.h"
+
 int dump_zeros = 0;
 int reset_history = 0;
 int ignore_history = 0;
@@ -64,6 +67,17 @@ struct ifstat_ent
 struct ifstat_ent *kern_db;
 struct ifstat_ent *hist_db;
 
+/* Record of the snapshot the daemon publishes in shared memory */
+struct ifstat_rec
+{
+	int			ifindex;
+	char			name[IFNAMSIZ];
+	unsigned long long	val[MAXS];
+	double			rate[MAXS];
+};
+
+struct statshm shm;
+
 static int match(const char *id)
 {
 	int i;
@@ -146,6 +160,166 @@ void load_info(void)
 	}
 }
 
+/*
+ * The daemon samples counters with RTM_GETSTATS, which carries nothing
+ * but the counters, and refreshes names and flags with a full link dump
+ * only after the kernel has announced a link change.
+ */
+struct link_name
+{
+	int			ifindex;
+	char			name[IFNAMSIZ];
+};
+
+static struct link_name *link_names;
+static unsigned link_hsize;
+static int links_dirty = 1;
+static int have_stats = 1;
+static struct rtnl_handle link_mon;
+
+static struct link_name *link_name_slot(int ifindex)
+{
+	unsigned h = (ifindex * 2654435761U) & (link_hsize - 1);
+
+	while (link_names[h].ifindex && link_names[h].ifindex != ifindex)
+		h = (h + 1) & (link_hsize - 1);
+	return &link_names[h];
+}
+
+static void link_names_build(void)
+{
+	struct ifstat_ent *n;
+	unsigned cnt = 0;
+
+	for (n = kern_db; n; n = n->next)
+		cnt++;
+
+	free(link_names);
+	link_hsize = 64;
+	while (link_hsize < 2 * cnt)
+		link_hsize *= 2;
+	link_names = calloc(link_hsize, sizeof(*link_names));
+	if (!link_names)
+		abort();
+
+	for (n = kern_db; n; n = n->next) {
+		struct link_name *l = link_name_slot(n->ifindex);
+
+		l->ifindex = n->ifindex;
+		strncpy(l->name, n->name, IFNAMSIZ - 1);
+	}
+}
+
+static int get_stats_nlmsg(const struct sockaddr_nl *who,
+			   struct nlmsghdr *m, void *arg)
+{
+	struct if_stats_msg *ifsm = NLMSG_DATA(m);
+	struct rtattr *tb[IFLA_STATS_MAX+1];
+	struct rtnl_link_stats64 *st;
+	struct link_name *l;
+	struct ifstat_ent *n;
+	int len = m->nlmsg_len;
+	int i;
+
+	if (m->nlmsg_type != RTM_NEWSTATS)
+		return 0;
+
+	len -= NLMSG_LENGTH(sizeof(*ifsm));
+	if (len < 0)
+		return -1;
+
+	/* Only the links which were up, as with the link dump */
+	l = link_name_slot(ifsm->ifindex);
+	if (!l->ifindex)
+		return 0;
+
+	parse_rtattr(tb, IFLA_STATS_MAX,
+		     (struct rtattr *)((char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm))),
+		     len);
+	if (tb[IFLA_STATS_LINK_64] == NULL ||
+	    RTA_PAYLOAD(tb[IFLA_STATS_LINK_64]) < MAXS * sizeof(__u64))
+		return 0;
+	st = RTA_DATA(tb[IFLA_STATS_LINK_64]);
+
+	n = malloc(sizeof(*n));
+	if (!n)
+		abort();
+	n->ifindex = l->ifindex;
+	n->name = strdup(l->name);
+	/* Same layout as rtnl_link_stats, wrapping is dealt with as for it */
+	for (i=0; i<MAXS; i++)
+		n->ival[i] = ((__u64 *)st)[i];
+	memset(&n->rate, 0, sizeof(n->rate));
+	for (i=0; i<MAXS; i++)
+		n->val[i] = n->ival[i];
+	n->next = kern_db;
+	kern_db = n;
+	return 0;
+}
+
+static int load_stats(void)
+{
+	struct ifstat_ent *db, *n;
+	struct rtnl_handle rth;
+	struct if_stats_msg ifsm = {
+		.family = AF_UNSPEC,
+		.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64),
+	};
+	int err;
+
+	if (rtnl_open(&rth, 0) < 0)
+		exit(1);
+
+	if (rtnl_dump_request(&rth, RTM_GETSTATS, &ifsm, sizeof(ifsm)) < 0) {
+		perror("Cannot send dump request");
+		exit(1);
+	}
+
+	err = rtnl_dump_filter(&rth, get_stats_nlmsg, NULL, NULL, NULL);
+	rtnl_close(&rth);
+
+	db = kern_db;
+	kern_db = NULL;
+
+	while (db) {
+		n = db;
+		db = db->next;
+		if (err < 0) {
+			free(n->name);
+			free(n);
+			continue;
+		}
+		n->next = kern_db;
+		kern_db = n;
+	}
+	return err;
+}
+
+static void load_daemon_info(void)
+{
+	if (have_stats && !links_dirty) {
+		if (load_stats() == 0)
+			return;
+		/* Kernels before 4.7 do not know the request */
+		have_stats = 0;
+	}
+
+	load_info();
+	link_names_build();
+	links_dirty = 0;
+}
+
+/* Any link notification may change a name or a flag, drop them all */
+static void drain_link_mon(void)
+{
+	char buf[8192];
+
+	while (recv(link_mon.fd, buf, sizeof(buf), MSG_DONTWAIT) > 0 ||
+	       errno == ENOBUFS || errno == EINTR)
+		;
+	links_dirty = 1;
+}
+
 void load_raw_table(FILE *fp)
 {
 	char buf[4096];
@@ -209,6 +383,76 @@ void load_raw_table(FILE *fp)
 	}
 }
 
+static int load_shm_table(const char *name)
+{
+	struct ifstat_ent *db = NULL;
+	struct ifstat_ent *n;
+	struct ifstat_rec *r;
+	char source[128];
+	unsigned len, i, k;
+	void *buf;
+
+	if (statshm_open(&shm, name) < 0)
+		return -1;
+	buf = statshm_read(&shm, source, &len);
+	statshm_close(&shm);
+	if (!buf)
+		return -1;
+
+	if (info_source[0] && strcmp(info_source, source))
+		source_mismatch = 1;
+	strcpy(info_source, source);
+
+	for (r = buf, i = 0; i < len / sizeof(*r); i++, r++) {
+		if ((n = malloc(sizeof(*n))) == NULL)
+			abort();
+		n->ifindex = r->ifindex;
+		n->name = strndup(r->name, IFNAMSIZ);
+		memcpy(n->val, r->val, sizeof(n->val));
+		memcpy(n->rate, r->rate, sizeof(n->rate));
+		for (k = 0; k < MAXS; k++)
+			n->ival[k] = (__u32)n->val[k];
+		n->next = db;
+		db = n;
+	}
+	free(buf);
+
+	while (db) {
+		n = db;
+		db = db->next;
+		n->next = kern_db;
+		kern_db = n;
+	}
+	return 0;
+}
+
+void publish_shm(void)
+{
+	static struct ifstat_rec *recs;
+	static unsigned size;
+	struct ifstat_ent *n;
+	unsigned cnt = 0;
+
+	for (n = kern_db; n; n = n->next) {
+		struct ifstat_rec *r;
+
+		if (cnt == size) {
+			size = size ? 2 * size : 64;
+			recs = realloc(recs, size * sizeof(*recs));
+			if (!recs)
+				abort();
+		}
+		r = &recs[cnt++];
+		memset(r, 0, sizeof(*r));
+		r->ifindex = n->ifindex;
+		strncpy(r->name, n->name, IFNAMSIZ - 1);
+		memcpy(r->val, n->val, sizeof(r->val));
+		memcpy(r->rate, n->rate, sizeof(r->rate));
+	}
+
+	statshm_publish(&shm, info_source, recs, cnt * sizeof(*recs));
+}
+
 void dump_raw_db(FILE *fp, int to_hist)
 {
 	struct ifstat_ent *n, *h;
@@ -425,19 +669,19 @@ void sigchild(int signo)
 
 void update_db(int interval)
 {
-	struct ifstat_ent *n, *h;
+	struct ifstat_ent *n, *h, **tail;
 
 	n = kern_db;
 	kern_db = NULL;
 
-	load_info();
+	load_daemon_info();
 
 	h = kern_db;
 	kern_db = n;
 
 	for (n = kern_db; n; n = n->next) {
-		struct ifstat_ent *h1;
-		for (h1 = h; h1; h1 = h1->next) {
+		struct ifstat_ent *h1, **hp;
+		for (hp = &h; (h1 = *hp) != NULL; hp = &h1->next) {
 			if (h1->ifindex == n->ifindex) {
 				int i;
 				for (i = 0; i < MAXS; i++) {
@@ -464,19 +708,24 @@ void update_db(int interval)
 					}
 				}
 
-				while (h != h1) {
-					struct ifstat_ent *tmp = h;
-					h = h->next;
-					free(tmp->name);
-					free(tmp);
-				};
-				h = h1->next;
+				/* Renamed links keep their counters */
+				if (strcmp(n->name, h1->name)) {
+					char *tmp = n->name;
+					n->name = h1->name;
+					h1->name = tmp;
+				}
+				*hp = h1->next;
 				free(h1->name);
 				free(h1);
 				break;
 			}
 		}
 	}
+
+	/* Whatever is left are links which came up since the last sample */
+	for (tail = &kern_db; *tail; tail = &(*tail)->next)
+		;
+	*tail = h;
 }
 
 #define T_DIFF(a,b) (((a).tv_sec-(b).tv_sec)*1000 + ((a).tv_usec-(b).tv_usec)/1000)
@@ -485,14 +734,16 @@ void update_db(int interval)
 void server_loop(int fd)
 {
 	struct timeval snaptime = { 0 };
-	struct pollfd p;
-	p.fd = fd;
-	p.events = p.revents = POLLIN;
+	struct pollfd p[2];
+	p[0].fd = fd;
+	p[0].events = p[0].revents = POLLIN;
+	p[1].fd = link_mon.fd;
+	p[1].events = p[1].revents = POLLIN;
 
 	sprintf(info_source, "%d.%lu sampling_interval=%d time_const=%d",
 		getpid(), (unsigned long)random(), scan_interval/1000, time_constant/1000);
 
-	load_info();
+	load_daemon_info();
 
 	for (;;) {
 		int status;
@@ -503,12 +754,16 @@ void server_loop(int fd)
 		tdiff = T_DIFF(now, snaptime);
 		if (tdiff >= scan_interval) {
 			update_db(tdiff);
+			publish_shm();
 			snaptime = now;
 			tdiff = 0;
 		}
 
-		if (poll(&p, 1, tdiff + scan_interval) > 0
-		    && (p.revents&POLLIN)) {
+		if (poll(p, 2, tdiff + scan_interval) <= 0)
+			goto reap;
+		if (p[1].revents)
+			drain_link_mon();
+		if (p[0].revents&POLLIN) {
 			int clnt = accept(fd, NULL, NULL);
 			if (clnt >= 0) {
 				pid_t pid;
@@ -529,11 +784,18 @@ void server_loop(int fd)
 				}
 			}
 		}
+reap:
 		while (children && waitpid(-1, &status, WNOHANG) > 0)
 			children--;
 	}
 }
 
+static void sigterm(int signo)
+{
+	shm_unlink(shm.name);
+	_exit(0);
+}
+
 int verify_forging(int fd)
 {
 	struct ucred cred;
@@ -659,12 +921,20 @@ int main(int argc, char *argv[])
 			perror("ifstat: listen");
 			exit(-1);
 		}
+		if (statshm_create(&shm, sun.sun_path+1, scan_interval) < 0) {
+			perror("ifstat: shm_open");
+			exit(-1);
+		}
+		if (rtnl_open(&link_mon, RTMGRP_LINK) < 0)
+			exit(-1);
 		if (daemon(0, 0)) {
 			perror("ifstat: daemon");
 			exit(-1);
 		}
 		signal(SIGPIPE, SIG_IGN);
 		signal(SIGCHLD, sigchild);
+		signal(SIGTERM, sigterm);
+		signal(SIGINT, sigterm);
 		server_loop(fd);
 		exit(0);
 	}
@@ -726,7 +996,14 @@ int main(int argc, char *argv[])
 		kern_db = NULL;
 	}
 
-	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0 &&
+	/* A running daemon publishes its snapshot, no need to ask it */
+	if (load_shm_table(sun.sun_path+1) == 0 ||
+	    load_shm_table("ifstat0") == 0) {
+		if (hist_db && source_mismatch) {
+			fprintf(stderr, "ifstat: history is stale, ignoring it.\n");
+			hist_db = NULL;
+		}
+	} else if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0 &&
 	    (connect(fd, (struct sockaddr*)&sun, 2+1+strlen(sun.sun_path+1)) == 0
 	     || (strcpy(sun.sun_path+1, "ifstat0"),
 		 connect(fd, (struct sockaddr*)&sun, 2+1+strlen(sun.sun_path+1)) == 0))
@@ -24,11 +24,14 @@
 #include <sys/poll.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <signal.h>
 #include <math.h>
 
 #include <SNAPSHOT.h>
 
+#include "statshm.h"
+
 int dump_zeros = 0;
 int reset_history = 0;
 int ignore_history = 0;
@@ -82,6 +85,18 @@ struct nstat_ent
 struct nstat_ent *kern_db;
 struct nstat_ent *hist_db;
 
+/* Record of the snapshot the daemon publishes in shared memory */
+#define NSTAT_ID_MAX	64
+
+struct nstat_rec
+{
+	char			id[NSTAT_ID_MAX];
+	unsigned long long	val;
+	double			rate;
+};
+
+struct statshm shm;
+
 char *useless_numbers[] = {
 "IpForwarding", "IpDefaultTTL",
 "TcpRtoAlgorithm", "TcpRtoMin", "TcpRtoMax",
@@ -157,6 +172,77 @@ void load_good_table(FILE *fp)
 }
 
 
+static int load_shm_table(const char *name)
+{
+	struct nstat_ent *db = NULL;
+	struct nstat_ent *n;
+	struct nstat_rec *r;
+	char source[128];
+	unsigned len, i;
+	void *buf;
+
+	if (statshm_open(&shm, name) < 0)
+		return -1;
+	buf = statshm_read(&shm, source, &len);
+	statshm_close(&shm);
+	if (!buf)
+		return -1;
+
+	if (info_source[0] && strcmp(info_source, source))
+		source_mismatch = 1;
+	strcpy(info_source, source);
+
+	for (r = buf, i = 0; i < len / sizeof(*r); i++, r++) {
+		if (useless_number(r->id))
+			continue;
+		if ((n = malloc(sizeof(*n))) == NULL)
+			abort();
+		n->id = strndup(r->id, NSTAT_ID_MAX);
+		n->ival = (unsigned long)r->val;
+		n->val = r->val;
+		n->rate = r->rate;
+		n->next = db;
+		db = n;
+	}
+	free(buf);
+
+	while (db) {
+		n = db;
+		db = db->next;
+		n->next = kern_db;
+		kern_db = n;
+	}
+	return 0;
+}
+
+void publish_shm(void)
+{
+	static struct nstat_rec *recs;
+	static unsigned size;
+	struct nstat_ent *n;
+	unsigned cnt = 0;
+
+	for (n = kern_db; n; n = n->next) {
+		struct nstat_rec *r;
+
+		if (strlen(n->id) >= NSTAT_ID_MAX)
+			continue;
+		if (cnt == size) {
+			size = size ? 2 * size : 256;
+			recs = realloc(recs, size * sizeof(*recs));
+			if (!recs)
+				abort();
+		}
+		r = &recs[cnt++];
+		memset(r, 0, sizeof(*r));
+		strcpy(r->id, n->id);
+		r->val = n->val;
+		r->rate = n->rate;
+	}
+
+	statshm_publish(&shm, info_source, recs, cnt * sizeof(*recs));
+}
+
 void load_ugly_table(FILE *fp)
 {
 	char buf[4096];
@@ -389,6 +475,7 @@ void server_loop(int fd)
 		tdiff = T_DIFF(now, snaptime);
 		if (tdiff >= scan_interval) {
 			update_db(tdiff);
+			publish_shm();
 			snaptime = now;
 			tdiff = 0;
 		}
@@ -419,6 +506,12 @@ void server_loop(int fd)
 	}
 }
 
+static void sigterm(int signo)
+{
+	shm_unlink(shm.name);
+	_exit(0);
+}
+
 int verify_forging(int fd)
 {
 	struct ucred cred;
@@ -513,12 +606,18 @@ int main(int argc, char *argv[])
 			perror("nstat: listen");
 			exit(-1);
 		}
+		if (statshm_create(&shm, sun.sun_path+1, scan_interval) < 0) {
+			perror("nstat: shm_open");
+			exit(-1);
+		}
 		if (daemon(0, 0)) {
 			perror("nstat: daemon");
 			exit(-1);
 		}
 		signal(SIGPIPE, SIG_IGN);
 		signal(SIGCHLD, sigchild);
+		signal(SIGTERM, sigterm);
+		signal(SIGINT, sigterm);
 		server_loop(fd);
 		exit(0);
 	}
@@ -578,7 +677,14 @@ int main(int argc, char *argv[])
 		kern_db = NULL;
 	}
 
-	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0 &&
+	/* A running daemon publishes its snapshot, no need to ask it */
+	if (load_shm_table(sun.sun_path+1) == 0 ||
+	    load_shm_table("nstat0") == 0) {
+		if (hist_db && source_mismatch) {
+			fprintf(stderr, "nstat: history is stale, ignoring it.\n");
+			hist_db = NULL;
+		}
+	} else if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0 &&
 	    (connect(fd, (struct sockaddr*)&sun, 2+1+strlen(sun.sun_path+1)) == 0
 	     || (strcpy(sun.sun_path+1, "nstat0"),
 		 connect(fd, (struct sockaddr*)&sun, 2+1+strlen(sun.sun_path+1)) == 0))
@@ -26,6 +26,7 @@
 #include <dirent.h>
 #include <fnmatch.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include "utils.h"
 #include "rt_names.h"
@@ -203,19 +204,52 @@ struct user_ent {
 	char		process[0];
 };
 
-#define USER_ENT_HASH_SIZE	256
-struct user_ent *user_ent_hash[USER_ENT_HASH_SIZE];
+/* The hash grows with the number of socket descriptors found */
+#define USER_ENT_HASH_MIN	256
+#define USER_ENT_THREADS	16
 
-static int user_ent_hashfn(unsigned int ino)
+static struct user_ent **user_ent_hash;
+static unsigned int user_ent_hash_size;
+static unsigned int user_ent_cnt;
+static int user_ent_built;
+
+static unsigned int user_ent_hashfn(unsigned int ino)
+{
+	return (ino * 2654435761U) >> 8;
+}
+
+static void user_ent_insert(struct user_ent *p)
 {
-	int val = (ino >> 24) ^ (ino >> 16) ^ (ino >> 8) ^ ino;
+	struct user_ent **pp;
 
-	return val & (USER_ENT_HASH_SIZE - 1);
+	pp = &user_ent_hash[user_ent_hashfn(p->ino) & (user_ent_hash_size - 1)];
+	p->next = *pp;
+	*pp = p;
 }
 
-static void user_ent_add(unsigned int ino, const char *process, int pid, int fd)
+static void user_ent_hash_grow(void)
 {
-	struct user_ent *p, **pp;
+	struct user_ent **old = user_ent_hash, *p, *next;
+	unsigned int i, old_size = user_ent_hash_size;
+
+	user_ent_hash_size = old_size ? 2 * old_size : USER_ENT_HASH_MIN;
+	user_ent_hash = calloc(user_ent_hash_size, sizeof(*user_ent_hash));
+	if (!user_ent_hash)
+		abort();
+
+	for (i = 0; i < old_size; i++) {
+		for (p = old[i]; p; p = next) {
+			next = p->next;
+			user_ent_insert(p);
+		}
+	}
+	free(old);
+}
+
+static struct user_ent *user_ent_alloc(unsigned int ino, const char *process,
+				       int pid, int fd)
+{
+	struct user_ent *p;
 	int str_len;
 
 	str_len = strlen(process) + 1;
@@ -227,113 +261,223 @@ static void user_ent_add(unsigned int ino, const char *process, int pid, int fd)
 	p->pid = pid;
 	p->fd = fd;
 	strcpy(p->process, process);
-
-	pp = &user_ent_hash[user_ent_hashfn(ino)];
-	p->next = *pp;
-	*pp = p;
+	return p;
 }
 
-static void user_ent_hash_build(void)
+struct user_ent_walk {
+	const char	*root;
+	int		*pids;
+	int		npids;
+	int		next;
+};
+
+/*
+ * Collect the socket descriptors of the processes handed out by the
+ * walk into a private list, so that several walkers can share it.
+ */
+static struct user_ent *user_ent_scan(struct user_ent_walk *w)
 {
-	const char *root = getenv("PROC_ROOT") ? : "/proc/";
-	struct dirent *d;
+	struct user_ent *list = NULL, **tail = &list;
 	char name[1024];
-	int nameoff;
-	DIR *dir;
-
-	strcpy(name, root);
-	if (strlen(name) == 0 || name[strlen(name)-1] != '/')
-		strcat(name, "/");
-
-	nameoff = strlen(name);
-
-	dir = opendir(name);
-	if (!dir)
-		return;
+	int i;
 
-	while ((d = readdir(dir)) != NULL) {
-		struct dirent *d1;
+	while ((i = __sync_fetch_and_add(&w->next, 1)) < w->npids) {
+		int pid = w->pids[i];
+		struct dirent *d;
 		char process[16];
-		int pid, pos;
-		DIR *dir1;
-		char crap;
+		DIR *dir;
 
-		if (sscanf(d->d_name, "%d%c", &pid, &crap) != 1)
-			continue;
-
-		sprintf(name + nameoff, "%d/fd/", pid);
-		pos = strlen(name);
-		if ((dir1 = opendir(name)) == NULL)
+		snprintf(name, sizeof(name), "%s%d/fd", w->root, pid);
+		if ((dir = opendir(name)) == NULL)
 			continue;
 
 		process[0] = '\0';
 
-		while ((d1 = readdir(dir1)) != NULL) {
+		while ((d = readdir(dir)) != NULL) {
 			const char *pattern = "socket:[";
+			struct user_ent *p;
 			unsigned int ino;
 			char lnk[64];
-			int fd;
+			char crap;
+			int fd, len;
 
-			if (sscanf(d1->d_name, "%d%c", &fd, &crap) != 1)
+			if (sscanf(d->d_name, "%d%c", &fd, &crap) != 1)
 				continue;
 
-			sprintf(name+pos, "%d", fd);
-			if (readlink(name, lnk, sizeof(lnk)-1) < 0 ||
-			    strncmp(lnk, pattern, strlen(pattern)))
+			len = readlinkat(dirfd(dir), d->d_name, lnk,
+					 sizeof(lnk) - 1);
+			if (len < 0)
+				continue;
+			lnk[len] = '\0';
+			if (strncmp(lnk, pattern, strlen(pattern)))
 				continue;
 
 			sscanf(lnk, "socket:[%u]", &ino);
 
 			if (process[0] == '\0') {
-				char tmp[1024];
 				FILE *fp;
 
-				snprintf(tmp, sizeof(tmp), "%s/%d/stat", root, pid);
-				if ((fp = fopen(tmp, "r")) != NULL) {
-					fscanf(fp, "%*d (%[^)])", process);
+				snprintf(name, sizeof(name), "%s%d/stat",
+					 w->root, pid);
+				if ((fp = fopen(name, "r")) != NULL) {
+					fscanf(fp, "%*d (%15[^)])", process);
 					fclose(fp);
 				}
 			}
 
-			user_ent_add(ino, process, pid, fd);
+			p = user_ent_alloc(ino, process, pid, fd);
+			*tail = p;
+			tail = &p->next;
+		}
+		closedir(dir);
+	}
+
+	return list;
+}
+
+static void *user_ent_thread(void *arg)
+{
+	return user_ent_scan(arg);
+}
+
+static void user_ent_merge(struct user_ent *list)
+{
+	struct user_ent *next;
+
+	for (; list; list = next) {
+		next = list->next;
+		if (++user_ent_cnt > user_ent_hash_size)
+			user_ent_hash_grow();
+		user_ent_insert(list);
+	}
+}
+
+static void user_ent_hash_build(void)
+{
+	const char *root = getenv("PROC_ROOT") ? : "/proc/";
+	struct user_ent_walk w = { .next = 0 };
+	pthread_t threads[USER_ENT_THREADS];
+	char name[1024];
+	struct dirent *d;
+	int nthreads, i, size = 0;
+	DIR *dir;
+
+	user_ent_built = 1;
+	user_ent_hash_grow();
+
+	strcpy(name, root);
+	if (strlen(name) == 0 || name[strlen(name)-1] != '/')
+		strcat(name, "/");
+	w.root = name;
+
+	dir = opendir(name);
+	if (!dir)
+		return;
+
+	while ((d = readdir(dir)) != NULL) {
+		int pid;
+		char crap;
+
+		if (sscanf(d->d_name, "%d%c", &pid, &crap) != 1)
+			continue;
+
+		if (w.npids == size) {
+			size = size ? 2 * size : 1024;
+			w.pids = realloc(w.pids, size * sizeof(*w.pids));
+			if (!w.pids)
+				abort();
 		}
-		closedir(dir1);
+		w.pids[w.npids++] = pid;
 	}
 	closedir(dir);
+
+	/* Reading the fd links of a busy host is syscall bound, spread it */
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > USER_ENT_THREADS)
+		nthreads = USER_ENT_THREADS;
+	if (nthreads > w.npids / 64)
+		nthreads = w.npids / 64;
+
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&threads[i], NULL, user_ent_thread, &w))
+			break;
+	nthreads = i;
+
+	user_ent_merge(user_ent_scan(&w));
+	for (i = 0; i < nthreads; i++) {
+		void *list;
+
+		pthread_join(threads[i], &list);
+		user_ent_merge(list);
+	}
+
+	free(w.pids);
+}
+
+/*
+ * Owners of one socket are listed by decreasing pid and fd, the order a
+ * single walk of /proc used to give, whichever walker found them.
+ */
+static int user_ent_cmp(const void *a, const void *b)
+{
+	const struct user_ent *x = *(struct user_ent * const *)a;
+	const struct user_ent *y = *(struct user_ent * const *)b;
+
+	if (x->pid != y->pid)
+		return x->pid < y->pid ? 1 : -1;
+	if (x->fd != y->fd)
+		return x->fd < y->fd ? 1 : -1;
+	return 0;
 }
 
+/*
+ * The process table is only walked once a socket which passed the
+ * filter asks for its users, "ss -p" with nothing to show skips it.
+ */
 int find_users(unsigned ino, char *buf, int buflen)
 {
+	static struct user_ent **found;
+	static int found_size;
 	struct user_ent *p;
-	int cnt = 0;
+	int cnt = 0, i;
 	char *ptr;
 
 	if (!ino)
 		return 0;
 
-	p = user_ent_hash[user_ent_hashfn(ino)];
-	ptr = buf;
-	while (p) {
+	if (!user_ent_built)
+		user_ent_hash_build();
+
+	p = user_ent_hash[user_ent_hashfn(ino) & (user_ent_hash_size - 1)];
+	for (; p; p = p->next) {
 		if (p->ino != ino)
-			goto next;
+			continue;
+		if (cnt == found_size) {
+			found_size = found_size ? 2 * found_size : 16;
+			found = realloc(found, found_size * sizeof(*found));
+			if (!found)
+				abort();
+		}
+		found[cnt++] = p;
+	}
+	qsort(found, cnt, sizeof(*found), user_ent_cmp);
 
+	ptr = buf;
+	for (i = 0; i < cnt; i++) {
 		if (ptr - buf >= buflen - 1)
 			break;
 
+		p = found[i];
 		snprintf(ptr, buflen - (ptr - buf),
 			 "(\"%s\",%d,%d),",
 			 p->process, p->pid, p->fd);
 		ptr += strlen(ptr);
-		cnt++;
-
-	next:
-		p = p->next;
 	}
 
 	if (ptr != buf)
 		ptr[-1] = '\0';
 
-	return cnt;
+	return i;
 }
 
 /* Get stats from slab */
@@ -817,7 +961,7 @@ static int ssfilter_bytecompile(struct ssfilter *f, char **bytecode)
 
 		for (b=a; b; b=b->next) {
 			len += 4 + sizeof(struct inet_diag_hostcond);
-			if (a->addr.family == AF_INET6)
+			if (b->addr.family == AF_INET6)
 				len += 16;
 			else
 				len += 4;
@@ -828,15 +972,15 @@ static int ssfilter_bytecompile(struct ssfilter *f, char **bytecode)
 		*bytecode = ptr;
 		for (b=a; b; b=b->next) {
 			struct inet_diag_bc_op *op = (struct inet_diag_bc_op *)ptr;
-			int alen = (a->addr.family == AF_INET6 ? 16 : 4);
+			int alen = (b->addr.family == AF_INET6 ? 16 : 4);
 			int oplen = alen + 4 + sizeof(struct inet_diag_hostcond);
 			struct inet_diag_hostcond *cond = (struct inet_diag_hostcond*)(ptr+4);
 
 			*op = (struct inet_diag_bc_op){ code, oplen, oplen+4 };
-			cond->family = a->addr.family;
-			cond->port = a->port;
-			cond->prefix_len = a->addr.bitlen;
-			memcpy(cond->addr, a->addr.data, alen);
+			cond->family = b->addr.family;
+			cond->port = b->port;
+			cond->prefix_len = b->addr.bitlen;
+			memcpy(cond->addr, b->addr.data, alen);
 			ptr += oplen;
 			if (b->next) {
 				op = (struct inet_diag_bc_op *)ptr;
@@ -881,7 +1025,8 @@ static int ssfilter_bytecompile(struct ssfilter *f, char **bytecode)
 
 		case SSF_AND:
 	{
-		char *a1, *a2, *a, l1, l2;
+		char *a1, *a2, *a;
+		int l1, l2;
 		l1 = ssfilter_bytecompile(f->pred, &a1);
 		l2 = ssfilter_bytecompile(f->post, &a2);
 		if (!(a = malloc(l1+l2))) abort();
@@ -894,7 +1039,8 @@ static int ssfilter_bytecompile(struct ssfilter *f, char **bytecode)
 	}
 		case SSF_OR:
 	{
-		char *a1, *a2, *a, l1, l2;
+		char *a1, *a2, *a;
+		int l1, l2;
 		l1 = ssfilter_bytecompile(f->pred, &a1);
 		l2 = ssfilter_bytecompile(f->post, &a2);
 		if (!(a = malloc(l1+l2+4))) abort();
@@ -907,7 +1053,8 @@ static int ssfilter_bytecompile(struct ssfilter *f, char **bytecode)
 	}
 		case SSF_NOT:
 	{
-		char *a1, *a, l1;
+		char *a1, *a;
+		int l1;
 		l1 = ssfilter_bytecompile(f->pred, &a1);
 		if (!(a = malloc(l1+4))) abort();
 		memcpy(a, a1, l1);
@@ -1402,25 +1549,27 @@ static void tcp_show_info(const struct nlmsghdr *nlh, struct inet_diag_msg *r)
 	}
 }
 
-static int tcp_show_sock(struct nlmsghdr *nlh, struct filter *f)
+static void tcp_sock_addrs(const struct inet_diag_msg *r, struct tcpstat *s)
 {
-	struct inet_diag_msg *r = NLMSG_DATA(nlh);
-	struct tcpstat s;
-
-	s.state = r->idiag_state;
-	s.local.family = s.remote.family = r->idiag_family;
-	s.lport = ntohs(r->id.idiag_sport);
-	s.rport = ntohs(r->id.idiag_dport);
-	if (s.local.family == AF_INET) {
-		s.local.bytelen = s.remote.bytelen = 4;
+	s->state = r->idiag_state;
+	s->local.family = s->remote.family = r->idiag_family;
+	s->lport = ntohs(r->id.idiag_sport);
+	s->rport = ntohs(r->id.idiag_dport);
+	if (s->local.family == AF_INET) {
+		s->local.bytelen = s->remote.bytelen = 4;
 	} else {
-		s.local.bytelen = s.remote.bytelen = 16;
+		s->local.bytelen = s->remote.bytelen = 16;
 	}
-	memcpy(s.local.data, r->id.idiag_src, s.local.bytelen);
-	memcpy(s.remote.data, r->id.idiag_dst, s.local.bytelen);
+	memcpy(s->local.data, r->id.idiag_src, s->local.bytelen);
+	memcpy(s->remote.data, r->id.idiag_dst, s->local.bytelen);
+}
 
-	if (f && f->f && run_ssfilter(f->f, &s) == 0)
-		return 0;
+static int tcp_print_sock(struct nlmsghdr *nlh)
+{
+	struct inet_diag_msg *r = NLMSG_DATA(nlh);
+	struct tcpstat s;
+
+	tcp_sock_addrs(r, &s);
 
 	if (netid_width)
 		printf("%-*s ", netid_width, "tcp");
@@ -1466,23 +1615,219 @@ static int tcp_show_sock(struct nlmsghdr *nlh, struct filter *f)
 	return 0;
 }
 
-static int tcp_show_netlink(struct filter *f, FILE *dump_fp, int socktype)
+/*
+ * Sorted output. Sockets are kept in a heap with the smallest key on
+ * top, so that with --top only the N largest ones are ever held and
+ * everything else is dropped right when it is read.
+ */
+enum {
+	SORT_NONE,
+	SORT_RTT,
+	SORT_SENDQ,
+	SORT_RECVQ,
+	SORT_BYTES,
+};
+
+static const char *sort_names[] = {
+	[SORT_RTT]	= "rtt",
+	[SORT_SENDQ]	= "send-q",
+	[SORT_RECVQ]	= "recv-q",
+	[SORT_BYTES]	= "bytes",
+};
+
+static int sort_key;
+static unsigned int sort_top;
+
+struct sort_ent
+{
+	__u64			key;
+	struct nlmsghdr		*nlh;
+};
+
+static struct sort_ent *sort_heap;
+static unsigned int sort_len, sort_size;
+
+/* Counters newer kernels append to struct tcp_info */
+struct tcp_info_ext
+{
+	struct tcp_info	info;
+	__u64		tcpi_pacing_rate;
+	__u64		tcpi_max_pacing_rate;
+	__u64		tcpi_bytes_acked;
+};
+
+static __u64 sort_key_of(struct nlmsghdr *nlh)
+{
+	struct inet_diag_msg *r = NLMSG_DATA(nlh);
+	struct rtattr *tb[INET_DIAG_MAX+1];
+	struct tcp_info_ext ext;
+	int len;
+
+	switch (sort_key) {
+	case SORT_SENDQ:
+		return r->idiag_wqueue;
+	case SORT_RECVQ:
+		return r->idiag_rqueue;
+	}
+
+	parse_rtattr(tb, INET_DIAG_MAX, (struct rtattr*)(r+1),
+		     nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*r)));
+	if (!tb[INET_DIAG_INFO])
+		return 0;
+
+	memset(&ext, 0, sizeof(ext));
+	len = RTA_PAYLOAD(tb[INET_DIAG_INFO]);
+	if (len > sizeof(ext))
+		len = sizeof(ext);
+	memcpy(&ext, RTA_DATA(tb[INET_DIAG_INFO]), len);
+
+	if (sort_key == SORT_RTT)
+		return ext.info.tcpi_rtt;
+	return ext.tcpi_bytes_acked;
+}
+
+static void sort_sift_down(unsigned int i, unsigned int len)
+{
+	struct sort_ent e = sort_heap[i];
+
+	for (;;) {
+		unsigned int c = 2 * i + 1;
+
+		if (c >= len)
+			break;
+		if (c + 1 < len && sort_heap[c + 1].key < sort_heap[c].key)
+			c++;
+		if (e.key <= sort_heap[c].key)
+			break;
+		sort_heap[i] = sort_heap[c];
+		i = c;
+	}
+	sort_heap[i] = e;
+}
+
+static int sort_add(struct nlmsghdr *nlh)
+{
+	__u64 key = sort_key_of(nlh);
+	struct nlmsghdr *copy;
+	unsigned int i;
+
+	if (sort_top && sort_len == sort_top) {
+		if (key <= sort_heap[0].key)
+			return 0;
+		free(sort_heap[0].nlh);
+		sort_len--;
+		sort_heap[0] = sort_heap[sort_len];
+		sort_sift_down(0, sort_len);
+	}
+
+	if (sort_len == sort_size) {
+		sort_size = sort_size ? 2 * sort_size : 1024;
+		if (sort_top && sort_size > sort_top)
+			sort_size = sort_top;
+		sort_heap = realloc(sort_heap, sort_size * sizeof(*sort_heap));
+		if (!sort_heap)
+			abort();
+	}
+
+	if (!(copy = malloc(nlh->nlmsg_len)))
+		abort();
+	memcpy(copy, nlh, nlh->nlmsg_len);
+
+	/* Sift up */
+	for (i = sort_len++; i; i = (i - 1) / 2) {
+		if (sort_heap[(i - 1) / 2].key <= key)
+			break;
+		sort_heap[i] = sort_heap[(i - 1) / 2];
+	}
+	sort_heap[i] = (struct sort_ent){ key, copy };
+
+	return 0;
+}
+
+/* Print the collected sockets, the largest key first */
+static void sort_flush(void)
+{
+	unsigned int i;
+
+	for (i = sort_len; i > 1; i--) {
+		struct sort_ent e = sort_heap[0];
+
+		sort_heap[0] = sort_heap[i - 1];
+		sort_heap[i - 1] = e;
+		sort_sift_down(0, i - 1);
+	}
+
+	for (i = 0; i < sort_len; i++) {
+		tcp_print_sock(sort_heap[i].nlh);
+		free(sort_heap[i].nlh);
+	}
+	sort_len = 0;
+}
+
+static int tcp_show_sock(struct nlmsghdr *nlh, struct filter *f)
+{
+	struct inet_diag_msg *r = NLMSG_DATA(nlh);
+	struct tcpstat s;
+
+	if (f && f->f) {
+		tcp_sock_addrs(r, &s);
+		if (run_ssfilter(f->f, &s) == 0)
+			return 0;
+	}
+
+	if (sort_key)
+		return sort_add(nlh);
+
+	return tcp_print_sock(nlh);
+}
+
+struct tcp_dump_arg
+{
+	struct filter *f;
+	FILE *dump_fp;
+	int userspace_filter;
+};
+
+static int tcp_show_netlink_msg(const struct sockaddr_nl *who,
+				struct nlmsghdr *h, void *arg)
+{
+	struct tcp_dump_arg *da = arg;
+	struct inet_diag_msg *r = NLMSG_DATA(h);
+
+	if (da->dump_fp) {
+		fwrite(h, 1, NLMSG_ALIGN(h->nlmsg_len), da->dump_fp);
+		return 0;
+	}
+	if (!(da->f->families & (1<<r->idiag_family)))
+		return 0;
+	return tcp_show_sock(h, da->userspace_filter ? da->f : NULL);
+}
+
+static int tcp_dump_netlink(struct filter *f, FILE *dump_fp, int socktype,
+			    int userspace_filter)
 {
-	int fd;
+	struct rtnl_handle rth;
 	struct sockaddr_nl nladdr;
 	struct {
 		struct nlmsghdr nlh;
 		struct inet_diag_req r;
 	} req;
+	struct tcp_dump_arg arg = {
+		.f = f,
+		.dump_fp = dump_fp,
+		.userspace_filter = userspace_filter,
+	};
 	char    *bc = NULL;
 	int	bclen;
 	struct msghdr msg;
 	struct rtattr rta;
-	char	buf[8192];
 	struct iovec iov[3];
+	int err;
 
-	if ((fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_INET_DIAG)) < 0)
+	if (rtnl_open_byproto(&rth, 0, NETLINK_INET_DIAG) < 0)
 		return -1;
+	/* A refusal is no news, the caller retries or falls back to /proc */
+	rth.flags |= RTNL_HANDLE_F_SUPPRESS_NLERR;
 
 	memset(&nladdr, 0, sizeof(nladdr));
 	nladdr.nl_family = AF_NETLINK;
@@ -1491,7 +1836,7 @@ static int tcp_show_netlink(struct filter *f, FILE *dump_fp, int socktype)
 	req.nlh.nlmsg_type = socktype;
 	req.nlh.nlmsg_flags = NLM_F_ROOT|NLM_F_MATCH|NLM_F_REQUEST;
 	req.nlh.nlmsg_pid = 0;
-	req.nlh.nlmsg_seq = 123456;
+	req.nlh.nlmsg_seq = rth.dump = ++rth.seq;
 	memset(&req.r, 0, sizeof(req.r));
 	req.r.idiag_family = AF_INET;
 	req.r.idiag_states = f->states;
@@ -1503,12 +1848,14 @@ static int tcp_show_netlink(struct filter *f, FILE *dump_fp, int socktype)
 		req.r.idiag_ext |= (1<<(INET_DIAG_VEGASINFO-1));
 		req.r.idiag_ext |= (1<<(INET_DIAG_CONG-1));
 	}
+	if (sort_key == SORT_RTT || sort_key == SORT_BYTES)
+		req.r.idiag_ext |= (1<<(INET_DIAG_INFO-1));
 
 	iov[0] = (struct iovec){
 		.iov_base = &req,
 		.iov_len = sizeof(req)
 	};
-	if (f->f) {
+	if (f->f && !userspace_filter) {
 		bclen = ssfilter_bytecompile(f->f, &bc);
 		rta.rta_type = INET_DIAG_REQ_BYTECODE;
 		rta.rta_len = RTA_LENGTH(bclen);
@@ -1521,88 +1868,49 @@ static int tcp_show_netlink(struct filter *f, FILE *dump_fp, int socktype)
 		.msg_name = (void*)&nladdr,
 		.msg_namelen = sizeof(nladdr),
 		.msg_iov = iov,
-		.msg_iovlen = f->f ? 3 : 1,
+		.msg_iovlen = bc ? 3 : 1,
 	};
 
-	if (sendmsg(fd, &msg, 0) < 0)
+	if (sendmsg(rth.fd, &msg, 0) < 0) {
+		free(bc);
+		rtnl_close(&rth);
 		return -1;
+	}
 
-	iov[0] = (struct iovec){
-		.iov_base = buf,
-		.iov_len = sizeof(buf)
-	};
+	err = rtnl_dump_filter(&rth, tcp_show_netlink_msg, &arg, NULL, NULL);
 
-	while (1) {
-		int status;
-		struct nlmsghdr *h;
-
-		msg = (struct msghdr) {
-			(void*)&nladdr, sizeof(nladdr),
-			iov,	1,
-			NULL,	0,
-			0
+	/* rtnl_dump_filter() eats NLMSG_DONE, TCPDIAG_FILE readers want it */
+	if (err == 0 && dump_fp) {
+		struct {
+			struct nlmsghdr nlh;
+			int		status;
+		} done = {
+			.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(int)),
+			.nlh.nlmsg_type = NLMSG_DONE,
+			.nlh.nlmsg_flags = NLM_F_MULTI,
+			.nlh.nlmsg_seq = rth.dump,
 		};
 
-		status = recvmsg(fd, &msg, 0);
-
-		if (status < 0) {
-			if (errno == EINTR)
-				continue;
-			perror("OVERRUN");
-			continue;
-		}
-		if (status == 0) {
-			fprintf(stderr, "EOF on netlink\n");
-			return 0;
-		}
-
-		if (dump_fp)
-			fwrite(buf, 1, NLMSG_ALIGN(status), dump_fp);
+		fwrite(&done, 1, sizeof(done), dump_fp);
+	}
+	free(bc);
+	rtnl_close(&rth);
+	return err;
+}
 
-		h = (struct nlmsghdr*)buf;
-		while (NLMSG_OK(h, status)) {
-			int err;
-			struct inet_diag_msg *r = NLMSG_DATA(h);
+static int tcp_show_netlink(struct filter *f, FILE *dump_fp, int socktype)
+{
+	int err;
 
-			if (/*h->nlmsg_pid != rth->local.nl_pid ||*/
-			    h->nlmsg_seq != 123456)
-				goto skip_it;
+	err = tcp_dump_netlink(f, dump_fp, socktype, 0);
 
-			if (h->nlmsg_type == NLMSG_DONE)
-				return 0;
-			if (h->nlmsg_type == NLMSG_ERROR) {
-				struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(h);
-				if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr))) {
-					fprintf(stderr, "ERROR truncated\n");
-				} else {
-					errno = -err->error;
-					perror("TCPDIAG answers");
-				}
-				return 0;
-			}
-			if (!dump_fp) {
-				if (!(f->families & (1<<r->idiag_family))) {
-					h = NLMSG_NEXT(h, status);
-					continue;
-				}
-				err = tcp_show_sock(h, NULL);
-				if (err < 0)
-					return err;
-			}
+	/* The kernel refused the filter program, it still can dump them all */
+	if (err < 0 && errno == EINVAL && f->f)
+		err = tcp_dump_netlink(f, dump_fp, socktype, 1);
 
-skip_it:
-			h = NLMSG_NEXT(h, status);
-		}
-		if (msg.msg_flags & MSG_TRUNC) {
-			fprintf(stderr, "Message truncated\n");
-			continue;
-		}
-		if (status) {
-			fprintf(stderr, "!!!Remnant of size %d\n", status);
-			exit(1);
-		}
-	}
-	return 0;
+	if (err == 0)
+		sort_flush();
+	return err;
 }
 
 static int tcp_show_netlink_file(struct filter *f)
@@ -1641,8 +1949,10 @@ static int tcp_show_netlink_file(struct filter *f)
 		}
 
 		/* The only legal exit point */
-		if (h->nlmsg_type == NLMSG_DONE)
+		if (h->nlmsg_type == NLMSG_DONE) {
+			sort_flush();
 			return 0;
+		}
 
 		if (h->nlmsg_type == NLMSG_ERROR) {
 			struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(h);
@@ -1678,6 +1988,12 @@ static int tcp_show(struct filter *f, int socktype)
 
 	/* Sigh... We have to parse /proc/net/tcp... */
 
+	/* Sorting keeps inet_diag messages, there are none to keep here */
+	if (sort_key) {
+		fprintf(stderr, "ss: --sort and --top need the inet_diag interface\n");
+		exit(-1);
+	}
+
 
 	/* Estimate amount of sockets and try to allocate
 	 * huge buffer to read all the table at one read.
@@ -2406,6 +2722,9 @@ static void _usage(FILE *dest)
 "   -p, --processes	show process using socket\n"
 "   -i, --info		show internal TCP information\n"
 "   -s, --summary	show socket usage summary\n"
+"       --sort=KEY      sort TCP sockets by KEY, the largest first\n"
+"                       KEY := {rtt|send-q|recv-q|bytes}\n"
+"       --top=NUM       show only the first NUM sorted sockets\n"
 "\n"
 "   -4, --ipv4          display only IP version 4 sockets\n"
 "   -6, --ipv6          display only IP version 6 sockets\n"
@@ -2494,6 +2813,8 @@ static const struct option long_opts[] = {
 	{ "filter", 1, 0, 'F' },
 	{ "version", 0, 0, 'V' },
 	{ "help", 0, 0, 'h' },
+	{ "sort", 1, 0, 'S' },
+	{ "top", 1, 0, 'T' },
 	{ 0 }
 
 };
@@ -2536,7 +2857,23 @@ int main(int argc, char *argv[])
 			break;
 		case 'p':
 			show_users++;
-			user_ent_hash_build();
+			break;
+		case 'S':
+			for (sort_key = SORT_RTT; sort_key <= SORT_BYTES; sort_key++)
+				if (strcmp(optarg, sort_names[sort_key]) == 0)
+					break;
+			if (sort_key > SORT_BYTES) {
+				fprintf(stderr, "ss: \"%s\" is invalid sort key\n", optarg);
+				usage();
+			}
+			break;
+		case 'T':
+			if (get_unsigned(&sort_top, optarg, 0) || !sort_top) {
+				fprintf(stderr, "ss: \"%s\" is invalid count\n", optarg);
+				usage();
+			}
+			if (!sort_key)
+				sort_key = SORT_RTT;
 			break;
 		case 'd':
 			current_filter.dbs |= (1<<DCCP_DB);
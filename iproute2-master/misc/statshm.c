@@ -0,0 +1,207 @@
+/*
+ * statshm.c	Counter snapshots in shared memory, for ifstat and nstat
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "statshm.h"
+
+static __u64 statshm_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static int statshm_map(struct statshm *s, unsigned size, int prot)
+{
+	void *p;
+
+	p = mmap(NULL, size, prot, MAP_SHARED, s->fd, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	if (s->hdr)
+		munmap(s->hdr, s->size);
+	s->hdr = p;
+	s->size = size;
+	return 0;
+}
+
+int statshm_create(struct statshm *s, const char *name, int interval)
+{
+	unsigned size = getpagesize();
+
+	memset(s, 0, sizeof(*s));
+	snprintf(s->name, sizeof(s->name), "/%s", name);
+
+	/* A daemon that went away may have left its segment behind */
+	shm_unlink(s->name);
+	s->fd = shm_open(s->name, O_RDWR|O_CREAT|O_EXCL, 0644);
+	if (s->fd < 0)
+		return -1;
+
+	if (ftruncate(s->fd, size) < 0 ||
+	    statshm_map(s, size, PROT_READ|PROT_WRITE) < 0) {
+		statshm_destroy(s);
+		return -1;
+	}
+
+	s->hdr->magic = STATSHM_MAGIC;
+	s->hdr->size = size;
+	s->hdr->interval = interval;
+	return 0;
+}
+
+int statshm_publish(struct statshm *s, const char *info_source,
+		   const void *data, unsigned len)
+{
+	volatile struct statshm_hdr *hdr;
+	unsigned need = sizeof(*hdr) + len;
+
+	if (need > s->size) {
+		unsigned size = s->size;
+
+		while (size < need)
+			size *= 2;
+		/* Readers remap once they see the new size */
+		if (ftruncate(s->fd, size) < 0 ||
+		    statshm_map(s, size, PROT_READ|PROT_WRITE) < 0)
+			return -1;
+	}
+	hdr = s->hdr;
+
+	hdr->seq++;
+	__sync_synchronize();
+
+	hdr->size = s->size;
+	hdr->len = len;
+	hdr->stamp = statshm_now();
+	strncpy((char *)hdr->info_source, info_source,
+		sizeof(hdr->info_source) - 1);
+	memcpy((char *)(hdr + 1), data, len);
+
+	__sync_synchronize();
+	hdr->seq++;
+	return 0;
+}
+
+void statshm_destroy(struct statshm *s)
+{
+	shm_unlink(s->name);
+	statshm_close(s);
+}
+
+int statshm_open(struct statshm *s, const char *name)
+{
+	struct stat stb;
+
+	memset(s, 0, sizeof(*s));
+	snprintf(s->name, sizeof(s->name), "/%s", name);
+
+	s->fd = shm_open(s->name, O_RDONLY, 0);
+	if (s->fd < 0)
+		return -1;
+
+	/* Same trust as in verify_forging(): our own daemon or root's */
+	if (fstat(s->fd, &stb) < 0 ||
+	    (stb.st_uid != getuid() && stb.st_uid != 0) ||
+	    stb.st_size < sizeof(struct statshm_hdr) ||
+	    statshm_map(s, stb.st_size, PROT_READ) < 0 ||
+	    s->hdr->magic != STATSHM_MAGIC)
+		goto fail;
+
+	/* Nobody has been sampling for a while, the daemon is gone */
+	if (s->hdr->stamp + 2 * s->hdr->interval + 1000 < statshm_now())
+		goto fail;
+
+	return 0;
+
+fail:
+	statshm_close(s);
+	return -1;
+}
+
+/* A publish takes microseconds, a writer stuck that long is dead */
+#define STATSHM_TRIES	1000
+
+/*
+ * Returns a consistent copy of the records, to be freed by the caller,
+ * and the info source of the daemon that wrote them. NULL if none
+ * could be had, the caller then asks the daemon or the kernel.
+ */
+void *statshm_read(struct statshm *s, char *info_source, unsigned *len)
+{
+	volatile struct statshm_hdr *hdr;
+	char *buf = NULL;
+	unsigned bufsize = 0;
+	int tries;
+
+	for (tries = 0; tries < STATSHM_TRIES; tries++) {
+		__u32 seq, size, n;
+
+		if (tries)
+			sched_yield();
+
+		hdr = s->hdr;
+		seq = hdr->seq;
+		__sync_synchronize();
+		if (seq & 1)
+			continue;
+
+		size = hdr->size;
+		n = hdr->len;
+		if (size > s->size) {
+			if (statshm_map(s, size, PROT_READ) < 0)
+				break;
+			continue;
+		}
+		if (n > size - sizeof(*hdr))
+			continue;
+
+		if (n > bufsize || !buf) {
+			free(buf);
+			bufsize = n;
+			buf = malloc(n ? : 1);
+			if (!buf)
+				return NULL;
+		}
+		memcpy(info_source, (char *)hdr->info_source,
+		       sizeof(hdr->info_source));
+		memcpy(buf, (char *)(hdr + 1), n);
+
+		__sync_synchronize();
+		if (hdr->seq == seq) {
+			info_source[sizeof(hdr->info_source) - 1] = 0;
+			*len = n;
+			return buf;
+		}
+	}
+
+	free(buf);
+	return NULL;
+}
+
+void statshm_close(struct statshm *s)
+{
+	if (s->hdr)
+		munmap(s->hdr, s->size);
+	if (s->fd >= 0)
+		close(s->fd);
+	s->hdr = NULL;
+	s->fd = -1;
+}
@@ -0,0 +1,43 @@
+#ifndef _STATSHM_H
+#define _STATSHM_H
+
+#include <asm/types.h>
+
+/*
+ * Snapshot published by the ifstat and nstat daemons. The writer makes
+ * seq odd while it updates the segment; readers copy the data out and
+ * retry if seq was odd or changed meanwhile.
+ */
+struct statshm_hdr
+{
+	__u32		magic;
+	__u32		seq;
+	__u32		size;		/* of the whole segment */
+	__u32		len;		/* of the records after the header */
+	__u32		interval;	/* sampling interval, ms */
+	__u32		pad;
+	__u64		stamp;		/* CLOCK_MONOTONIC of the last sample, ms */
+	char		info_source[128];
+};
+
+#define STATSHM_MAGIC	0x53544d31
+
+struct statshm
+{
+	int			fd;
+	struct statshm_hdr	*hdr;
+	unsigned		size;
+	char			name[64];
+};
+
+extern int statshm_create(struct statshm *s, const char *name,
+			  int interval);
+extern int statshm_publish(struct statshm *s, const char *info_source,
+			   const void *data, unsigned len);
+extern void statshm_destroy(struct statshm *s);
+extern int statshm_open(struct statshm *s, const char *name);
+extern void *statshm_read(struct statshm *s, char *info_source,
+			  unsigned *len);
+extern void statshm_close(struct statshm *s);
+
+#endif /* _STATSHM_H */
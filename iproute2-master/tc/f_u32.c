@@ -20,11 +20,13 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <string.h>
+#include <errno.h>
 #include <linux/if.h>
 #include <linux/if_ether.h>
 
 #include "utils.h"
 #include "tc_util.h"
+#include "tc_common.h"
 
 extern int show_pretty;
 
@@ -1103,7 +1105,7 @@ static int u32_parse_opt(struct filter_util *qu, char *handle,
 				}
 				NEXT_ARG();
 			}
-			hash = sel2.sel.keys[0].val&sel2.sel.keys[0].mask;
+			hash = sel2.keys[0].val&sel2.keys[0].mask;
 			hash ^= hash>>16;
 			hash ^= hash>>8;
 			htid = ((hash%divisor)<<12)|(htid&0xFFF00000);
@@ -1287,8 +1289,910 @@ static int u32_print_opt(struct filter_util *qu, FILE *f, struct rtattr *opt,
 	return 0;
 }
 
+/*
+ * "tc filter replace-set ... u32 file FILE" replaces whatever sits at the
+ * preference with a hash tree for the rules in FILE, one set of u32
+ * options per line, the first matching line winning as in a flat list.
+ *
+ * A run of rules matching the same header byte exactly is moved below a
+ * link node hashing on that byte, and each bucket of the new table is
+ * laid out the same way with the bytes left. Whatever is not worth
+ * hashing stays a plain list in the bucket, after or before the links.
+ */
+#define U32SET_LEAF	4	/* rules not worth a hash table */
+#define U32SET_CAND	32	/* header bytes considered per rule */
+#define U32SET_WINDOW	64
+#define U32SET_FULL	-2	/* no node IDs left after the old set */
+
+struct u32_rule
+{
+	struct tc_u32_sel	*sel;
+	char			*attrs;		/* the other TCA_U32_* ones */
+	int			attrlen;
+	int			lineno;
+};
+
+struct u32_hash
+{
+	int			pos;		/* byte of the header hashed */
+	int			len;		/* rules below the link */
+	unsigned		divisor;
+	unsigned		plain;		/* or rules left as they are */
+};
+
+struct u32_set
+{
+	struct nlmsghdr		*tmpl;
+	unsigned char		used[0x800];	/* hash table IDs on the qdisc */
+	__u32			qdisc;
+	__u32			*classes;	/* share its tables */
+	int			nclasses;
+	int			own;		/* dumping the set's parent */
+	unsigned		htid;
+	int			tables;
+
+	/* The set being built */
+	unsigned char		new[0x800];	/* its tables */
+	unsigned short		newparent[0x800];
+	unsigned		rootnode;	/* last node ID given in the root */
+
+	/* The set being replaced */
+	int			exists;
+	__u16			proto;
+	unsigned		root;		/* its root table, 0 if replaced
+						   before the new one is built */
+	unsigned		maxnode;	/* highest node ID in the root */
+	unsigned char		old[0x800];	/* its tables */
+	unsigned short		parent[0x800];	/* the table linking to each */
+	__u32			*nodes;		/* the nodes of its root */
+	int			nnodes;
+};
+
+static const char *u32_set_file;
+static int u32_set_errors;
+
+static unsigned char *u32_set_gone;
+
+static void u32_set_ack_teardown(int htid, int error)
+{
+	if (htid)
+		u32_set_gone[htid] = 0;
+}
+
+static void u32_set_ack_err(int lineno, int error)
+{
+	fprintf(stderr, "RTNETLINK answers: %s\n", strerror(error));
+	if (lineno)
+		fprintf(stderr, "Rule failed %s:%d\n", u32_set_file, lineno);
+	u32_set_errors++;
+}
+
+static int u32_rule_parse(struct filter_util *qu, struct u32_rule *r,
+			  int argc, char **argv)
+{
+	struct {
+		struct nlmsghdr		n;
+		struct tcmsg		t;
+		char			buf[MAX_MSG];
+	} req;
+	struct rtattr *tb[TCA_MAX+1];
+	struct rtattr *opt[TCA_U32_MAX+1];
+	struct rtattr *rta;
+	int len;
+
+	memset(&req, 0, sizeof(req));
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+
+	if (u32_parse_opt(qu, NULL, argc, argv, &req.n))
+		return -1;
+
+	parse_rtattr(tb, TCA_MAX, TCA_RTA(&req.t),
+		     req.n.nlmsg_len - NLMSG_LENGTH(sizeof(struct tcmsg)));
+	parse_rtattr_nested(opt, TCA_U32_MAX, tb[TCA_OPTIONS]);
+
+	if (req.t.tcm_handle || opt[TCA_U32_HASH] || opt[TCA_U32_LINK] ||
+	    opt[TCA_U32_DIVISOR]) {
+		fprintf(stderr, "\"ht\", \"link\", \"divisor\", \"sample\" "
+			"and \"order\" are chosen by replace-set\n");
+		return -1;
+	}
+	if (!opt[TCA_U32_SEL]) {
+		fprintf(stderr, "A rule needs a \"match\"\n");
+		return -1;
+	}
+
+	r->sel = malloc(RTA_PAYLOAD(opt[TCA_U32_SEL]));
+	if (!r->sel)
+		return -1;
+	memcpy(r->sel, RTA_DATA(opt[TCA_U32_SEL]), RTA_PAYLOAD(opt[TCA_U32_SEL]));
+	if (r->sel->hmask ||
+	    r->sel->flags & (TC_U32_OFFSET|TC_U32_VAROFFSET|TC_U32_EAT)) {
+		fprintf(stderr, "\"hashkey\" and \"offset\" are chosen by "
+			"replace-set\n");
+		return -1;
+	}
+
+	/* Classid, actions, police, indev and mark go along as they are */
+	r->attrs = malloc(RTA_PAYLOAD(tb[TCA_OPTIONS]));
+	if (!r->attrs)
+		return -1;
+	r->attrlen = 0;
+	len = RTA_PAYLOAD(tb[TCA_OPTIONS]);
+	for (rta = RTA_DATA(tb[TCA_OPTIONS]); RTA_OK(rta, len);
+	     rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == TCA_U32_SEL)
+			continue;
+		memcpy(r->attrs + r->attrlen, rta, rta->rta_len);
+		r->attrlen += RTA_ALIGN(rta->rta_len);
+	}
+	return 0;
+}
+
+/* Value of a header byte the rule matches exactly, or -1 */
+static int u32_rule_byte(const struct tc_u32_sel *sel, int pos)
+{
+	int i;
+
+	for (i = 0; i < sel->nkeys; i++) {
+		const struct tc_u32_key *key = &sel->keys[i];
+		int shift;
+
+		if (key->offmask || pos < key->off || pos >= key->off + 4)
+			continue;
+		shift = 24 - 8*(pos - key->off);
+		if (((ntohl(key->mask) >> shift) & 0xFF) == 0xFF)
+			return (ntohl(key->val) >> shift) & 0xFF;
+	}
+	return -1;
+}
+
+static int u32_set_used(const int *used, int nused, int pos)
+{
+	while (nused--)
+		if (used[nused] == pos)
+			return 1;
+	return 0;
+}
+
+/*
+ * Tells whether the rule at index i matches exactly a byte which no run
+ * of the head rule carries that far, and so might start a better one.
+ */
+static int u32_set_fresh(const struct tc_u32_sel *sel, int i, const int *cand,
+			 const int *len, int ncand, const int *used, int nused)
+{
+	int k, b, c;
+
+	for (k = 0; k < sel->nkeys; k++) {
+		for (b = 0; b < 4; b++) {
+			int pos = sel->keys[k].off + b;
+
+			if (u32_rule_byte(sel, pos) < 0 ||
+			    u32_set_used(used, nused, pos))
+				continue;
+			for (c = 0; c < ncand; c++)
+				if (cand[c] == pos)
+					break;
+			if (c == ncand || len[c] <= i)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Picks the byte to hash the rules at the head of r on, the one saving
+ * the most comparisons, or tells how many rules to leave in the bucket.
+ */
+static int u32_set_pick(struct u32_rule **r, int n, const int *used,
+			int nused, struct u32_hash *h)
+{
+	const struct tc_u32_sel *sel = r[0]->sel;
+	int cand[U32SET_CAND], len[U32SET_CAND];
+	unsigned cnt[256], fold[256];
+	int ncand = 0, active, best = -1, bestgain = 0, bestmax = 0;
+	int i, c;
+
+	memset(h, 0, sizeof(*h));
+	h->plain = 1;
+	if (n <= U32SET_LEAF) {
+		h->plain = n;
+		return 0;
+	}
+
+	for (i = 0; i < sel->nkeys && ncand < U32SET_CAND; i++) {
+		int b;
+
+		for (b = 0; b < 4 && ncand < U32SET_CAND; b++) {
+			int pos = sel->keys[i].off + b;
+
+			if (u32_rule_byte(sel, pos) >= 0 &&
+			    !u32_set_used(used, nused, pos))
+				cand[ncand++] = pos;
+		}
+	}
+	if (!ncand)
+		goto plain;
+
+	/* How many rules in a row match each of them exactly */
+	for (c = 0; c < ncand; c++)
+		len[c] = n;
+	active = ncand;
+	for (i = 1; i < n && active; i++) {
+		for (c = 0; c < ncand; c++) {
+			if (len[c] == n && u32_rule_byte(r[i]->sel, cand[c]) < 0) {
+				len[c] = i;
+				active--;
+			}
+		}
+	}
+
+	for (c = 0; c < ncand; c++) {
+		int max = 0;
+
+		memset(cnt, 0, sizeof(cnt));
+		for (i = 0; i < len[c]; i++) {
+			int v = u32_rule_byte(r[i]->sel, cand[c]);
+
+			if (++cnt[v] > max)
+				max = cnt[v];
+		}
+		if (len[c] - max > bestgain) {
+			best = c;
+			bestgain = len[c] - max;
+			bestmax = max;
+		}
+	}
+
+	if (bestgain < U32SET_LEAF)
+		goto plain;
+
+	h->pos = cand[best];
+	h->len = len[best];
+
+	/* The fewest buckets spreading the rules as well as 256 would */
+	memset(cnt, 0, sizeof(cnt));
+	for (i = 0; i < h->len; i++)
+		cnt[u32_rule_byte(r[i]->sel, h->pos)]++;
+	for (h->divisor = 2; h->divisor < 256; h->divisor <<= 1) {
+		unsigned max = 0;
+
+		memset(fold, 0, sizeof(fold));
+		for (i = 0; i < 256; i++) {
+			if ((fold[i & (h->divisor - 1)] += cnt[i]) > max)
+				max = fold[i & (h->divisor - 1)];
+		}
+		if (max == bestmax)
+			break;
+	}
+	return 1;
+
+plain:
+	/*
+	 * A run starting further down the same byte can save no more than
+	 * the one from the head did, so only a byte new there may pay off.
+	 */
+	for (i = 1; i < n; i++)
+		if (u32_set_fresh(r[i]->sel, i, cand, len, ncand, used, nused))
+			break;
+	h->plain = i;
+	return 0;
+}
+
+static int u32_set_send(struct u32_set *s, __u32 htid, __u32 handle,
+			const struct tc_u32_sel *sel, __u32 link,
+			const char *attrs, int attrlen)
+{
+	struct {
+		struct nlmsghdr		n;
+		struct tcmsg		t;
+		char			buf[MAX_MSG];
+	} req;
+	struct rtattr *tail;
+
+	memcpy(&req, s->tmpl, NLMSG_LENGTH(sizeof(struct tcmsg)));
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+	req.n.nlmsg_flags = NLM_F_REQUEST|NLM_F_CREATE|NLM_F_EXCL;
+	req.n.nlmsg_type = RTM_NEWTFILTER;
+	req.t.tcm_handle = handle;
+
+	addattr_l(&req.n, sizeof(req), TCA_KIND, "u32", 4);
+	tail = addattr_nest(&req.n, sizeof(req), TCA_OPTIONS);
+	if (htid)
+		addattr32(&req.n, sizeof(req), TCA_U32_HASH, htid);
+	if (link)
+		addattr32(&req.n, sizeof(req), TCA_U32_LINK, link);
+	addattr_l(&req.n, sizeof(req), TCA_U32_SEL, sel,
+		  sizeof(*sel) + sel->nkeys*sizeof(struct tc_u32_key));
+	if (attrlen && addraw_l(&req.n, sizeof(req), attrs, attrlen) < 0)
+		return -1;
+	addattr_nest_end(&req.n, tail);
+
+	if (rtnl_talk(&rth, &req.n, 0, 0, NULL, NULL, NULL) < 0)
+		return -1;
+	return 0;
+}
+
+static int u32_set_table(struct u32_set *s, unsigned divisor, __u32 *htid)
+{
+	struct {
+		struct nlmsghdr		n;
+		struct tcmsg		t;
+		char			buf[256];
+	} req;
+	struct rtattr *tail;
+
+	do {
+		if (++s->htid >= 0x800) {
+			fprintf(stderr, "Out of u32 hash table IDs\n");
+			return -1;
+		}
+	} while (s->used[s->htid]);
+	s->used[s->htid] = 1;
+	s->new[s->htid] = 1;
+	*htid = s->htid << 20;
+	s->tables++;
+
+	memcpy(&req, s->tmpl, NLMSG_LENGTH(sizeof(struct tcmsg)));
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+	req.n.nlmsg_flags = NLM_F_REQUEST|NLM_F_CREATE|NLM_F_EXCL;
+	req.n.nlmsg_type = RTM_NEWTFILTER;
+	req.t.tcm_handle = *htid;
+
+	addattr_l(&req.n, sizeof(req), TCA_KIND, "u32", 4);
+	tail = addattr_nest(&req.n, sizeof(req), TCA_OPTIONS);
+	addattr32(&req.n, sizeof(req), TCA_U32_DIVISOR, divisor);
+	addattr_nest_end(&req.n, tail);
+
+	rth.tag = 0;
+	if (rtnl_talk(&rth, &req.n, 0, 0, NULL, NULL, NULL) < 0)
+		return -1;
+	return 0;
+}
+
+/*
+ * Handle of the next node of a bucket. Node IDs are given here, root
+ * ones too, as the kernel would wrap around past 0xFFF and so put later
+ * rules first.
+ */
+static __u32 u32_set_handle(struct u32_set *s, __u32 htid, unsigned *nodeid)
+{
+	return (htid ? htid : s->root << 20) | ++*nodeid;
+}
+
+/* Whether the bucket has room for one more node, see u32_set_bucket() */
+static int u32_set_room(struct u32_set *s, __u32 htid, unsigned nodeid,
+			struct u32_rule *r)
+{
+	if (nodeid + 1 <= 0xFFF)
+		return 0;
+	if (!htid && s->root)
+		return U32SET_FULL;
+	fprintf(stderr, "Too many rules alike near %s:%d\n",
+		u32_set_file, r->lineno);
+	return -1;
+}
+
+/*
+ * Lays r out in one bucket, htid 0 being the root table of the
+ * preference, whose nodes go after those of the set being replaced if
+ * that is still there. Buckets are filled before the link to them is
+ * made, so packets never see a half built tree. Returns the most nodes
+ * a packet may be compared against.
+ */
+static int u32_set_bucket(struct u32_set *s, struct u32_rule **r, int n,
+			  __u32 htid, int *used, int nused, int *depth)
+{
+	unsigned local = 0;
+	unsigned *nodeid = htid ? &local : &s->rootnode;
+	int worst = 0;
+	int i = 0;
+	int err;
+
+	*depth = 1;
+
+	while (i < n) {
+		struct u32_hash h;
+		unsigned b;
+
+		if ((err = u32_set_room(s, htid, *nodeid, r[i])) < 0)
+			return err;
+
+		if (u32_set_pick(r + i, n - i, used, nused, &h)) {
+			struct tc_u32_sel link;
+			struct u32_rule **sub;
+			unsigned start[256 + 1];
+			__u32 child;
+			int maxworst = 0;
+			int j;
+
+			if (u32_set_table(s, h.divisor, &child) < 0)
+				return -1;
+			s->newparent[child >> 20] = htid >> 20;
+
+			/* Stable split of the run over the buckets */
+			sub = malloc(h.len * sizeof(*sub));
+			if (!sub)
+				return -1;
+			memset(start, 0, sizeof(start));
+			for (j = 0; j < h.len; j++)
+				start[(u32_rule_byte(r[i + j]->sel, h.pos) &
+				       (h.divisor - 1)) + 1]++;
+			for (b = 0; b < h.divisor; b++)
+				start[b + 1] += start[b];
+			for (j = 0; j < h.len; j++)
+				sub[start[u32_rule_byte(r[i + j]->sel, h.pos) &
+					  (h.divisor - 1)]++] = r[i + j];
+
+			used[nused] = h.pos;
+			for (b = 0, j = 0; b < h.divisor; b++) {
+				int w, d;
+
+				if (start[b] == j)
+					continue;
+				w = u32_set_bucket(s, sub + j, start[b] - j,
+						   child | (b << 12), used,
+						   nused + 1, &d);
+				if (w < 0) {
+					free(sub);
+					return w;
+				}
+				if (w > maxworst)
+					maxworst = w;
+				if (d + 1 > *depth)
+					*depth = d + 1;
+				j = start[b];
+			}
+			free(sub);
+
+			/* No keys, so everything reaching it is hashed */
+			memset(&link, 0, sizeof(link));
+			link.hoff = h.pos & ~3;
+			link.hmask = htonl(0xFF << (24 - 8*(h.pos & 3)));
+			rth.tag = 0;
+			if (u32_set_send(s, htid, u32_set_handle(s, htid, nodeid),
+					 &link, child, NULL, 0) < 0)
+				return -1;
+			worst += 1 + maxworst;
+			i += h.len;
+			continue;
+		}
+
+		for (b = 0; b < h.plain; b++, i++) {
+			if ((err = u32_set_room(s, htid, *nodeid, r[i])) < 0)
+				return err;
+			rth.tag = r[i]->lineno;
+			if (u32_set_send(s, htid, u32_set_handle(s, htid, nodeid),
+					 r[i]->sel, 0, r[i]->attrs,
+					 r[i]->attrlen) < 0)
+				return -1;
+			worst++;
+		}
+	}
+	return worst;
+}
+
+/* Notes the preference being there and the tables the others use */
+static int u32_set_scan(const struct sockaddr_nl *who, struct nlmsghdr *n,
+			void *arg)
+{
+	struct u32_set *s = arg;
+	struct tcmsg *t = NLMSG_DATA(n);
+	struct tcmsg *tmpl = NLMSG_DATA(s->tmpl);
+	struct rtattr *tb[TCA_MAX+1];
+	struct rtattr *opt[TCA_U32_MAX+1];
+	int len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*t));
+	unsigned ht;
+
+	if (n->nlmsg_type != RTM_NEWTFILTER || len < 0)
+		return 0;
+
+	if (s->own && TC_H_MAJ(t->tcm_info) == TC_H_MAJ(tmpl->tcm_info)) {
+		s->exists = 1;
+		s->proto = TC_H_MIN(t->tcm_info);
+	}
+
+	parse_rtattr(tb, TCA_MAX, TCA_RTA(t), len);
+	if (!tb[TCA_KIND] || strcmp(RTA_DATA(tb[TCA_KIND]), "u32") != 0)
+		return 0;
+
+	/* Tables outlive their preference, the old set's ones included */
+	ht = t->tcm_handle >> 20;
+	if (ht < 0x800)
+		s->used[ht] = 1;
+
+	if (!s->own || TC_H_MAJ(t->tcm_info) != TC_H_MAJ(tmpl->tcm_info) ||
+	    !tb[TCA_OPTIONS])
+		return 0;
+
+	parse_rtattr_nested(opt, TCA_U32_MAX, tb[TCA_OPTIONS]);
+	if (opt[TCA_U32_DIVISOR] && ht < 0x800)
+		s->old[ht] = 1;
+	if (opt[TCA_U32_LINK]) {
+		__u32 child = *(__u32 *)RTA_DATA(opt[TCA_U32_LINK]) >> 20;
+
+		if (child < 0x800)
+			s->parent[child] = ht;
+	}
+
+	/* Root tables have IDs from 0x800 up, their nodes are in bucket 0 */
+	if (ht >= 0x800 && TC_U32_NODE(t->tcm_handle)) {
+		__u32 *nodes = realloc(s->nodes, (s->nnodes + 1) *
+				       sizeof(*nodes));
+
+		if (!nodes)
+			return -1;
+		s->nodes = nodes;
+		s->nodes[s->nnodes++] = t->tcm_handle;
+		s->root = ht;
+		if (TC_U32_NODE(t->tcm_handle) > s->maxnode)
+			s->maxnode = TC_U32_NODE(t->tcm_handle);
+	}
+	return 0;
+}
+
+/* Notes the root qdisc, filters added at "root" go there */
+static int u32_set_qdisc(const struct sockaddr_nl *who, struct nlmsghdr *n,
+			 void *arg)
+{
+	struct u32_set *s = arg;
+	struct tcmsg *t = NLMSG_DATA(n);
+
+	if (n->nlmsg_type == RTM_NEWQDISC && t->tcm_parent == TC_H_ROOT)
+		s->qdisc = t->tcm_handle;
+	return 0;
+}
+
+static int u32_set_class(const struct sockaddr_nl *who, struct nlmsghdr *n,
+			 void *arg)
+{
+	struct u32_set *s = arg;
+	struct tcmsg *t = NLMSG_DATA(n);
+	__u32 *classes;
+
+	if (n->nlmsg_type != RTM_NEWTCLASS ||
+	    TC_H_MAJ(t->tcm_handle) != s->qdisc)
+		return 0;
+
+	classes = realloc(s->classes, (s->nclasses + 1) * sizeof(*classes));
+	if (!classes)
+		return -1;
+	s->classes = classes;
+	s->classes[s->nclasses++] = t->tcm_handle;
+	return 0;
+}
+
+static int u32_set_dump(struct u32_set *s, int type, __u32 parent,
+			rtnl_filter_t filter)
+{
+	struct tcmsg t;
+
+	memcpy(&t, NLMSG_DATA(s->tmpl), sizeof(t));
+	t.tcm_handle = 0;
+	t.tcm_parent = parent;
+	t.tcm_info = 0;
+	if (rtnl_dump_request(&rth, type, &t, sizeof(t)) < 0) {
+		perror("Cannot send dump request");
+		return -1;
+	}
+	if (rtnl_dump_filter(&rth, filter, s, NULL, NULL) < 0) {
+		fprintf(stderr, "Dump terminated\n");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * The kernel keeps the u32 hash tables per qdisc, the filters of all its
+ * classes use them too. So every one of these is dumped for the table
+ * IDs taken, only the set's own parent for the set being replaced.
+ */
+static int u32_set_scan_qdisc(struct u32_set *s)
+{
+	__u32 parent = ((struct tcmsg *)NLMSG_DATA(s->tmpl))->tcm_parent;
+	int i;
+
+	s->qdisc = TC_H_MAJ(parent);
+	if (parent == TC_H_ROOT) {
+		s->qdisc = 0;
+		if (u32_set_dump(s, RTM_GETQDISC, 0, u32_set_qdisc) < 0)
+			return -1;
+		parent = s->qdisc;
+	}
+
+	s->own = 1;
+	if (u32_set_dump(s, RTM_GETTFILTER, parent, u32_set_scan) < 0)
+		return -1;
+	s->own = 0;
+	if (!s->qdisc)
+		return 0;
+
+	if (parent != s->qdisc &&
+	    u32_set_dump(s, RTM_GETTFILTER, s->qdisc, u32_set_scan) < 0)
+		return -1;
+	if (u32_set_dump(s, RTM_GETTCLASS, s->qdisc, u32_set_class) < 0)
+		return -1;
+	for (i = 0; i < s->nclasses; i++) {
+		if (s->classes[i] != parent &&
+		    u32_set_dump(s, RTM_GETTFILTER, s->classes[i],
+				 u32_set_scan) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static void u32_set_del(struct u32_set *s, __u32 handle)
+{
+	struct {
+		struct nlmsghdr		n;
+		struct tcmsg		t;
+		char			buf[64];
+	} req;
+
+	memcpy(&req, s->tmpl, NLMSG_LENGTH(sizeof(struct tcmsg)));
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+	req.n.nlmsg_flags = NLM_F_REQUEST;
+	req.n.nlmsg_type = RTM_DELTFILTER;
+	req.t.tcm_handle = handle;
+	if (handle)
+		addattr_l(&req.n, sizeof(req), TCA_KIND, "u32", 4);
+	else	/* the whole preference, whatever its protocol */
+		req.t.tcm_info = TC_H_MAJ(req.t.tcm_info);
+
+	rtnl_talk(&rth, &req.n, 0, 0, NULL, NULL, NULL);
+}
+
+/*
+ * The kernel keeps hash tables for as long as any u32 filter is on the
+ * qdisc, and a table can only be deleted once nothing links to it. So
+ * tables go from the top of their tree down, once the root nodes linking
+ * to them are gone. Links are only dropped after an RCU grace period,
+ * tables still busy are tried again a little later. Tables linked from
+ * elsewhere stay behind, unused.
+ */
+static void u32_set_drop(struct u32_set *s, unsigned char *tables,
+			 const unsigned short *parent)
+{
+	unsigned char gone[0x800];
+	int round, left, last = -1;
+	int h;
+
+	memset(gone, 0, sizeof(gone));
+	u32_set_gone = gone;
+
+	for (round = 0; round < 100; round++) {
+		for (h = 1; h < 0x800; h++) {
+			unsigned p = parent[h];
+
+			if (!tables[h] || gone[h] ||
+			    (p && p < 0x800 && tables[p] && !gone[p]))
+				continue;
+			rth.tag = h;
+			u32_set_del(s, h << 20);
+			gone[h] = 1;
+		}
+		rtnl_wait_acks(&rth, 0);
+
+		for (h = 1, left = 0; h < 0x800; h++)
+			if (tables[h] && !gone[h])
+				left++;
+		if (left == 0)
+			break;
+		if (left == last)
+			usleep(10000);
+		last = left;
+	}
+
+	for (h = 1; h < 0x800; h++) {
+		if (tables[h] && gone[h]) {
+			tables[h] = 0;
+			s->used[h] = 0;
+		}
+	}
+	u32_set_gone = NULL;
+	rth.tag = 0;
+}
+
+/* Removes the old set, the preference too when replacing it bluntly */
+static void u32_set_teardown(struct u32_set *s, int pref)
+{
+	int i;
+
+	rth.tag = 0;
+	for (i = 0; i < s->nnodes; i++)
+		u32_set_del(s, s->nodes[i]);
+	s->nnodes = 0;
+	u32_set_drop(s, s->old, s->parent);
+	if (pref)
+		u32_set_del(s, 0);
+}
+
+/* Removes whatever of the new set made it to the kernel */
+static void u32_set_rollback(struct u32_set *s)
+{
+	unsigned id;
+
+	rth.tag = 0;
+	if (s->root) {
+		for (id = s->maxnode + 1; id <= s->rootnode && id <= 0xFFF; id++)
+			u32_set_del(s, (s->root << 20) | id);
+	} else {
+		u32_set_del(s, 0);
+	}
+	u32_set_drop(s, s->new, s->newparent);
+	s->rootnode = s->maxnode;
+}
+
+static int u32_set_build(struct u32_set *s, struct u32_rule **order, int n,
+			 int *depth)
+{
+	int used[128 * 4];	/* bytes hashed on above a bucket */
+	int worst;
+
+	s->htid = 0;
+	s->tables = 0;
+	s->rootnode = s->maxnode;
+	u32_set_errors = 0;
+	if (rtnl_set_window(&rth, U32SET_WINDOW, u32_set_ack_err) < 0)
+		return -1;
+	worst = u32_set_bucket(s, order, n, 0, used, 0, depth);
+	if (rtnl_wait_acks(&rth, 0) < 0 && worst >= 0)
+		worst = -1;
+	if (u32_set_errors && worst >= 0)
+		worst = -1;
+	return worst;
+}
+
+static int u32_parse_set(struct filter_util *qu, struct nlmsghdr *n,
+			 int argc, char **argv)
+{
+	struct u32_rule *rules = NULL, **order;
+	struct u32_set set;
+	char *line = NULL;
+	size_t linelen = 0;
+	FILE *fp = stdin;
+	int nrules = 0, size = 0;
+	int window = rth.window;
+	rtnl_ack_err_t ack_err = rth.ack_err;
+	int tag = rth.tag;
+	int lineno = cmdlineno;
+	int worst, depth, i;
+	int ret = -1;
+
+	memset(&set, 0, sizeof(set));
+	u32_set_file = NULL;
+	while (argc > 0) {
+		if (strcmp(*argv, "file") == 0) {
+			NEXT_ARG();
+			u32_set_file = *argv;
+		} else if (strcmp(*argv, "help") == 0) {
+			fprintf(stderr, "Usage: ... u32 file FILE\n");
+			fprintf(stderr, "Where FILE has one line of u32 "
+				"options per rule, \"-\" being stdin\n");
+			return -1;
+		} else {
+			fprintf(stderr, "What is \"%s\"?\n", *argv);
+			return -1;
+		}
+		argc--; argv++;
+	}
+	if (!u32_set_file) {
+		fprintf(stderr, "replace-set needs a rule \"file\"\n");
+		return -1;
+	}
+	if (strcmp(u32_set_file, "-") != 0) {
+		fp = fopen(u32_set_file, "r");
+		if (!fp) {
+			fprintf(stderr, "Cannot open \"%s\": %s\n",
+				u32_set_file, strerror(errno));
+			return -1;
+		}
+	}
+
+	cmdlineno = 0;
+	while (getcmdline(&line, &linelen, fp) != -1) {
+		char *largv[100];
+		int largc = makeargs(line, largv, 100);
+
+		if (largc == 0)
+			continue;
+		if (nrules == size) {
+			size = size ? 2 * size : 1024;
+			rules = realloc(rules, size * sizeof(*rules));
+			if (!rules) {
+				perror("replace-set");
+				goto out;
+			}
+		}
+		memset(&rules[nrules], 0, sizeof(*rules));
+		rules[nrules].lineno = cmdlineno;
+		if (u32_rule_parse(qu, &rules[nrules++], largc, largv)) {
+			fprintf(stderr, "Bad rule %s:%d\n", u32_set_file,
+				cmdlineno);
+			goto out;
+		}
+	}
+	if (nrules == 0) {
+		fprintf(stderr, "No rules in \"%s\"\n", u32_set_file);
+		goto out;
+	}
+
+	set.tmpl = n;
+	if (u32_set_scan_qdisc(&set) < 0)
+		goto out;
+
+	order = malloc(nrules * sizeof(*order));
+	if (!order)
+		goto out;
+	for (i = 0; i < nrules; i++)
+		order[i] = &rules[i];
+
+	/*
+	 * The new set goes in after the old one, which is only removed
+	 * once the new one is complete, so that packets meet either. If
+	 * the preference has another protocol or kind, or its root has no
+	 * room left, the old set has to go first.
+	 */
+	if (!set.exists ||
+	    set.proto != TC_H_MIN(((struct tcmsg *)NLMSG_DATA(n))->tcm_info))
+		set.root = 0;
+	worst = -1;
+	if (set.exists && !set.root) {
+		if (rtnl_set_window(&rth, U32SET_WINDOW,
+				    u32_set_ack_teardown) < 0)
+			goto out_order;
+		u32_set_teardown(&set, 1);
+	}
+
+	/* All of it goes out in one go, failures come back by line */
+	worst = u32_set_build(&set, order, nrules, &depth);
+	if (worst == U32SET_FULL) {
+		rtnl_set_window(&rth, U32SET_WINDOW, u32_set_ack_teardown);
+		u32_set_rollback(&set);
+		u32_set_teardown(&set, 1);
+		set.root = set.maxnode = 0;
+		worst = u32_set_build(&set, order, nrules, &depth);
+	}
+
+	rtnl_set_window(&rth, U32SET_WINDOW, u32_set_ack_teardown);
+	if (worst < 0) {
+		u32_set_rollback(&set);
+		fprintf(stderr, "replace-set failed, %s\n", set.root ?
+			"the old filters are left in place" :
+			"no filters are left at the preference");
+	} else if (set.root) {
+		u32_set_teardown(&set, 0);
+	}
+
+out_order:
+	free(order);
+	rtnl_set_window(&rth, window, ack_err);
+	rth.tag = tag;
+	if (worst < 0)
+		goto out;
+
+	printf("%d rules, %d hash tables, depth %d, "
+	       "at most %d nodes checked per packet\n",
+	       nrules, set.tables + 1, depth, worst);
+	ret = 0;
+out:
+	cmdlineno = lineno;
+	free(set.nodes);
+	free(set.classes);
+	for (i = 0; i < nrules; i++) {
+		free(rules[i].sel);
+		free(rules[i].attrs);
+	}
+	free(rules);
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+	return ret;
+}
+
 struct filter_util u32_filter_util = {
 	.id = "u32",
 	.parse_fopt = u32_parse_opt,
 	.print_fopt = u32_print_opt,
+	.parse_fset = u32_parse_set,
 };
@@ -214,6 +214,12 @@ static int do_cmd(int argc, char **argv)
 	return -1;
 }
 
+/* Commands may exit(), requests still queued must not be lost */
+static void batch_drain(void)
+{
+	rtnl_wait_acks(&rth, 0);
+}
+
 static int batch(const char *name)
 {
 	char *line = NULL;
@@ -235,6 +241,13 @@ static int batch(const char *name)
 		return -1;
 	}
 
+	batch_name = name;
+	if (force) {
+		if (rtnl_set_window(&rth, BATCH_WINDOW, batch_ack_err) < 0)
+			return -1;
+		atexit(batch_drain);
+	}
+
 	cmdlineno = 0;
 	while (getcmdline(&line, &len, stdin) != -1) {
 		char *largv[100];
@@ -244,6 +257,7 @@ static int batch(const char *name)
 		if (largc == 0)
 			continue;	/* blank line */
 
+		rth.tag = cmdlineno;
 		if (do_cmd(largc, largv)) {
 			fprintf(stderr, "Command failed %s:%d\n", name, cmdlineno);
 			ret = 1;
@@ -254,6 +268,9 @@ static int batch(const char *name)
 	if (line)
 		free(line);
 
+	if (rtnl_wait_acks(&rth, 0) < 0 || batch_errors)
+		ret = 1;
+
 	rtnl_close(&rth);
 	return ret;
 }
@@ -36,6 +36,9 @@ static void usage(void)
 	fprintf(stderr, "       [ root | classid CLASSID ] [ handle FILTERID ]\n");
 	fprintf(stderr, "       [ [ FILTER_TYPE ] [ help | OPTIONS ] ]\n");
 	fprintf(stderr, "\n");
+	fprintf(stderr, "       tc filter replace-set dev STRING [ root | parent CLASSID ]\n");
+	fprintf(stderr, "       pref PRIO protocol PROTO FILTER_TYPE [ help | OPTIONS ]\n");
+	fprintf(stderr, "\n");
 	fprintf(stderr, "       tc filter show [ dev STRING ] [ root | parent CLASSID ]\n");
 	fprintf(stderr, "Where:\n");
 	fprintf(stderr, "FILTER_TYPE := { rsvp | u32 | fw | route | etc. }\n");
@@ -175,6 +178,103 @@ int tc_filter_modify(int cmd, unsigned flags, int argc, char **argv)
 	return 0;
 }
 
+/*
+ * Replaces the filters at a preference with a set the classifier lays
+ * out itself, see the parse_fset() of the kind.
+ */
+static int tc_filter_set(int argc, char **argv)
+{
+	struct {
+		struct nlmsghdr 	n;
+		struct tcmsg 		t;
+	} req;
+	struct filter_util *q = NULL;
+	__u32 prio = 0;
+	__u32 protocol = htons(ETH_P_ALL);
+	int protocol_set = 0;
+	char  d[16];
+	char  k[16];
+
+	memset(&req, 0, sizeof(req));
+	memset(d, 0, sizeof(d));
+	memset(k, 0, sizeof(k));
+
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+	req.t.tcm_family = AF_UNSPEC;
+
+	while (argc > 0) {
+		if (strcmp(*argv, "dev") == 0) {
+			NEXT_ARG();
+			if (d[0])
+				duparg("dev", *argv);
+			strncpy(d, *argv, sizeof(d)-1);
+		} else if (strcmp(*argv, "root") == 0) {
+			if (req.t.tcm_parent) {
+				fprintf(stderr, "Error: \"root\" is duplicate parent ID\n");
+				return -1;
+			}
+			req.t.tcm_parent = TC_H_ROOT;
+		} else if (strcmp(*argv, "parent") == 0) {
+			__u32 handle;
+			NEXT_ARG();
+			if (req.t.tcm_parent)
+				duparg("parent", *argv);
+			if (get_tc_classid(&handle, *argv))
+				invarg(*argv, "Invalid parent ID");
+			req.t.tcm_parent = handle;
+		} else if (matches(*argv, "preference") == 0 ||
+			   matches(*argv, "priority") == 0) {
+			NEXT_ARG();
+			if (prio)
+				duparg("priority", *argv);
+			if (get_u32(&prio, *argv, 0))
+				invarg(*argv, "invalid priority value");
+		} else if (matches(*argv, "protocol") == 0) {
+			__u16 id;
+			NEXT_ARG();
+			if (protocol_set)
+				duparg("protocol", *argv);
+			if (ll_proto_a2n(&id, *argv))
+				invarg(*argv, "invalid protocol");
+			protocol = id;
+			protocol_set = 1;
+		} else if (matches(*argv, "help") == 0) {
+			usage();
+			return 0;
+		} else {
+			strncpy(k, *argv, sizeof(k)-1);
+
+			q = get_filter_kind(k);
+			argc--; argv++;
+			break;
+		}
+
+		argc--; argv++;
+	}
+
+	if (!d[0] || !prio || !q) {
+		fprintf(stderr, "replace-set needs \"dev\", \"pref\" and a filter type\n");
+		return -1;
+	}
+	if (!q->parse_fset) {
+		fprintf(stderr, "Filter \"%s\" does not support replace-set\n", k);
+		return -1;
+	}
+
+	req.t.tcm_info = TC_H_MAKE(prio<<16, protocol);
+
+	ll_init_map(&rth);
+
+	if ((req.t.tcm_ifindex = ll_name_to_index(d)) == 0) {
+		fprintf(stderr, "Cannot find device \"%s\"\n", d);
+		return 1;
+	}
+
+	if (q->parse_fset(q, &req.n, argc, argv))
+		return 2;
+	return 0;
+}
+
 static __u32 filter_parent;
 static int filter_ifindex;
 static __u32 filter_prio;
@@ -361,6 +461,8 @@ int do_filter(int argc, char **argv)
 		return tc_filter_modify(RTM_NEWTFILTER, NLM_F_CREATE, argc-1, argv+1);
 	if (matches(*argv, "delete") == 0)
 		return tc_filter_modify(RTM_DELTFILTER, 0,  argc-1, argv+1);
+	if (strcmp(*argv, "replace-set") == 0)
+		return tc_filter_set(argc-1, argv+1);
 #if 0
 	if (matches(*argv, "get") == 0)
 		return tc_filter_get(RTM_GETTFILTER, 0,  argc-1, argv+1);
@@ -39,6 +39,9 @@ struct filter_util
 	int	(*parse_fopt)(struct filter_util *qu, char *fhandle, int argc,
 			      char **argv, struct nlmsghdr *n);
 	int	(*print_fopt)(struct filter_util *qu, FILE *f, struct rtattr *opt, __u32 fhandle);
+	/* Optional, "tc filter replace-set"; n carries the tcmsg to use */
+	int	(*parse_fset)(struct filter_util *qu, struct nlmsghdr *n,
+			      int argc, char **argv);
 };
 
 struct action_util
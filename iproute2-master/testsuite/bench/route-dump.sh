@@ -0,0 +1,32 @@
+#!/bin/bash
+#
+# Time "ip route show" on a routing table holding a large number of
+# routes, installed into a scratch network namespace.
+#
+# Usage: IP=../../ip/ip ./route-dump.sh [ROUTES [ROUNDS]]
+#
+
+IP=${IP:-ip}
+ROUTES=${1:-1000000}
+ROUNDS=${2:-5}
+NS=route-dump-$$
+BATCH=`mktemp /tmp/route-dump.XXXXXX` || exit 1
+
+trap "$IP netns delete $NS 2>/dev/null; rm -f $BATCH" EXIT
+
+$IP netns add $NS || exit 1
+$IP netns exec $NS $IP link set lo up || exit 1
+
+awk -v n=$ROUTES 'BEGIN {
+	for (i = 0; i < n; i++)
+		printf "route add 10.%d.%d.%d/32 dev lo\n",
+		       int(i / 65536) % 256, int(i / 256) % 256, i % 256
+}' > $BATCH
+
+echo "Installing $ROUTES routes"
+$IP netns exec $NS $IP -force -batch $BATCH || exit 1
+
+TIMEFORMAT="ip route show: %3R s real, %3U s user, %3S s sys"
+for i in `seq $ROUNDS`; do
+	time $IP netns exec $NS $IP route show > /dev/null
+done
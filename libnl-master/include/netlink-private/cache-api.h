@@ -240,8 +240,22 @@ struct nl_cache_ops
 				  change_func_t change_cb, change_func_v2_t change_cb_v2,
 				  void *data);
 
-	void (*reserved_1)(void);
-	void (*reserved_2)(void);
+	/**
+	 * Called when a cache is freed which carries a type specific
+	 * lookup index in \c c_index. Must release the index.
+	 */
+	void  (*co_free_index)(struct nl_cache *);
+
+	/**
+	 * Called after an object has been added to and before an object
+	 * is removed from a cache which carries a lookup index in
+	 * \c c_index, so the index can be maintained incrementally.
+	 * \c add is 1 for additions and 0 for removals. Objects updated
+	 * in place through \c oo_update are not reported and must not
+	 * change the attributes the index is built on.
+	 */
+	void  (*co_index_update)(struct nl_cache *, struct nl_object *, int add);
+
 	void (*reserved_3)(void);
 	void (*reserved_4)(void);
 	void (*reserved_5)(void);
@@ -258,6 +272,14 @@ struct nl_cache_ops
 	struct nl_cache *co_major_cache;
 	struct genl_ops *	co_genl;
 
+	/**
+	 * Parser statistics, updated atomically. Only every
+	 * NL_CACHE_PARSE_SAMPLE'th message is timed.
+	 */
+	uint64_t		co_nparsed;
+	uint64_t		co_nsampled;
+	uint64_t		co_parse_time;
+
 	/* Message type definition */
 	struct nl_msgtype	co_msgtypes[];
 };
@@ -18,5 +18,7 @@
 #define GENL_HDRSIZE(hdrlen) (GENL_HDRLEN + (hdrlen))
 
 extern int		genl_resolve_id(struct genl_ops *ops);
+extern struct genl_family *genl_ctrl_resolver_get(struct nl_sock *sk,
+						  const char *name, int probe);
 
 #endif
@@ -136,6 +136,30 @@ extern int __str2flags(const char *, const struct trans_tbl *, size_t);
 
 extern void dump_from_ops(struct nl_object *, struct nl_dump_params *);
 extern struct rtnl_link *link_lookup(struct nl_cache *cache, int ifindex);
+extern void __nla_schema_init(struct nla_schema *, const struct nla_policy *);
+
+/*
+ * Defines an attribute schema with static storage for a parser of the
+ * library, it must be initialized with __nla_schema_init() from the
+ * __init function of the module before use.
+ */
+#define NLA_SCHEMA_DEFINE(name, maxtype)				\
+	static struct nla_schema_attr name##_attrs[(maxtype) + 1];	\
+	static struct nla_schema name = {				\
+		.ns_maxtype = (maxtype),				\
+		.ns_attrs = name##_attrs,				\
+	}
+
+extern void route_lpm_free(struct nl_cache *cache);
+extern void route_lpm_update(struct nl_cache *cache, struct nl_object *obj,
+			     int add);
+extern void xfrm_sp_index_free(struct nl_cache *cache);
+extern void xfrm_sp_index_update(struct nl_cache *cache, struct nl_object *obj,
+				 int add);
+extern void queue_msg_borrow_payload(struct nfnl_queue_msg *msg, void *payload,
+				     int len);
+extern int queue_msg_parse(struct nfnl_queue_msg *msg, struct nlmsghdr *nlh,
+			   int borrow);
 
 static inline int nl_cb_call(struct nl_cb *cb, enum nl_cb_type type, struct nl_msg *msg)
 {
@@ -179,6 +203,24 @@ static inline int nl_cb_call(struct nl_cb *cb, enum nl_cb_type type, struct nl_m
 extern int nl_cache_parse(struct nl_cache_ops *, struct sockaddr_nl *,
 			  struct nlmsghdr *, struct nl_parser_param *);
 
+extern int __nl_cache_rcu_add(struct nl_cache *, struct nl_object *);
+extern int __nl_cache_rcu_update(struct nl_cache *, struct nl_object *);
+extern void __nl_cache_rcu_del(struct nl_cache *, struct nl_object *);
+extern void __nl_cache_rcu_free(struct nl_cache *);
+
+/* Only every n'th message parsed into a cache is timed */
+#define NL_CACHE_PARSE_SAMPLE	16
+
+extern uint64_t __nl_stat_time(void);
+extern void __nl_sock_stat_sent(struct nl_sock *, struct nlmsghdr *);
+extern void __nl_sock_stat_recvd(struct nl_sock *, struct nlmsghdr *);
+
+static inline void __nl_sock_stat_add(struct nl_sock *sk,
+				      enum nl_sock_stat_id id, uint64_t n)
+{
+	sk->s_stats.ss_counters[id] += n;
+}
+
 
 static inline void rtnl_copy_ratespec(struct rtnl_ratespec *dst,
 				      struct tc_ratespec *src)
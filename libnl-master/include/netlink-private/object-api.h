@@ -191,6 +191,7 @@ extern "C" {
 	struct nl_list_head	ce_list;	\
 	int			ce_msgtype;	\
 	int			ce_flags;	\
+	uint32_t		ce_gen;		\
 	uint64_t		ce_mask;
 
 struct nl_object
@@ -367,6 +368,10 @@ struct nl_object_ops
 	 * Get key attributes by family function
 	 */
 	uint32_t   (*oo_id_attrs_get)(struct nl_object *);
+
+	/** Allocation statistics, updated atomically */
+	uint64_t	oo_nalloc;
+	uint64_t	oo_nfree;
 };
 
 /** @} */
@@ -39,6 +39,7 @@
 #define NL_NO_AUTO_ACK		(1<<5)
 
 #define NL_MSG_CRED_PRESENT 1
+#define NL_MSG_EXT_BUF 2
 
 struct nl_cache_ops;
 struct nl_sock;
@@ -76,6 +77,23 @@ struct nl_cb
 	enum nl_cb_type		cb_active;
 };
 
+#define NL_SOCK_STATS_PENDING	64
+
+struct nl_sock_stats
+{
+	uint64_t		ss_counters[__NL_SOCK_STAT_MAX];
+	uint64_t		ss_reply_hist[NL_SOCK_REPLY_HIST_SIZE];
+
+	/*
+	 * Send time of outstanding requests, indexed by sequence number.
+	 * With more requests in flight, only the most recent ones are timed.
+	 */
+	struct {
+		uint32_t	seq;
+		uint64_t	sent;
+	}			ss_pending[NL_SOCK_STATS_PENDING];
+};
+
 struct nl_sock
 {
 	struct sockaddr_nl	s_local;
@@ -87,6 +105,7 @@ struct nl_sock
 	int			s_flags;
 	struct nl_cb *		s_cb;
 	size_t			s_bufsize;
+	struct nl_sock_stats	s_stats;
 };
 
 struct nl_cache
@@ -97,10 +116,18 @@ struct nl_cache
 	int                     c_iarg2;
 	int			c_refcnt;
 	unsigned int		c_flags;
+	uint32_t		c_gen;
 	struct nl_hash_table *	hashtable;
 	struct nl_cache_ops *   c_ops;
+	struct nl_cache_rcu *	c_rcu;
+	void *			c_index;
+	uint64_t		c_nadded;
+	uint64_t		c_nremoved;
+	uint64_t		c_nresyncs;
 };
 
+struct nl_cache_rcu;
+
 struct nl_cache_assoc
 {
 	struct nl_cache *	ca_cache;
@@ -109,6 +136,9 @@ struct nl_cache_assoc
 	void *			ca_change_data;
 };
 
+struct nl_cache_mngr_ring;
+struct nl_cache_mngr_event;
+
 struct nl_cache_mngr
 {
 	int			cm_protocol;
@@ -117,6 +147,22 @@ struct nl_cache_mngr
 	struct nl_sock *	cm_sock;
 	struct nl_sock *	cm_sync_sock;
 	struct nl_cache_assoc *	cm_assocs;
+	struct nl_cb *		cm_cb;
+	unsigned int		cm_batch;
+	struct nl_cache_mngr_ring *cm_ring;
+	struct nl_cache_mngr_event *cm_pending;
+	unsigned int		cm_npending;
+	unsigned int		cm_pending_size;
+	int *			cm_pending_hash;
+	uint64_t		cm_overruns;
+	uint64_t		cm_resyncs;
+	uint64_t		cm_coalesced;
+	int			cm_event_fd;
+	int			cm_stop_fd;
+#ifndef DISABLE_PTHREADS
+	pthread_t		cm_thread;
+#endif
+	int			cm_thread_running;
 };
 
 struct nl_parser_param;
@@ -154,6 +200,20 @@ struct nl_msg
 	int			nm_refcnt;
 };
 
+struct nla_schema_attr
+{
+	uint16_t		sa_minlen;
+	/* maxlen - minlen, a single unsigned comparison covers both */
+	uint16_t		sa_range;
+	uint8_t			sa_string;
+};
+
+struct nla_schema
+{
+	int			ns_maxtype;
+	struct nla_schema_attr *ns_attrs;
+};
+
 struct rtnl_link_map
 {
 	uint64_t lm_mem_start;
@@ -993,6 +1053,8 @@ struct nfnl_queue {
 	uint32_t		queue_maxlen;
 	uint32_t		queue_copy_range;
 	uint8_t			queue_copy_mode;
+	uint32_t		queue_flags;
+	uint32_t		queue_flag_mask;
 };
 
 struct nfnl_queue_msg {
@@ -1013,7 +1075,10 @@ struct nfnl_queue_msg {
 	int			queue_msg_hwaddr_len;
 	void *			queue_msg_payload;
 	int			queue_msg_payload_len;
+	int			queue_msg_payload_borrowed;
 	uint32_t		queue_msg_verdict;
+	uint32_t		queue_msg_cap_len;
+	uint32_t		queue_msg_skb_info;
 };
 
 struct ematch_quoted {
@@ -94,6 +94,18 @@ extern int		nla_validate(const struct nlattr *, int, int,
 				     const struct nla_policy *);
 extern struct nlattr *	nla_find(const struct nlattr *, int, int);
 
+/* Compiled policies */
+struct nla_schema;
+
+extern int		nla_schema_compile(const struct nla_policy *, int,
+					   struct nla_schema **);
+extern void		nla_schema_free(struct nla_schema *);
+extern int		nla_schema_get_maxtype(const struct nla_schema *);
+extern int		nla_parse_schema(struct nlattr **, struct nlattr *, int,
+					 const struct nla_schema *);
+extern int		nla_parse_nested_schema(struct nlattr **, struct nlattr *,
+						const struct nla_schema *);
+
 /* Helper Functions */
 extern int		nla_memcpy(void *, const struct nlattr *, int);
 extern size_t		nla_strlcpy(char *, const struct nlattr *, size_t);
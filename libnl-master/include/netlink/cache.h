@@ -86,6 +86,10 @@ extern int			nl_cache_resync(struct nl_sock *,
 						struct nl_cache *,
 						change_func_t,
 						void *);
+extern int			nl_cache_resync_v2(struct nl_sock *,
+						   struct nl_cache *,
+						   change_func_v2_t,
+						   void *);
 extern int			nl_cache_include(struct nl_cache *,
 						 struct nl_object *,
 						 change_func_t,
@@ -125,6 +129,52 @@ extern void			nl_cache_foreach_filter(struct nl_cache *,
 								   void *),
 							void *arg);
 
+/* Statistics */
+enum nl_cache_stat_id {
+	NL_CACHE_STAT_OBJECTS,
+	NL_CACHE_STAT_ADDED,
+	NL_CACHE_STAT_REMOVED,
+	NL_CACHE_STAT_RESYNCS,
+	NL_CACHE_STAT_MSGS_PARSED,
+	NL_CACHE_STAT_PARSE_TIME,
+	NL_CACHE_STAT_OBJ_ALLOCS,
+	NL_CACHE_STAT_OBJ_LIVE,
+	NL_CACHE_STAT_HASH_SIZE,
+	NL_CACHE_STAT_HASH_USED,
+	NL_CACHE_STAT_HASH_MAX_CHAIN,
+	__NL_CACHE_STAT_MAX,
+};
+
+#define NL_CACHE_STAT_MAX	(__NL_CACHE_STAT_MAX - 1)
+
+extern uint64_t			nl_cache_get_stat(struct nl_cache *,
+						  enum nl_cache_stat_id);
+extern char *			nl_cache_stat2str(int, char *, size_t);
+extern int			nl_cache_str2stat(const char *);
+
+/* Snapshots */
+extern int			nl_cache_snapshot_save(struct nl_sock *,
+						       struct nl_cache *,
+						       const char *);
+extern int			nl_cache_snapshot_load(struct nl_cache *,
+						       const char *, time_t *);
+
+/* Concurrent readers */
+struct nl_cache_reader;
+
+extern int			nl_cache_set_concurrent(struct nl_cache *);
+extern struct nl_cache_reader *	nl_cache_reader_alloc(struct nl_cache *);
+extern void			nl_cache_reader_free(struct nl_cache_reader *);
+extern void			nl_cache_read_lock(struct nl_cache_reader *);
+extern void			nl_cache_read_unlock(struct nl_cache_reader *);
+extern struct nl_object *	nl_cache_search_rcu(struct nl_cache_reader *,
+						    struct nl_object *);
+extern void			nl_cache_foreach_rcu(struct nl_cache_reader *,
+						     struct nl_object *,
+						     void (*cb)(struct nl_object *,
+								void *),
+						     void *arg);
+
 /* --- cache management --- */
 
 /* Cache type management */
@@ -167,6 +217,14 @@ extern int			nl_cache_mngr_get_fd(struct nl_cache_mngr *);
 extern int			nl_cache_mngr_poll(struct nl_cache_mngr *,
 						   int);
 extern int			nl_cache_mngr_data_ready(struct nl_cache_mngr *);
+extern int			nl_cache_mngr_set_bufsize(struct nl_cache_mngr *,
+							  int);
+extern int			nl_cache_mngr_set_batch(struct nl_cache_mngr *,
+							unsigned int);
+extern int			nl_cache_mngr_start_thread(struct nl_cache_mngr *);
+extern void			nl_cache_mngr_stop_thread(struct nl_cache_mngr *);
+extern uint64_t			nl_cache_mngr_get_overruns(struct nl_cache_mngr *);
+extern uint64_t			nl_cache_mngr_get_resyncs(struct nl_cache_mngr *);
 extern void			nl_cache_mngr_info(struct nl_cache_mngr *,
 						   struct nl_dump_params *);
 extern void			nl_cache_mngr_free(struct nl_cache_mngr *);
@@ -32,6 +32,7 @@ extern int			genl_ctrl_resolve(struct nl_sock *,
 extern int 			genl_ctrl_resolve_grp(struct nl_sock *sk,
 						      const char *family,
 						      const char *grp);
+extern void			genl_ctrl_resolver_flush(void);
 
 #ifdef __cplusplus
 }
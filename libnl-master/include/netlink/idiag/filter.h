@@ -0,0 +1,43 @@
+/*
+ * netlink/idiag/filter.h		Inetdiag Netlink Socket Filters
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#ifndef NETLINK_IDIAGNL_FILTER_H_
+#define NETLINK_IDIAGNL_FILTER_H_
+
+#include <netlink/netlink.h>
+#include <netlink/addr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct idiagnl_filter;
+
+extern struct idiagnl_filter *idiagnl_filter_alloc(void);
+extern void	idiagnl_filter_free(struct idiagnl_filter *);
+
+extern void	idiagnl_filter_set_states(struct idiagnl_filter *, uint16_t);
+extern uint16_t	idiagnl_filter_get_states(const struct idiagnl_filter *);
+extern int	idiagnl_filter_add_sport(struct idiagnl_filter *, uint16_t,
+					 uint16_t, int);
+extern int	idiagnl_filter_add_dport(struct idiagnl_filter *, uint16_t,
+					 uint16_t, int);
+extern int	idiagnl_filter_add_src(struct idiagnl_filter *,
+				       struct nl_addr *, int, int);
+extern int	idiagnl_filter_add_dst(struct idiagnl_filter *,
+				       struct nl_addr *, int, int);
+
+extern int	idiagnl_send_filtered(struct nl_sock *, int, uint8_t, uint16_t,
+				      uint16_t, struct idiagnl_filter *);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NETLINK_IDIAGNL_FILTER_H_ */
@@ -78,6 +78,15 @@ extern void	       idiagnl_msg_set_tcpinfo(struct idiagnl_msg *,
 
 extern int		idiagnl_msg_parse(struct nlmsghdr *,
                                           struct idiagnl_msg **);
+
+struct idiagnl_filter;
+
+extern int		idiagnl_msg_dump_foreach(struct nl_sock *, uint8_t,
+						 uint16_t, uint16_t,
+						 struct idiagnl_filter *,
+						 int (*)(struct idiagnl_msg *,
+							 void *),
+						 void *);
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
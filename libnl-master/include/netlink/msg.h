@@ -67,6 +67,9 @@ extern int		  nlmsg_ok(const struct nlmsghdr *, int);
 extern struct nlmsghdr *  nlmsg_next(struct nlmsghdr *, int *);
 extern int		  nlmsg_parse(struct nlmsghdr *, int, struct nlattr **,
 				      int, const struct nla_policy *);
+extern int		  nlmsg_parse_schema(struct nlmsghdr *, int,
+					     struct nlattr **,
+					     const struct nla_schema *);
 extern struct nlattr *	  nlmsg_find_attr(struct nlmsghdr *, int, int);
 extern int		  nlmsg_validate(struct nlmsghdr *, int, int,
 					 const struct nla_policy *);
@@ -74,6 +77,8 @@ extern int		  nlmsg_validate(struct nlmsghdr *, int, int,
 extern struct nl_msg *	  nlmsg_alloc(void);
 extern struct nl_msg *	  nlmsg_alloc_size(size_t);
 extern struct nl_msg *	  nlmsg_alloc_simple(int, int);
+extern struct nl_msg *	  nlmsg_alloc_buf(void *, size_t);
+extern void		  nlmsg_reset(struct nl_msg *);
 extern void		  nlmsg_set_default_size(size_t);
 extern struct nl_msg *	  nlmsg_inherit(struct nlmsghdr *);
 extern struct nl_msg *	  nlmsg_convert(struct nlmsghdr *);
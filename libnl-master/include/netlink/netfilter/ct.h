@@ -42,6 +42,9 @@ extern void	nfnl_ct_get(struct nfnl_ct *);
 extern void	nfnl_ct_put(struct nfnl_ct *);
 
 extern int	nfnl_ct_dump_request(struct nl_sock *);
+extern int	nfnl_ct_dump_foreach(struct nl_sock *,
+				     int (*)(struct nfnl_ct *, void *),
+				     void *);
 
 extern int	nfnl_ct_build_add_request(const struct nfnl_ct *, int,
 					  struct nl_msg **);
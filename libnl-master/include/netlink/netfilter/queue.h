@@ -61,6 +61,11 @@ extern void			nfnl_queue_set_copy_range(struct nfnl_queue *,
 extern int			nfnl_queue_test_copy_range(const struct nfnl_queue *);
 extern uint32_t			nfnl_queue_get_copy_range(const struct nfnl_queue *);
 
+extern void			nfnl_queue_set_flags(struct nfnl_queue *, uint32_t);
+extern void			nfnl_queue_unset_flags(struct nfnl_queue *, uint32_t);
+extern int			nfnl_queue_test_flags(const struct nfnl_queue *);
+extern uint32_t			nfnl_queue_get_flags(const struct nfnl_queue *);
+
 extern int	nfnl_queue_build_pf_bind(uint8_t, struct nl_msg **);
 extern int	nfnl_queue_pf_bind(struct nl_sock *, uint8_t);
 
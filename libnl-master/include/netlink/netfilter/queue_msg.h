@@ -21,6 +21,8 @@ extern "C" {
 struct nl_sock;
 struct nlmsghdr;
 struct nfnl_queue_msg;
+struct nfnl_queue;
+struct nfnl_queue_consumer;
 
 extern struct nl_object_ops queue_msg_obj_ops;
 
@@ -90,6 +92,14 @@ extern void			nfnl_queue_msg_set_verdict(struct nfnl_queue_msg *,
 extern int			nfnl_queue_msg_test_verdict(const struct nfnl_queue_msg *);
 extern unsigned int		nfnl_queue_msg_get_verdict(const struct nfnl_queue_msg *);
 
+extern void			nfnl_queue_msg_set_cap_len(struct nfnl_queue_msg *, uint32_t);
+extern int			nfnl_queue_msg_test_cap_len(const struct nfnl_queue_msg *);
+extern uint32_t			nfnl_queue_msg_get_cap_len(const struct nfnl_queue_msg *);
+
+extern void			nfnl_queue_msg_set_skb_info(struct nfnl_queue_msg *, uint32_t);
+extern int			nfnl_queue_msg_test_skb_info(const struct nfnl_queue_msg *);
+extern uint32_t			nfnl_queue_msg_get_skb_info(const struct nfnl_queue_msg *);
+
 extern struct nl_msg *		nfnl_queue_msg_build_verdict(const struct nfnl_queue_msg *);
 extern int			nfnl_queue_msg_send_verdict(struct nl_sock *,
 							    const struct nfnl_queue_msg *);
@@ -100,6 +110,28 @@ extern int			nfnl_queue_msg_send_verdict_batch(struct nl_sock *,
 extern int			nfnl_queue_msg_send_verdict_payload(struct nl_sock *,
 						const struct nfnl_queue_msg *,
 						const void *, unsigned );
+
+/*
+ * Consumer
+ *
+ * The message passed to the callback lives on the stack and its payload
+ * points into the receive buffer of the consumer. Both are only valid
+ * until the callback returns, clone the message to keep it.
+ */
+extern int			nfnl_queue_consumer_alloc(struct nfnl_queue *,
+						int (*)(struct nfnl_queue_msg *, void *),
+						void *,
+						struct nfnl_queue_consumer **);
+extern void			nfnl_queue_consumer_free(struct nfnl_queue_consumer *);
+extern struct nl_sock *		nfnl_queue_consumer_get_sock(struct nfnl_queue_consumer *);
+extern int			nfnl_queue_consumer_set_batch(struct nfnl_queue_consumer *,
+							      unsigned int);
+extern int			nfnl_queue_consumer_dispatch(struct nfnl_queue_consumer *);
+extern int			nfnl_queue_consumer_start(struct nfnl_queue_consumer *, int);
+extern void			nfnl_queue_consumer_stop(struct nfnl_queue_consumer *);
+extern uint64_t			nfnl_queue_consumer_get_packets(struct nfnl_queue_consumer *);
+extern uint64_t			nfnl_queue_consumer_get_verdicts(struct nfnl_queue_consumer *);
+extern uint64_t			nfnl_queue_consumer_get_overruns(struct nfnl_queue_consumer *);
 #ifdef __cplusplus
 }
 #endif
@@ -113,6 +113,9 @@ extern struct rtnl_nexthop * rtnl_route_nexthop_n(struct rtnl_route *r, int n);
 
 extern int	rtnl_route_guess_scope(struct rtnl_route *);
 
+extern struct rtnl_route *rtnl_route_lookup(struct nl_cache *,
+					   struct nl_addr *, uint32_t);
+
 extern char *	rtnl_route_table2str(int, char *, size_t);
 extern int	rtnl_route_str2table(const char *);
 extern int	rtnl_route_read_table_names(const char *);
@@ -19,6 +19,28 @@
 extern "C" {
 #endif
 
+/* Socket statistics */
+enum nl_sock_stat_id {
+	NL_SOCK_STAT_RX_MSGS,
+	NL_SOCK_STAT_RX_BYTES,
+	NL_SOCK_STAT_RX_CALLS,
+	NL_SOCK_STAT_TX_MSGS,
+	NL_SOCK_STAT_TX_BYTES,
+	NL_SOCK_STAT_TX_CALLS,
+	NL_SOCK_STAT_ACKS,
+	NL_SOCK_STAT_ERRORS,
+	NL_SOCK_STAT_OVERRUNS,
+	NL_SOCK_STAT_REPLIES,
+	NL_SOCK_STAT_REPLY_TIME,
+	NL_SOCK_STAT_REPLY_TIME_MAX,
+	__NL_SOCK_STAT_MAX,
+};
+
+#define NL_SOCK_STAT_MAX	(__NL_SOCK_STAT_MAX - 1)
+
+/* Buckets of the reply latency histogram */
+#define NL_SOCK_REPLY_HIST_SIZE	24
+
 extern struct nl_sock *	nl_socket_alloc(void);
 extern struct nl_sock *	nl_socket_alloc_cb(struct nl_cb *);
 extern void		nl_socket_free(struct nl_sock *);
@@ -65,6 +87,14 @@ extern int		nl_socket_set_nonblocking(const struct nl_sock *);
 extern void		nl_socket_enable_msg_peek(struct nl_sock *);
 extern void		nl_socket_disable_msg_peek(struct nl_sock *);
 
+extern uint64_t		nl_socket_get_stat(const struct nl_sock *,
+					   enum nl_sock_stat_id);
+extern int		nl_socket_get_reply_hist(const struct nl_sock *,
+					       uint64_t *, int);
+extern void		nl_socket_reset_stats(struct nl_sock *);
+extern char *		nl_socket_stat2str(int, char *, size_t);
+extern int		nl_socket_str2stat(const char *);
+
 #ifdef __cplusplus
 }
 #endif
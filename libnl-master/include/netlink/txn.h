@@ -0,0 +1,42 @@
+/*
+ * netlink/txn.h		Pipelined Transactions
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#ifndef NETLINK_TXN_H_
+#define NETLINK_TXN_H_
+
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct nl_txn;
+
+extern int		nl_txn_alloc(struct nl_sock *, struct nl_txn **);
+extern void		nl_txn_free(struct nl_txn *);
+
+extern void		nl_txn_set_window(struct nl_txn *, unsigned int);
+extern unsigned int	nl_txn_get_window(struct nl_txn *);
+extern void		nl_txn_set_error_cb(struct nl_txn *,
+					    void (*)(struct nl_msg *, int, void *),
+					    void *);
+
+extern int		nl_txn_add(struct nl_txn *, struct nl_msg *);
+extern int		nl_txn_flush(struct nl_txn *);
+extern int		nl_txn_commit(struct nl_txn *);
+
+extern unsigned int	nl_txn_get_pending(struct nl_txn *);
+extern unsigned int	nl_txn_get_errors(struct nl_txn *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -52,6 +52,7 @@ extern void                     xfrmnl_sp_put(struct xfrmnl_sp *);
 
 extern int                      xfrmnl_sp_alloc_cache(struct nl_sock *, struct nl_cache **);
 extern struct xfrmnl_sp*        xfrmnl_sp_get(struct nl_cache*, unsigned int, unsigned int);
+extern struct xfrmnl_sp*        xfrmnl_sp_lookup(struct nl_cache*, unsigned int, struct xfrmnl_sel*, unsigned int);
 
 extern int                      xfrmnl_sp_parse(struct nlmsghdr *n, struct xfrmnl_sp **result);
 
@@ -334,6 +334,204 @@ struct nlattr *nla_find(const struct nlattr *head, int len, int attrtype)
 
 /** @} */
 
+/**
+ * @name Compiled Policies
+ *
+ * Parsers which run for every message of a large dump, e.g. the message
+ * parsers of the caches, can digest their validation policy once into an
+ * attribute schema. The schema holds the accepted payload length range
+ * of every attribute type in a compact table, so validation takes a
+ * single comparison per attribute instead of a lookup of the policy and
+ * of the default minimal length of its type. Parsing with a schema is
+ * equivalent to nla_parse() with the policy the schema was compiled from.
+ *
+ * @code
+ * struct nla_schema *schema;
+ *
+ * if ((err = nla_schema_compile(my_policy, MY_ATTR_MAX, &schema)) < 0)
+ *         return err;
+ *
+ * // for every message received
+ * err = nlmsg_parse_schema(nlh, sizeof(struct my_hdr), tb, schema);
+ * @endcode
+ * @{
+ */
+
+/** @cond SKIP */
+/*
+ * Cannot fail, the types of the policy must be valid. Policies of the
+ * library are, those of applications are checked by nla_schema_compile().
+ */
+void __nla_schema_init(struct nla_schema *schema,
+		       const struct nla_policy *policy)
+{
+	int i;
+
+	for (i = 0; i <= schema->ns_maxtype; i++) {
+		struct nla_schema_attr *sa = &schema->ns_attrs[i];
+		unsigned int minlen = 0, maxlen = UINT16_MAX;
+
+		if (policy) {
+			const struct nla_policy *pt = &policy[i];
+
+			if (pt->type > NLA_TYPE_MAX)
+				BUG();
+
+			if (pt->minlen)
+				minlen = pt->minlen;
+			else if (pt->type != NLA_UNSPEC)
+				minlen = nla_attr_minlen[pt->type];
+
+			if (pt->maxlen)
+				maxlen = pt->maxlen;
+
+			sa->sa_string = pt->type == NLA_STRING;
+		}
+
+		if (maxlen < minlen) {
+			/* Such an attribute never validates */
+			sa->sa_minlen = UINT16_MAX;
+			sa->sa_range = 0;
+		} else {
+			sa->sa_minlen = minlen;
+			sa->sa_range = maxlen - minlen;
+		}
+	}
+}
+/** @endcond */
+
+/**
+ * Compile an attribute validation policy into a schema
+ * @arg policy		Attribute validation policy (maxtype+1 elements).
+ * @arg maxtype		Maximum attribute type expected and accepted.
+ * @arg result		Pointer to store resulting schema.
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nla_schema_compile(const struct nla_policy *policy, int maxtype,
+		       struct nla_schema **result)
+{
+	struct nla_schema *schema;
+	int i;
+
+	if (maxtype < 0 || maxtype > (uint16_t) NLA_TYPE_MASK)
+		return -NLE_INVAL;
+
+	for (i = 0; policy && i <= maxtype; i++)
+		if (policy[i].type > NLA_TYPE_MAX)
+			return -NLE_INVAL;
+
+	schema = calloc(1, sizeof(*schema) +
+			   (maxtype + 1) * sizeof(struct nla_schema_attr));
+	if (!schema)
+		return -NLE_NOMEM;
+
+	schema->ns_maxtype = maxtype;
+	schema->ns_attrs = (struct nla_schema_attr *) (schema + 1);
+
+	__nla_schema_init(schema, policy);
+
+	*result = schema;
+
+	return 0;
+}
+
+/**
+ * Free an attribute schema
+ * @arg schema		Attribute schema.
+ */
+void nla_schema_free(struct nla_schema *schema)
+{
+	free(schema);
+}
+
+/**
+ * Return maximum attribute type of an attribute schema
+ * @arg schema		Attribute schema.
+ *
+ * @return Maximum attribute type, index arrays passed to the parsing
+ *         functions must have room for one more element.
+ */
+int nla_schema_get_maxtype(const struct nla_schema *schema)
+{
+	return schema->ns_maxtype;
+}
+
+/**
+ * Create attribute index based on a stream of attributes and a schema.
+ * @arg tb		Index array to be filled (maxtype+1 elements).
+ * @arg head		Head of attribute stream.
+ * @arg len		Length of attribute stream.
+ * @arg schema		Attribute schema.
+ *
+ * Same as nla_parse() with the maximum type and policy the schema was
+ * compiled from.
+ *
+ * @see nla_parse
+ * @return 0 on success or a negative error code.
+ */
+int nla_parse_schema(struct nlattr *tb[], struct nlattr *head, int len,
+		     const struct nla_schema *schema)
+{
+	const struct nla_schema_attr *sa;
+	const int maxtype = schema->ns_maxtype;
+	struct nlattr *nla = head;
+	unsigned int plen;
+	int type;
+
+	memset(tb, 0, sizeof(struct nlattr *) * (maxtype + 1));
+
+	while (len >= (int) sizeof(*nla) && nla->nla_len >= sizeof(*nla) &&
+	       nla->nla_len <= len) {
+		type = nla->nla_type & NLA_TYPE_MASK;
+		plen = nla->nla_len - NLA_HDRLEN;
+
+		if (type <= maxtype) {
+			sa = &schema->ns_attrs[type];
+
+			if (plen - sa->sa_minlen > sa->sa_range)
+				return -NLE_RANGE;
+
+			if (sa->sa_string &&
+			    ((char *) nla)[NLA_HDRLEN + plen - 1] != '\0')
+				return -NLE_INVAL;
+
+			if (tb[type])
+				NL_DBG(1, "Attribute of type %#x found multiple "
+					  "times in message, previous attribute "
+					  "is being ignored.\n", type);
+
+			tb[type] = nla;
+		}
+
+		len -= NLA_ALIGN(nla->nla_len);
+		nla = (struct nlattr *) ((char *) nla + NLA_ALIGN(nla->nla_len));
+	}
+
+	if (len > 0)
+		NL_DBG(1, "netlink: %d bytes leftover after parsing "
+		       "attributes.\n", len);
+
+	return 0;
+}
+
+/**
+ * Create attribute index based on nested attribute and a schema
+ * @arg tb		Index array to be filled (maxtype+1 elements).
+ * @arg nla		Nested Attribute.
+ * @arg schema		Attribute schema of the nested attributes.
+ *
+ * @see nla_parse_nested
+ * @return 0 on success or a negative error code.
+ */
+int nla_parse_nested_schema(struct nlattr *tb[], struct nlattr *nla,
+			    const struct nla_schema *schema)
+{
+	return nla_parse_schema(tb, nla_data(nla), nla_len(nla), schema);
+}
+
+/** @} */
+
 /**
  * @name Helper Functions
  * @{
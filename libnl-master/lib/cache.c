@@ -55,6 +55,11 @@
 #include <netlink/object.h>
 #include <netlink/hashtable.h>
 #include <netlink/utils.h>
+#include <sys/mman.h>
+
+/** @cond SKIP */
+#define NL_CACHE_HASH_MAX	(1 << 22)
+/** @endcond */
 
 /**
  * @name Access Functions
@@ -380,6 +385,11 @@ static void __nl_cache_free(struct nl_cache *cache)
 	if (cache->hashtable)
 		nl_hash_table_free(cache->hashtable);
 
+	__nl_cache_rcu_free(cache);
+
+	if (cache->c_index && cache->c_ops->co_free_index)
+		cache->c_ops->co_free_index(cache);
+
 	NL_DBG(2, "Freeing cache %p <%s>...\n", cache, nl_cache_name(cache));
 	free(cache);
 }
@@ -431,11 +441,43 @@ void nl_cache_put(struct nl_cache *cache)
  * @{
  */
 
+/*
+ * Hash tables start out with a fixed number of chains. Once the cache
+ * holds more than two objects per chain on average, rehash into a table
+ * four times the size so that lookups in large caches stay short.
+ */
+static void __cache_grow_hashtable(struct nl_cache *cache)
+{
+	struct nl_hash_table *ht;
+	struct nl_object *obj;
+	int size = cache->hashtable->size;
+
+	if (cache->c_nitems <= 2 * size || size >= NL_CACHE_HASH_MAX)
+		return;
+
+	if (!(ht = nl_hash_table_alloc(size * 4)))
+		return;
+
+	nl_list_for_each_entry(obj, &cache->c_items, ce_list) {
+		if (nl_hash_table_add(ht, obj) < 0) {
+			nl_hash_table_free(ht);
+			return;
+		}
+	}
+
+	nl_hash_table_free(cache->hashtable);
+	cache->hashtable = ht;
+
+	NL_DBG(2, "Resized hashtable of cache %p <%s> to %d chains\n",
+	       cache, nl_cache_name(cache), size * 4);
+}
+
 static int __cache_add(struct nl_cache *cache, struct nl_object *obj)
 {
 	int ret;
 
 	obj->ce_cache = cache;
+	obj->ce_gen = cache->c_gen;
 
 	if (cache->hashtable) {
 		ret = nl_hash_table_add(cache->hashtable, obj);
@@ -445,8 +487,25 @@ static int __cache_add(struct nl_cache *cache, struct nl_object *obj)
 		}
 	}
 
+	if (cache->c_rcu) {
+		ret = __nl_cache_rcu_add(cache, obj);
+		if (ret < 0) {
+			if (cache->hashtable)
+				nl_hash_table_del(cache->hashtable, obj);
+			obj->ce_cache = NULL;
+			return ret;
+		}
+	}
+
 	nl_list_add_tail(&obj->ce_list, &cache->c_items);
 	cache->c_nitems++;
+	cache->c_nadded++;
+
+	if (cache->hashtable)
+		__cache_grow_hashtable(cache);
+
+	if (cache->c_index && cache->c_ops->co_index_update)
+		cache->c_ops->co_index_update(cache, obj, 1);
 
 	NL_DBG(3, "Added object %p to cache %p <%s>, nitems %d\n",
 	       obj, cache, nl_cache_name(cache), cache->c_nitems);
@@ -556,6 +615,9 @@ void nl_cache_remove(struct nl_object *obj)
 	if (cache == NULL)
 		return;
 
+	if (cache->c_index && cache->c_ops->co_index_update)
+		cache->c_ops->co_index_update(cache, obj, 0);
+
 	if (cache->hashtable) {
 		ret = nl_hash_table_del(cache->hashtable, obj);
 		if (ret < 0)
@@ -563,10 +625,14 @@ void nl_cache_remove(struct nl_object *obj)
 			       obj, cache, nl_cache_name(cache));
 	}
 
+	if (cache->c_rcu)
+		__nl_cache_rcu_del(cache, obj);
+
 	nl_list_del(&obj->ce_list);
 	obj->ce_cache = NULL;
 	nl_object_put(obj);
 	cache->c_nitems--;
+	cache->c_nremoved++;
 
 	NL_DBG(2, "Deleted object %p from cache %p <%s>.\n",
 	       obj, cache, nl_cache_name(cache));
@@ -796,9 +862,32 @@ static int cache_include(struct nl_cache *cache, struct nl_object *obj,
 	case NL_ACT_DEL:
 		old = nl_cache_search(cache, obj);
 		if (old) {
+			if (type->mt_act == NL_ACT_NEW) {
+				diff = nl_object_diff64(old, obj);
+
+				/*
+				 * Nothing the object type compares has
+				 * changed, but attributes outside of its
+				 * comparison (statistics, lifetimes) may
+				 * have. Replace the cached object anyway
+				 * and report nothing. The swap is neither
+				 * an addition nor a removal, so keep it
+				 * out of the statistics.
+				 */
+				if (diff == 0) {
+					nl_cache_remove(old);
+					nl_cache_move(cache, obj);
+					cache->c_nremoved--;
+					cache->c_nadded--;
+					nl_object_put(old);
+					return 0;
+				}
+			}
+
 			if (cb_v2 && old->ce_ops->oo_update) {
 				clone = nl_object_clone(old);
-				diff = nl_object_diff64(old, obj);
+				if (type->mt_act != NL_ACT_NEW)
+					diff = nl_object_diff64(old, obj);
 			}
 			/*
 			 * Some objects types might support merging the new
@@ -806,6 +895,9 @@ static int cache_include(struct nl_cache *cache, struct nl_object *obj,
 			 * Handle them first.
 			 */
 			if (nl_object_update(old, obj) == 0) {
+				old->ce_gen = cache->c_gen;
+				if (cache->c_rcu)
+					__nl_cache_rcu_update(cache, old);
 				if (cb_v2) {
 					cb_v2(cache, clone, obj, diff,
 					      NL_ACT_CHANGE, data);
@@ -837,9 +929,6 @@ static int cache_include(struct nl_cache *cache, struct nl_object *obj,
 				} else if (cb)
 					cb(cache, obj, NL_ACT_NEW, data);
 			} else if (old) {
-				diff = 0;
-				if (cb || cb_v2)
-					diff = nl_object_diff64(old, obj);
 				if (diff && cb_v2) {
 					cb_v2(cache, old, obj, diff, NL_ACT_CHANGE,
 					      data);
@@ -910,19 +999,14 @@ static int resync_cb(struct nl_object *c, struct nl_parser_param *p)
 					ca->ca_change_data);
 }
 
-int nl_cache_resync(struct nl_sock *sk, struct nl_cache *cache,
-		    change_func_t change_cb, void *data)
+static int __nl_cache_resync(struct nl_sock *sk, struct nl_cache *cache,
+			     struct nl_cache_assoc *ca)
 {
 	struct nl_object *obj, *next;
 	struct nl_af_group *grp;
-	struct nl_cache_assoc ca = {
-		.ca_cache = cache,
-		.ca_change = change_cb,
-		.ca_change_data = data,
-	};
 	struct nl_parser_param p = {
 		.pp_cb = resync_cb,
-		.pp_arg = &ca,
+		.pp_arg = ca,
 	};
 	int err;
 
@@ -931,8 +1015,16 @@ int nl_cache_resync(struct nl_sock *sk, struct nl_cache *cache,
 
 	NL_DBG(1, "Resyncing cache %p <%s>...\n", cache, nl_cache_name(cache));
 
-	/* Mark all objects so we can see if some of them are obsolete */
-	nl_cache_mark_all(cache);
+	/*
+	 * Start a new generation. Every object seen during the dump is
+	 * stamped with it, whatever is left on the old generation
+	 * afterwards is obsolete. Generation 0 is never used so that
+	 * objects which have not been added by a resync stay distinct.
+	 */
+	if (++cache->c_gen == 0)
+		cache->c_gen = 1;
+
+	cache->c_nresyncs++;
 
 	grp = cache->c_ops->co_groups;
 	do {
@@ -957,13 +1049,18 @@ restart:
 		(cache->c_flags & NL_CACHE_AF_ITER));
 
 	nl_list_for_each_entry_safe(obj, next, &cache->c_items, ce_list) {
-		if (nl_object_is_marked(obj)) {
-			nl_object_get(obj);
-			nl_cache_remove(obj);
-			if (change_cb)
-				change_cb(cache, obj, NL_ACT_DEL, data);
-			nl_object_put(obj);
-		}
+		if (obj->ce_gen == cache->c_gen)
+			continue;
+
+		nl_object_get(obj);
+		nl_cache_remove(obj);
+		if (ca->ca_change_v2)
+			ca->ca_change_v2(cache, obj, NULL, 0, NL_ACT_DEL,
+					 ca->ca_change_data);
+		else if (ca->ca_change)
+			ca->ca_change(cache, obj, NL_ACT_DEL,
+				      ca->ca_change_data);
+		nl_object_put(obj);
 	}
 
 	NL_DBG(1, "Finished resyncing %p <%s>\n", cache, nl_cache_name(cache));
@@ -973,6 +1070,63 @@ errout:
 	return err;
 }
 
+/**
+ * Synchronize a cache with the kernel
+ * @arg sk		Netlink socket.
+ * @arg cache		Cache to synchronize
+ * @arg change_cb	Change callback (optional)
+ * @arg data		Argument passed to change callback
+ *
+ * Requests a full dump and reconciles the cache with it. Objects
+ * identical to their cached counterpart are silently refreshed, changed
+ * objects are updated or replaced and objects no longer present in
+ * the kernel are removed. The change callback is only invoked for
+ * objects which were actually added, changed or removed.
+ *
+ * Obsolete objects are detected by a per cache generation counter,
+ * the cache does not need to be marked beforehand.
+ *
+ * @see nl_cache_resync_v2()
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nl_cache_resync(struct nl_sock *sk, struct nl_cache *cache,
+		    change_func_t change_cb, void *data)
+{
+	struct nl_cache_assoc ca = {
+		.ca_cache = cache,
+		.ca_change = change_cb,
+		.ca_change_data = data,
+	};
+
+	return __nl_cache_resync(sk, cache, &ca);
+}
+
+/**
+ * Synchronize a cache with the kernel, reporting attribute differences
+ * @arg sk		Netlink socket.
+ * @arg cache		Cache to synchronize
+ * @arg change_cb	Change callback (optional)
+ * @arg data		Argument passed to change callback
+ *
+ * Same as nl_cache_resync() but invokes a change_func_v2_t callback
+ * which is provided with the old and new object and the bitmask of
+ * differing attributes as computed by nl_object_diff64().
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nl_cache_resync_v2(struct nl_sock *sk, struct nl_cache *cache,
+		       change_func_v2_t change_cb, void *data)
+{
+	struct nl_cache_assoc ca = {
+		.ca_cache = cache,
+		.ca_change_v2 = change_cb,
+		.ca_change_data = data,
+	};
+
+	return __nl_cache_resync(sk, cache, &ca);
+}
+
 /** @} */
 
 /**
@@ -984,11 +1138,16 @@ errout:
 int nl_cache_parse(struct nl_cache_ops *ops, struct sockaddr_nl *who,
 		   struct nlmsghdr *nlh, struct nl_parser_param *params)
 {
+	uint64_t n, start = 0;
 	int i, err;
 
 	if (!nlmsg_valid_hdr(nlh, ops->co_hdrsize))
 		return -NLE_MSG_TOOSHORT;
 
+	n = __atomic_add_fetch(&ops->co_nparsed, 1, __ATOMIC_RELAXED);
+	if (n % NL_CACHE_PARSE_SAMPLE == 0)
+		start = __nl_stat_time();
+
 	for (i = 0; ops->co_msgtypes[i].mt_id >= 0; i++) {
 		if (ops->co_msgtypes[i].mt_id == nlh->nlmsg_type) {
 			err = ops->co_msg_parser(ops, who, nlh, params);
@@ -1000,6 +1159,12 @@ int nl_cache_parse(struct nl_cache_ops *ops, struct sockaddr_nl *who,
 
 	err = -NLE_MSGTYPE_NOSUPPORT;
 errout:
+	if (start) {
+		__atomic_add_fetch(&ops->co_parse_time,
+				   __nl_stat_time() - start, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&ops->co_nsampled, 1, __ATOMIC_RELAXED);
+	}
+
 	return err;
 }
 /** @endcond */
@@ -1077,6 +1242,356 @@ restart:
 
 /** @} */
 
+/**
+ * @name Snapshots
+ *
+ * A snapshot holds the raw messages of a cache dump. Loading it fills
+ * a cache without talking to the kernel, e.g. to let a daemon serve
+ * requests right after startup. A subsequent nl_cache_resync() brings
+ * the cache up to date and reports only what changed in the meantime.
+ *
+ * @code
+ * if (nl_cache_snapshot_load(cache, path, NULL) < 0)
+ * 	nl_cache_refill(sk, cache);
+ * else
+ * 	nl_cache_resync(sk, cache, change_cb, NULL);
+ * @endcode
+ * @{
+ */
+
+/** @cond SKIP */
+#define NL_SNAPSHOT_MAGIC	"NLCS"
+#define NL_SNAPSHOT_VERSION	1
+
+struct nl_snapshot_hdr {
+	char		sh_magic[4];
+	uint16_t	sh_version;
+	uint16_t	sh_hdrlen;
+	uint32_t	sh_protocol;
+	uint32_t	sh_gen;
+	uint32_t	sh_nmsgs;
+	uint32_t	sh_pad;
+	uint64_t	sh_datalen;
+	uint64_t	sh_saved;
+	char		sh_name[32];
+};
+
+struct snapshot_xdata {
+	struct update_xdata	update;
+	char *			buf;
+	size_t			len;
+	size_t			size;
+	uint32_t		nmsgs;
+};
+
+static int snapshot_msg_parser(struct nl_msg *msg, void *arg)
+{
+	struct snapshot_xdata *x = arg;
+	struct nlmsghdr *nlh = nlmsg_hdr(msg);
+	size_t len = NLMSG_ALIGN(nlh->nlmsg_len);
+
+	if (x->len + len > x->size) {
+		size_t size = x->size ? 2 * x->size : 65536;
+		char *buf;
+
+		while (x->len + len > size)
+			size *= 2;
+
+		if (!(buf = realloc(x->buf, size)))
+			return -NLE_NOMEM;
+
+		x->buf = buf;
+		x->size = size;
+	}
+
+	memcpy(x->buf + x->len, nlh, nlh->nlmsg_len);
+	memset(x->buf + x->len + nlh->nlmsg_len, 0, len - nlh->nlmsg_len);
+	x->len += len;
+	x->nmsgs++;
+
+	return update_msg_parser(msg, &x->update);
+}
+
+/* Objects of a snapshot being loaded, added to the cache once all parsed */
+struct snapshot_objs {
+	struct nl_object **	objs;
+	int			n;
+	int			size;
+};
+
+static int snapshot_collect_cb(struct nl_object *obj, struct nl_parser_param *p)
+{
+	struct snapshot_objs *o = p->pp_arg;
+
+	if (o->n == o->size) {
+		int size = o->size ? 2 * o->size : 1024;
+		struct nl_object **objs;
+
+		if (!(objs = realloc(o->objs, size * sizeof(*objs))))
+			return -NLE_NOMEM;
+
+		o->objs = objs;
+		o->size = size;
+	}
+
+	nl_object_get(obj);
+	o->objs[o->n++] = obj;
+
+	return 0;
+}
+
+static int snapshot_write(const char *path, struct nl_snapshot_hdr *hdr,
+			  const void *data)
+{
+	char tmp[PATH_MAX];
+	FILE *fd;
+	int err = 0;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp))
+		return -NLE_RANGE;
+
+	if (!(fd = fopen(tmp, "w")))
+		return -nl_syserr2nlerr(errno);
+
+	if (fwrite(hdr, sizeof(*hdr), 1, fd) != 1 ||
+	    (hdr->sh_datalen &&
+	     fwrite(data, hdr->sh_datalen, 1, fd) != 1) ||
+	    fflush(fd) || fsync(fileno(fd)))
+		err = -nl_syserr2nlerr(errno);
+
+	if (fclose(fd) && !err)
+		err = -nl_syserr2nlerr(errno);
+
+	if (!err && rename(tmp, path) < 0)
+		err = -nl_syserr2nlerr(errno);
+
+	if (err < 0)
+		unlink(tmp);
+
+	return err;
+}
+/** @endcond */
+
+/**
+ * Refill a cache and save the dump as snapshot
+ * @arg sk		Netlink socket.
+ * @arg cache		Cache to refill
+ * @arg path		Path of the snapshot file
+ *
+ * Same as nl_cache_refill() but also writes the messages received from
+ * the kernel to \p path. The file is replaced atomically, readers never
+ * see a partial snapshot.
+ *
+ * @see nl_cache_snapshot_load()
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nl_cache_snapshot_save(struct nl_sock *sk, struct nl_cache *cache,
+			   const char *path)
+{
+	struct nl_af_group *grp;
+	struct nl_snapshot_hdr hdr = {
+		.sh_magic = NL_SNAPSHOT_MAGIC,
+		.sh_version = NL_SNAPSHOT_VERSION,
+		.sh_hdrlen = sizeof(hdr),
+	};
+	struct nl_parser_param p = {
+		.pp_cb = pickup_cb,
+		.pp_arg = cache,
+	};
+	struct snapshot_xdata x = {
+		.update = {
+			.ops = cache->c_ops,
+			.params = &p,
+		},
+	};
+	struct nl_cb *cb;
+	size_t start;
+	uint32_t nstart;
+	int err;
+
+	if (sk->s_proto != cache->c_ops->co_protocol)
+		return -NLE_PROTO_MISMATCH;
+
+	if (!(cb = nl_cb_clone(sk->s_cb)))
+		return -NLE_NOMEM;
+
+	nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, snapshot_msg_parser, &x);
+
+	nl_cache_clear(cache);
+	grp = cache->c_ops->co_groups;
+	do {
+		if (grp && grp->ag_group &&
+			(cache->c_flags & NL_CACHE_AF_ITER))
+			nl_cache_set_arg1(cache, grp->ag_family);
+
+		start = x.len;
+		nstart = x.nmsgs;
+restart:
+		err = nl_cache_request_full_dump(sk, cache);
+		if (err < 0)
+			goto errout;
+
+		err = nl_recvmsgs(sk, cb);
+		if (err == -NLE_DUMP_INTR) {
+			/* Drop the inconsistent part of the snapshot */
+			x.len = start;
+			x.nmsgs = nstart;
+			goto restart;
+		} else if (err < 0)
+			goto errout;
+
+		if (grp)
+			grp++;
+	} while (grp && grp->ag_group &&
+			(cache->c_flags & NL_CACHE_AF_ITER));
+
+	hdr.sh_protocol = cache->c_ops->co_protocol;
+	hdr.sh_gen = cache->c_gen;
+	hdr.sh_nmsgs = x.nmsgs;
+	hdr.sh_datalen = x.len;
+	hdr.sh_saved = time(NULL);
+	strncpy(hdr.sh_name, nl_cache_name(cache), sizeof(hdr.sh_name) - 1);
+
+	err = snapshot_write(path, &hdr, x.buf);
+
+	NL_DBG(2, "Saved snapshot of cache %p <%s> to %s, %u messages: %d\n",
+	       cache, nl_cache_name(cache), path, x.nmsgs, err);
+errout:
+	nl_cb_put(cb);
+	free(x.buf);
+
+	return err;
+}
+
+/**
+ * Fill a cache from a snapshot
+ * @arg cache		Cache to fill
+ * @arg path		Path of the snapshot file
+ * @arg saved		Result pointer for the time of the snapshot (optional)
+ *
+ * Parses the messages saved by nl_cache_snapshot_save() and replaces
+ * the content of the cache with the resulting objects. The file is
+ * mapped into memory, no copy of the messages is made. The snapshot is
+ * validated and parsed as a whole before the cache is touched, the cache
+ * is left unchanged if it cannot be loaded. Only if memory runs out
+ * while the objects are added is the cache left empty.
+ *
+ * The snapshot reflects the kernel state at the time it was saved.
+ * Use nl_cache_resync() to catch up with changes made since then.
+ *
+ * @return 0 on success, -NLE_OBJ_MISMATCH if the snapshot belongs to a
+ *         different cache type, -NLE_PARSE_ERR or -NLE_MSG_TRUNC if the
+ *         file is corrupted or another negative error code.
+ */
+int nl_cache_snapshot_load(struct nl_cache *cache, const char *path,
+			   time_t *saved)
+{
+	struct nl_snapshot_hdr *hdr;
+	struct sockaddr_nl who = { .nl_family = AF_NETLINK };
+	struct snapshot_objs o = { NULL };
+	struct nl_parser_param p = {
+		.pp_cb = snapshot_collect_cb,
+		.pp_arg = &o,
+	};
+	struct nlmsghdr *nlh;
+	struct stat st;
+	void *map = MAP_FAILED;
+	uint32_t n;
+	int fd, len, i, err;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -nl_syserr2nlerr(errno);
+
+	if (fstat(fd, &st) < 0) {
+		err = -nl_syserr2nlerr(errno);
+		goto errout;
+	}
+
+	if (st.st_size < sizeof(*hdr)) {
+		err = -NLE_MSG_TRUNC;
+		goto errout;
+	}
+
+	/* Private and writable, parsers may modify the messages */
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		   fd, 0);
+	if (map == MAP_FAILED) {
+		err = -nl_syserr2nlerr(errno);
+		goto errout;
+	}
+
+	hdr = map;
+	if (memcmp(hdr->sh_magic, NL_SNAPSHOT_MAGIC, 4) ||
+	    hdr->sh_version != NL_SNAPSHOT_VERSION ||
+	    hdr->sh_hdrlen < sizeof(*hdr) || hdr->sh_hdrlen % NLMSG_ALIGNTO) {
+		err = -NLE_PARSE_ERR;
+		goto errout;
+	}
+
+	if (hdr->sh_protocol != cache->c_ops->co_protocol ||
+	    strncmp(hdr->sh_name, nl_cache_name(cache),
+		    sizeof(hdr->sh_name))) {
+		err = -NLE_OBJ_MISMATCH;
+		goto errout;
+	}
+
+	if (hdr->sh_datalen > st.st_size - hdr->sh_hdrlen ||
+	    hdr->sh_datalen > INT_MAX) {
+		err = -NLE_MSG_TRUNC;
+		goto errout;
+	}
+
+	/* Validate all messages before touching the cache */
+	nlh = (struct nlmsghdr *) ((char *) map + hdr->sh_hdrlen);
+	len = hdr->sh_datalen;
+	for (n = 0; nlmsg_ok(nlh, len); n++)
+		nlh = nlmsg_next(nlh, &len);
+
+	if (len || n != hdr->sh_nmsgs) {
+		err = -NLE_MSG_TRUNC;
+		goto errout;
+	}
+
+	nlh = (struct nlmsghdr *) ((char *) map + hdr->sh_hdrlen);
+	len = hdr->sh_datalen;
+	for (; nlmsg_ok(nlh, len); nlh = nlmsg_next(nlh, &len)) {
+		err = nl_cache_parse(cache->c_ops, &who, nlh, &p);
+		if (err < 0)
+			goto errout;
+	}
+
+	nl_cache_clear(cache);
+	cache->c_gen = hdr->sh_gen;
+
+	for (i = 0; i < o.n; i++) {
+		err = nl_cache_add(cache, o.objs[i]);
+		if (err < 0 && err != -NLE_EXIST) {
+			nl_cache_clear(cache);
+			goto errout;
+		}
+	}
+
+	if (saved)
+		*saved = hdr->sh_saved;
+
+	NL_DBG(2, "Loaded snapshot %s into cache %p <%s>, %d objects\n",
+	       path, cache, nl_cache_name(cache), cache->c_nitems);
+
+	err = 0;
+errout:
+	for (i = 0; i < o.n; i++)
+		nl_object_put(o.objs[i]);
+	free(o.objs);
+	if (map != MAP_FAILED)
+		munmap(map, st.st_size);
+	close(fd);
+
+	return err;
+}
+
+/** @} */
+
 /**
  * @name Utillities
  * @{
@@ -1309,4 +1824,109 @@ void nl_cache_foreach_filter(struct nl_cache *cache, struct nl_object *filter,
 
 /** @} */
 
+/**
+ * @name Statistics
+ *
+ * Caches count the objects added and removed as well as the resyncs
+ * performed. The parser counters are maintained per cache type and
+ * cover all caches of the type, including the ones of cache managers.
+ * Parse times are measured on a sample of the messages to keep the
+ * overhead low.
+ * @{
+ */
+
+/**
+ * Get cache statistic
+ * @arg cache		Cache
+ * @arg id		Identifier of statistical counter
+ *
+ * The hashtable statistics walk the hashtable and are as expensive as
+ * the cache is large. NL_CACHE_STAT_PARSE_TIME is the average time in
+ * nanoseconds spent in the message parser of the cache type.
+ *
+ * @return Value of counter or 0 if not specified.
+ */
+uint64_t nl_cache_get_stat(struct nl_cache *cache, enum nl_cache_stat_id id)
+{
+	struct nl_cache_ops *ops = cache->c_ops;
+	struct nl_object_ops *obj_ops = ops->co_obj_ops;
+	uint64_t n, max = 0, used = 0;
+	nl_hash_node_t *node;
+	int i;
+
+	switch (id) {
+	case NL_CACHE_STAT_OBJECTS:
+		return cache->c_nitems;
+	case NL_CACHE_STAT_ADDED:
+		return cache->c_nadded;
+	case NL_CACHE_STAT_REMOVED:
+		return cache->c_nremoved;
+	case NL_CACHE_STAT_RESYNCS:
+		return cache->c_nresyncs;
+	case NL_CACHE_STAT_MSGS_PARSED:
+		return __atomic_load_n(&ops->co_nparsed, __ATOMIC_RELAXED);
+	case NL_CACHE_STAT_PARSE_TIME:
+		n = __atomic_load_n(&ops->co_nsampled, __ATOMIC_RELAXED);
+		return n ? __atomic_load_n(&ops->co_parse_time,
+					   __ATOMIC_RELAXED) / n : 0;
+	case NL_CACHE_STAT_OBJ_ALLOCS:
+		return obj_ops ? __atomic_load_n(&obj_ops->oo_nalloc,
+						 __ATOMIC_RELAXED) : 0;
+	case NL_CACHE_STAT_OBJ_LIVE:
+		return obj_ops ? __atomic_load_n(&obj_ops->oo_nalloc,
+						 __ATOMIC_RELAXED) -
+				 __atomic_load_n(&obj_ops->oo_nfree,
+						 __ATOMIC_RELAXED) : 0;
+	case NL_CACHE_STAT_HASH_SIZE:
+		return cache->hashtable ? cache->hashtable->size : 0;
+	case NL_CACHE_STAT_HASH_USED:
+	case NL_CACHE_STAT_HASH_MAX_CHAIN:
+		if (!cache->hashtable)
+			return 0;
+
+		for (i = 0; i < cache->hashtable->size; i++) {
+			n = 0;
+			for (node = cache->hashtable->nodes[i]; node;
+			     node = node->next)
+				n++;
+			if (n)
+				used++;
+			if (n > max)
+				max = n;
+		}
+
+		return id == NL_CACHE_STAT_HASH_USED ? used : max;
+	default:
+		return 0;
+	}
+}
+
+/** @cond SKIP */
+static const struct trans_tbl cache_stats[] = {
+	__ADD(NL_CACHE_STAT_OBJECTS, objects),
+	__ADD(NL_CACHE_STAT_ADDED, added),
+	__ADD(NL_CACHE_STAT_REMOVED, removed),
+	__ADD(NL_CACHE_STAT_RESYNCS, resyncs),
+	__ADD(NL_CACHE_STAT_MSGS_PARSED, msgs_parsed),
+	__ADD(NL_CACHE_STAT_PARSE_TIME, parse_time),
+	__ADD(NL_CACHE_STAT_OBJ_ALLOCS, obj_allocs),
+	__ADD(NL_CACHE_STAT_OBJ_LIVE, obj_live),
+	__ADD(NL_CACHE_STAT_HASH_SIZE, hash_size),
+	__ADD(NL_CACHE_STAT_HASH_USED, hash_used),
+	__ADD(NL_CACHE_STAT_HASH_MAX_CHAIN, hash_max_chain),
+};
+/** @endcond */
+
+char *nl_cache_stat2str(int st, char *buf, size_t len)
+{
+	return __type2str(st, buf, len, cache_stats, ARRAY_SIZE(cache_stats));
+}
+
+int nl_cache_str2stat(const char *name)
+{
+	return __str2type(name, cache_stats, ARRAY_SIZE(cache_stats));
+}
+
+/** @} */
+
 /** @} */
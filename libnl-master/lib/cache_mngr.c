@@ -37,12 +37,68 @@
 #include <netlink/netlink.h>
 #include <netlink/cache.h>
 #include <netlink/utils.h>
+#include <sys/eventfd.h>
 
 /** @cond SKIP */
 #define NASSOC_INIT		16
 #define NASSOC_EXPAND		8
+#define NBATCH_DEFAULT		32
+#define NRING_PER_BATCH		8
+#define NPENDING_INIT		64
+#define NPENDING_SCAN		64
+
+/*
+ * Single producer, single consumer ring of received datagrams. In
+ * threaded mode the reader thread is the producer and the thread
+ * calling nl_cache_mngr_data_ready() the consumer. Without a thread
+ * both run in the same context. A negative length marks a datagram
+ * lost to a socket overrun or truncation.
+ */
+struct nl_cache_mngr_ring {
+	unsigned int		r_size;
+	size_t			r_slot_size;
+	unsigned int		r_head;
+	unsigned int		r_tail;
+	unsigned char *		r_buf;
+	ssize_t *		r_len;
+	struct mmsghdr *	r_mmsg;
+	struct iovec *		r_iov;
+};
+
+/*
+ * Pending events are chained per hash bucket of their object, newest
+ * first, the bucket table having twice as many entries as cm_pending.
+ */
+struct nl_cache_mngr_event {
+	struct nl_cache_assoc *	ev_assoc;
+	struct nl_object *	ev_obj;
+	uint32_t		ev_bucket;
+	int			ev_next;
+};
+
+struct collect_xdata {
+	struct nl_cache_mngr *	mngr;
+	struct nl_cache_assoc *	assoc;
+};
 /** @endcond */
 
+static int mngr_include(struct nl_cache_assoc *ca, struct nl_object *obj)
+{
+	struct nl_cache_ops *ops = ca->ca_cache->c_ops;
+
+	if (ops->co_include_event)
+		return ops->co_include_event(ca->ca_cache, obj, ca->ca_change,
+					     ca->ca_change_v2,
+					     ca->ca_change_data);
+	else {
+		if (ca->ca_change_v2)
+			return nl_cache_include_v2(ca->ca_cache, obj, ca->ca_change_v2, ca->ca_change_data);
+		else
+			return nl_cache_include(ca->ca_cache, obj, ca->ca_change, ca->ca_change_data);
+	}
+
+}
+
 static int include_cb(struct nl_object *obj, struct nl_parser_param *p)
 {
 	struct nl_cache_assoc *ca = p->pp_arg;
@@ -58,17 +114,25 @@ static int include_cb(struct nl_object *obj, struct nl_parser_param *p)
 		if (ops->co_event_filter(ca->ca_cache, obj) != NL_OK)
 			return 0;
 
-	if (ops->co_include_event)
-		return ops->co_include_event(ca->ca_cache, obj, ca->ca_change,
-					     ca->ca_change_v2,
-					     ca->ca_change_data);
-	else {
-		if (ca->ca_change_v2)
-			return nl_cache_include_v2(ca->ca_cache, obj, ca->ca_change_v2, ca->ca_change_data);
-		else
-			return nl_cache_include(ca->ca_cache, obj, ca->ca_change, ca->ca_change_data);
+	return mngr_include(ca, obj);
+}
+
+static struct nl_cache_assoc *mngr_assoc_lookup(struct nl_cache_mngr *mngr,
+						int type)
+{
+	struct nl_cache_ops *ops;
+	int i, n;
+
+	for (i = 0; i < mngr->cm_nassocs; i++) {
+		if (mngr->cm_assocs[i].ca_cache) {
+			ops = mngr->cm_assocs[i].ca_cache->c_ops;
+			for (n = 0; ops->co_msgtypes[n].mt_id >= 0; n++)
+				if (ops->co_msgtypes[n].mt_id == type)
+					return &mngr->cm_assocs[i];
+		}
 	}
 
+	return NULL;
 }
 
 static int event_input(struct nl_msg *msg, void *arg)
@@ -76,8 +140,7 @@ static int event_input(struct nl_msg *msg, void *arg)
 	struct nl_cache_mngr *mngr = arg;
 	int protocol = nlmsg_get_proto(msg);
 	int type = nlmsg_hdr(msg)->nlmsg_type;
-	struct nl_cache_ops *ops;
-	int i, n;
+	struct nl_cache_assoc *ca;
 	struct nl_parser_param p = {
 		.pp_cb = include_cb,
 	};
@@ -92,23 +155,436 @@ static int event_input(struct nl_msg *msg, void *arg)
 	if (mngr->cm_protocol != protocol)
 		BUG();
 
+	if (!(ca = mngr_assoc_lookup(mngr, type)))
+		return NL_SKIP;
+
+	NL_DBG(2, "Associated message %p to cache %p\n", msg, ca->ca_cache);
+	p.pp_arg = ca;
+
+	return nl_cache_parse(ca->ca_cache->c_ops, NULL, nlmsg_hdr(msg), &p);
+}
+
+static void mngr_discard_pending(struct nl_cache_mngr *mngr)
+{
+	int i;
+
+	for (i = 0; i < mngr->cm_npending; i++) {
+		nl_object_put(mngr->cm_pending[i].ev_obj);
+		mngr->cm_pending_hash[mngr->cm_pending[i].ev_bucket] = -1;
+	}
+
+	mngr->cm_npending = 0;
+}
+
+/*
+ * Discard all notifications queued on the socket after an overrun.
+ * They predate the resync dump and would otherwise be applied on top
+ * of it, reverting the cache to a stale state.
+ */
+static void mngr_flush_sock(struct nl_cache_mngr *mngr)
+{
+	char buf;
+
+	while (recv(nl_socket_get_fd(mngr->cm_sock), &buf, sizeof(buf),
+		    MSG_DONTWAIT | MSG_TRUNC) >= 0 || errno == EINTR)
+		;
+}
+
+/* Resynchronize all caches after notifications have been lost */
+static int mngr_resync(struct nl_cache_mngr *mngr)
+{
+	struct nl_cache_assoc *ca;
+	int i, err;
+
 	for (i = 0; i < mngr->cm_nassocs; i++) {
-		if (mngr->cm_assocs[i].ca_cache) {
-			ops = mngr->cm_assocs[i].ca_cache->c_ops;
-			for (n = 0; ops->co_msgtypes[n].mt_id >= 0; n++)
-				if (ops->co_msgtypes[n].mt_id == type)
-					goto found;
+		ca = &mngr->cm_assocs[i];
+		if (!ca->ca_cache)
+			continue;
+
+		NL_DBG(1, "Cache manager %p, resyncing cache %p <%s>\n",
+		       mngr, ca->ca_cache, nl_cache_name(ca->ca_cache));
+
+		if (ca->ca_change_v2)
+			err = nl_cache_resync_v2(mngr->cm_sync_sock,
+						 ca->ca_cache,
+						 ca->ca_change_v2,
+						 ca->ca_change_data);
+		else
+			err = nl_cache_resync(mngr->cm_sync_sock, ca->ca_cache,
+					      ca->ca_change,
+					      ca->ca_change_data);
+		if (err < 0)
+			return err;
+	}
+
+	mngr->cm_resyncs++;
+
+	return 0;
+}
+
+static uint32_t mngr_pending_bucket(struct nl_cache_mngr *mngr,
+				    struct nl_object *obj)
+{
+	uint32_t key;
+
+	nl_object_keygen(obj, &key, 2 * mngr->cm_pending_size);
+
+	return key;
+}
+
+static int mngr_pending_grow(struct nl_cache_mngr *mngr)
+{
+	unsigned int size = mngr->cm_pending_size * 2 ? : NPENDING_INIT;
+	struct nl_cache_mngr_event *ev;
+	int *hash;
+	int i;
+
+	ev = realloc(mngr->cm_pending, size * sizeof(*ev));
+	if (!ev)
+		return -NLE_NOMEM;
+	mngr->cm_pending = ev;
+
+	hash = realloc(mngr->cm_pending_hash, 2 * size * sizeof(*hash));
+	if (!hash)
+		return -NLE_NOMEM;
+	mngr->cm_pending_hash = hash;
+	mngr->cm_pending_size = size;
+
+	/* Rehash, oldest first so that chains stay newest first */
+	memset(hash, 0xff, 2 * size * sizeof(*hash));
+	for (i = 0; i < mngr->cm_npending; i++) {
+		ev = &mngr->cm_pending[i];
+		if (!ev->ev_obj)
+			continue;
+		ev->ev_bucket = mngr_pending_bucket(mngr, ev->ev_obj);
+		ev->ev_next = hash[ev->ev_bucket];
+		hash[ev->ev_bucket] = i;
+	}
+
+	return 0;
+}
+
+/*
+ * Whether including an event into the cache replaces the cached object
+ * rather than merging into it, i.e. whether the type refuses to merge
+ * the event into a copy of its object as an addition. The outcome of
+ * such an event does not depend on the events before it.
+ */
+static int mngr_event_alone(struct nl_cache_ops *ops, struct nl_object *obj)
+{
+	struct nl_object *old, *new;
+	int i, alone = 0;
+
+	if (!obj->ce_ops->oo_update)
+		return 1;
+
+	old = nl_object_clone(obj);
+	new = nl_object_clone(obj);
+	if (old && new) {
+		for (i = 0; ops->co_msgtypes[i].mt_id >= 0; i++) {
+			if (ops->co_msgtypes[i].mt_act == NL_ACT_NEW) {
+				new->ce_msgtype = ops->co_msgtypes[i].mt_id;
+				break;
+			}
+		}
+		alone = nl_object_update(old, new) < 0;
+	}
+
+	nl_object_put(old);
+	nl_object_put(new);
+
+	return alone;
+}
+
+/*
+ * Queue a parsed event. An event which replaces the cached object makes
+ * all pending events for the same object redundant. One which merges
+ * into it through oo_update is merged into the pending event right away
+ * if that replaces the cached object, and the merged one would too.
+ * Object types which provide their own include handler see every event.
+ */
+static int collect_cb(struct nl_object *obj, struct nl_parser_param *p)
+{
+	struct collect_xdata *x = p->pp_arg;
+	struct nl_cache_mngr *mngr = x->mngr;
+	struct nl_cache_assoc *ca = x->assoc;
+	struct nl_cache_ops *ops = ca->ca_cache->c_ops;
+	struct nl_cache_mngr_event *ev, *prev = NULL;
+	struct nl_msgtype *mt;
+	struct nl_object *merged;
+	uint32_t bucket;
+	int i, n, err;
+
+	if (ops->co_event_filter)
+		if (ops->co_event_filter(ca->ca_cache, obj) != NL_OK)
+			return 0;
+
+	if (mngr->cm_npending >= mngr->cm_pending_size &&
+	    (err = mngr_pending_grow(mngr)) < 0)
+		return err;
+
+	bucket = mngr_pending_bucket(mngr, obj);
+
+	/* Newest first, a few events of the bucket are enough */
+	for (i = mngr->cm_pending_hash[bucket], n = 0;
+	     i >= 0 && n < NPENDING_SCAN && !ops->co_include_event;
+	     i = ev->ev_next, n++) {
+		ev = &mngr->cm_pending[i];
+		if (ev->ev_obj && ev->ev_assoc == ca &&
+		    nl_object_identical(ev->ev_obj, obj)) {
+			prev = ev;
+			break;
 		}
 	}
 
-	return NL_SKIP;
+	if (prev && mngr_event_alone(ops, obj)) {
+		for (; i >= 0 && n < NPENDING_SCAN; i = ev->ev_next, n++) {
+			ev = &mngr->cm_pending[i];
+			if (ev->ev_obj && ev->ev_assoc == ca &&
+			    nl_object_identical(ev->ev_obj, obj)) {
+				nl_object_put(ev->ev_obj);
+				ev->ev_obj = NULL;
+				mngr->cm_coalesced++;
+			}
+		}
+	} else if (prev &&
+		   (mt = nl_msgtype_lookup(ops, prev->ev_obj->ce_msgtype)) &&
+		   mt->mt_act == NL_ACT_NEW &&
+		   mngr_event_alone(ops, prev->ev_obj) &&
+		   (merged = nl_object_clone(prev->ev_obj))) {
+		if (nl_object_update(merged, obj) == 0 &&
+		    mngr_event_alone(ops, merged)) {
+			nl_object_put(prev->ev_obj);
+			prev->ev_obj = merged;
+			mngr->cm_coalesced++;
+			return 0;
+		}
+		nl_object_put(merged);
+	}
 
-found:
-	NL_DBG(2, "Associated message %p to cache %p\n",
-	       msg, mngr->cm_assocs[i].ca_cache);
-	p.pp_arg = &mngr->cm_assocs[i];
+	nl_object_get(obj);
+	ev = &mngr->cm_pending[mngr->cm_npending];
+	ev->ev_assoc = ca;
+	ev->ev_obj = obj;
+	ev->ev_bucket = bucket;
+	ev->ev_next = mngr->cm_pending_hash[bucket];
+	mngr->cm_pending_hash[bucket] = mngr->cm_npending++;
 
-	return nl_cache_parse(ops, NULL, nlmsg_hdr(msg), &p);
+	return 0;
+}
+
+static int mngr_apply_pending(struct nl_cache_mngr *mngr)
+{
+	struct nl_cache_mngr_event *ev;
+	int i, err = 0;
+
+	for (i = 0; i < mngr->cm_npending; i++) {
+		ev = &mngr->cm_pending[i];
+		if (!ev->ev_obj)
+			continue;
+
+		if (err >= 0)
+			err = mngr_include(ev->ev_assoc, ev->ev_obj);
+		nl_object_put(ev->ev_obj);
+	}
+
+	for (i = 0; i < mngr->cm_npending; i++)
+		mngr->cm_pending_hash[mngr->cm_pending[i].ev_bucket] = -1;
+	mngr->cm_npending = 0;
+
+	return err < 0 ? err : 0;
+}
+
+static int mngr_collect(struct nl_cache_mngr *mngr, void *buf, size_t len)
+{
+	struct nlmsghdr *nlh = buf;
+	struct collect_xdata x = {
+		.mngr = mngr,
+	};
+	struct nl_parser_param p = {
+		.pp_cb = collect_cb,
+		.pp_arg = &x,
+	};
+	int remaining = len, nmsgs = 0, err;
+
+	for (; nlmsg_ok(nlh, remaining); nlh = nlmsg_next(nlh, &remaining)) {
+		if (nlh->nlmsg_type < NLMSG_MIN_TYPE)
+			continue;
+
+		if (!(x.assoc = mngr_assoc_lookup(mngr, nlh->nlmsg_type)))
+			continue;
+
+		err = nl_cache_parse(x.assoc->ca_cache->c_ops, NULL, nlh, &p);
+		if (err < 0)
+			return err;
+
+		nmsgs++;
+	}
+
+	return nmsgs;
+}
+
+static struct nl_cache_mngr_ring *mngr_ring_alloc(unsigned int batch)
+{
+	struct nl_cache_mngr_ring *r;
+	unsigned int size = 1;
+
+	while (size < batch * NRING_PER_BATCH)
+		size <<= 1;
+
+	if (!(r = calloc(1, sizeof(*r))))
+		return NULL;
+
+	r->r_size = size;
+	r->r_slot_size = getpagesize() * 4;
+	r->r_buf = malloc(size * r->r_slot_size);
+	r->r_len = calloc(size, sizeof(*r->r_len));
+	r->r_mmsg = calloc(batch, sizeof(*r->r_mmsg));
+	r->r_iov = calloc(batch, sizeof(*r->r_iov));
+
+	if (!r->r_buf || !r->r_len || !r->r_mmsg || !r->r_iov) {
+		free(r->r_buf);
+		free(r->r_len);
+		free(r->r_mmsg);
+		free(r->r_iov);
+		free(r);
+		return NULL;
+	}
+
+	return r;
+}
+
+static void mngr_ring_free(struct nl_cache_mngr_ring *r)
+{
+	if (!r)
+		return;
+
+	free(r->r_buf);
+	free(r->r_len);
+	free(r->r_mmsg);
+	free(r->r_iov);
+	free(r);
+}
+
+static unsigned int mngr_ring_space(struct nl_cache_mngr_ring *r)
+{
+	unsigned int tail = __atomic_load_n(&r->r_tail, __ATOMIC_ACQUIRE);
+
+	return r->r_size - (r->r_head - tail);
+}
+
+/*
+ * Producer side: receive up to cm_batch datagrams with a single
+ * recvmmsg() directly into the free ring slots and publish them.
+ * Returns the number of slots published, 0 if no data was available
+ * or the ring is full.
+ */
+static int mngr_ring_fill(struct nl_cache_mngr *mngr)
+{
+	struct nl_cache_mngr_ring *r = mngr->cm_ring;
+	unsigned int head = r->r_head, n, i, slot;
+	int ret;
+
+	n = mngr_ring_space(r);
+	if (n > mngr->cm_batch)
+		n = mngr->cm_batch;
+	if (n == 0)
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		slot = (head + i) & (r->r_size - 1);
+		r->r_iov[i].iov_base = r->r_buf + slot * r->r_slot_size;
+		r->r_iov[i].iov_len = r->r_slot_size;
+		memset(&r->r_mmsg[i], 0, sizeof(r->r_mmsg[i]));
+		r->r_mmsg[i].msg_hdr.msg_iov = &r->r_iov[i];
+		r->r_mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+retry:
+	ret = recvmmsg(nl_socket_get_fd(mngr->cm_sock), r->r_mmsg, n,
+		       MSG_DONTWAIT, NULL);
+	if (ret < 0) {
+		if (errno == EINTR)
+			goto retry;
+
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+
+		if (errno != ENOBUFS) {
+			NL_DBG(4, "Cache manager %p, recvmmsg() failed with %d (%s)\n",
+			       mngr, errno, nl_strerror_l(errno));
+			return -nl_syserr2nlerr(errno);
+		}
+
+		NL_DBG(1, "Cache manager %p, socket overrun\n", mngr);
+		__atomic_add_fetch(&mngr->cm_overruns, 1, __ATOMIC_RELAXED);
+		mngr_flush_sock(mngr);
+		r->r_len[head & (r->r_size - 1)] = -1;
+		ret = 1;
+	} else {
+		for (i = 0; i < ret; i++) {
+			slot = (head + i) & (r->r_size - 1);
+			r->r_len[slot] = r->r_mmsg[i].msg_len;
+
+			if (r->r_mmsg[i].msg_hdr.msg_flags & MSG_TRUNC) {
+				NL_DBG(1, "Cache manager %p, truncated event\n",
+				       mngr);
+				__atomic_add_fetch(&mngr->cm_overruns, 1,
+						   __ATOMIC_RELAXED);
+				r->r_len[slot] = -1;
+			}
+		}
+	}
+
+	__atomic_store_n(&r->r_head, head + ret, __ATOMIC_RELEASE);
+
+	return ret;
+}
+
+/*
+ * Consumer side: parse all published datagrams and apply the
+ * coalesced events. Events collected before a lost datagram are
+ * dropped, the caches are resynced after applying the rest.
+ */
+static int mngr_ring_drain(struct nl_cache_mngr *mngr)
+{
+	struct nl_cache_mngr_ring *r = mngr->cm_ring;
+	unsigned int head, tail = r->r_tail, slot;
+	int nmsgs = 0, lost = 0, err = 0;
+
+	head = __atomic_load_n(&r->r_head, __ATOMIC_ACQUIRE);
+
+	for (; tail != head; tail++) {
+		slot = tail & (r->r_size - 1);
+		if (r->r_len[slot] < 0) {
+			mngr_discard_pending(mngr);
+			lost = 1;
+			continue;
+		}
+
+		if (err < 0)
+			continue;
+
+		err = mngr_collect(mngr, r->r_buf + slot * r->r_slot_size,
+				   r->r_len[slot]);
+		if (err > 0)
+			nmsgs += err;
+	}
+
+	__atomic_store_n(&r->r_tail, tail, __ATOMIC_RELEASE);
+
+	if (err < 0) {
+		mngr_discard_pending(mngr);
+		return err;
+	}
+
+	if ((err = mngr_apply_pending(mngr)) < 0)
+		return err;
+
+	if (lost && (err = mngr_resync(mngr)) < 0)
+		return err;
+
+	return nmsgs;
 }
 
 /**
@@ -164,6 +640,8 @@ int nl_cache_mngr_alloc(struct nl_sock *sk, int protocol, int flags,
 	mngr->cm_nassocs = NASSOC_INIT;
 	mngr->cm_protocol = protocol;
 	mngr->cm_flags = flags;
+	mngr->cm_event_fd = -1;
+	mngr->cm_stop_fd = -1;
 	mngr->cm_assocs = calloc(mngr->cm_nassocs,
 				 sizeof(struct nl_cache_assoc));
 	if (!mngr->cm_assocs)
@@ -178,6 +656,13 @@ int nl_cache_mngr_alloc(struct nl_sock *sk, int protocol, int flags,
 	if ((err = nl_socket_set_nonblocking(mngr->cm_sock)) < 0)
 		goto errout;
 
+	mngr->cm_cb = nl_cb_clone(mngr->cm_sock->s_cb);
+	if (!mngr->cm_cb) {
+		err = -NLE_NOMEM;
+		goto errout;
+	}
+	nl_cb_set(mngr->cm_cb, NL_CB_VALID, NL_CB_CUSTOM, event_input, mngr);
+
 	/* Create and allocate socket for sync cache fills */
 	mngr->cm_sync_sock = nl_socket_alloc();
 	if (!mngr->cm_sync_sock) {
@@ -465,9 +950,247 @@ errout_free_cache:
  */
 int nl_cache_mngr_get_fd(struct nl_cache_mngr *mngr)
 {
+	if (mngr->cm_thread_running)
+		return mngr->cm_event_fd;
+
 	return nl_socket_get_fd(mngr->cm_sock);
 }
 
+/**
+ * Set receive buffer size of the notification socket
+ * @arg mngr		Cache manager
+ * @arg rxbuf		Receive buffer size in bytes
+ *
+ * Notifications arriving while the receive buffer is full are dropped
+ * by the kernel and force the manager to resynchronize all caches. A
+ * large buffer absorbs event bursts such as route flaps. The size is
+ * forced beyond \c rmem_max if the process has \c CAP_NET_ADMIN.
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nl_cache_mngr_set_bufsize(struct nl_cache_mngr *mngr, int rxbuf)
+{
+	int fd = nl_socket_get_fd(mngr->cm_sock);
+
+	if (rxbuf <= 0)
+		return -NLE_INVAL;
+
+	if (fd == -1)
+		return -NLE_BAD_SOCK;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE,
+		       &rxbuf, sizeof(rxbuf)) == 0)
+		return 0;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rxbuf, sizeof(rxbuf)) < 0) {
+		NL_DBG(4, "nl_cache_mngr_set_bufsize(%p): setsockopt() failed with %d (%s)\n",
+			mngr, errno, nl_strerror_l(errno));
+		return -nl_syserr2nlerr(errno);
+	}
+
+	return 0;
+}
+
+/**
+ * Enable batched event processing
+ * @arg mngr		Cache manager
+ * @arg batch		Maximum number of datagrams per receive call, 0 to disable
+ *
+ * In batched mode nl_cache_mngr_data_ready() drains the socket with
+ * recvmmsg(), reading up to \p batch datagrams per system call. All
+ * events received are parsed first, repeated events for the same
+ * object are coalesced and only the most recent one is applied to
+ * the cache. Object types which merge partial updates (e.g. IPv6
+ * multipath routes) are never coalesced.
+ *
+ * Datagrams lost to a socket overrun or truncated because they
+ * exceed the receive slot size cause all caches to be resynced.
+ *
+ * The batch size cannot be changed while the reader thread is running.
+ *
+ * @see nl_cache_mngr_start_thread()
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nl_cache_mngr_set_batch(struct nl_cache_mngr *mngr, unsigned int batch)
+{
+	struct nl_cache_mngr_ring *ring = NULL;
+
+	if (mngr->cm_thread_running)
+		return -NLE_BUSY;
+
+	if (batch && !(ring = mngr_ring_alloc(batch)))
+		return -NLE_NOMEM;
+
+	mngr_ring_free(mngr->cm_ring);
+	mngr->cm_ring = ring;
+	mngr->cm_batch = batch;
+
+	return 0;
+}
+
+#ifndef DISABLE_PTHREADS
+static void *mngr_reader(void *arg)
+{
+	struct nl_cache_mngr *mngr = arg;
+	struct pollfd fds[2] = {
+		{ .fd = nl_socket_get_fd(mngr->cm_sock), .events = POLLIN },
+		{ .fd = mngr->cm_stop_fd, .events = POLLIN },
+	};
+	uint64_t one = 1;
+	int n, nfill;
+
+	for (;;) {
+		/*
+		 * If the consumer falls behind and the ring is full,
+		 * only wait for the stop signal and check again shortly.
+		 * The socket buffer keeps absorbing events meanwhile.
+		 */
+		if (mngr_ring_space(mngr->cm_ring) == 0)
+			n = poll(&fds[1], 1, 1);
+		else
+			n = poll(fds, 2, -1);
+
+		if (n < 0 && errno != EINTR)
+			break;
+
+		if (fds[1].revents)
+			break;
+
+		nfill = 0;
+		while ((n = mngr_ring_fill(mngr)) > 0)
+			nfill += n;
+
+		if (nfill && write(mngr->cm_event_fd, &one, sizeof(one)) < 0)
+			NL_DBG(1, "Cache manager %p, unable to signal events\n",
+			       mngr);
+
+		if (n < 0) {
+			NL_DBG(1, "Cache manager %p, reader stopped: %s\n",
+			       mngr, nl_geterror(n));
+			break;
+		}
+	}
+
+	return NULL;
+}
+#endif
+
+/**
+ * Receive notifications in a dedicated thread
+ * @arg mngr		Cache manager
+ *
+ * Starts a thread which does nothing but drain the notification socket
+ * into a lock-free ring buffer, minimizing the risk of socket overruns
+ * while the application is busy. Enables batched mode with a default
+ * batch size if nl_cache_mngr_set_batch() has not been called.
+ *
+ * The caches are still only modified by nl_cache_mngr_data_ready()
+ * in the context of the caller. While the thread is running,
+ * nl_cache_mngr_get_fd() returns an eventfd which becomes readable
+ * when events are waiting to be processed.
+ *
+ * @see nl_cache_mngr_stop_thread()
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nl_cache_mngr_start_thread(struct nl_cache_mngr *mngr)
+{
+#ifndef DISABLE_PTHREADS
+	int err;
+
+	if (mngr->cm_thread_running)
+		return -NLE_BUSY;
+
+	if (!mngr->cm_ring &&
+	    (err = nl_cache_mngr_set_batch(mngr, NBATCH_DEFAULT)) < 0)
+		return err;
+
+	mngr->cm_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	mngr->cm_stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (mngr->cm_event_fd < 0 || mngr->cm_stop_fd < 0) {
+		err = -nl_syserr2nlerr(errno);
+		goto errout;
+	}
+
+	if ((err = pthread_create(&mngr->cm_thread, NULL, mngr_reader, mngr))) {
+		err = -nl_syserr2nlerr(err);
+		goto errout;
+	}
+
+	mngr->cm_thread_running = 1;
+
+	NL_DBG(1, "Cache manager %p, started reader thread\n", mngr);
+
+	return 0;
+
+errout:
+	if (mngr->cm_event_fd >= 0)
+		close(mngr->cm_event_fd);
+	if (mngr->cm_stop_fd >= 0)
+		close(mngr->cm_stop_fd);
+	mngr->cm_event_fd = mngr->cm_stop_fd = -1;
+
+	return err;
+#else
+	return -NLE_OPNOTSUPP;
+#endif
+}
+
+/**
+ * Stop the notification reader thread
+ * @arg mngr		Cache manager
+ *
+ * Stops the thread started by nl_cache_mngr_start_thread(). Events
+ * already received remain queued and are processed by the next call
+ * to nl_cache_mngr_data_ready().
+ */
+void nl_cache_mngr_stop_thread(struct nl_cache_mngr *mngr)
+{
+#ifndef DISABLE_PTHREADS
+	uint64_t one = 1;
+
+	if (!mngr->cm_thread_running)
+		return;
+
+	if (write(mngr->cm_stop_fd, &one, sizeof(one)) < 0)
+		BUG();
+
+	pthread_join(mngr->cm_thread, NULL);
+	mngr->cm_thread_running = 0;
+
+	close(mngr->cm_event_fd);
+	close(mngr->cm_stop_fd);
+	mngr->cm_event_fd = mngr->cm_stop_fd = -1;
+
+	NL_DBG(1, "Cache manager %p, stopped reader thread\n", mngr);
+#endif
+}
+
+/**
+ * Return number of socket overruns
+ * @arg mngr		Cache manager
+ *
+ * @return Number of times notifications were lost because the socket
+ *         receive buffer overflowed or an event was truncated.
+ */
+uint64_t nl_cache_mngr_get_overruns(struct nl_cache_mngr *mngr)
+{
+	return __atomic_load_n(&mngr->cm_overruns, __ATOMIC_RELAXED);
+}
+
+/**
+ * Return number of cache resyncs
+ * @arg mngr		Cache manager
+ *
+ * @return Number of times the manager resynchronized its caches with
+ *         a full dump to recover from lost notifications.
+ */
+uint64_t nl_cache_mngr_get_resyncs(struct nl_cache_mngr *mngr)
+{
+	return mngr->cm_resyncs;
+}
+
 /**
  * Check for event notifications
  * @arg mngr		Cache Manager
@@ -491,7 +1214,7 @@ int nl_cache_mngr_poll(struct nl_cache_mngr *mngr, int timeout)
 {
 	int ret;
 	struct pollfd fds = {
-		.fd = nl_socket_get_fd(mngr->cm_sock),
+		.fd = nl_cache_mngr_get_fd(mngr),
 		.events = POLLIN,
 	};
 
@@ -529,24 +1252,52 @@ int nl_cache_mngr_poll(struct nl_cache_mngr *mngr, int timeout)
 int nl_cache_mngr_data_ready(struct nl_cache_mngr *mngr)
 {
 	int err, nread = 0;
-	struct nl_cb *cb;
+	uint64_t cnt;
 
 	NL_DBG(2, "Cache manager %p, reading new data from fd %d\n",
 	       mngr, nl_socket_get_fd(mngr->cm_sock));
 
-	cb = nl_cb_clone(mngr->cm_sock->s_cb);
-	if (cb == NULL)
-		return -NLE_NOMEM;
+	if (mngr->cm_thread_running) {
+		/* Clear the event counter before looking at the ring */
+		if (read(mngr->cm_event_fd, &cnt, sizeof(cnt)) < 0 &&
+		    errno != EAGAIN)
+			return -nl_syserr2nlerr(errno);
+
+		return mngr_ring_drain(mngr);
+	}
+
+	if (mngr->cm_ring) {
+		while ((err = mngr_ring_fill(mngr)) > 0) {
+			if ((err = mngr_ring_drain(mngr)) < 0)
+				return err;
+			nread += err;
+		}
+
+		return err < 0 ? err : nread;
+	}
 
-	nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, event_input, mngr);
+	for (;;) {
+		err = nl_recvmsgs_report(mngr->cm_sock, mngr->cm_cb);
+		if (err > 0) {
+			NL_DBG(2, "Cache manager %p, recvmsgs read %d messages\n",
+			       mngr, err);
+			nread += err;
+			continue;
+		}
+
+		/* ENOBUFS is reported as -NLE_NOMEM, tell them apart */
+		if (err == -NLE_NOMEM && errno == ENOBUFS) {
+			NL_DBG(1, "Cache manager %p, socket overrun\n", mngr);
+			mngr->cm_overruns++;
+			mngr_flush_sock(mngr);
+			if ((err = mngr_resync(mngr)) < 0)
+				return err;
+			continue;
+		}
 
-	while ((err = nl_recvmsgs_report(mngr->cm_sock, cb)) > 0) {
-		NL_DBG(2, "Cache manager %p, recvmsgs read %d messages\n",
-		       mngr, err);
-		nread += err;
+		break;
 	}
 
-	nl_cb_put(cb);
 	if (err < 0 && err != -NLE_AGAIN)
 		return err;
 
@@ -573,6 +1324,13 @@ void nl_cache_mngr_info(struct nl_cache_mngr *mngr, struct nl_dump_params *p)
 	nl_dump_line(p, "  .flags    = %#x\n", mngr->cm_flags);
 	nl_dump_line(p, "  .nassocs  = %u\n", mngr->cm_nassocs);
 	nl_dump_line(p, "  .sock     = <%p>\n", mngr->cm_sock);
+	nl_dump_line(p, "  .batch    = %u\n", mngr->cm_batch);
+	nl_dump_line(p, "  .thread   = %s\n",
+		     mngr->cm_thread_running ? "running" : "none");
+	nl_dump_line(p, "  .overruns = %" PRIu64 "\n",
+		     nl_cache_mngr_get_overruns(mngr));
+	nl_dump_line(p, "  .resyncs  = %" PRIu64 "\n", mngr->cm_resyncs);
+	nl_dump_line(p, "  .coalesced = %" PRIu64 "\n", mngr->cm_coalesced);
 
 	for (i = 0; i < mngr->cm_nassocs; i++) {
 		struct nl_cache_assoc *assoc = &mngr->cm_assocs[i];
@@ -608,6 +1366,8 @@ void nl_cache_mngr_free(struct nl_cache_mngr *mngr)
 	if (!mngr)
 		return;
 
+	nl_cache_mngr_stop_thread(mngr);
+
 	if (mngr->cm_sock)
 		nl_close(mngr->cm_sock);
 
@@ -626,7 +1386,13 @@ void nl_cache_mngr_free(struct nl_cache_mngr *mngr)
 		}
 	}
 
+	mngr_discard_pending(mngr);
+
 	free(mngr->cm_assocs);
+	free(mngr->cm_pending);
+	free(mngr->cm_pending_hash);
+	mngr_ring_free(mngr->cm_ring);
+	nl_cb_put(mngr->cm_cb);
 
 	NL_DBG(1, "Cache manager %p freed\n", mngr);
 
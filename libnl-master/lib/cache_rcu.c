@@ -0,0 +1,547 @@
+/*
+ * lib/cache_rcu.c	Concurrent Cache Readers
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+/**
+ * @ingroup cache
+ * @defgroup cache_rcu Concurrent Readers
+ * @brief Lock-free lookups from multiple threads
+ *
+ * Caches are not thread safe, any access must be serialized by the
+ * application. For read-mostly workloads with a single writer, e.g.
+ * a cache manager thread applying kernel notifications while many
+ * threads look up objects, a cache can be switched into concurrent
+ * mode with nl_cache_set_concurrent().
+ *
+ * In concurrent mode the cache maintains a second, read-only index
+ * holding immutable copies of all objects. The writer keeps using the
+ * regular cache API, every addition, removal or update is published
+ * to the index. Readers never block the writer or each other:
+ *
+ * @code
+ * struct nl_cache_reader *reader = nl_cache_reader_alloc(cache);
+ *
+ * nl_cache_read_lock(reader);
+ * obj = nl_cache_search_rcu(reader, needle);
+ * if (obj)
+ * 	use(rtnl_route_get_table((struct rtnl_route *) obj));
+ * nl_cache_read_unlock(reader);
+ *
+ * nl_cache_reader_free(reader);
+ * @endcode
+ *
+ * Objects returned by the read side are borrowed. They stay valid
+ * until nl_cache_read_unlock() and must not be modified, referenced
+ * with nl_object_get() or cloned. Copy out whatever is needed beyond
+ * the read side critical section.
+ *
+ * Memory of removed objects is reclaimed by the writer using epoch
+ * based reclamation once no reader can hold a reference anymore.
+ * Each reading thread needs its own reader handle.
+ *
+ * @{
+ *
+ * Header
+ * ------
+ * ~~~~{.c}
+ * #include <netlink/cache.h>
+ * ~~~~
+ */
+
+#include <netlink-private/netlink.h>
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/object.h>
+
+/** @cond SKIP */
+#define RCU_MIN_BUCKETS		256
+
+struct nl_rcu_node {
+	struct nl_rcu_node *	n_next;
+	struct nl_object *	n_obj;
+};
+
+struct nl_rcu_table {
+	uint32_t		t_size;
+	struct nl_rcu_node *	t_buckets[0];
+};
+
+struct nl_rcu_garbage {
+	struct nl_rcu_garbage *	g_next;
+	uint64_t		g_epoch;
+	void *			g_ptr;
+	struct nl_object *	g_obj;
+};
+
+struct nl_cache_reader {
+	struct nl_cache_rcu *	r_rcu;
+	uint64_t		r_epoch;
+	struct nl_cache_reader *r_next;
+};
+
+struct nl_cache_rcu {
+	struct nl_rcu_table *	cr_table;
+	uint32_t		cr_nitems;
+	int			cr_hashed;
+	uint64_t		cr_epoch;
+	struct nl_rcu_garbage *	cr_garbage;
+	struct nl_cache_reader *cr_readers;
+#ifndef DISABLE_PTHREADS
+	pthread_mutex_t		cr_readers_lock;
+#endif
+};
+/** @endcond */
+
+static struct nl_rcu_table *rcu_table_alloc(uint32_t size)
+{
+	struct nl_rcu_table *t;
+
+	t = calloc(1, sizeof(*t) + size * sizeof(t->t_buckets[0]));
+	if (t)
+		t->t_size = size;
+
+	return t;
+}
+
+static uint32_t rcu_bucket(struct nl_rcu_table *t, struct nl_object *obj)
+{
+	uint32_t key;
+
+	nl_object_keygen(obj, &key, t->t_size);
+
+	return key;
+}
+
+static void rcu_retire(struct nl_cache_rcu *rcu, void *ptr,
+		       struct nl_object *obj)
+{
+	struct nl_rcu_garbage *g;
+
+	/*
+	 * Without memory to track it, the garbage is leaked rather than
+	 * freed early under a reader's feet.
+	 */
+	if (!(g = malloc(sizeof(*g))))
+		return;
+
+	g->g_epoch = rcu->cr_epoch;
+	g->g_ptr = ptr;
+	g->g_obj = obj;
+	g->g_next = rcu->cr_garbage;
+	rcu->cr_garbage = g;
+
+	__atomic_store_n(&rcu->cr_epoch, rcu->cr_epoch + 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Free all garbage retired before the oldest epoch any reader is
+ * currently in. The fence pairs with the one in nl_cache_read_lock():
+ * either the reader announced its epoch before we scan, or it will
+ * not find the unlinked nodes.
+ */
+static void rcu_reclaim(struct nl_cache_rcu *rcu)
+{
+	struct nl_rcu_garbage *g, **pp;
+	struct nl_cache_reader *r;
+	uint64_t oldest = UINT64_MAX, e;
+
+	if (!rcu->cr_garbage)
+		return;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	nl_lock(&rcu->cr_readers_lock);
+	for (r = rcu->cr_readers; r; r = r->r_next) {
+		e = __atomic_load_n(&r->r_epoch, __ATOMIC_SEQ_CST);
+		if (e && e - 1 < oldest)
+			oldest = e - 1;
+	}
+	nl_unlock(&rcu->cr_readers_lock);
+
+	pp = &rcu->cr_garbage;
+	while ((g = *pp)) {
+		if (g->g_epoch < oldest) {
+			*pp = g->g_next;
+			free(g->g_ptr);
+			nl_object_put(g->g_obj);
+			free(g);
+		} else
+			pp = &g->g_next;
+	}
+}
+
+/*
+ * Grow the index once chains get long. The new table is built from
+ * fresh nodes pointing to the same immutable objects and published
+ * atomically, the old table and its nodes are retired as a whole.
+ */
+static void rcu_resize(struct nl_cache_rcu *rcu)
+{
+	struct nl_rcu_table *old = rcu->cr_table, *new;
+	struct nl_rcu_node *n, *copy, *next;
+	uint32_t i, b;
+
+	if (!(new = rcu_table_alloc(old->t_size * 2)))
+		return;
+
+	for (i = 0; i < old->t_size; i++) {
+		for (n = old->t_buckets[i]; n; n = n->n_next) {
+			if (!(copy = malloc(sizeof(*copy))))
+				goto errout;
+
+			b = rcu_bucket(new, n->n_obj);
+			copy->n_obj = n->n_obj;
+			copy->n_next = new->t_buckets[b];
+			new->t_buckets[b] = copy;
+		}
+	}
+
+	__atomic_store_n(&rcu->cr_table, new, __ATOMIC_RELEASE);
+
+	for (i = 0; i < old->t_size; i++)
+		for (n = old->t_buckets[i]; n; n = n->n_next)
+			rcu_retire(rcu, n, NULL);
+	rcu_retire(rcu, old, NULL);
+
+	NL_DBG(2, "Resized concurrent index to %u buckets\n", new->t_size);
+	return;
+
+errout:
+	for (i = 0; i < new->t_size; i++) {
+		for (n = new->t_buckets[i]; n; n = next) {
+			next = n->n_next;
+			free(n);
+		}
+	}
+	free(new);
+}
+
+/** @cond SKIP */
+int __nl_cache_rcu_add(struct nl_cache *cache, struct nl_object *obj)
+{
+	struct nl_cache_rcu *rcu = cache->c_rcu;
+	struct nl_rcu_table *t = rcu->cr_table;
+	struct nl_rcu_node *n;
+	uint32_t b;
+
+	if (!(n = malloc(sizeof(*n))))
+		return -NLE_NOMEM;
+
+	if (!(n->n_obj = nl_object_clone(obj))) {
+		free(n);
+		return -NLE_NOMEM;
+	}
+
+	b = rcu_bucket(t, n->n_obj);
+	n->n_next = t->t_buckets[b];
+	__atomic_store_n(&t->t_buckets[b], n, __ATOMIC_RELEASE);
+
+	if (++rcu->cr_nitems > 2 * t->t_size && rcu->cr_hashed)
+		rcu_resize(rcu);
+
+	rcu_reclaim(rcu);
+
+	return 0;
+}
+
+void __nl_cache_rcu_del(struct nl_cache *cache, struct nl_object *obj)
+{
+	struct nl_cache_rcu *rcu = cache->c_rcu;
+	struct nl_rcu_table *t = rcu->cr_table;
+	struct nl_rcu_node *n, **pp;
+
+	pp = &t->t_buckets[rcu_bucket(t, obj)];
+	while ((n = *pp)) {
+		if (nl_object_identical(n->n_obj, obj)) {
+			__atomic_store_n(pp, n->n_next, __ATOMIC_RELEASE);
+			rcu->cr_nitems--;
+			rcu_retire(rcu, n, n->n_obj);
+			break;
+		}
+		pp = &n->n_next;
+	}
+
+	rcu_reclaim(rcu);
+}
+
+/*
+ * Publish the new state of an object updated in place by swapping in
+ * a fresh copy, readers see either the old or the new version.
+ */
+int __nl_cache_rcu_update(struct nl_cache *cache, struct nl_object *obj)
+{
+	struct nl_cache_rcu *rcu = cache->c_rcu;
+	struct nl_rcu_table *t = rcu->cr_table;
+	struct nl_rcu_node *n, *new, **pp;
+
+	pp = &t->t_buckets[rcu_bucket(t, obj)];
+	for (n = *pp; n; pp = &n->n_next, n = *pp)
+		if (nl_object_identical(n->n_obj, obj))
+			break;
+
+	if (!n)
+		return __nl_cache_rcu_add(cache, obj);
+
+	if (!(new = malloc(sizeof(*new))))
+		return -NLE_NOMEM;
+
+	if (!(new->n_obj = nl_object_clone(obj))) {
+		free(new);
+		return -NLE_NOMEM;
+	}
+
+	new->n_next = n->n_next;
+	__atomic_store_n(pp, new, __ATOMIC_RELEASE);
+	rcu_retire(rcu, n, n->n_obj);
+	rcu_reclaim(rcu);
+
+	return 0;
+}
+
+void __nl_cache_rcu_free(struct nl_cache *cache)
+{
+	struct nl_cache_rcu *rcu = cache->c_rcu;
+	struct nl_rcu_garbage *g, *gnext;
+	struct nl_rcu_node *n, *next;
+	uint32_t i;
+
+	if (!rcu)
+		return;
+
+	if (rcu->cr_readers)
+		APPBUG("Cache freed with concurrent readers attached");
+
+	for (i = 0; i < rcu->cr_table->t_size; i++) {
+		for (n = rcu->cr_table->t_buckets[i]; n; n = next) {
+			next = n->n_next;
+			nl_object_put(n->n_obj);
+			free(n);
+		}
+	}
+
+	for (g = rcu->cr_garbage; g; g = gnext) {
+		gnext = g->g_next;
+		free(g->g_ptr);
+		nl_object_put(g->g_obj);
+		free(g);
+	}
+
+	free(rcu->cr_table);
+#ifndef DISABLE_PTHREADS
+	pthread_mutex_destroy(&rcu->cr_readers_lock);
+#endif
+	free(rcu);
+	cache->c_rcu = NULL;
+}
+/** @endcond */
+
+/**
+ * @name Writer
+ * @{
+ */
+
+/**
+ * Enable concurrent readers on a cache
+ * @arg cache		Cache
+ *
+ * Builds the read-only index from the current content of the cache.
+ * From this point on, any modification of the cache is published to
+ * readers. The cache must be modified by a single thread only.
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nl_cache_set_concurrent(struct nl_cache *cache)
+{
+#ifndef DISABLE_PTHREADS
+	struct nl_cache_rcu *rcu;
+	struct nl_object *obj;
+	uint32_t size = RCU_MIN_BUCKETS;
+	int err;
+
+	if (cache->c_rcu)
+		return 0;
+
+	if (!(rcu = calloc(1, sizeof(*rcu))))
+		return -NLE_NOMEM;
+
+	while (size < cache->c_nitems)
+		size <<= 1;
+
+	if (!(rcu->cr_table = rcu_table_alloc(size))) {
+		free(rcu);
+		return -NLE_NOMEM;
+	}
+
+	pthread_mutex_init(&rcu->cr_readers_lock, NULL);
+	rcu->cr_hashed = !!cache->c_ops->co_obj_ops->oo_keygen;
+	rcu->cr_epoch = 1;
+	cache->c_rcu = rcu;
+
+	nl_list_for_each_entry(obj, &cache->c_items, ce_list) {
+		if ((err = __nl_cache_rcu_add(cache, obj)) < 0) {
+			__nl_cache_rcu_free(cache);
+			return err;
+		}
+	}
+
+	NL_DBG(2, "Enabled concurrent readers for cache %p <%s>\n",
+	       cache, nl_cache_name(cache));
+
+	return 0;
+#else
+	return -NLE_OPNOTSUPP;
+#endif
+}
+
+/** @} */
+
+/**
+ * @name Readers
+ * @{
+ */
+
+/**
+ * Allocate a reader handle
+ * @arg cache		Cache in concurrent mode
+ *
+ * Every thread reading the cache concurrently needs its own handle.
+ * The handle must be freed before the cache is freed.
+ *
+ * @return Reader handle or NULL if the cache is not in concurrent mode
+ *         or allocation failed.
+ */
+struct nl_cache_reader *nl_cache_reader_alloc(struct nl_cache *cache)
+{
+	struct nl_cache_rcu *rcu = cache->c_rcu;
+	struct nl_cache_reader *r;
+
+	if (!rcu || !(r = calloc(1, sizeof(*r))))
+		return NULL;
+
+	r->r_rcu = rcu;
+
+	nl_lock(&rcu->cr_readers_lock);
+	r->r_next = rcu->cr_readers;
+	rcu->cr_readers = r;
+	nl_unlock(&rcu->cr_readers_lock);
+
+	return r;
+}
+
+/**
+ * Free a reader handle
+ * @arg r		Reader handle
+ *
+ * The reader must not be inside a read side critical section.
+ */
+void nl_cache_reader_free(struct nl_cache_reader *r)
+{
+	struct nl_cache_reader **pp;
+
+	if (!r)
+		return;
+
+	nl_lock(&r->r_rcu->cr_readers_lock);
+	for (pp = &r->r_rcu->cr_readers; *pp; pp = &(*pp)->r_next) {
+		if (*pp == r) {
+			*pp = r->r_next;
+			break;
+		}
+	}
+	nl_unlock(&r->r_rcu->cr_readers_lock);
+
+	free(r);
+}
+
+/**
+ * Enter read side critical section
+ * @arg r		Reader handle
+ *
+ * Objects obtained from the cache until nl_cache_read_unlock() remain
+ * valid even if the writer removes them meanwhile. Critical sections
+ * must be short, they delay the release of memory by the writer.
+ */
+void nl_cache_read_lock(struct nl_cache_reader *r)
+{
+	uint64_t epoch = __atomic_load_n(&r->r_rcu->cr_epoch, __ATOMIC_ACQUIRE);
+
+	/* Store epoch + 1, zero means quiescent */
+	__atomic_store_n(&r->r_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * Leave read side critical section
+ * @arg r		Reader handle
+ */
+void nl_cache_read_unlock(struct nl_cache_reader *r)
+{
+	__atomic_store_n(&r->r_epoch, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Search object without locking
+ * @arg r		Reader handle inside a read side critical section
+ * @arg needle		Object to look for
+ *
+ * Same as nl_cache_search() but safe to call concurrently with the
+ * writer. No reference is acquired on the returned object.
+ *
+ * @return Borrowed pointer to object or NULL if not found.
+ */
+struct nl_object *nl_cache_search_rcu(struct nl_cache_reader *r,
+				      struct nl_object *needle)
+{
+	struct nl_rcu_table *t;
+	struct nl_rcu_node *n;
+
+	t = __atomic_load_n(&r->r_rcu->cr_table, __ATOMIC_ACQUIRE);
+	n = __atomic_load_n(&t->t_buckets[rcu_bucket(t, needle)],
+			    __ATOMIC_ACQUIRE);
+
+	for (; n; n = __atomic_load_n(&n->n_next, __ATOMIC_ACQUIRE))
+		if (nl_object_identical(n->n_obj, needle))
+			return n->n_obj;
+
+	return NULL;
+}
+
+/**
+ * Call a callback on each object without locking
+ * @arg r		Reader handle inside a read side critical section
+ * @arg filter		Filter object (optional)
+ * @arg cb		Callback function
+ * @arg arg		Argument passed to callback function
+ *
+ * Iterates over a consistent view of the buckets at the time they are
+ * visited. Objects added or removed during the walk may or may not be
+ * seen. The objects passed to \p cb are borrowed.
+ */
+void nl_cache_foreach_rcu(struct nl_cache_reader *r, struct nl_object *filter,
+			  void (*cb)(struct nl_object *, void *), void *arg)
+{
+	struct nl_rcu_table *t;
+	struct nl_rcu_node *n;
+	uint32_t i;
+
+	t = __atomic_load_n(&r->r_rcu->cr_table, __ATOMIC_ACQUIRE);
+
+	for (i = 0; i < t->t_size; i++) {
+		n = __atomic_load_n(&t->t_buckets[i], __ATOMIC_ACQUIRE);
+		for (; n; n = __atomic_load_n(&n->n_next, __ATOMIC_ACQUIRE)) {
+			if (filter && !nl_object_match_filter(n->n_obj, filter))
+				continue;
+
+			cb(n->n_obj, arg);
+		}
+	}
+}
+
+/** @} */
+
+/** @} */
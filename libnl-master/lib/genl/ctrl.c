@@ -405,22 +405,229 @@ struct genl_family *genl_ctrl_search_by_name(struct nl_cache *cache,
 /** @} */
 
 /**
- * @name Direct Resolvers
+ * @name Resolvers
  *
- * These functions communicate directly with the kernel and do not require
- * a cache to be kept up to date.
+ * Family and group names are resolved through a process wide cache which
+ * is filled with a single dump of all families on first use. The cache
+ * is kept current by a dedicated socket subscribed to the notification
+ * group of the controller, which is checked for pending notifications on
+ * every lookup. A name not found in the cache is queried from the kernel
+ * directly, allowing for the module providing the family to be loaded.
+ *
+ * Family identifiers are specific to a network namespace. A process
+ * switching namespaces must call genl_ctrl_resolver_flush() afterwards.
  *
  * @{
  */
 
+/** @cond SKIP */
+static NL_LOCK(resolver_lock);
+static struct nl_sock *resolver_sock;
+static struct nl_cache *resolver_cache;
+
+static void resolver_remove(const char *name)
+{
+	struct genl_family *family;
+
+	if ((family = genl_ctrl_search_by_name(resolver_cache, name))) {
+		nl_cache_remove((struct nl_object *) family);
+		genl_family_put(family);
+	}
+}
+
+/*
+ * Group notifications only carry the groups affected. Lookups may still
+ * hold the cached family, so a copy with the groups added or removed
+ * takes its place. Families not cached are queried on the next lookup.
+ */
+static void resolver_update_grps(const char *name, int cmd,
+				 struct nlattr *attr)
+{
+	struct genl_family *family, *copy = NULL, *grps = NULL;
+	struct genl_family_grp *grp, *old, *tmp;
+
+	if (!attr || !(family = genl_ctrl_search_by_name(resolver_cache, name)))
+		return;
+
+	if (!(grps = genl_family_alloc()) ||
+	    parse_mcast_grps(grps, attr) < 0 ||
+	    !(copy = (struct genl_family *)
+			nl_object_clone((struct nl_object *) family)))
+		goto errout;
+
+	nl_list_for_each_entry(grp, &grps->gf_mc_grps, list) {
+		nl_list_for_each_entry_safe(old, tmp, &copy->gf_mc_grps, list) {
+			if (old->id == grp->id) {
+				nl_list_del(&old->list);
+				free(old);
+			}
+		}
+
+		if (cmd == CTRL_CMD_NEWMCAST_GRP &&
+		    genl_family_add_grp(copy, grp->id, grp->name) < 0)
+			goto errout;
+	}
+
+	nl_cache_remove((struct nl_object *) family);
+	if (nl_cache_add(resolver_cache, (struct nl_object *) copy) < 0)
+		goto errout;
+
+	genl_family_put(copy);
+	genl_family_put(grps);
+	genl_family_put(family);
+	return;
+
+errout:
+	/* Have the family queried again */
+	nl_cache_remove((struct nl_object *) family);
+	genl_family_put(copy);
+	genl_family_put(grps);
+	genl_family_put(family);
+}
+
+static int resolver_event(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *nlh = nlmsg_hdr(msg);
+	struct nlattr *tb[CTRL_ATTR_MAX+1];
+	struct genlmsghdr *ghdr;
+	const char *name;
+
+	if (genlmsg_parse(nlh, 0, tb, CTRL_ATTR_MAX, ctrl_policy) < 0 ||
+	    !tb[CTRL_ATTR_FAMILY_NAME])
+		return NL_SKIP;
+
+	ghdr = nlmsg_data(nlh);
+	name = nla_get_string(tb[CTRL_ATTR_FAMILY_NAME]);
+
+	NL_DBG(2, "Resolver cache: family %s changed (cmd %u)\n",
+	       name, ghdr->cmd);
+
+	switch (ghdr->cmd) {
+	case CTRL_CMD_NEWMCAST_GRP:
+	case CTRL_CMD_DELMCAST_GRP:
+		resolver_update_grps(name, ghdr->cmd,
+				     tb[CTRL_ATTR_MCAST_GROUPS]);
+		break;
+	case CTRL_CMD_NEWFAMILY:
+		resolver_remove(name);
+		nl_cache_parse_and_add(resolver_cache, msg);
+		break;
+	default:
+		resolver_remove(name);
+		break;
+	}
+
+	return NL_OK;
+}
+
+static void resolver_free(void)
+{
+	nl_cache_free(resolver_cache);
+	nl_socket_free(resolver_sock);
+	resolver_cache = NULL;
+	resolver_sock = NULL;
+}
+
+static int resolver_init(struct nl_sock *sk)
+{
+	int err;
+
+	if (!(resolver_sock = nl_socket_alloc()))
+		return -NLE_NOMEM;
+
+	nl_socket_disable_seq_check(resolver_sock);
+	nl_socket_modify_cb(resolver_sock, NL_CB_VALID, NL_CB_CUSTOM,
+			    resolver_event, NULL);
+
+	/*
+	 * Subscribe before dumping the families so no change between the
+	 * dump and the subscription goes unnoticed.
+	 */
+	if ((err = genl_connect(resolver_sock)) < 0 ||
+	    (err = nl_socket_set_nonblocking(resolver_sock)) < 0 ||
+	    (err = nl_socket_add_membership(resolver_sock, GENL_ID_CTRL)) < 0 ||
+	    (err = genl_ctrl_alloc_cache(sk, &resolver_cache)) < 0) {
+		resolver_free();
+		return err;
+	}
+
+	NL_DBG(1, "Resolver cache: %d families\n",
+	       nl_cache_nitems(resolver_cache));
+
+	return 0;
+}
+
+/* Apply pending notifications, start over if some of them were lost */
+static int resolver_sync(struct nl_sock *sk)
+{
+	int err;
+
+	if (!resolver_sock)
+		return sk ? resolver_init(sk) : -NLE_NOCACHE;
+
+	while ((err = nl_recvmsgs_default(resolver_sock)) >= 0)
+		;
+
+	if (err == -NLE_AGAIN)
+		return 0;
+
+	NL_DBG(1, "Resolver cache: notifications lost: %s\n",
+	       nl_geterror(err));
+	resolver_free();
+
+	return sk ? resolver_init(sk) : err;
+}
+
+/*
+ * Look up a family by name. The socket is used to fill the cache if
+ * needed, without a socket only an existing cache is consulted. If
+ * probe is set, names missing in the cache are queried from the kernel.
+ */
+struct genl_family *genl_ctrl_resolver_get(struct nl_sock *sk,
+					   const char *name, int probe)
+{
+	struct genl_family *family = NULL;
+
+	nl_lock(&resolver_lock);
+
+	if (resolver_sync(sk) == 0)
+		family = genl_ctrl_search_by_name(resolver_cache, name);
+
+	if (!family && sk && probe) {
+		family = genl_ctrl_probe_by_name(sk, name);
+		if (family && resolver_cache)
+			nl_cache_add(resolver_cache, (struct nl_object *) family);
+	}
+
+	nl_unlock(&resolver_lock);
+
+	return family;
+}
+/** @endcond */
+
+/**
+ * Drop the resolver cache
+ *
+ * Releases the cache used by genl_ctrl_resolve(), genl_ctrl_resolve_grp()
+ * and genl_ops_resolve() along with its notification socket. The cache
+ * is filled again on the next lookup. Must be called after switching
+ * network namespaces.
+ */
+void genl_ctrl_resolver_flush(void)
+{
+	nl_lock(&resolver_lock);
+	resolver_free();
+	nl_unlock(&resolver_lock);
+}
+
 /**
  * Resolve Generic Netlink family name to numeric identifier
  * @arg sk		Generic Netlink socket.
  * @arg name		Name of Generic Netlink family
  *
  * Resolves the Generic Netlink family name to the corresponding numeric
- * family identifier. This function queries the kernel directly, use
- * genl_ctrl_search_by_name() if you need to resolve multiple names.
+ * family identifier. Only the first lookup and lookups of names not
+ * known yet require communication with the kernel.
  *
  * @see genl_ctrl_search_by_name()
  *
@@ -431,7 +638,7 @@ int genl_ctrl_resolve(struct nl_sock *sk, const char *name)
 	struct genl_family *family;
 	int err;
 
-	family = genl_ctrl_probe_by_name(sk, name);
+	family = genl_ctrl_resolver_get(sk, name, 1);
 	if (family == NULL) {
 		err = -NLE_OBJ_NOTFOUND;
 		goto errout;
@@ -475,7 +682,7 @@ int genl_ctrl_resolve_grp(struct nl_sock *sk, const char *family_name,
 	struct genl_family *family;
 	int err;
 
-	family = genl_ctrl_probe_by_name(sk, family_name);
+	family = genl_ctrl_resolver_get(sk, family_name, 1);
 	if (family == NULL) {
 		err = -NLE_OBJ_NOTFOUND;
 		goto errout;
@@ -540,6 +747,7 @@ static void __init ctrl_init(void)
 
 static void __exit ctrl_exit(void)
 {
+	resolver_free();
 	genl_unregister(&genl_ctrl_ops);
 }
 /** @endcond */
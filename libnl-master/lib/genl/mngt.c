@@ -288,11 +288,11 @@ void genl_unregister(struct nl_cache_ops *ops)
 /** @} */
 
 /** @cond SKIP */
-static int __genl_ops_resolve(struct nl_cache *ctrl, struct genl_ops *ops)
+static int __genl_ops_resolve(struct nl_sock *sk, struct genl_ops *ops)
 {
 	struct genl_family *family;
 
-	family = genl_ctrl_search_by_name(ctrl, ops->o_name);
+	family = genl_ctrl_resolver_get(sk, ops->o_name, 1);
 	if (family != NULL) {
 		ops->o_id = genl_family_get_id(family);
 
@@ -319,6 +319,10 @@ int genl_resolve_id(struct genl_ops *ops)
 	if (!ops->o_name)
 		return -NLE_INVAL;
 
+	/* Avoid setting up a socket if the resolver cache knows the family */
+	if (__genl_ops_resolve(NULL, ops) == 0)
+		return 0;
+
 	if (!(sk = nl_socket_alloc()))
 		return -NLE_NOMEM;
 
@@ -344,23 +348,16 @@ errout_free:
  * @arg sk		Generic Netlink socket
  * @arg ops		Generic Netlink family definition
  *
- * Resolves the family name to its numeric identifier.
+ * Resolves the family name to its numeric identifier using the resolver
+ * cache of the controller.
+ *
+ * @see genl_ctrl_resolve()
  *
  * @return 0 on success or a negative error code.
  */
 int genl_ops_resolve(struct nl_sock *sk, struct genl_ops *ops)
 {
-	struct nl_cache *ctrl;
-	int err;
-
-	if ((err = genl_ctrl_alloc_cache(sk, &ctrl)) < 0)
-		goto errout;
-
-	err = __genl_ops_resolve(ctrl, ops);
-
-	nl_cache_free(ctrl);
-errout:
-	return err;
+	return __genl_ops_resolve(sk, ops);
 }
 
 /**
@@ -378,19 +375,13 @@ errout:
  */
 int genl_mngt_resolve(struct nl_sock *sk)
 {
-	struct nl_cache *ctrl;
 	struct genl_ops *ops;
 	int err = 0;
 
-	if ((err = genl_ctrl_alloc_cache(sk, &ctrl)) < 0)
-		goto errout;
-
 	nl_list_for_each_entry(ops, &genl_ops_list, o_list) {
-		err = __genl_ops_resolve(ctrl, ops);
+		err = __genl_ops_resolve(sk, ops);
 	}
 
-	nl_cache_free(ctrl);
-errout:
 	return err;
 }
 
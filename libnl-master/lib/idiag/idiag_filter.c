@@ -0,0 +1,448 @@
+/*
+ * lib/idiag/idiag_filter.c	Inet Diag Socket Filters
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+/**
+ * @ingroup idiag
+ * @defgroup idiagnl_filter Inet Diag Socket Filters
+ *
+ * Socket filters are compiled into inet_diag bytecode and attached to
+ * the dump request so that the kernel only reports matching sockets.
+ * All conditions added to a filter must match for a socket to be
+ * reported; each condition may be negated individually.
+ *
+ * @code
+ * struct idiagnl_filter *filter = idiagnl_filter_alloc();
+ *
+ * idiagnl_filter_set_states(filter, 1 << TCP_ESTABLISHED);
+ * idiagnl_filter_add_dport(filter, 443, 443, 0);
+ * idiagnl_send_filtered(sk, 0, AF_INET, IDIAGNL_SS_ALL, 0, filter);
+ * idiagnl_filter_free(filter);
+ * @endcode
+ * @{
+ */
+
+#include <netlink-private/netlink.h>
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+#include <netlink/attr.h>
+#include <netlink/idiag/idiagnl.h>
+#include <netlink/idiag/filter.h>
+#include <linux/inet_diag.h>
+
+/** @cond SKIP */
+enum {
+	IDIAG_COND_SPORT,
+	IDIAG_COND_DPORT,
+	IDIAG_COND_SRC,
+	IDIAG_COND_DST,
+};
+
+struct idiag_cond {
+	uint8_t			ic_type;
+	uint8_t			ic_negate;
+	uint16_t		ic_min;
+	uint16_t		ic_max;
+	int			ic_port;
+	struct nl_addr *	ic_addr;
+};
+
+struct idiagnl_filter {
+	struct idiag_cond *	f_cond;
+	unsigned int		f_ncond;
+	unsigned int		f_size;
+	uint16_t		f_states;
+};
+
+#define IDIAG_PORT_OP_LEN	(2 * sizeof(struct inet_diag_bc_op))
+/** @endcond */
+
+/**
+ * Allocate a socket filter
+ *
+ * The new filter matches all sockets in all states.
+ *
+ * @return Newly allocated filter or NULL.
+ */
+struct idiagnl_filter *idiagnl_filter_alloc(void)
+{
+	struct idiagnl_filter *filter;
+
+	if (!(filter = calloc(1, sizeof(*filter))))
+		return NULL;
+
+	filter->f_states = 0xffff;
+
+	return filter;
+}
+
+/**
+ * Free a socket filter
+ * @arg filter		Socket filter
+ */
+void idiagnl_filter_free(struct idiagnl_filter *filter)
+{
+	unsigned int i;
+
+	if (!filter)
+		return;
+
+	for (i = 0; i < filter->f_ncond; i++)
+		nl_addr_put(filter->f_cond[i].ic_addr);
+
+	free(filter->f_cond);
+	free(filter);
+}
+
+/**
+ * Restrict socket states
+ * @arg filter		Socket filter
+ * @arg states		Bitmask of socket states (1 << TCP_*)
+ *
+ * The states are combined with the states passed to
+ * idiagnl_send_filtered(), only sockets in a state present in both
+ * masks are reported.
+ */
+void idiagnl_filter_set_states(struct idiagnl_filter *filter, uint16_t states)
+{
+	filter->f_states = states;
+}
+
+uint16_t idiagnl_filter_get_states(const struct idiagnl_filter *filter)
+{
+	return filter->f_states;
+}
+
+static struct idiag_cond *filter_add(struct idiagnl_filter *filter, int type,
+				     int negate)
+{
+	struct idiag_cond *cond;
+
+	if (filter->f_ncond == filter->f_size) {
+		unsigned int size = filter->f_size ? 2 * filter->f_size : 4;
+
+		cond = realloc(filter->f_cond, size * sizeof(*cond));
+		if (!cond)
+			return NULL;
+
+		filter->f_cond = cond;
+		filter->f_size = size;
+	}
+
+	cond = &filter->f_cond[filter->f_ncond++];
+	memset(cond, 0, sizeof(*cond));
+	cond->ic_type = type;
+	cond->ic_negate = !!negate;
+
+	return cond;
+}
+
+static int filter_add_port(struct idiagnl_filter *filter, int type,
+			   uint16_t min, uint16_t max, int negate)
+{
+	struct idiag_cond *cond;
+
+	if (min > max)
+		return -NLE_INVAL;
+
+	if (!(cond = filter_add(filter, type, negate)))
+		return -NLE_NOMEM;
+
+	cond->ic_min = min;
+	cond->ic_max = max;
+
+	return 0;
+}
+
+/**
+ * Match on the local port
+ * @arg filter		Socket filter
+ * @arg min		Lowest port to match
+ * @arg max		Highest port to match
+ * @arg negate		Match sockets with a port outside of the range
+ *
+ * @return 0 on success or a negative error code.
+ */
+int idiagnl_filter_add_sport(struct idiagnl_filter *filter, uint16_t min,
+			     uint16_t max, int negate)
+{
+	return filter_add_port(filter, IDIAG_COND_SPORT, min, max, negate);
+}
+
+/**
+ * Match on the remote port
+ * @arg filter		Socket filter
+ * @arg min		Lowest port to match
+ * @arg max		Highest port to match
+ * @arg negate		Match sockets with a port outside of the range
+ *
+ * @return 0 on success or a negative error code.
+ */
+int idiagnl_filter_add_dport(struct idiagnl_filter *filter, uint16_t min,
+			     uint16_t max, int negate)
+{
+	return filter_add_port(filter, IDIAG_COND_DPORT, min, max, negate);
+}
+
+static int filter_add_host(struct idiagnl_filter *filter, int type,
+			   struct nl_addr *addr, int port, int negate)
+{
+	struct idiag_cond *cond;
+
+	if (port < -1 || port > 0xffff)
+		return -NLE_RANGE;
+
+	if (addr) {
+		switch (nl_addr_get_family(addr)) {
+		case AF_INET:
+		case AF_INET6:
+			break;
+		default:
+			return -NLE_AF_NOSUPPORT;
+		}
+
+		if (nl_addr_get_len(addr) != (nl_addr_get_family(addr) ==
+					      AF_INET ? 4 : 16))
+			return -NLE_INVAL;
+	}
+
+	if (!(cond = filter_add(filter, type, negate)))
+		return -NLE_NOMEM;
+
+	cond->ic_port = port;
+	cond->ic_addr = addr ? nl_addr_get(addr) : NULL;
+
+	return 0;
+}
+
+/**
+ * Match on the local address
+ * @arg filter		Socket filter
+ * @arg addr		Address prefix to match or NULL
+ * @arg port		Local port to match or -1 for any
+ * @arg negate		Match sockets not matching the address and port
+ *
+ * The prefix length of \c addr determines how many bits are compared,
+ * an IPv4 prefix also matches IPv4-mapped IPv6 sockets.
+ *
+ * @return 0 on success or a negative error code.
+ */
+int idiagnl_filter_add_src(struct idiagnl_filter *filter, struct nl_addr *addr,
+			   int port, int negate)
+{
+	return filter_add_host(filter, IDIAG_COND_SRC, addr, port, negate);
+}
+
+/**
+ * Match on the remote address
+ * @arg filter		Socket filter
+ * @arg addr		Address prefix to match or NULL
+ * @arg port		Remote port to match or -1 for any
+ * @arg negate		Match sockets not matching the address and port
+ *
+ * @see idiagnl_filter_add_src()
+ * @return 0 on success or a negative error code.
+ */
+int idiagnl_filter_add_dst(struct idiagnl_filter *filter, struct nl_addr *addr,
+			   int port, int negate)
+{
+	return filter_add_host(filter, IDIAG_COND_DST, addr, port, negate);
+}
+
+/*
+ * Length of the instructions testing a condition, excluding the jump
+ * which rejects the socket if a negated condition matches.
+ */
+static unsigned int cond_len(const struct idiag_cond *cond)
+{
+	unsigned int len = 0;
+
+	switch (cond->ic_type) {
+	case IDIAG_COND_SPORT:
+	case IDIAG_COND_DPORT:
+		if (cond->ic_min > 0)
+			len += IDIAG_PORT_OP_LEN;
+		if (cond->ic_max < 0xffff)
+			len += IDIAG_PORT_OP_LEN;
+		break;
+
+	default:
+		len = sizeof(struct inet_diag_bc_op) +
+		      sizeof(struct inet_diag_hostcond);
+		if (cond->ic_addr)
+			len += nl_addr_get_len(cond->ic_addr);
+		break;
+	}
+
+	return len;
+}
+
+static unsigned int filter_len(const struct idiagnl_filter *filter)
+{
+	unsigned int i, len = 0;
+
+	for (i = 0; i < filter->f_ncond; i++) {
+		len += cond_len(&filter->f_cond[i]);
+		if (filter->f_cond[i].ic_negate)
+			len += sizeof(struct inet_diag_bc_op);
+	}
+
+	return len;
+}
+
+/*
+ * Each instruction jumps to its successor if it matches. A plain
+ * condition rejects the socket as soon as one of its instructions does
+ * not match by jumping past the end of the program. A negated condition
+ * instead continues after its trailing jump, which is only reached if
+ * all instructions matched and rejects the socket.
+ */
+static void filter_compile(const struct idiagnl_filter *filter, void *buf,
+			   unsigned int len)
+{
+	struct inet_diag_bc_op *op;
+	struct inet_diag_hostcond *hc;
+	unsigned int i, off, body, fail, remain = len;
+	char *pos = buf;
+
+	for (i = 0; i < filter->f_ncond; i++) {
+		const struct idiag_cond *cond = &filter->f_cond[i];
+		int port[2], code[2], n = 0, k;
+
+		/* Where to continue if an instruction does not match */
+		body = cond_len(cond);
+		fail = cond->ic_negate ? body + 4 : remain + 4;
+		off = 0;
+
+		switch (cond->ic_type) {
+		case IDIAG_COND_SPORT:
+		case IDIAG_COND_DPORT:
+			if (cond->ic_min > 0) {
+				code[n] = cond->ic_type == IDIAG_COND_SPORT ?
+					  INET_DIAG_BC_S_GE : INET_DIAG_BC_D_GE;
+				port[n++] = cond->ic_min;
+			}
+			if (cond->ic_max < 0xffff) {
+				code[n] = cond->ic_type == IDIAG_COND_SPORT ?
+					  INET_DIAG_BC_S_LE : INET_DIAG_BC_D_LE;
+				port[n++] = cond->ic_max;
+			}
+
+			for (k = 0; k < n; k++) {
+				op = (struct inet_diag_bc_op *) (pos + off);
+				op[0].code = code[k];
+				op[0].yes = IDIAG_PORT_OP_LEN;
+				op[0].no = fail - off;
+				op[1].code = INET_DIAG_BC_NOP;
+				op[1].yes = 0;
+				op[1].no = port[k];
+				off += IDIAG_PORT_OP_LEN;
+			}
+			break;
+
+		default:
+			op = (struct inet_diag_bc_op *) pos;
+			op->code = cond->ic_type == IDIAG_COND_SRC ?
+				   INET_DIAG_BC_S_COND : INET_DIAG_BC_D_COND;
+			op->yes = body;
+			op->no = fail;
+
+			hc = (struct inet_diag_hostcond *) (op + 1);
+			hc->port = cond->ic_port;
+			if (cond->ic_addr) {
+				hc->family = nl_addr_get_family(cond->ic_addr);
+				hc->prefix_len = nl_addr_get_prefixlen(cond->ic_addr);
+				memcpy(hc->addr, nl_addr_get_binary_addr(cond->ic_addr),
+				       nl_addr_get_len(cond->ic_addr));
+			} else {
+				hc->family = AF_UNSPEC;
+				hc->prefix_len = 0;
+			}
+			off = body;
+			break;
+		}
+
+		if (cond->ic_negate) {
+			op = (struct inet_diag_bc_op *) (pos + off);
+			op->code = INET_DIAG_BC_JMP;
+			op->yes = sizeof(*op);
+			op->no = remain - off + 4;
+			off += sizeof(*op);
+		}
+
+		pos += off;
+		remain -= off;
+	}
+}
+
+/**
+ * Send inet diag dump request with a socket filter
+ * @arg sk		Netlink socket.
+ * @arg flags		Message flags
+ * @arg family		Address family
+ * @arg states		Socket states to query
+ * @arg ext		Inet Diag attribute extensions to query
+ * @arg filter		Socket filter or NULL
+ *
+ * Works like idiagnl_send_simple() but additionally attaches the
+ * compiled \c filter to the request so that sockets not matching the
+ * filter are skipped by the kernel.
+ *
+ * @return 0 on success or a negative error code. Like
+ * idiagnl_send_simple(), this function returns the number of bytes sent.
+ * Treat any non-negative number as success.
+ */
+int idiagnl_send_filtered(struct nl_sock *sk, int flags, uint8_t family,
+			  uint16_t states, uint16_t ext,
+			  struct idiagnl_filter *filter)
+{
+	struct inet_diag_req req;
+	struct nl_msg *msg;
+	struct nlattr *nla;
+	unsigned int len;
+	int err;
+
+	if (!filter)
+		return idiagnl_send_simple(sk, flags, family, states, ext);
+
+	len = filter_len(filter);
+	if (len > 0xffff - 4)
+		return -NLE_RANGE;
+
+	memset(&req, 0, sizeof(req));
+	req.idiag_family = family;
+	req.idiag_states = states & filter->f_states;
+	req.idiag_ext = ext;
+
+	msg = nlmsg_alloc_size(NLMSG_SPACE(sizeof(req)) + nla_total_size(len));
+	if (!msg)
+		return -NLE_NOMEM;
+
+	if (!nlmsg_put(msg, NL_AUTO_PORT, NL_AUTO_SEQ, TCPDIAG_GETSOCK, 0,
+		       flags | NLM_F_ROOT) ||
+	    nlmsg_append(msg, &req, sizeof(req), NLMSG_ALIGNTO) < 0)
+		goto nla_put_failure;
+
+	if (len > 0) {
+		if (!(nla = nla_reserve(msg, INET_DIAG_REQ_BYTECODE, len)))
+			goto nla_put_failure;
+
+		filter_compile(filter, nla_data(nla), len);
+	}
+
+	err = nl_send_auto(sk, msg);
+	nlmsg_free(msg);
+
+	return err;
+
+nla_put_failure:
+	nlmsg_free(msg);
+	return -NLE_MSGSIZE;
+}
+
+/** @} */
@@ -14,6 +14,7 @@
 #include <netlink/idiag/msg.h>
 #include <netlink/idiag/meminfo.h>
 #include <netlink/idiag/vegasinfo.h>
+#include <netlink/idiag/filter.h>
 #include <linux/inet_diag.h>
 
 
@@ -674,22 +675,61 @@ static struct nla_policy ext_policy[INET_DIAG_MAX+1] = {
 	[INET_DIAG_SHUTDOWN]   = { .type = NLA_U8 },
 };
 
-int idiagnl_msg_parse(struct nlmsghdr *nlh, struct idiagnl_msg **result)
+/** @cond SKIP */
+/*
+ * Borrowed message handed out by idiagnl_msg_dump_foreach(). Addresses
+ * and sub-objects are backed by the view, the congestion control name
+ * points into the netlink message.
+ */
+struct idiag_view {
+	struct idiagnl_msg		iv_msg;
+	struct {
+		struct nl_addr		a;
+		char			data[16];
+	}				iv_addr[2];
+	struct idiagnl_meminfo		iv_meminfo;
+	struct idiagnl_vegasinfo	iv_vegasinfo;
+};
+/** @endcond */
+
+static struct nl_addr *idiag_addr(struct idiag_view *view, int idx,
+				  int family, void *buf, size_t len)
+{
+	struct nl_addr *addr;
+
+	if (!view)
+		return nl_addr_build(family, buf, len);
+
+	addr = &view->iv_addr[idx].a;
+	addr->a_family = family;
+	addr->a_maxsize = sizeof(view->iv_addr[0].data);
+	addr->a_len = len;
+	addr->a_prefixlen = len * 8;
+	addr->a_refcnt = 1;
+	memcpy(addr->a_addr, buf, len);
+
+	return addr;
+}
+
+static void idiag_view_init_obj(struct nl_object *obj, struct nl_object_ops *ops)
+{
+	obj->ce_ops = ops;
+	obj->ce_refcnt = 1;
+	nl_init_list_head(&obj->ce_list);
+}
+
+static int idiag_msg_parse(struct idiagnl_msg *msg, struct nlmsghdr *nlh,
+			   struct idiag_view *view)
 {
-	struct idiagnl_msg *msg = NULL;
 	struct inet_diag_msg *raw_msg = NULL;
 	struct nl_addr *src = NULL, *dst = NULL;
 	struct nlattr *tb[INET_DIAG_MAX+1];
 	int err = 0;
 
-	msg = idiagnl_msg_alloc();
-	if (!msg)
-		goto errout_nomem;
-
 	err = nlmsg_parse(nlh, sizeof(struct inet_diag_msg), tb, INET_DIAG_MAX,
 			ext_policy);
 	if (err < 0)
-		goto errout;
+		return err;
 
 	raw_msg = nlmsg_data(nlh);
 	msg->idiag_family = raw_msg->idiag_family;
@@ -718,27 +758,21 @@ int idiagnl_msg_parse(struct nlmsghdr *nlh, struct idiagnl_msg **result)
 	                IDIAGNL_ATTR_DPORT |
 	                IDIAGNL_ATTR_IFINDEX);
 
-	dst = nl_addr_build(raw_msg->idiag_family, raw_msg->id.idiag_dst,
-			sizeof(raw_msg->id.idiag_dst));
+	dst = idiag_addr(view, 0, raw_msg->idiag_family, raw_msg->id.idiag_dst,
+			 sizeof(raw_msg->id.idiag_dst));
 	if (!dst)
-		goto errout_nomem;
-
-	err = idiagnl_msg_set_dst(msg, dst);
-	if (err < 0)
-		goto errout;
+		return -NLE_NOMEM;
 
-	nl_addr_put(dst);
+	msg->idiag_dst = dst;
+	msg->ce_mask |= IDIAGNL_ATTR_DST;
 
-	src = nl_addr_build(raw_msg->idiag_family, raw_msg->id.idiag_src,
-			sizeof(raw_msg->id.idiag_src));
+	src = idiag_addr(view, 1, raw_msg->idiag_family, raw_msg->id.idiag_src,
+			 sizeof(raw_msg->id.idiag_src));
 	if (!src)
-		goto errout_nomem;
-
-	err = idiagnl_msg_set_src(msg, src);
-	if (err < 0)
-		goto errout;
+		return -NLE_NOMEM;
 
-	nl_addr_put(src);
+	msg->idiag_src = src;
+	msg->ce_mask |= IDIAGNL_ATTR_SRC;
 
 	if (tb[INET_DIAG_TOS]) {
 		msg->idiag_tos = nla_get_u8(tb[INET_DIAG_TOS]);
@@ -756,7 +790,10 @@ int idiagnl_msg_parse(struct nlmsghdr *nlh, struct idiagnl_msg **result)
 	}
 
 	if (tb[INET_DIAG_CONG]) {
-		msg->idiag_cong = nla_strdup(tb[INET_DIAG_CONG]);
+		if (view)
+			msg->idiag_cong = nla_data(tb[INET_DIAG_CONG]);
+		else if (!(msg->idiag_cong = nla_strdup(tb[INET_DIAG_CONG])))
+			return -NLE_NOMEM;
 		msg->ce_mask |= IDIAGNL_ATTR_CONG;
 	}
 
@@ -767,11 +804,15 @@ int idiagnl_msg_parse(struct nlmsghdr *nlh, struct idiagnl_msg **result)
 	}
 
 	if (tb[INET_DIAG_MEMINFO]) {
-		struct idiagnl_meminfo *minfo = idiagnl_meminfo_alloc();
+		struct idiagnl_meminfo *minfo;
 		struct inet_diag_meminfo *raw_minfo = NULL;
 
-		if (!minfo)
-			goto errout_nomem;
+		if (view) {
+			minfo = &view->iv_meminfo;
+			idiag_view_init_obj((struct nl_object *) minfo,
+					    &idiagnl_meminfo_obj_ops);
+		} else if (!(minfo = idiagnl_meminfo_alloc()))
+			return -NLE_NOMEM;
 
 		raw_minfo = (struct inet_diag_meminfo *)
 			nla_data(tb[INET_DIAG_MEMINFO]);
@@ -786,11 +827,15 @@ int idiagnl_msg_parse(struct nlmsghdr *nlh, struct idiagnl_msg **result)
 	}
 
 	if (tb[INET_DIAG_VEGASINFO]) {
-		struct idiagnl_vegasinfo *vinfo = idiagnl_vegasinfo_alloc();
+		struct idiagnl_vegasinfo *vinfo;
 		struct tcpvegas_info *raw_vinfo = NULL;
 
-		if (!vinfo)
-			goto errout_nomem;
+		if (view) {
+			vinfo = &view->iv_vegasinfo;
+			idiag_view_init_obj((struct nl_object *) vinfo,
+					    &idiagnl_vegasinfo_obj_ops);
+		} else if (!(vinfo = idiagnl_vegasinfo_alloc()))
+			return -NLE_NOMEM;
 
 		raw_vinfo = (struct tcpvegas_info *)
 			nla_data(tb[INET_DIAG_VEGASINFO]);
@@ -810,18 +855,133 @@ int idiagnl_msg_parse(struct nlmsghdr *nlh, struct idiagnl_msg **result)
 		msg->ce_mask |= IDIAGNL_ATTR_SKMEMINFO;
 	}
 
+	return 0;
+}
+
+int idiagnl_msg_parse(struct nlmsghdr *nlh, struct idiagnl_msg **result)
+{
+	struct idiagnl_msg *msg;
+	int err;
+
+	if (!(msg = idiagnl_msg_alloc()))
+		return -NLE_NOMEM;
+
+	if ((err = idiag_msg_parse(msg, nlh, NULL)) < 0) {
+		idiagnl_msg_put(msg);
+		return err;
+	}
+
 	*result = msg;
 	return 0;
+}
 
-errout:
-	idiagnl_msg_put(msg);
-	return err;
+/**
+ * @name Streaming
+ * @{
+ */
+
+/** @cond SKIP */
+struct idiag_dump_arg {
+	int		(*cb)(struct idiagnl_msg *, void *);
+	void *		arg;
+	int		err;
+	int		stop;
+};
+/** @endcond */
 
-errout_nomem:
-	err = -NLE_NOMEM;
-	goto errout;
+static int idiag_dump_valid(struct nl_msg *msg, void *arg)
+{
+	struct idiag_dump_arg *d = arg;
+	struct nlmsghdr *nlh = nlmsg_hdr(msg);
+	struct idiag_view view;
+	int err;
+
+	if (d->stop || (nlh->nlmsg_type != TCPDIAG_GETSOCK &&
+			nlh->nlmsg_type != DCCPDIAG_GETSOCK))
+		return NL_SKIP;
+
+	memset(&view.iv_msg, 0, sizeof(view.iv_msg));
+	idiag_view_init_obj((struct nl_object *) &view.iv_msg,
+			    &idiagnl_msg_obj_ops);
+
+	if ((err = idiag_msg_parse(&view.iv_msg, nlh, &view)) < 0) {
+		d->err = err;
+		d->stop = 1;
+		return NL_SKIP;
+	}
+
+	err = d->cb(&view.iv_msg, d->arg);
+	if (err < 0)
+		d->err = err;
+	if (err < 0 || err == NL_STOP)
+		d->stop = 1;
+
+	return NL_OK;
 }
 
+/**
+ * Walk sockets in the kernel without building a cache
+ * @arg sk		Netlink socket
+ * @arg family		Address family to query
+ * @arg states		Socket states to query
+ * @arg ext		Inet Diag attribute extensions to query
+ * @arg filter		Socket filter or NULL
+ * @arg cb		Function called for every socket
+ * @arg arg		Argument passed to \c cb
+ *
+ * Requests a socket dump through idiagnl_send_filtered() and calls \c cb
+ * for every socket as it is received. The message passed to \c cb,
+ * including its addresses and sub-objects, lives on the stack of the
+ * receiving function and is only valid for the duration of the call; no
+ * object is allocated per socket. The callback must neither acquire nor
+ * release a reference to it, use nl_object_clone() to keep a socket
+ * around.
+ *
+ * Only the extensions requested in \c ext are reported, a scan which
+ * only looks at addresses and ports should pass 0 to keep the dump
+ * small.
+ *
+ * The callback returns NL_OK to continue or NL_STOP to stop the walk.
+ * A negative return value stops the walk as well and is returned by
+ * this function. The remainder of the dump is drained from the socket
+ * in either case so the socket can be reused.
+ *
+ * @return 0 on success or a negative error code.
+ */
+int idiagnl_msg_dump_foreach(struct nl_sock *sk, uint8_t family,
+			     uint16_t states, uint16_t ext,
+			     struct idiagnl_filter *filter,
+			     int (*cb)(struct idiagnl_msg *, void *), void *arg)
+{
+	struct idiag_dump_arg d = {
+		.cb = cb,
+		.arg = arg,
+	};
+	struct nl_cb *orig, *nlcb;
+	int err;
+
+	orig = nl_socket_get_cb(sk);
+	nlcb = nl_cb_clone(orig);
+	nl_cb_put(orig);
+	if (!nlcb)
+		return -NLE_NOMEM;
+
+	nl_cb_set(nlcb, NL_CB_VALID, NL_CB_CUSTOM, idiag_dump_valid, &d);
+
+	err = idiagnl_send_filtered(sk, 0, family, states, ext, filter);
+	if (err >= 0)
+		err = nl_recvmsgs(sk, nlcb);
+
+	nl_cb_put(nlcb);
+
+	if (err < 0)
+		return err;
+
+	return d.err;
+}
+
+/** @} */
+
 static const struct trans_tbl idiagnl_attrs[] = {
 	__ADD(IDIAGNL_ATTR_FAMILY, family),
 	__ADD(IDIAGNL_ATTR_STATE, state),
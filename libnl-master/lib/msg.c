@@ -221,6 +221,25 @@ int nlmsg_parse(struct nlmsghdr *nlh, int hdrlen, struct nlattr *tb[],
 			 nlmsg_attrlen(nlh, hdrlen), policy);
 }
 
+/**
+ * parse attributes of a netlink message using a compiled policy
+ * @arg nlh		netlink message header
+ * @arg hdrlen		length of family specific header
+ * @arg tb		destination array with maxtype+1 elements
+ * @arg schema		attribute schema
+ *
+ * See nla_parse_schema()
+ */
+int nlmsg_parse_schema(struct nlmsghdr *nlh, int hdrlen, struct nlattr *tb[],
+		       const struct nla_schema *schema)
+{
+	if (!nlmsg_valid_hdr(nlh, hdrlen))
+		return -NLE_MSG_TOOSHORT;
+
+	return nla_parse_schema(tb, nlmsg_attrdata(nlh, hdrlen),
+				nlmsg_attrlen(nlh, hdrlen), schema);
+}
+
 /**
  * nlmsg_find_attr - find a specific attribute in a netlink message
  * @arg nlh		netlink message header
@@ -259,33 +278,131 @@ int nlmsg_validate(struct nlmsghdr *nlh, int hdrlen, int maxtype,
  * @{
  */
 
+/** @cond SKIP */
+/*
+ * Messages are usually built, sent and freed right away, often in a
+ * loop. Released messages are kept in a small pool and are handed out
+ * again by the next allocation, so bulk programming does not hit the
+ * heap for every message. Only payload buffers of the default size are
+ * kept with them, others are freed on release so that the pool neither
+ * holds on to large buffers nor zeroes them for small messages.
+ */
+#define MSG_POOL_SIZE	8
+
+static NL_LOCK(msg_pool_lock);
+static struct nl_msg *msg_pool[MSG_POOL_SIZE];
+static int msg_pool_len;
+
+/*
+ * Returns a pooled message, with its buffer if that is len bytes long,
+ * or NULL. A message without buffer is preferred over freeing the one
+ * of another size.
+ */
+static struct nl_msg *msg_pool_get(size_t len)
+{
+	struct nl_msg *nm = NULL;
+	int i, fit, best = -1, bestfit = -1;
+
+	nl_lock(&msg_pool_lock);
+	for (i = msg_pool_len - 1; i >= 0; i--) {
+		if (!msg_pool[i]->nm_nlh)
+			fit = 1;
+		else if (len && msg_pool[i]->nm_size == len)
+			fit = 2;
+		else
+			fit = 0;
+
+		if (fit > bestfit) {
+			best = i;
+			bestfit = fit;
+			if (fit == (len ? 2 : 1))
+				break;
+		}
+	}
+
+	if (best >= 0) {
+		nm = msg_pool[best];
+		msg_pool[best] = msg_pool[--msg_pool_len];
+	}
+	nl_unlock(&msg_pool_lock);
+
+	if (nm && nm->nm_nlh && nm->nm_size != len) {
+		free(nm->nm_nlh);
+		nm->nm_nlh = NULL;
+		nm->nm_size = 0;
+	}
+
+	return nm;
+}
+
+static int msg_pool_put(struct nl_msg *nm)
+{
+	int ret = 0;
+
+	nl_lock(&msg_pool_lock);
+	if (msg_pool_len < MSG_POOL_SIZE) {
+		msg_pool[msg_pool_len++] = nm;
+		ret = 1;
+	}
+	nl_unlock(&msg_pool_lock);
+
+	return ret;
+}
+
+static void __exit msg_pool_exit(void)
+{
+	while (msg_pool_len > 0) {
+		struct nl_msg *nm = msg_pool[--msg_pool_len];
+
+		free(nm->nm_nlh);
+		free(nm);
+	}
+}
+
+static void msg_init(struct nl_msg *nm, struct nlmsghdr *nlh, size_t len)
+{
+	memset(nm, 0, sizeof(*nm));
+	nm->nm_refcnt = 1;
+	nm->nm_protocol = -1;
+	nm->nm_nlh = nlh;
+	nm->nm_size = len;
+	nm->nm_nlh->nlmsg_len = nlmsg_total_size(0);
+}
+/** @endcond */
+
 static struct nl_msg *__nlmsg_alloc(size_t len)
 {
 	struct nl_msg *nm;
+	struct nlmsghdr *nlh;
 
 	if (len < sizeof(struct nlmsghdr))
 		len = sizeof(struct nlmsghdr);
 
-	nm = calloc(1, sizeof(*nm));
-	if (!nm)
-		goto errout;
+	if ((nm = msg_pool_get(len)) && nm->nm_nlh) {
+		/* Builders rely on the payload being zeroed */
+		nlh = nm->nm_nlh;
+		memset(nlh, 0, len);
+		msg_init(nm, nlh, len);
 
-	nm->nm_refcnt = 1;
+		NL_DBG(2, "msg %p: Reused message, maxlen=%zu\n", nm, len);
 
-	nm->nm_nlh = calloc(1, len);
-	if (!nm->nm_nlh)
-		goto errout;
+		return nm;
+	}
 
-	nm->nm_protocol = -1;
-	nm->nm_size = len;
-	nm->nm_nlh->nlmsg_len = nlmsg_total_size(0);
+	if (!nm && !(nm = malloc(sizeof(*nm))))
+		return NULL;
+
+	nlh = calloc(1, len);
+	if (!nlh) {
+		free(nm);
+		return NULL;
+	}
+
+	msg_init(nm, nlh, len);
 
 	NL_DBG(2, "msg %p: Allocated new message, maxlen=%zu\n", nm, len);
 
 	return nm;
-errout:
-	free(nm);
-	return NULL;
 }
 
 /**
@@ -359,6 +476,65 @@ struct nl_msg *nlmsg_alloc_simple(int nlmsgtype, int flags)
 	return msg;
 }
 
+/**
+ * Allocate a new netlink message on top of a caller provided buffer
+ * @arg buf		Buffer to hold the message, aligned to NLMSG_ALIGNTO
+ * @arg len		Size of the buffer in bytes.
+ *
+ * Allocates a new netlink message whose payload lives in \a buf, for
+ * example a buffer on the stack or carved from an arena. The buffer is
+ * zeroed and must remain valid until the last reference to the message
+ * has been released; nlmsg_free() does not free it. If the message is
+ * expanded with nlmsg_expand(), the payload is moved to the heap.
+ *
+ * Together with the pool of released messages kept by the library this
+ * allows to construct messages without any heap allocation.
+ *
+ * @return Newly allocated netlink message or NULL.
+ */
+struct nl_msg *nlmsg_alloc_buf(void *buf, size_t len)
+{
+	struct nl_msg *nm;
+
+	if (!buf || len < nlmsg_total_size(0))
+		return NULL;
+
+	if (!(nm = msg_pool_get(0)) && !(nm = malloc(sizeof(*nm))))
+		return NULL;
+
+	memset(buf, 0, len);
+	msg_init(nm, buf, len);
+	nm->nm_flags |= NL_MSG_EXT_BUF;
+
+	NL_DBG(2, "msg %p: Allocated new message on buffer %p, maxlen=%zu\n",
+	       nm, buf, len);
+
+	return nm;
+}
+
+/**
+ * Reset a netlink message for reuse
+ * @arg msg		Netlink message.
+ *
+ * Discards the header and payload of the message, as well as any
+ * source, destination and credentials, while keeping the message buffer
+ * and protocol. The message can then be used to construct a new message
+ * in place, e.g. for every request of a bulk programming loop.
+ *
+ * @note Must not be called while other references to the message are
+ *       held.
+ */
+void nlmsg_reset(struct nl_msg *msg)
+{
+	int protocol = msg->nm_protocol;
+	int flags = msg->nm_flags & NL_MSG_EXT_BUF;
+
+	memset(msg->nm_nlh, 0, msg->nm_size);
+	msg_init(msg, msg->nm_nlh, msg->nm_size);
+	msg->nm_protocol = protocol;
+	msg->nm_flags = flags;
+}
+
 /**
  * Set the default maximum message payload size for allocated messages
  * @arg max		Size of payload in bytes.
@@ -478,10 +654,17 @@ int nlmsg_expand(struct nl_msg *n, size_t newlen)
 	if (newlen <= n->nm_size)
 		return -NLE_INVAL;
 
-	tmp = realloc(n->nm_nlh, newlen);
-	if (tmp == NULL)
+	if (n->nm_flags & NL_MSG_EXT_BUF) {
+		if ((tmp = malloc(newlen)) == NULL)
+			return -NLE_NOMEM;
+
+		memcpy(tmp, n->nm_nlh, n->nm_size);
+		n->nm_flags &= ~NL_MSG_EXT_BUF;
+	} else if ((tmp = realloc(n->nm_nlh, newlen)) == NULL)
 		return -NLE_NOMEM;
 
+	memset(tmp + n->nm_size, 0, newlen - n->nm_size);
+
 	n->nm_nlh = tmp;
 	n->nm_size = newlen;
 
@@ -557,7 +740,8 @@ void nlmsg_get(struct nl_msg *msg)
  * Release a reference from an netlink message
  * @arg msg		message to release reference from
  *
- * Frees memory after the last reference has been released.
+ * After the last reference has been released the message is kept for
+ * reuse by a later allocation or its memory is freed.
  */
 void nlmsg_free(struct nl_msg *msg)
 {
@@ -572,6 +756,21 @@ void nlmsg_free(struct nl_msg *msg)
 		BUG();
 
 	if (msg->nm_refcnt <= 0) {
+		if (msg->nm_flags & NL_MSG_EXT_BUF) {
+			/* Not ours, the message is pooled without buffer */
+			msg->nm_nlh = NULL;
+			msg->nm_size = 0;
+		} else if (msg->nm_size != default_msg_size) {
+			free(msg->nm_nlh);
+			msg->nm_nlh = NULL;
+			msg->nm_size = 0;
+		}
+
+		if (msg_pool_put(msg)) {
+			NL_DBG(2, "msg %p: Released to pool\n", msg);
+			return;
+		}
+
 		free(msg->nm_nlh);
 		NL_DBG(2, "msg %p: Freed\n", msg);
 		free(msg);
@@ -98,18 +98,68 @@ static struct nla_policy ct_timestamp_policy[CTA_TIMESTAMP_MAX + 1] = {
 	[CTA_TIMESTAMP_STOP]	= { .type = NLA_U64 },
 };
 
-static int ct_parse_ip(struct nfnl_ct *ct, int repl, struct nlattr *attr)
+/* Compiled from the policies above on initialization */
+NLA_SCHEMA_DEFINE(ct_schema, CTA_MAX);
+NLA_SCHEMA_DEFINE(ct_tuple_schema, CTA_TUPLE_MAX);
+NLA_SCHEMA_DEFINE(ct_ip_schema, CTA_IP_MAX);
+NLA_SCHEMA_DEFINE(ct_proto_schema, CTA_PROTO_MAX);
+NLA_SCHEMA_DEFINE(ct_protoinfo_schema, CTA_PROTOINFO_MAX);
+NLA_SCHEMA_DEFINE(ct_protoinfo_tcp_schema, CTA_PROTOINFO_TCP_MAX);
+NLA_SCHEMA_DEFINE(ct_counters_schema, CTA_COUNTERS_MAX);
+NLA_SCHEMA_DEFINE(ct_timestamp_schema, CTA_TIMESTAMP_MAX);
+
+/** @cond SKIP */
+/*
+ * Borrowed conntrack handed out by nfnl_ct_dump_foreach(). The addresses
+ * of both tuples are backed by the view itself so that parsing an entry
+ * does not allocate.
+ */
+struct ct_view {
+	struct nfnl_ct		cv_ct;
+	struct {
+		struct nl_addr	a;
+		char		data[16];
+	}			cv_addr[4];
+	unsigned int		cv_naddr;
+};
+/** @endcond */
+
+static struct nl_addr *ct_addr_attr(struct ct_view *view, struct nlattr *nla,
+				    int family)
+{
+	struct nl_addr *addr;
+
+	if (!view)
+		return nl_addr_alloc_attr(nla, family);
+
+	if (view->cv_naddr >= ARRAY_SIZE(view->cv_addr) ||
+	    nla_len(nla) > sizeof(view->cv_addr[0].data))
+		return NULL;
+
+	addr = &view->cv_addr[view->cv_naddr++].a;
+	addr->a_family = family;
+	addr->a_maxsize = sizeof(view->cv_addr[0].data);
+	addr->a_len = nla_len(nla);
+	addr->a_prefixlen = addr->a_len * 8;
+	addr->a_refcnt = 1;
+	memcpy(addr->a_addr, nla_data(nla), addr->a_len);
+
+	return addr;
+}
+
+static int ct_parse_ip(struct nfnl_ct *ct, int repl, struct nlattr *attr,
+		       struct ct_view *view)
 {
 	struct nlattr *tb[CTA_IP_MAX+1];
 	struct nl_addr *addr;
 	int err;
 
-	err = nla_parse_nested(tb, CTA_IP_MAX, attr, ct_ip_policy);
+	err = nla_parse_nested_schema(tb, attr, &ct_ip_schema);
 	if (err < 0)
 		goto errout;
 
 	if (tb[CTA_IP_V4_SRC]) {
-		addr = nl_addr_alloc_attr(tb[CTA_IP_V4_SRC], AF_INET);
+		addr = ct_addr_attr(view, tb[CTA_IP_V4_SRC], AF_INET);
 		if (addr == NULL)
 			goto errout_enomem;
 		err = nfnl_ct_set_src(ct, repl, addr);
@@ -118,7 +168,7 @@ static int ct_parse_ip(struct nfnl_ct *ct, int repl, struct nlattr *attr)
 			goto errout;
 	}
 	if (tb[CTA_IP_V4_DST]) {
-		addr = nl_addr_alloc_attr(tb[CTA_IP_V4_DST], AF_INET);
+		addr = ct_addr_attr(view, tb[CTA_IP_V4_DST], AF_INET);
 		if (addr == NULL)
 			goto errout_enomem;
 		err = nfnl_ct_set_dst(ct, repl, addr);
@@ -127,7 +177,7 @@ static int ct_parse_ip(struct nfnl_ct *ct, int repl, struct nlattr *attr)
 			goto errout;
 	}
 	if (tb[CTA_IP_V6_SRC]) {
-		addr = nl_addr_alloc_attr(tb[CTA_IP_V6_SRC], AF_INET6);
+		addr = ct_addr_attr(view, tb[CTA_IP_V6_SRC], AF_INET6);
 		if (addr == NULL)
 			goto errout_enomem;
 		err = nfnl_ct_set_src(ct, repl, addr);
@@ -136,7 +186,7 @@ static int ct_parse_ip(struct nfnl_ct *ct, int repl, struct nlattr *attr)
 			goto errout;
 	}
 	if (tb[CTA_IP_V6_DST]) {
-		addr = nl_addr_alloc_attr(tb[CTA_IP_V6_DST], AF_INET6);
+		addr = ct_addr_attr(view, tb[CTA_IP_V6_DST], AF_INET6);
 		if (addr == NULL)
 			goto errout_enomem;
 		err = nfnl_ct_set_dst(ct, repl, addr);
@@ -158,7 +208,7 @@ static int ct_parse_proto(struct nfnl_ct *ct, int repl, struct nlattr *attr)
 	struct nlattr *tb[CTA_PROTO_MAX+1];
 	int err;
 
-	err = nla_parse_nested(tb, CTA_PROTO_MAX, attr, ct_proto_policy);
+	err = nla_parse_nested_schema(tb, attr, &ct_proto_schema);
 	if (err < 0)
 		return err;
 
@@ -196,17 +246,18 @@ static int ct_parse_proto(struct nfnl_ct *ct, int repl, struct nlattr *attr)
 	return 0;
 }
 
-static int ct_parse_tuple(struct nfnl_ct *ct, int repl, struct nlattr *attr)
+static int ct_parse_tuple(struct nfnl_ct *ct, int repl, struct nlattr *attr,
+			  struct ct_view *view)
 {
 	struct nlattr *tb[CTA_TUPLE_MAX+1];
 	int err;
 
-	err = nla_parse_nested(tb, CTA_TUPLE_MAX, attr, ct_tuple_policy);
+	err = nla_parse_nested_schema(tb, attr, &ct_tuple_schema);
 	if (err < 0)
 		return err;
 
 	if (tb[CTA_TUPLE_IP]) {
-		err = ct_parse_ip(ct, repl, tb[CTA_TUPLE_IP]);
+		err = ct_parse_ip(ct, repl, tb[CTA_TUPLE_IP], view);
 		if (err < 0)
 			return err;
 	}
@@ -225,8 +276,7 @@ static int ct_parse_protoinfo_tcp(struct nfnl_ct *ct, struct nlattr *attr)
 	struct nlattr *tb[CTA_PROTOINFO_TCP_MAX+1];
 	int err;
 
-	err = nla_parse_nested(tb, CTA_PROTOINFO_TCP_MAX, attr,
-			       ct_protoinfo_tcp_policy);
+	err = nla_parse_nested_schema(tb, attr, &ct_protoinfo_tcp_schema);
 	if (err < 0)
 		return err;
 
@@ -242,8 +292,7 @@ static int ct_parse_protoinfo(struct nfnl_ct *ct, struct nlattr *attr)
 	struct nlattr *tb[CTA_PROTOINFO_MAX+1];
 	int err;
 
-	err = nla_parse_nested(tb, CTA_PROTOINFO_MAX, attr,
-			       ct_protoinfo_policy);
+	err = nla_parse_nested_schema(tb, attr, &ct_protoinfo_schema);
 	if (err < 0)
 		return err;
 
@@ -261,7 +310,7 @@ static int ct_parse_counters(struct nfnl_ct *ct, int repl, struct nlattr *attr)
 	struct nlattr *tb[CTA_COUNTERS_MAX+1];
 	int err;
 
-	err = nla_parse_nested(tb, CTA_COUNTERS_MAX, attr, ct_counters_policy);
+	err = nla_parse_nested_schema(tb, attr, &ct_counters_schema);
 	if (err < 0)
 		return err;
 
@@ -301,8 +350,7 @@ static int ct_parse_timestamp(struct nfnl_ct *ct, struct nlattr *attr)
 	struct nlattr *tb[CTA_TIMESTAMP_MAX + 1];
 	int err;
 
-	err = nla_parse_nested(tb, CTA_TIMESTAMP_MAX, attr,
-			       ct_timestamp_policy);
+	err = nla_parse_nested_schema(tb, attr, &ct_timestamp_schema);
 	if (err < 0)
 		return err;
 
@@ -314,40 +362,36 @@ static int ct_parse_timestamp(struct nfnl_ct *ct, struct nlattr *attr)
 	return 0;
 }
 
-int nfnlmsg_ct_parse(struct nlmsghdr *nlh, struct nfnl_ct **result)
+static int ct_parse_msg(struct nfnl_ct *ct, struct nlmsghdr *nlh,
+			struct ct_view *view)
 {
-	struct nfnl_ct *ct;
 	struct nlattr *tb[CTA_MAX+1];
 	int err;
 
-	ct = nfnl_ct_alloc();
-	if (!ct)
-		return -NLE_NOMEM;
-
 	ct->ce_msgtype = nlh->nlmsg_type;
 
-	err = nlmsg_parse(nlh, sizeof(struct nfgenmsg), tb, CTA_MAX,
-			  ct_policy);
+	err = nlmsg_parse_schema(nlh, sizeof(struct nfgenmsg), tb,
+				 &ct_schema);
 	if (err < 0)
-		goto errout;
+		return err;
 
 	nfnl_ct_set_family(ct, nfnlmsg_family(nlh));
 
 	if (tb[CTA_TUPLE_ORIG]) {
-		err = ct_parse_tuple(ct, 0, tb[CTA_TUPLE_ORIG]);
+		err = ct_parse_tuple(ct, 0, tb[CTA_TUPLE_ORIG], view);
 		if (err < 0)
-			goto errout;
+			return err;
 	}
 	if (tb[CTA_TUPLE_REPLY]) {
-		err = ct_parse_tuple(ct, 1, tb[CTA_TUPLE_REPLY]);
+		err = ct_parse_tuple(ct, 1, tb[CTA_TUPLE_REPLY], view);
 		if (err < 0)
-			goto errout;
+			return err;
 	}
 
 	if (tb[CTA_PROTOINFO]) {
 		err = ct_parse_protoinfo(ct, tb[CTA_PROTOINFO]);
 		if (err < 0)
-			goto errout;
+			return err;
 	}
 
 	if (tb[CTA_STATUS])
@@ -366,27 +410,40 @@ int nfnlmsg_ct_parse(struct nlmsghdr *nlh, struct nfnl_ct **result)
 	if (tb[CTA_COUNTERS_ORIG]) {
 		err = ct_parse_counters(ct, 0, tb[CTA_COUNTERS_ORIG]);
 		if (err < 0)
-			goto errout;
+			return err;
 	}
 
 	if (tb[CTA_COUNTERS_REPLY]) {
 		err = ct_parse_counters(ct, 1, tb[CTA_COUNTERS_REPLY]);
 		if (err < 0)
-			goto errout;
+			return err;
 	}
 
 	if (tb[CTA_TIMESTAMP]) {
 		err = ct_parse_timestamp(ct, tb[CTA_TIMESTAMP]);
 		if (err < 0)
-			goto errout;
+			return err;
 	}
 
-	*result = ct;
 	return 0;
+}
 
-errout:
-	nfnl_ct_put(ct);
-	return err;
+int nfnlmsg_ct_parse(struct nlmsghdr *nlh, struct nfnl_ct **result)
+{
+	struct nfnl_ct *ct;
+	int err;
+
+	ct = nfnl_ct_alloc();
+	if (!ct)
+		return -NLE_NOMEM;
+
+	if ((err = ct_parse_msg(ct, nlh, NULL)) < 0) {
+		nfnl_ct_put(ct);
+		return err;
+	}
+
+	*result = ct;
+	return 0;
 }
 
 static int ct_msg_parser(struct nl_cache_ops *ops, struct sockaddr_nl *who,
@@ -416,6 +473,95 @@ int nfnl_ct_dump_request(struct nl_sock *sk)
 				NLM_F_DUMP, AF_UNSPEC, 0);
 }
 
+/** @cond SKIP */
+struct ct_dump_arg {
+	int		(*cb)(struct nfnl_ct *, void *);
+	void *		arg;
+	int		err;
+	int		stop;
+};
+/** @endcond */
+
+static int ct_dump_valid(struct nl_msg *msg, void *arg)
+{
+	struct ct_dump_arg *d = arg;
+	struct nlmsghdr *nlh = nlmsg_hdr(msg);
+	struct ct_view view;
+	int err;
+
+	if (d->stop || nfnlmsg_subsys(nlh) != NFNL_SUBSYS_CTNETLINK ||
+	    nfnlmsg_subtype(nlh) != IPCTNL_MSG_CT_NEW)
+		return NL_SKIP;
+
+	memset(&view, 0, sizeof(view));
+	view.cv_ct.ce_ops = &ct_obj_ops;
+	view.cv_ct.ce_refcnt = 1;
+	nl_init_list_head(&view.cv_ct.ce_list);
+
+	if ((err = ct_parse_msg(&view.cv_ct, nlh, &view)) < 0) {
+		d->err = err;
+		d->stop = 1;
+		return NL_SKIP;
+	}
+
+	err = d->cb(&view.cv_ct, d->arg);
+	if (err < 0)
+		d->err = err;
+	if (err < 0 || err == NL_STOP)
+		d->stop = 1;
+
+	return NL_OK;
+}
+
+/**
+ * Walk all conntracks in the kernel without building a cache
+ * @arg sk		Netlink socket.
+ * @arg cb		Function called for every conntrack
+ * @arg arg		Argument passed to \c cb
+ *
+ * Requests a dump of the conntrack table and calls \c cb for every
+ * entry as it is received. The conntrack passed to \c cb lives on the
+ * stack of the receiving function and is only valid for the duration of
+ * the call; no memory is allocated per entry. The callback must neither
+ * acquire nor release a reference to it, use nl_object_clone() to keep
+ * an entry around.
+ *
+ * The callback returns NL_OK to continue or NL_STOP to stop the walk.
+ * A negative return value stops the walk as well and is returned by
+ * this function. The remainder of the dump is drained from the socket
+ * in either case so the socket can be reused.
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nfnl_ct_dump_foreach(struct nl_sock *sk,
+			 int (*cb)(struct nfnl_ct *, void *), void *arg)
+{
+	struct ct_dump_arg d = {
+		.cb = cb,
+		.arg = arg,
+	};
+	struct nl_cb *orig, *nlcb;
+	int err;
+
+	orig = nl_socket_get_cb(sk);
+	nlcb = nl_cb_clone(orig);
+	nl_cb_put(orig);
+	if (!nlcb)
+		return -NLE_NOMEM;
+
+	nl_cb_set(nlcb, NL_CB_VALID, NL_CB_CUSTOM, ct_dump_valid, &d);
+
+	if ((err = nfnl_ct_dump_request(sk)) >= 0)
+		err = nl_recvmsgs(sk, nlcb);
+
+	nl_cb_put(nlcb);
+
+	if (err < 0)
+		return err;
+
+	return d.err;
+}
+
 static int ct_request_update(struct nl_cache *cache, struct nl_sock *sk)
 {
 	return nfnl_ct_dump_request(sk);
@@ -667,6 +813,15 @@ static struct nl_cache_ops nfnl_ct_ops = {
 
 static void __init ct_init(void)
 {
+	__nla_schema_init(&ct_schema, ct_policy);
+	__nla_schema_init(&ct_tuple_schema, ct_tuple_policy);
+	__nla_schema_init(&ct_ip_schema, ct_ip_policy);
+	__nla_schema_init(&ct_proto_schema, ct_proto_policy);
+	__nla_schema_init(&ct_protoinfo_schema, ct_protoinfo_policy);
+	__nla_schema_init(&ct_protoinfo_tcp_schema, ct_protoinfo_tcp_policy);
+	__nla_schema_init(&ct_counters_schema, ct_counters_policy);
+	__nla_schema_init(&ct_timestamp_schema, ct_timestamp_policy);
+
 	nl_cache_mngt_register(&nfnl_ct_ops);
 }
 
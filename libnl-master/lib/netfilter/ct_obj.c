@@ -19,6 +19,7 @@
 #include <netlink-private/netlink.h>
 #include <netlink/netfilter/nfnl.h>
 #include <netlink/netfilter/ct.h>
+#include <netlink/hashtable.h>
 
 /** @cond SKIP */
 #define CT_ATTR_FAMILY		(1UL << 0)
@@ -297,6 +298,71 @@ static void ct_dump_stats(struct nl_object *a, struct nl_dump_params *p)
 	}
 }
 
+/*
+ * A conntrack is identified by its original tuple and its zone, which
+ * is what the kernel uses to look it up. Ports and ICMP identifiers only
+ * take part if the protocol provides them.
+ */
+static uint32_t ct_id_attrs_get(struct nl_object *obj)
+{
+	uint32_t rv = obj->ce_ops->oo_id_attrs;
+
+	rv |= obj->ce_mask & (CT_ATTR_ORIG_SRC_PORT | CT_ATTR_ORIG_DST_PORT |
+			      CT_ATTR_ORIG_ICMP_ID | CT_ATTR_ORIG_ICMP_TYPE |
+			      CT_ATTR_ORIG_ICMP_CODE | CT_ATTR_ZONE);
+
+	return rv;
+}
+
+static void ct_keygen(struct nl_object *obj, uint32_t *hashkey,
+		      uint32_t table_sz)
+{
+	struct nfnl_ct *ct = (struct nfnl_ct *) obj;
+	struct ct_hash_key {
+		uint8_t		family;
+		uint8_t		proto;
+		uint16_t	zone;
+		uint16_t	sport;
+		uint16_t	dport;
+		uint16_t	icmp_id;
+		uint8_t		icmp_type;
+		uint8_t		icmp_code;
+		uint8_t		src[16];
+		uint8_t		dst[16];
+	} __attribute__((packed)) key;
+	struct nl_addr *src = ct->ct_orig.src, *dst = ct->ct_orig.dst;
+
+	memset(&key, 0, sizeof(key));
+
+	key.family = ct->ct_family;
+	key.proto = ct->ct_proto;
+	if (ct->ce_mask & CT_ATTR_ZONE)
+		key.zone = ct->ct_zone;
+	if (ct->ce_mask & CT_ATTR_ORIG_SRC_PORT)
+		key.sport = ct->ct_orig.proto.port.src;
+	if (ct->ce_mask & CT_ATTR_ORIG_DST_PORT)
+		key.dport = ct->ct_orig.proto.port.dst;
+	if (ct->ce_mask & CT_ATTR_ORIG_ICMP_ID)
+		key.icmp_id = ct->ct_orig.proto.icmp.id;
+	if (ct->ce_mask & CT_ATTR_ORIG_ICMP_TYPE)
+		key.icmp_type = ct->ct_orig.proto.icmp.type;
+	if (ct->ce_mask & CT_ATTR_ORIG_ICMP_CODE)
+		key.icmp_code = ct->ct_orig.proto.icmp.code;
+	if ((ct->ce_mask & CT_ATTR_ORIG_SRC) && src)
+		memcpy(key.src, nl_addr_get_binary_addr(src),
+		       min_t(unsigned int, nl_addr_get_len(src),
+			     sizeof(key.src)));
+	if ((ct->ce_mask & CT_ATTR_ORIG_DST) && dst)
+		memcpy(key.dst, nl_addr_get_binary_addr(dst),
+		       min_t(unsigned int, nl_addr_get_len(dst),
+			     sizeof(key.dst)));
+
+	*hashkey = nl_hash(&key, sizeof(key), 0) % table_sz;
+
+	NL_DBG(5, "ct %p key (fam %d proto %d) hash 0x%x\n",
+	       ct, key.family, key.proto, *hashkey);
+}
+
 static uint64_t ct_compare(struct nl_object *_a, struct nl_object *_b,
 			   uint64_t attrs, int flags)
 {
@@ -318,6 +384,7 @@ static uint64_t ct_compare(struct nl_object *_a, struct nl_object *_b,
 	diff |= CT_DIFF_VAL(MARK,		ct_mark);
 	diff |= CT_DIFF_VAL(USE,		ct_use);
 	diff |= CT_DIFF_VAL(ID,			ct_id);
+	diff |= CT_DIFF_VAL(ZONE,		ct_zone);
 	diff |= CT_DIFF_ADDR(ORIG_SRC,		ct_orig.src);
 	diff |= CT_DIFF_ADDR(ORIG_DST,		ct_orig.dst);
 	diff |= CT_DIFF_VAL(ORIG_SRC_PORT,	ct_orig.proto.port.src);
@@ -844,7 +911,11 @@ struct nl_object_ops ct_obj_ops = {
 	    [NL_DUMP_STATS]	= ct_dump_stats,
 	},
 	.oo_compare		= ct_compare,
+	.oo_keygen		= ct_keygen,
 	.oo_attrs2str		= ct_attrs2str,
+	.oo_id_attrs		= (CT_ATTR_FAMILY | CT_ATTR_PROTO |
+				   CT_ATTR_ORIG_SRC | CT_ATTR_ORIG_DST),
+	.oo_id_attrs_get	= ct_id_attrs_get,
 };
 
 /** @} */
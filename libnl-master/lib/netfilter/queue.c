@@ -149,6 +149,13 @@ static int nfnl_queue_build_request(const struct nfnl_queue *queue,
 			goto nla_put_failure;
 	}
 
+	if (nfnl_queue_test_flags(queue) &&
+	    (nla_put_u32(msg, NFQA_CFG_MASK,
+			 htonl(queue->queue_flag_mask)) < 0 ||
+	     nla_put_u32(msg, NFQA_CFG_FLAGS,
+			 htonl(nfnl_queue_get_flags(queue))) < 0))
+		goto nla_put_failure;
+
 	*result = msg;
 	return 0;
 
@@ -0,0 +1,651 @@
+/*
+ * lib/netfilter/queue_consumer.c	Netfilter Queue Consumer
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+/**
+ * @ingroup queue
+ * @defgroup queue_consumer Consumer
+ * @brief High-throughput packet processing loop
+ *
+ * A queue consumer owns a netlink socket bound to a single queue and
+ * implements the receive, parse and verdict cycle in a way which keeps
+ * per-packet overhead to a minimum:
+ *
+ * - Packets are received in batches with a single recvmmsg() call into
+ *   preallocated buffers.
+ * - Packets are handed to the callback as a queue message which lives
+ *   on the stack and whose payload points into the receive buffer. No
+ *   memory is allocated or copied per packet.
+ * - The verdict is the return value of the callback. Consecutive packets
+ *   with the same verdict are answered with a single batch verdict and
+ *   all verdicts of a receive batch are sent with one system call.
+ *
+ * The callback must not hold on to the message or its payload after it
+ * returns, use nl_object_clone() to keep a copy. Replacing the payload
+ * with nfnl_queue_msg_set_payload() is permitted, the message then owns
+ * a copy of the new payload, which is released once the callback
+ * returns. The new payload is not sent to the kernel, see
+ * nfnl_queue_msg_send_verdict_payload().
+ *
+ * Packet ids are assigned sequentially by the kernel. If the socket
+ * overruns, the lost packets are detected by a gap in the ids and
+ * released with a batch verdict: NF_ACCEPT if the queue has been
+ * configured with NFQA_CFG_F_FAIL_OPEN, NF_DROP otherwise.
+ *
+ * To scale beyond a single CPU, spread packets over a range of queues
+ * (`--queue-balance` with `--queue-cpu-fanout` in iptables, `fanout`
+ * in nftables) and run one consumer per queue, each pinned to the CPU
+ * feeding it:
+ * @code
+ * for (i = 0; i < ncpus; i++) {
+ *         nfnl_queue_set_group(queue, base + i);
+ *         nfnl_queue_consumer_alloc(queue, my_filter, NULL, &consumer[i]);
+ *         nfnl_queue_consumer_start(consumer[i], i);
+ * }
+ * @endcode
+ * @{
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+
+#include <netlink-private/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink_queue.h>
+#include <netlink/attr.h>
+#include <netlink/netfilter/nfnl.h>
+#include <netlink/netfilter/queue.h>
+#include <netlink/netfilter/queue_msg.h>
+
+/** @cond SKIP */
+#define QC_BATCH_DEFAULT	64
+#define QC_RCVBUF		(32 * 1024 * 1024)
+#define QC_OVERHEAD		1024
+#define QC_MAX_PAYLOAD		0xffff
+
+#define QC_VERDICT_SIZE		(NLMSG_ALIGN(sizeof(struct nlmsghdr)) + \
+				 NLMSG_ALIGN(sizeof(struct nfgenmsg)) + \
+				 nla_total_size(sizeof(struct nfqnl_msg_verdict_hdr)) + \
+				 nla_total_size(sizeof(uint32_t)))
+
+struct nfnl_queue_consumer {
+	struct nl_sock *	qc_sock;
+	uint16_t		qc_group;
+	uint32_t		qc_lost_verdict;
+
+	int		      (*qc_cb)(struct nfnl_queue_msg *, void *);
+	void *			qc_arg;
+
+	unsigned int		qc_batch;
+	size_t			qc_slot;
+	char *			qc_rxbuf;
+	struct mmsghdr *	qc_mmsg;
+	struct iovec *		qc_iov;
+
+	char *			qc_txbuf;
+	size_t			qc_txlen;
+	size_t			qc_txsize;
+
+	/* Run of consecutive packets with the same verdict */
+	uint32_t		qc_run_id;
+	uint32_t		qc_run_verdict;
+	unsigned int		qc_run_len;
+
+	uint32_t		qc_next_id;
+	int			qc_have_id;
+
+	uint64_t		qc_packets;
+	uint64_t		qc_verdicts;
+	uint64_t		qc_overruns;
+
+	int			qc_cpu;
+	int			qc_stop_fd;
+	int			qc_thread_running;
+#ifndef DISABLE_PTHREADS
+	pthread_t		qc_thread;
+#endif
+};
+/** @endcond */
+
+static void consumer_free_buffers(struct nfnl_queue_consumer *c)
+{
+	free(c->qc_rxbuf);
+	free(c->qc_mmsg);
+	free(c->qc_iov);
+	free(c->qc_txbuf);
+
+	c->qc_rxbuf = c->qc_txbuf = NULL;
+	c->qc_mmsg = NULL;
+	c->qc_iov = NULL;
+}
+
+static int consumer_alloc_buffers(struct nfnl_queue_consumer *c,
+				  unsigned int batch)
+{
+	unsigned int i;
+
+	consumer_free_buffers(c);
+
+	/*
+	 * A lost packet may require an additional verdict, so two
+	 * verdicts per packet plus the final run is the worst case.
+	 */
+	c->qc_txsize = (2 * batch + 1) * QC_VERDICT_SIZE;
+	c->qc_rxbuf = malloc(batch * c->qc_slot);
+	c->qc_mmsg = calloc(batch, sizeof(*c->qc_mmsg));
+	c->qc_iov = calloc(batch, sizeof(*c->qc_iov));
+	c->qc_txbuf = malloc(c->qc_txsize);
+
+	if (!c->qc_rxbuf || !c->qc_mmsg || !c->qc_iov || !c->qc_txbuf) {
+		consumer_free_buffers(c);
+		return -NLE_NOMEM;
+	}
+
+	for (i = 0; i < batch; i++) {
+		c->qc_iov[i].iov_base = c->qc_rxbuf + i * c->qc_slot;
+		c->qc_iov[i].iov_len = c->qc_slot;
+		c->qc_mmsg[i].msg_hdr.msg_iov = &c->qc_iov[i];
+		c->qc_mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	c->qc_batch = batch;
+
+	return 0;
+}
+
+/**
+ * Allocate a queue consumer
+ * @arg queue		Queue to bind to
+ * @arg cb		Callback invoked for every packet
+ * @arg arg		Argument passed to the callback
+ * @arg result		Result pointer
+ *
+ * Opens a new netlink socket and binds it to the queue, creating the
+ * queue with the configuration of \c queue. The group of the queue must
+ * be set. The receive buffers are sized for the largest payload the copy
+ * mode and copy range permit, which also accommodates the unsegmented
+ * packets of queues with NFQA_CFG_F_GSO.
+ *
+ * The callback is given the packet and returns its verdict, one of the
+ * NF_* values. The mark of the packet may be changed in the callback
+ * using nfnl_queue_msg_set_mark(), it is then sent along with the
+ * verdict. A negative return value drops the packet and is returned by
+ * nfnl_queue_consumer_dispatch().
+ *
+ * The queue is destroyed when the consumer is freed.
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nfnl_queue_consumer_alloc(struct nfnl_queue *queue,
+			      int (*cb)(struct nfnl_queue_msg *, void *),
+			      void *arg, struct nfnl_queue_consumer **result)
+{
+	struct nfnl_queue_consumer *c;
+	uint32_t flags = 0, payload = 0;
+	int err, bufsize = QC_RCVBUF;
+
+	if (!nfnl_queue_test_group(queue) || !cb)
+		return -NLE_MISSING_ATTR;
+
+	if (!(c = calloc(1, sizeof(*c))))
+		return -NLE_NOMEM;
+
+	c->qc_group = nfnl_queue_get_group(queue);
+	c->qc_cb = cb;
+	c->qc_arg = arg;
+	c->qc_cpu = -1;
+	c->qc_stop_fd = -1;
+
+	if (nfnl_queue_test_flags(queue))
+		flags = nfnl_queue_get_flags(queue);
+
+	c->qc_lost_verdict = (flags & NFQA_CFG_F_FAIL_OPEN) ?
+			     NF_ACCEPT : NF_DROP;
+
+	if (nfnl_queue_test_copy_mode(queue) &&
+	    nfnl_queue_get_copy_mode(queue) == NFNL_QUEUE_COPY_PACKET) {
+		payload = QC_MAX_PAYLOAD;
+		if (nfnl_queue_test_copy_range(queue) &&
+		    nfnl_queue_get_copy_range(queue) < payload)
+			payload = nfnl_queue_get_copy_range(queue);
+	}
+
+	c->qc_slot = payload + QC_OVERHEAD;
+	c->qc_slot = (c->qc_slot + getpagesize() - 1) & ~(getpagesize() - 1);
+
+	if ((err = consumer_alloc_buffers(c, QC_BATCH_DEFAULT)) < 0)
+		goto errout;
+
+	if (!(c->qc_sock = nl_socket_alloc())) {
+		err = -NLE_NOMEM;
+		goto errout;
+	}
+
+	if ((err = nfnl_connect(c->qc_sock)) < 0)
+		goto errout;
+
+	/* The forced variant requires CAP_NET_ADMIN, fall back if denied */
+	if (setsockopt(nl_socket_get_fd(c->qc_sock), SOL_SOCKET, SO_RCVBUFFORCE,
+		       &bufsize, sizeof(bufsize)) < 0)
+		nl_socket_set_buffer_size(c->qc_sock, bufsize, 0);
+
+	if ((err = nfnl_queue_create(c->qc_sock, queue)) < 0)
+		goto errout;
+
+	NL_DBG(2, "Queue consumer %p, group %u, slot size %zu\n",
+	       c, c->qc_group, c->qc_slot);
+
+	*result = c;
+	return 0;
+
+errout:
+	nfnl_queue_consumer_free(c);
+	return err;
+}
+
+/**
+ * Free a queue consumer
+ * @arg c		Queue consumer
+ *
+ * Stops the worker thread if running and closes the socket, which
+ * destroys the queue.
+ */
+void nfnl_queue_consumer_free(struct nfnl_queue_consumer *c)
+{
+	if (!c)
+		return;
+
+	nfnl_queue_consumer_stop(c);
+	nl_socket_free(c->qc_sock);
+	consumer_free_buffers(c);
+	free(c);
+}
+
+/**
+ * Return the socket of a queue consumer
+ * @arg c		Queue consumer
+ *
+ * The socket may be used to wait for packets with poll() before calling
+ * nfnl_queue_consumer_dispatch().
+ */
+struct nl_sock *nfnl_queue_consumer_get_sock(struct nfnl_queue_consumer *c)
+{
+	return c->qc_sock;
+}
+
+/**
+ * Set number of packets received per system call
+ * @arg c		Queue consumer
+ * @arg batch		Maximum number of packets per batch
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nfnl_queue_consumer_set_batch(struct nfnl_queue_consumer *c,
+				  unsigned int batch)
+{
+	if (c->qc_thread_running)
+		return -NLE_BUSY;
+
+	if (!batch)
+		return -NLE_INVAL;
+
+	return consumer_alloc_buffers(c, batch);
+}
+
+static void consumer_put_verdict(struct nfnl_queue_consumer *c, int type,
+				 uint32_t id, uint32_t verdict,
+				 const uint32_t *mark)
+{
+	struct nlmsghdr *nlh;
+	struct nfgenmsg *nfg;
+	struct nlattr *nla;
+	struct nfqnl_msg_verdict_hdr *hdr;
+
+	nlh = (struct nlmsghdr *) (c->qc_txbuf + c->qc_txlen);
+	nlh->nlmsg_type = NFNLMSG_TYPE(NFNL_SUBSYS_QUEUE, type);
+	nlh->nlmsg_flags = NLM_F_REQUEST;
+	nlh->nlmsg_seq = 0;
+	nlh->nlmsg_pid = 0;
+	nlh->nlmsg_len = NLMSG_LENGTH(sizeof(*nfg));
+
+	nfg = nlmsg_data(nlh);
+	nfg->nfgen_family = AF_UNSPEC;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(c->qc_group);
+
+	nla = (struct nlattr *) ((char *) nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+	nla->nla_type = NFQA_VERDICT_HDR;
+	nla->nla_len = nla_attr_size(sizeof(*hdr));
+	hdr = nla_data(nla);
+	hdr->verdict = htonl(verdict);
+	hdr->id = htonl(id);
+	nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + nla_total_size(sizeof(*hdr));
+
+	if (mark) {
+		nla = (struct nlattr *) ((char *) nlh + nlh->nlmsg_len);
+		nla->nla_type = NFQA_MARK;
+		nla->nla_len = nla_attr_size(sizeof(uint32_t));
+		*(uint32_t *) nla_data(nla) = htonl(*mark);
+		nlh->nlmsg_len += nla_total_size(sizeof(uint32_t));
+	}
+
+	c->qc_txlen += NLMSG_ALIGN(nlh->nlmsg_len);
+	c->qc_verdicts++;
+}
+
+static void consumer_flush_run(struct nfnl_queue_consumer *c)
+{
+	if (!c->qc_run_len)
+		return;
+
+	consumer_put_verdict(c, c->qc_run_len > 1 ? NFQNL_MSG_VERDICT_BATCH :
+						     NFQNL_MSG_VERDICT,
+			     c->qc_run_id, c->qc_run_verdict, NULL);
+	c->qc_run_len = 0;
+}
+
+static int consumer_send(struct nfnl_queue_consumer *c)
+{
+	int err;
+
+	consumer_flush_run(c);
+
+	if (!c->qc_txlen)
+		return 0;
+
+	err = nl_sendto(c->qc_sock, c->qc_txbuf, c->qc_txlen);
+	c->qc_txlen = 0;
+
+	return err < 0 ? err : 0;
+}
+
+static int consumer_handle(struct nfnl_queue_consumer *c,
+			   struct nlmsghdr *nlh)
+{
+	struct nfnl_queue_msg msg;
+	uint32_t id, mark;
+	int verdict, err, has_mark;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.ce_ops = &queue_msg_obj_ops;
+	msg.ce_refcnt = 1;
+
+	if ((err = queue_msg_parse(&msg, nlh, 1)) < 0)
+		return err;
+
+	if (!nfnl_queue_msg_test_packetid(&msg))
+		return -NLE_MISSING_ATTR;
+
+	id = nfnl_queue_msg_get_packetid(&msg);
+	c->qc_packets++;
+
+	/*
+	 * Packets missing in the sequence were lost to a socket overrun,
+	 * they are still waiting in the queue and need a verdict.
+	 */
+	if (c->qc_have_id && (int32_t) (id - c->qc_next_id) > 0) {
+		NL_DBG(2, "Queue consumer %p, lost packets %u-%u\n",
+		       c, c->qc_next_id, id - 1);
+		consumer_flush_run(c);
+		consumer_put_verdict(c, NFQNL_MSG_VERDICT_BATCH, id - 1,
+				     c->qc_lost_verdict, NULL);
+	}
+
+	c->qc_next_id = id + 1;
+	c->qc_have_id = 1;
+
+	has_mark = nfnl_queue_msg_test_mark(&msg);
+	mark = nfnl_queue_msg_get_mark(&msg);
+
+	if ((verdict = c->qc_cb(&msg, c->qc_arg)) < 0) {
+		err = verdict;
+		verdict = NF_DROP;
+	} else
+		err = 0;
+
+	/* The callback replaced the payload with a copy of its own */
+	if (!msg.queue_msg_payload_borrowed)
+		free(msg.queue_msg_payload);
+
+	if (nfnl_queue_msg_test_mark(&msg) &&
+	    (!has_mark || nfnl_queue_msg_get_mark(&msg) != mark)) {
+		mark = nfnl_queue_msg_get_mark(&msg);
+		consumer_flush_run(c);
+		consumer_put_verdict(c, NFQNL_MSG_VERDICT, id, verdict, &mark);
+	} else if (c->qc_run_len && c->qc_run_verdict == (uint32_t) verdict) {
+		c->qc_run_id = id;
+		c->qc_run_len++;
+	} else {
+		consumer_flush_run(c);
+		c->qc_run_id = id;
+		c->qc_run_verdict = verdict;
+		c->qc_run_len = 1;
+	}
+
+	/* A receive batch may carry more messages than datagrams */
+	if (c->qc_txlen + 2 * QC_VERDICT_SIZE > c->qc_txsize) {
+		int serr = consumer_send(c);
+		if (serr < 0)
+			return serr;
+	}
+
+	return err;
+}
+
+/**
+ * Receive and process a batch of packets
+ * @arg c		Queue consumer
+ *
+ * Waits for at least one packet, then receives as many packets as are
+ * available up to the batch size without blocking, passes them to the
+ * callback and sends the resulting verdicts. Must not be called while
+ * the worker thread is running.
+ *
+ * Socket overruns are counted and otherwise ignored, see
+ * nfnl_queue_consumer_get_overruns().
+ *
+ * @return Number of packets processed or a negative error code.
+ */
+int nfnl_queue_consumer_dispatch(struct nfnl_queue_consumer *c)
+{
+	uint64_t packets = c->qc_packets;
+	int i, n, len, err = 0, cerr;
+
+	n = recvmmsg(nl_socket_get_fd(c->qc_sock), c->qc_mmsg, c->qc_batch,
+		     MSG_WAITFORONE, NULL);
+	if (n < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+			return 0;
+		if (errno == ENOBUFS) {
+			c->qc_overruns++;
+			return 0;
+		}
+		return -nl_syserr2nlerr(errno);
+	}
+
+	for (i = 0; i < n; i++) {
+		struct nlmsghdr *nlh = c->qc_iov[i].iov_base;
+
+		len = c->qc_mmsg[i].msg_len;
+		if (c->qc_mmsg[i].msg_hdr.msg_flags & MSG_TRUNC) {
+			/* Released as lost packet once the gap is noticed */
+			NL_DBG(1, "Queue consumer %p, truncated packet, slot "
+			       "size %zu too small\n", c, c->qc_slot);
+			continue;
+		}
+
+		for (; nlmsg_ok(nlh, len); nlh = nlmsg_next(nlh, &len)) {
+			if (NFNL_SUBSYS_ID(nlh->nlmsg_type) != NFNL_SUBSYS_QUEUE ||
+			    NFNL_MSG_TYPE(nlh->nlmsg_type) != NFQNL_MSG_PACKET)
+				continue;
+
+			if ((cerr = consumer_handle(c, nlh)) < 0 && !err)
+				err = cerr;
+		}
+	}
+
+	if ((cerr = consumer_send(c)) < 0)
+		return cerr;
+
+	return err < 0 ? err : (int) (c->qc_packets - packets);
+}
+
+#ifndef DISABLE_PTHREADS
+static void *consumer_worker(void *arg)
+{
+	struct nfnl_queue_consumer *c = arg;
+	struct pollfd fds[2] = {
+		{ .fd = nl_socket_get_fd(c->qc_sock), .events = POLLIN },
+		{ .fd = c->qc_stop_fd, .events = POLLIN },
+	};
+	int err;
+
+	if (c->qc_cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(c->qc_cpu, &set);
+		if ((err = pthread_setaffinity_np(pthread_self(),
+						  sizeof(set), &set)))
+			NL_DBG(1, "Queue consumer %p, unable to pin to "
+			       "CPU %d: %s\n", c, c->qc_cpu, strerror(err));
+	}
+
+	for (;;) {
+		if (poll(fds, 2, -1) < 0 && errno != EINTR)
+			break;
+
+		if (fds[1].revents)
+			break;
+
+		if (!fds[0].revents)
+			continue;
+
+		err = nfnl_queue_consumer_dispatch(c);
+		if (err == -NLE_NOMEM || err == -NLE_BAD_SOCK) {
+			NL_DBG(1, "Queue consumer %p, worker stopped: %s\n",
+			       c, nl_geterror(err));
+			break;
+		}
+	}
+
+	return NULL;
+}
+#endif
+
+/**
+ * Process packets in a dedicated worker thread
+ * @arg c		Queue consumer
+ * @arg cpu		CPU to pin the worker to or -1
+ *
+ * Starts a thread which calls nfnl_queue_consumer_dispatch() whenever
+ * packets are available. The callback is invoked in the context of
+ * this thread.
+ *
+ * @see nfnl_queue_consumer_stop()
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nfnl_queue_consumer_start(struct nfnl_queue_consumer *c, int cpu)
+{
+#ifndef DISABLE_PTHREADS
+	int err;
+
+	if (c->qc_thread_running)
+		return -NLE_BUSY;
+
+	if ((c->qc_stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+		return -nl_syserr2nlerr(errno);
+
+	c->qc_cpu = cpu;
+
+	if ((err = pthread_create(&c->qc_thread, NULL, consumer_worker, c))) {
+		close(c->qc_stop_fd);
+		c->qc_stop_fd = -1;
+		return -nl_syserr2nlerr(err);
+	}
+
+	c->qc_thread_running = 1;
+
+	NL_DBG(1, "Queue consumer %p, started worker thread\n", c);
+
+	return 0;
+#else
+	return -NLE_OPNOTSUPP;
+#endif
+}
+
+/**
+ * Stop the worker thread
+ * @arg c		Queue consumer
+ *
+ * Stops the thread started by nfnl_queue_consumer_start(). Packets
+ * still queued remain in the socket and are processed by the next
+ * call to nfnl_queue_consumer_dispatch().
+ */
+void nfnl_queue_consumer_stop(struct nfnl_queue_consumer *c)
+{
+#ifndef DISABLE_PTHREADS
+	uint64_t one = 1;
+
+	if (!c->qc_thread_running)
+		return;
+
+	if (write(c->qc_stop_fd, &one, sizeof(one)) < 0)
+		BUG();
+
+	pthread_join(c->qc_thread, NULL);
+	c->qc_thread_running = 0;
+
+	close(c->qc_stop_fd);
+	c->qc_stop_fd = -1;
+
+	NL_DBG(1, "Queue consumer %p, stopped worker thread\n", c);
+#endif
+}
+
+/**
+ * @name Statistics
+ * @{
+ */
+
+/**
+ * Return number of packets processed
+ * @arg c		Queue consumer
+ */
+uint64_t nfnl_queue_consumer_get_packets(struct nfnl_queue_consumer *c)
+{
+	return c->qc_packets;
+}
+
+/**
+ * Return number of verdict messages sent
+ * @arg c		Queue consumer
+ *
+ * Compared to the number of packets, this shows how effective verdicts
+ * are being batched.
+ */
+uint64_t nfnl_queue_consumer_get_verdicts(struct nfnl_queue_consumer *c)
+{
+	return c->qc_verdicts;
+}
+
+/**
+ * Return number of socket overruns
+ * @arg c		Queue consumer
+ */
+uint64_t nfnl_queue_consumer_get_overruns(struct nfnl_queue_consumer *c)
+{
+	return c->qc_overruns;
+}
+
+/** @} */
+
+/** @} */
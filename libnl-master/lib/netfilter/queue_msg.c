@@ -46,26 +46,28 @@ static struct nla_policy queue_policy[NFQA_MAX+1] = {
 	[NFQA_HWADDR]			= {
 		.minlen	= sizeof(struct nfqnl_msg_packet_hw),
 	},
+	[NFQA_CAP_LEN]			= { .type = NLA_U32 },
+	[NFQA_SKB_INFO]			= { .type = NLA_U32 },
 };
 
-int nfnlmsg_queue_msg_parse(struct nlmsghdr *nlh,
-			    struct nfnl_queue_msg **result)
+/** @cond SKIP */
+/*
+ * Parse a packet message into an existing queue message. If borrow is
+ * set, the payload is not copied but refers to the netlink message.
+ */
+int queue_msg_parse(struct nfnl_queue_msg *msg, struct nlmsghdr *nlh,
+		    int borrow)
 {
-	struct nfnl_queue_msg *msg;
 	struct nlattr *tb[NFQA_MAX+1];
 	struct nlattr *attr;
 	int err;
 
-	msg = nfnl_queue_msg_alloc();
-	if (!msg)
-		return -NLE_NOMEM;
-
 	msg->ce_msgtype = nlh->nlmsg_type;
 
 	err = nlmsg_parse(nlh, sizeof(struct nfgenmsg), tb, NFQA_MAX,
 			  queue_policy);
 	if (err < 0)
-		goto errout;
+		return err;
 
 	nfnl_queue_msg_set_group(msg, nfnlmsg_res_id(nlh));
 	nfnl_queue_msg_set_family(msg, nfnlmsg_family(nlh));
@@ -118,20 +120,45 @@ int nfnlmsg_queue_msg_parse(struct nlmsghdr *nlh,
 					  ntohs(hw->hw_addrlen));
 	}
 
+	attr = tb[NFQA_CAP_LEN];
+	if (attr)
+		nfnl_queue_msg_set_cap_len(msg, ntohl(nla_get_u32(attr)));
+
+	attr = tb[NFQA_SKB_INFO];
+	if (attr)
+		nfnl_queue_msg_set_skb_info(msg, ntohl(nla_get_u32(attr)));
+
 	attr = tb[NFQA_PAYLOAD];
-	if (attr) {
+	if (attr && borrow)
+		queue_msg_borrow_payload(msg, nla_data(attr), nla_len(attr));
+	else if (attr) {
 		err = nfnl_queue_msg_set_payload(msg, nla_data(attr),
 						 nla_len(attr));
 		if (err < 0)
-			goto errout;
+			return err;
 	}
 
-	*result = msg;
 	return 0;
+}
+/** @endcond */
 
-errout:
-	nfnl_queue_msg_put(msg);
-	return err;
+int nfnlmsg_queue_msg_parse(struct nlmsghdr *nlh,
+			    struct nfnl_queue_msg **result)
+{
+	struct nfnl_queue_msg *msg;
+	int err;
+
+	msg = nfnl_queue_msg_alloc();
+	if (!msg)
+		return -NLE_NOMEM;
+
+	if ((err = queue_msg_parse(msg, nlh, 0)) < 0) {
+		nfnl_queue_msg_put(msg);
+		return err;
+	}
+
+	*result = msg;
+	return 0;
 }
 
 static int queue_msg_parser(struct nl_cache_ops *ops, struct sockaddr_nl *who,
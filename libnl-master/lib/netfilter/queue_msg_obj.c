@@ -30,6 +30,8 @@
 #define QUEUE_MSG_ATTR_HWADDR		(1UL << 11)
 #define QUEUE_MSG_ATTR_PAYLOAD		(1UL << 12)
 #define QUEUE_MSG_ATTR_VERDICT		(1UL << 13)
+#define QUEUE_MSG_ATTR_CAP_LEN		(1UL << 14)
+#define QUEUE_MSG_ATTR_SKB_INFO		(1UL << 15)
 /** @endcond */
 
 static void nfnl_queue_msg_free_data(struct nl_object *c)
@@ -39,7 +41,8 @@ static void nfnl_queue_msg_free_data(struct nl_object *c)
 	if (msg == NULL)
 		return;
 
-	free(msg->queue_msg_payload);
+	if (!msg->queue_msg_payload_borrowed)
+		free(msg->queue_msg_payload);
 }
 
 static int nfnl_queue_msg_clone(struct nl_object *_dst, struct nl_object *_src)
@@ -48,6 +51,10 @@ static int nfnl_queue_msg_clone(struct nl_object *_dst, struct nl_object *_src)
 	struct nfnl_queue_msg *src = (struct nfnl_queue_msg *) _src;
 	int err;
 
+	/* The payload pointer was copied along, it belongs to src */
+	dst->queue_msg_payload = NULL;
+	dst->queue_msg_payload_borrowed = 0;
+
 	if (src->queue_msg_payload) {
 		err = nfnl_queue_msg_set_payload(dst, src->queue_msg_payload,
 						 src->queue_msg_payload_len);
@@ -411,10 +418,13 @@ int nfnl_queue_msg_set_payload(struct nfnl_queue_msg *msg, uint8_t *payload,
 		return -NLE_NOMEM;
 	memcpy(new_payload, payload, len);
 
-	free(msg->queue_msg_payload);
+	/* A borrowed payload is not ours to free, the copy is */
+	if (!msg->queue_msg_payload_borrowed)
+		free(msg->queue_msg_payload);
 
 	msg->queue_msg_payload = new_payload;
 	msg->queue_msg_payload_len = len;
+	msg->queue_msg_payload_borrowed = 0;
 	msg->ce_mask |= QUEUE_MSG_ATTR_PAYLOAD;
 	return 0;
 }
@@ -424,6 +434,21 @@ int nfnl_queue_msg_test_payload(const struct nfnl_queue_msg *msg)
 	return !!(msg->ce_mask & QUEUE_MSG_ATTR_PAYLOAD);
 }
 
+/** @cond SKIP */
+/*
+ * Point the payload of a message which is never freed, such as the
+ * borrowed messages of a queue consumer, at memory owned by the caller.
+ */
+void queue_msg_borrow_payload(struct nfnl_queue_msg *msg, void *payload,
+			      int len)
+{
+	msg->queue_msg_payload = payload;
+	msg->queue_msg_payload_len = len;
+	msg->queue_msg_payload_borrowed = 1;
+	msg->ce_mask |= QUEUE_MSG_ATTR_PAYLOAD;
+}
+/** @endcond */
+
 const void *nfnl_queue_msg_get_payload(const struct nfnl_queue_msg *msg, int *len)
 {
 	if (!(msg->ce_mask & QUEUE_MSG_ATTR_PAYLOAD)) {
@@ -457,6 +482,52 @@ unsigned int nfnl_queue_msg_get_verdict(const struct nfnl_queue_msg *msg)
 	return msg->queue_msg_verdict;
 }
 
+/**
+ * Set length of the packet before it was truncated to the copy range
+ * @arg msg        queue msg
+ * @arg len        original packet length
+ */
+void nfnl_queue_msg_set_cap_len(struct nfnl_queue_msg *msg, uint32_t len)
+{
+	msg->queue_msg_cap_len = len;
+	msg->ce_mask |= QUEUE_MSG_ATTR_CAP_LEN;
+}
+
+int nfnl_queue_msg_test_cap_len(const struct nfnl_queue_msg *msg)
+{
+	return !!(msg->ce_mask & QUEUE_MSG_ATTR_CAP_LEN);
+}
+
+uint32_t nfnl_queue_msg_get_cap_len(const struct nfnl_queue_msg *msg)
+{
+	return msg->queue_msg_cap_len;
+}
+
+/**
+ * Set skb meta information
+ * @arg msg        queue msg
+ * @arg info       NFQA_SKB_* flags
+ *
+ * Queues configured with NFQA_CFG_F_GSO report through NFQA_SKB_GSO and
+ * NFQA_SKB_CSUMNOTREADY that a packet is unsegmented or lacks a valid
+ * checksum.
+ */
+void nfnl_queue_msg_set_skb_info(struct nfnl_queue_msg *msg, uint32_t info)
+{
+	msg->queue_msg_skb_info = info;
+	msg->ce_mask |= QUEUE_MSG_ATTR_SKB_INFO;
+}
+
+int nfnl_queue_msg_test_skb_info(const struct nfnl_queue_msg *msg)
+{
+	return !!(msg->ce_mask & QUEUE_MSG_ATTR_SKB_INFO);
+}
+
+uint32_t nfnl_queue_msg_get_skb_info(const struct nfnl_queue_msg *msg)
+{
+	return msg->queue_msg_skb_info;
+}
+
 static const struct trans_tbl nfnl_queue_msg_attrs[] = {
 	__ADD(QUEUE_MSG_ATTR_GROUP,		group),
 	__ADD(QUEUE_MSG_ATTR_FAMILY,		family),
@@ -472,6 +543,8 @@ static const struct trans_tbl nfnl_queue_msg_attrs[] = {
 	__ADD(QUEUE_MSG_ATTR_HWADDR,		hwaddr),
 	__ADD(QUEUE_MSG_ATTR_PAYLOAD,		payload),
 	__ADD(QUEUE_MSG_ATTR_VERDICT,		verdict),
+	__ADD(QUEUE_MSG_ATTR_CAP_LEN,		cap_len),
+	__ADD(QUEUE_MSG_ATTR_SKB_INFO,		skb_info),
 };
 
 static char *nfnl_queue_msg_attrs2str(int attrs, char *buf, size_t len)
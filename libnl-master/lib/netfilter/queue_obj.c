@@ -25,6 +25,7 @@
 #define QUEUE_ATTR_MAXLEN		(1UL << 1)
 #define QUEUE_ATTR_COPY_MODE		(1UL << 2)
 #define QUEUE_ATTR_COPY_RANGE		(1UL << 3)
+#define QUEUE_ATTR_FLAGS		(1UL << 4)
 /** @endcond */
 
 
@@ -49,6 +50,10 @@ static void nfnl_queue_dump(struct nl_object *a, struct nl_dump_params *p)
 	if (queue->ce_mask & QUEUE_ATTR_COPY_RANGE)
 		nl_dump(p, "copy_range=%u ", queue->queue_copy_range);
 
+	if (queue->ce_mask & QUEUE_ATTR_FLAGS)
+		nl_dump(p, "flags=0x%x/0x%x ", queue->queue_flags,
+			queue->queue_flag_mask);
+
 	nl_dump(p, "\n");
 }
 
@@ -161,6 +166,43 @@ uint32_t nfnl_queue_get_copy_range(const struct nfnl_queue *queue)
 	return queue->queue_copy_range;
 }
 
+/**
+ * Set queue flags
+ * @arg queue		Queue
+ * @arg flags		NFQA_CFG_F_* flags to enable
+ *
+ * Flags which are neither set nor unset explicitly are left untouched
+ * in the kernel when the queue is created or changed.
+ */
+void nfnl_queue_set_flags(struct nfnl_queue *queue, uint32_t flags)
+{
+	queue->queue_flag_mask |= flags;
+	queue->queue_flags |= flags;
+	queue->ce_mask |= QUEUE_ATTR_FLAGS;
+}
+
+/**
+ * Unset queue flags
+ * @arg queue		Queue
+ * @arg flags		NFQA_CFG_F_* flags to disable
+ */
+void nfnl_queue_unset_flags(struct nfnl_queue *queue, uint32_t flags)
+{
+	queue->queue_flag_mask |= flags;
+	queue->queue_flags &= ~flags;
+	queue->ce_mask |= QUEUE_ATTR_FLAGS;
+}
+
+int nfnl_queue_test_flags(const struct nfnl_queue *queue)
+{
+	return !!(queue->ce_mask & QUEUE_ATTR_FLAGS);
+}
+
+uint32_t nfnl_queue_get_flags(const struct nfnl_queue *queue)
+{
+	return queue->queue_flags;
+}
+
 static uint64_t nfnl_queue_compare(struct nl_object *_a, struct nl_object *_b,
 				   uint64_t attrs, int flags)
 {
@@ -177,6 +219,7 @@ static uint64_t nfnl_queue_compare(struct nl_object *_a, struct nl_object *_b,
 	diff |= NFNL_QUEUE_DIFF_VAL(MAXLEN,	queue_maxlen);
 	diff |= NFNL_QUEUE_DIFF_VAL(COPY_MODE,	queue_copy_mode);
 	diff |= NFNL_QUEUE_DIFF_VAL(COPY_RANGE,	queue_copy_range);
+	diff |= NFNL_QUEUE_DIFF_VAL(FLAGS,	queue_flags);
 
 #undef NFNL_QUEUE_DIFF
 #undef NFNL_QUEUE_DIFF_VAL
@@ -189,6 +232,7 @@ static const struct trans_tbl nfnl_queue_attrs[] = {
 	__ADD(QUEUE_ATTR_MAXLEN,	maxlen),
 	__ADD(QUEUE_ATTR_COPY_MODE,	copy_mode),
 	__ADD(QUEUE_ATTR_COPY_RANGE,	copy_range),
+	__ADD(QUEUE_ATTR_FLAGS,		flags),
 };
 
 static char *nfnl_queue_attrs2str(int attrs, char *buf, size_t len)
@@ -346,6 +346,10 @@ int nl_sendmsg(struct nl_sock *sk, struct nl_msg *msg, struct msghdr *hdr)
 		return -nl_syserr2nlerr(errno);
 	}
 
+	__nl_sock_stat_add(sk, NL_SOCK_STAT_TX_CALLS, 1);
+	__nl_sock_stat_add(sk, NL_SOCK_STAT_TX_BYTES, ret);
+	__nl_sock_stat_sent(sk, nlmsg_hdr(msg));
+
 	NL_DBG(4, "sent %d bytes\n", ret);
 	return ret;
 }
@@ -700,6 +704,7 @@ int nl_recv(struct nl_sock *sk, struct sockaddr_nl *nla,
 retry:
 
 	n = recvmsg(sk->s_fd, &msg, flags);
+	__nl_sock_stat_add(sk, NL_SOCK_STAT_RX_CALLS, 1);
 	if (!n) {
 		retval = 0;
 		goto abort;
@@ -712,6 +717,8 @@ retry:
 
 		NL_DBG(4, "nl_sendmsg(%p): nl_recv() failed with %d (%s)\n",
 			sk, errno, nl_strerror_l(errno));
+		if (errno == ENOBUFS)
+			__nl_sock_stat_add(sk, NL_SOCK_STAT_OVERRUNS, 1);
 		retval = -nl_syserr2nlerr(errno);
 		goto abort;
 	}
@@ -787,6 +794,7 @@ retry:
 		}
 	}
 
+	__nl_sock_stat_add(sk, NL_SOCK_STAT_RX_BYTES, n);
 	retval = n;
 abort:
 	free(msg.msg_control);
@@ -867,6 +875,7 @@ continue_reading:
 			nlmsg_set_creds(msg, creds);
 
 		nrecv++;
+		__nl_sock_stat_recvd(sk, hdr);
 
 		/* Raw callback is the first, it gives the most control
 		 * to the user and he can do his very own parsing. */
@@ -69,6 +69,8 @@ struct nl_object *nl_object_alloc(struct nl_object_ops *ops)
 	if (ops->oo_constructor)
 		ops->oo_constructor(new);
 
+	__atomic_add_fetch(&ops->oo_nalloc, 1, __ATOMIC_RELAXED);
+
 	NL_DBG(4, "Allocated new object %p\n", new);
 
 	return new;
@@ -185,6 +187,8 @@ void nl_object_free(struct nl_object *obj)
 	if (ops->oo_free_data)
 		ops->oo_free_data(obj);
 
+	__atomic_add_fetch(&ops->oo_nfree, 1, __ATOMIC_RELAXED);
+
 	NL_DBG(4, "Freed object %p\n", obj);
 
 	free(obj);
@@ -193,6 +193,8 @@ static struct nla_policy addr_policy[IFA_MAX+1] = {
 	[IFA_CACHEINFO]	= { .minlen = sizeof(struct ifa_cacheinfo) },
 };
 
+NLA_SCHEMA_DEFINE(addr_schema, IFA_MAX);
+
 static int addr_msg_parser(struct nl_cache_ops *ops, struct sockaddr_nl *who,
 			   struct nlmsghdr *nlh, struct nl_parser_param *pp)
 {
@@ -209,7 +211,7 @@ static int addr_msg_parser(struct nl_cache_ops *ops, struct sockaddr_nl *who,
 
 	addr->ce_msgtype = nlh->nlmsg_type;
 
-	err = nlmsg_parse(nlh, sizeof(*ifa), tb, IFA_MAX, addr_policy);
+	err = nlmsg_parse_schema(nlh, sizeof(*ifa), tb, &addr_schema);
 	if (err < 0)
 		goto errout;
 
@@ -1198,6 +1200,7 @@ static struct nl_cache_ops rtnl_addr_ops = {
 
 static void __init addr_init(void)
 {
+	__nla_schema_init(&addr_schema, addr_policy);
 	nl_cache_mngt_register(&rtnl_addr_ops);
 }
 
@@ -331,6 +331,8 @@ static struct nla_policy neigh_policy[NDA_MAX+1] = {
 	[NDA_PROBES]	= { .type = NLA_U32 },
 };
 
+NLA_SCHEMA_DEFINE(neigh_schema, NDA_MAX);
+
 static int neigh_msg_parser(struct nl_cache_ops *ops, struct sockaddr_nl *who,
 			    struct nlmsghdr *n, struct nl_parser_param *pp)
 {
@@ -363,7 +365,7 @@ int rtnl_neigh_parse(struct nlmsghdr *n, struct rtnl_neigh **result)
 	neigh->ce_msgtype = n->nlmsg_type;
 	nm = nlmsg_data(n);
 
-	err = nlmsg_parse(n, sizeof(*nm), tb, NDA_MAX, neigh_policy);
+	err = nlmsg_parse_schema(n, sizeof(*nm), tb, &neigh_schema);
 	if (err < 0)
 		goto errout;
 
@@ -1062,6 +1064,7 @@ static struct nl_cache_ops rtnl_neigh_ops = {
 
 static void __init neigh_init(void)
 {
+	__nla_schema_init(&neigh_schema, neigh_policy);
 	nl_cache_mngt_register(&rtnl_neigh_ops);
 }
 
@@ -191,6 +191,8 @@ static struct nl_cache_ops rtnl_route_ops = {
 	.co_groups		= route_groups,
 	.co_request_update	= route_request_update,
 	.co_msg_parser		= route_msg_parser,
+	.co_free_index		= route_lpm_free,
+	.co_index_update	= route_lpm_update,
 	.co_obj_ops		= &route_obj_ops,
 };
 
@@ -0,0 +1,533 @@
+/*
+ * lib/route/route_lpm.c	Route Lookup Index
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+/**
+ * @ingroup route
+ * @defgroup route_lpm Longest Prefix Match
+ *
+ * Resolves addresses against the routes held in a route cache without
+ * asking the kernel.
+ *
+ * The first lookup for a given address family and routing table compiles
+ * the matching routes of the cache into a compressed multibit trie. Every
+ * node of the trie covers 6 bits of the address. Children and leaves of a
+ * node are stored in arrays addressed by counting the bits set in two 64
+ * bit vectors, runs of entries resolving to the same route share a leaf,
+ * and a lookup touches at most 6 nodes for IPv4 and 22 nodes for IPv6.
+ *
+ * The trie refers to the routes of the cache directly. Once built, it is
+ * kept up to date as routes are added to or removed from the cache, e.g.
+ * by nl_cache_resync() or a cache manager applying notifications. Only
+ * the node a route's prefix ends in and the entries below the prefix are
+ * recomputed.
+ *
+ * Only routes a lookup without further keys would match are considered:
+ * cloned routes, source specific routes and routes with a TOS selector
+ * are ignored. If several routes share a prefix, the one with the lowest
+ * priority wins.
+ *
+ * @note Lookups may rebuild the index and thus modify the cache's private
+ *       state. Lookups on the same cache must not run concurrently with
+ *       each other nor with modifications of the cache.
+ *
+ * @{
+ */
+
+#include <netlink-private/netlink.h>
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/addr.h>
+#include <netlink/route/route.h>
+
+/** @cond SKIP */
+#define LPM_STRIDE	6
+#define LPM_FANOUT	(1 << LPM_STRIDE)
+#define LPM_KEYLEN	3
+#define LPM_MAXDEPTH	((128 + LPM_STRIDE - 1) / LPM_STRIDE)
+
+struct lpm_prefix
+{
+	struct rtnl_route *	lp_route;
+	uint8_t			lp_idx;		/* first entry covered */
+	uint8_t			lp_len;		/* prefix bits within the node */
+};
+
+struct lpm_node
+{
+	uint64_t		ln_vec;		/* entries with a child */
+	uint64_t		ln_leafvec;	/* entries starting a leaf run */
+	struct lpm_node **	ln_children;
+	struct rtnl_route **	ln_leaves;
+	struct lpm_prefix *	ln_prefixes;	/* routes ending in this node */
+	unsigned int		ln_nprefixes;
+};
+
+struct lpm_trie
+{
+	uint8_t			lt_family;
+	uint32_t		lt_table;
+	struct lpm_node *	lt_root;
+	uint32_t		lt_nnodes;
+	struct lpm_trie *	lt_next;
+};
+
+struct lpm_index
+{
+	struct lpm_trie *	li_tries;
+};
+/** @endcond */
+
+static int lpm_addrlen(int family)
+{
+	switch (family) {
+	case AF_INET:
+		return 4;
+	case AF_INET6:
+		return 16;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Addresses are kept as host order 64 bit words, most significant bit
+ * first, padded with a zero word so that extracting a stride crossing
+ * the last word never reads beyond the key.
+ */
+static void lpm_key(uint64_t *key, const uint8_t *addr, int len)
+{
+	int i;
+
+	memset(key, 0, LPM_KEYLEN * sizeof(*key));
+	for (i = 0; i < len; i++)
+		key[i >> 3] |= (uint64_t) addr[i] << (56 - ((i & 7) << 3));
+}
+
+static inline unsigned int lpm_bits(const uint64_t *key, unsigned int off)
+{
+	uint64_t w = key[off >> 6];
+	unsigned int sh = off & 63;
+
+	if (sh <= 64 - LPM_STRIDE)
+		return (w >> (64 - LPM_STRIDE - sh)) & (LPM_FANOUT - 1);
+
+	return ((w << (sh - (64 - LPM_STRIDE))) |
+		(key[(off >> 6) + 1] >> (128 - LPM_STRIDE - sh))) &
+		(LPM_FANOUT - 1);
+}
+
+static inline struct lpm_node *lpm_child(struct lpm_node *n, unsigned int i)
+{
+	return n->ln_children[__builtin_popcountll(n->ln_vec &
+						   ((1ULL << i) - 1))];
+}
+
+static void lpm_node_free(struct lpm_node *n)
+{
+	int i;
+
+	if (!n)
+		return;
+
+	for (i = 0; i < __builtin_popcountll(n->ln_vec); i++)
+		lpm_node_free(n->ln_children[i]);
+
+	free(n->ln_children);
+	free(n->ln_leaves);
+	free(n->ln_prefixes);
+	free(n);
+}
+
+/*
+ * The prefixes of a node are sorted so that a prefix always overrides
+ * the ones before it where they overlap: shortest first and, for equal
+ * lengths, highest priority value first. Among identical prefixes the
+ * route which was added first wins.
+ */
+static int lpm_prefix_cmp(const struct lpm_prefix *a,
+			  const struct lpm_prefix *b)
+{
+	if (a->lp_len != b->lp_len)
+		return a->lp_len < b->lp_len ? -1 : 1;
+
+	if (a->lp_route->rt_prio != b->lp_route->rt_prio)
+		return a->lp_route->rt_prio > b->lp_route->rt_prio ? -1 : 1;
+
+	return 0;
+}
+
+/* Route entry i of a node resolves to, given what its parent entry does */
+static struct rtnl_route *lpm_resolve(struct lpm_node *n, unsigned int i,
+				      struct rtnl_route *inherited)
+{
+	struct rtnl_route *r = inherited;
+	unsigned int k;
+
+	for (k = 0; k < n->ln_nprefixes; k++) {
+		struct lpm_prefix *p = &n->ln_prefixes[k];
+
+		if ((i >> (LPM_STRIDE - p->lp_len)) ==
+		    (p->lp_idx >> (LPM_STRIDE - p->lp_len)))
+			r = p->lp_route;
+	}
+
+	return r;
+}
+
+/*
+ * Recomputes the leaves of a node from its prefixes and the route its
+ * parent entry resolves to, descending into the children of the entries
+ * lo to hi - 1. Runs of identical leaves are collapsed.
+ */
+static int lpm_refresh(struct lpm_node *n, struct rtnl_route *inherited,
+		       unsigned int lo, unsigned int hi)
+{
+	struct rtnl_route *leaf[LPM_FANOUT], **leaves, *prev = NULL;
+	uint64_t leafvec = 0;
+	unsigned int i, j, k, nleaves = 0;
+	int err, first = 1;
+
+	for (i = 0; i < LPM_FANOUT; i++)
+		leaf[i] = inherited;
+
+	for (k = 0; k < n->ln_nprefixes; k++) {
+		struct lpm_prefix *p = &n->ln_prefixes[k];
+
+		j = p->lp_idx + (1 << (LPM_STRIDE - p->lp_len));
+		for (i = p->lp_idx; i < j; i++)
+			leaf[i] = p->lp_route;
+	}
+
+	for (i = lo; i < hi; i++)
+		if (n->ln_vec & (1ULL << i))
+			if ((err = lpm_refresh(lpm_child(n, i), leaf[i],
+					       0, LPM_FANOUT)) < 0)
+				return err;
+
+	for (i = 0; i < LPM_FANOUT; i++) {
+		if (n->ln_vec & (1ULL << i))
+			continue;
+
+		if (first || leaf[i] != prev) {
+			leafvec |= 1ULL << i;
+			leaf[nleaves++] = leaf[i];
+			prev = leaf[i];
+			first = 0;
+		}
+	}
+
+	if (!(leaves = realloc(n->ln_leaves,
+			       (nleaves ? nleaves : 1) * sizeof(*leaves))))
+		return -NLE_NOMEM;
+
+	memcpy(leaves, leaf, nleaves * sizeof(*leaves));
+	n->ln_leaves = leaves;
+	n->ln_leafvec = leafvec;
+
+	return 0;
+}
+
+static int lpm_child_add(struct lpm_trie *t, struct lpm_node *n,
+			 unsigned int i, struct rtnl_route *inherited)
+{
+	struct lpm_node **children, *c;
+	unsigned int pos = __builtin_popcountll(n->ln_vec & ((1ULL << i) - 1));
+	unsigned int nchildren = __builtin_popcountll(n->ln_vec);
+
+	if (!(c = calloc(1, sizeof(*c))))
+		return -NLE_NOMEM;
+
+	if (lpm_refresh(c, inherited, 0, 0) < 0 ||
+	    !(children = realloc(n->ln_children,
+				 (nchildren + 1) * sizeof(*children)))) {
+		lpm_node_free(c);
+		return -NLE_NOMEM;
+	}
+
+	memmove(&children[pos + 1], &children[pos],
+		(nchildren - pos) * sizeof(*children));
+	children[pos] = c;
+	n->ln_children = children;
+	n->ln_vec |= 1ULL << i;
+	t->lt_nnodes++;
+
+	return 0;
+}
+
+static void lpm_child_del(struct lpm_trie *t, struct lpm_node *n,
+			  unsigned int i)
+{
+	unsigned int pos = __builtin_popcountll(n->ln_vec & ((1ULL << i) - 1));
+	unsigned int nchildren = __builtin_popcountll(n->ln_vec);
+
+	lpm_node_free(n->ln_children[pos]);
+	memmove(&n->ln_children[pos], &n->ln_children[pos + 1],
+		(nchildren - pos - 1) * sizeof(*n->ln_children));
+	n->ln_vec &= ~(1ULL << i);
+	t->lt_nnodes--;
+}
+
+static int lpm_eligible(struct lpm_trie *t, struct rtnl_route *r)
+{
+	if (r->rt_family != t->lt_family || !r->rt_dst)
+		return 0;
+
+	if (t->lt_table != RT_TABLE_UNSPEC && r->rt_table != t->lt_table)
+		return 0;
+
+	if (r->rt_tos || (r->rt_src && nl_addr_get_prefixlen(r->rt_src)) ||
+	    (r->rt_flags & RTM_F_CLONED))
+		return 0;
+
+	if (nl_addr_get_len(r->rt_dst) > lpm_addrlen(r->rt_family) ||
+	    nl_addr_get_prefixlen(r->rt_dst) > lpm_addrlen(r->rt_family) * 8)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Adds a route to or removes it from the node its prefix ends in and
+ * refreshes the entries below the prefix. Nodes are created along the
+ * way on addition and pruned once they no longer carry a prefix nor a
+ * child on removal.
+ */
+static int lpm_update(struct lpm_trie *t, struct rtnl_route *r, int add)
+{
+	struct lpm_node *path[LPM_MAXDEPTH], *n = t->lt_root;
+	struct rtnl_route *inherited[LPM_MAXDEPTH + 1];
+	unsigned int idx[LPM_MAXDEPTH];
+	struct lpm_prefix p = { .lp_route = r };
+	uint64_t key[LPM_KEYLEN];
+	unsigned int plen, depth, d, k;
+	int err;
+
+	if (!lpm_eligible(t, r))
+		return 0;
+
+	lpm_key(key, nl_addr_get_binary_addr(r->rt_dst),
+		nl_addr_get_len(r->rt_dst));
+	plen = nl_addr_get_prefixlen(r->rt_dst);
+	depth = plen ? (plen - 1) / LPM_STRIDE : 0;
+
+	inherited[0] = NULL;
+	for (d = 0; d < depth; d++) {
+		path[d] = n;
+		idx[d] = lpm_bits(key, d * LPM_STRIDE);
+		inherited[d + 1] = lpm_resolve(n, idx[d], inherited[d]);
+
+		if (!(n->ln_vec & (1ULL << idx[d]))) {
+			if (!add)
+				return 0;
+
+			if ((err = lpm_child_add(t, n, idx[d],
+						 inherited[d + 1])) < 0 ||
+			    (err = lpm_refresh(n, inherited[d], 0, 0)) < 0)
+				return err;
+		}
+
+		n = lpm_child(n, idx[d]);
+	}
+
+	p.lp_len = plen - depth * LPM_STRIDE;
+	p.lp_idx = lpm_bits(key, depth * LPM_STRIDE) &
+		   ~((1 << (LPM_STRIDE - p.lp_len)) - 1);
+
+	if (add) {
+		struct lpm_prefix *prefixes;
+
+		if (!(prefixes = realloc(n->ln_prefixes,
+					 (n->ln_nprefixes + 1) *
+					 sizeof(*prefixes))))
+			return -NLE_NOMEM;
+		n->ln_prefixes = prefixes;
+
+		for (k = 0; k < n->ln_nprefixes; k++)
+			if (lpm_prefix_cmp(&prefixes[k], &p) >= 0)
+				break;
+
+		memmove(&prefixes[k + 1], &prefixes[k],
+			(n->ln_nprefixes - k) * sizeof(*prefixes));
+		prefixes[k] = p;
+		n->ln_nprefixes++;
+	} else {
+		for (k = 0; k < n->ln_nprefixes; k++)
+			if (n->ln_prefixes[k].lp_route == r)
+				break;
+
+		if (k == n->ln_nprefixes)
+			return 0;
+
+		memmove(&n->ln_prefixes[k], &n->ln_prefixes[k + 1],
+			(n->ln_nprefixes - k - 1) * sizeof(*n->ln_prefixes));
+		n->ln_nprefixes--;
+	}
+
+	if ((err = lpm_refresh(n, inherited[depth], p.lp_idx,
+			       p.lp_idx + (1 << (LPM_STRIDE - p.lp_len)))) < 0)
+		return err;
+
+	for (d = depth; d > 0 && !n->ln_nprefixes && !n->ln_vec; d--) {
+		n = path[d - 1];
+		lpm_child_del(t, n, idx[d - 1]);
+		if ((err = lpm_refresh(n, inherited[d - 1], 0, 0)) < 0)
+			return err;
+	}
+
+	return 0;
+}
+
+static void lpm_trie_free(struct lpm_trie *t)
+{
+	lpm_node_free(t->lt_root);
+	free(t);
+}
+
+static struct lpm_trie *lpm_trie_get(struct nl_cache *cache, uint8_t family,
+				     uint32_t table)
+{
+	struct lpm_index *li = cache->c_index;
+	struct lpm_trie *t;
+	struct nl_object *obj;
+
+	if (!li) {
+		if (!(li = calloc(1, sizeof(*li))))
+			return NULL;
+		cache->c_index = li;
+	}
+
+	for (t = li->li_tries; t; t = t->lt_next)
+		if (t->lt_family == family && t->lt_table == table)
+			return t;
+
+	if (!(t = calloc(1, sizeof(*t))))
+		return NULL;
+
+	t->lt_family = family;
+	t->lt_table = table;
+
+	if (!(t->lt_root = calloc(1, sizeof(*t->lt_root))) ||
+	    lpm_refresh(t->lt_root, NULL, 0, 0) < 0)
+		goto errout;
+	t->lt_nnodes = 1;
+
+	nl_list_for_each_entry(obj, &cache->c_items, ce_list)
+		if (lpm_update(t, (struct rtnl_route *) obj, 1) < 0)
+			goto errout;
+
+	t->lt_next = li->li_tries;
+	li->li_tries = t;
+
+	NL_DBG(2, "Compiled routes of cache %p into %u nodes\n",
+	       cache, t->lt_nnodes);
+
+	return t;
+
+errout:
+	lpm_trie_free(t);
+	return NULL;
+}
+
+/** @cond SKIP */
+void route_lpm_free(struct nl_cache *cache)
+{
+	struct lpm_index *li = cache->c_index;
+	struct lpm_trie *t, *next;
+
+	if (!li)
+		return;
+
+	for (t = li->li_tries; t; t = next) {
+		next = t->lt_next;
+		lpm_trie_free(t);
+	}
+
+	free(li);
+	cache->c_index = NULL;
+}
+
+void route_lpm_update(struct nl_cache *cache, struct nl_object *obj, int add)
+{
+	struct lpm_index *li = cache->c_index;
+	struct lpm_trie *t;
+
+	for (t = li->li_tries; t; t = t->lt_next) {
+		if (lpm_update(t, (struct rtnl_route *) obj, add) < 0) {
+			/* Drop the index, the next lookup rebuilds it */
+			NL_DBG(2, "Dropping route index of cache %p\n", cache);
+			route_lpm_free(cache);
+			return;
+		}
+	}
+}
+/** @endcond */
+
+/**
+ * Find the most specific route covering an address
+ * @arg cache		Route cache
+ * @arg addr		Address to look up (AF_INET or AF_INET6)
+ * @arg table		Routing table or RT_TABLE_UNSPEC to consider all tables
+ *
+ * Performs a longest prefix match of \c addr against the routes of the
+ * cache, the equivalent of a FIB lookup restricted to a single table.
+ * The prefix length of \c addr is ignored.
+ *
+ * The returned route may be of any type, callers interested in
+ * forwarding decisions must check for RTN_UNREACHABLE, RTN_BLACKHOLE
+ * and friends themselves.
+ *
+ * @note The reference counter of the returned route is incremented,
+ *       use rtnl_route_put() to release it.
+ *
+ * @return Route or NULL if no route covers the address.
+ */
+struct rtnl_route *rtnl_route_lookup(struct nl_cache *cache,
+				     struct nl_addr *addr, uint32_t table)
+{
+	struct lpm_trie *t;
+	struct lpm_node *n;
+	struct rtnl_route *r;
+	uint64_t key[LPM_KEYLEN], bit, mask;
+	unsigned int off = 0, idx;
+	int family, alen;
+
+	if (cache->c_ops->co_obj_ops != &route_obj_ops)
+		return NULL;
+
+	family = nl_addr_get_family(addr);
+	alen = lpm_addrlen(family);
+	if (alen < 0 || nl_addr_get_len(addr) != alen)
+		return NULL;
+
+	if (!(t = lpm_trie_get(cache, family, table)))
+		return NULL;
+
+	lpm_key(key, nl_addr_get_binary_addr(addr), alen);
+
+	n = t->lt_root;
+	for (;;) {
+		idx = lpm_bits(key, off);
+		bit = 1ULL << idx;
+		mask = bit | (bit - 1);
+
+		if (!(n->ln_vec & bit))
+			break;
+
+		n = n->ln_children[__builtin_popcountll(n->ln_vec & mask) - 1];
+		off += LPM_STRIDE;
+	}
+
+	r = n->ln_leaves[__builtin_popcountll(n->ln_leafvec & mask) - 1];
+	if (r)
+		rtnl_route_get(r);
+
+	return r;
+}
+
+/** @} */
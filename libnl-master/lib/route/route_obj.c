@@ -1019,6 +1019,13 @@ static struct nla_policy route_policy[RTA_MAX+1] = {
 	[RTA_ENCAP_TYPE] = { .type = NLA_U16 },
 };
 
+NLA_SCHEMA_DEFINE(route_schema, RTA_MAX);
+
+static void __init route_obj_init(void)
+{
+	__nla_schema_init(&route_schema, route_policy);
+}
+
 static int parse_multipath(struct rtnl_route *route, struct nlattr *attr)
 {
 	struct rtnl_nexthop *nh = NULL;
@@ -1038,10 +1045,10 @@ static int parse_multipath(struct rtnl_route *route, struct nlattr *attr)
 		if (rtnh->rtnh_len > sizeof(*rtnh)) {
 			struct nlattr *ntb[RTA_MAX + 1];
 
-			err = nla_parse(ntb, RTA_MAX, (struct nlattr *)
-					RTNH_DATA(rtnh),
-					rtnh->rtnh_len - sizeof(*rtnh),
-					route_policy);
+			err = nla_parse_schema(ntb, (struct nlattr *)
+					       RTNH_DATA(rtnh),
+					       rtnh->rtnh_len - sizeof(*rtnh),
+					       &route_schema);
 			if (err < 0)
 				goto errout;
 
@@ -1130,7 +1137,7 @@ int rtnl_route_parse(struct nlmsghdr *nlh, struct rtnl_route **result)
 
 	route->ce_msgtype = nlh->nlmsg_type;
 
-	err = nlmsg_parse(nlh, sizeof(struct rtmsg), tb, RTA_MAX, route_policy);
+	err = nlmsg_parse_schema(nlh, sizeof(struct rtmsg), tb, &route_schema);
 	if (err < 0)
 		goto errout;
 
@@ -941,4 +941,162 @@ int nl_socket_recv_pktinfo(struct nl_sock *sk, int state)
 
 /** @} */
 
+/**
+ * @name Statistics
+ *
+ * Every socket counts the messages and bytes it sends and receives as
+ * well as the acknowledgements, errors and receive buffer overruns it
+ * sees. For every request sent, the time until the kernel completes
+ * it, i.e. until the acknowledgement, the end of the dump or the
+ * reply arrives, is recorded in a histogram. The counters are updated
+ * without locking and follow the threading rules of the socket.
+ *
+ * @code
+ * nl_socket_get_stat(sk, NL_SOCK_STAT_REPLY_TIME) /
+ * 	nl_socket_get_stat(sk, NL_SOCK_STAT_REPLIES);
+ * @endcode
+ * @{
+ */
+
+/** @cond SKIP */
+uint64_t __nl_stat_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void __nl_sock_stat_sent(struct nl_sock *sk, struct nlmsghdr *nlh)
+{
+	struct nl_sock_stats *st = &sk->s_stats;
+
+	st->ss_counters[NL_SOCK_STAT_TX_MSGS]++;
+
+	if (nlh->nlmsg_flags & NLM_F_REQUEST) {
+		int i = nlh->nlmsg_seq % NL_SOCK_STATS_PENDING;
+
+		st->ss_pending[i].seq = nlh->nlmsg_seq;
+		st->ss_pending[i].sent = __nl_stat_time();
+	}
+}
+
+void __nl_sock_stat_recvd(struct nl_sock *sk, struct nlmsghdr *nlh)
+{
+	struct nl_sock_stats *st = &sk->s_stats;
+	uint64_t delta, us;
+	int i;
+
+	st->ss_counters[NL_SOCK_STAT_RX_MSGS]++;
+
+	if (nlh->nlmsg_type == NLMSG_ERROR &&
+	    nlh->nlmsg_len >= nlmsg_size(sizeof(struct nlmsgerr))) {
+		struct nlmsgerr *e = nlmsg_data(nlh);
+
+		st->ss_counters[e->error ? NL_SOCK_STAT_ERRORS
+					 : NL_SOCK_STAT_ACKS]++;
+	} else if (nlh->nlmsg_type != NLMSG_DONE &&
+		   (nlh->nlmsg_flags & NLM_F_MULTI))
+		return;
+
+	/* Last message in response to a request */
+	i = nlh->nlmsg_seq % NL_SOCK_STATS_PENDING;
+	if (!st->ss_pending[i].sent || st->ss_pending[i].seq != nlh->nlmsg_seq)
+		return;
+
+	delta = __nl_stat_time() - st->ss_pending[i].sent;
+	st->ss_pending[i].sent = 0;
+
+	st->ss_counters[NL_SOCK_STAT_REPLIES]++;
+	st->ss_counters[NL_SOCK_STAT_REPLY_TIME] += delta;
+	if (delta > st->ss_counters[NL_SOCK_STAT_REPLY_TIME_MAX])
+		st->ss_counters[NL_SOCK_STAT_REPLY_TIME_MAX] = delta;
+
+	us = delta / 1000;
+	i = us ? 64 - __builtin_clzll(us) : 0;
+	if (i >= NL_SOCK_REPLY_HIST_SIZE)
+		i = NL_SOCK_REPLY_HIST_SIZE - 1;
+	st->ss_reply_hist[i]++;
+}
+/** @endcond */
+
+/**
+ * Get socket statistic
+ * @arg sk		Netlink socket.
+ * @arg id		Identifier of statistical counter
+ *
+ * Times are reported in nanoseconds.
+ *
+ * @return Value of counter or 0 if not specified.
+ */
+uint64_t nl_socket_get_stat(const struct nl_sock *sk, enum nl_sock_stat_id id)
+{
+	if (id > NL_SOCK_STAT_MAX)
+		return 0;
+
+	return sk->s_stats.ss_counters[id];
+}
+
+/**
+ * Get histogram of reply latencies
+ * @arg sk		Netlink socket.
+ * @arg hist		Array to store the histogram into
+ * @arg size		Number of elements in \p hist
+ *
+ * Bucket 0 counts requests completed within less than a microsecond,
+ * bucket i counts requests completed within 2^(i-1) to 2^i microseconds.
+ * The last of the NL_SOCK_REPLY_HIST_SIZE buckets also counts everything
+ * slower.
+ *
+ * @return Number of buckets stored.
+ */
+int nl_socket_get_reply_hist(const struct nl_sock *sk, uint64_t *hist, int size)
+{
+	if (size > NL_SOCK_REPLY_HIST_SIZE)
+		size = NL_SOCK_REPLY_HIST_SIZE;
+	if (size < 0)
+		size = 0;
+
+	memcpy(hist, sk->s_stats.ss_reply_hist, size * sizeof(*hist));
+
+	return size;
+}
+
+/**
+ * Reset all socket statistics
+ * @arg sk		Netlink socket.
+ */
+void nl_socket_reset_stats(struct nl_sock *sk)
+{
+	memset(&sk->s_stats, 0, sizeof(sk->s_stats));
+}
+
+static const struct trans_tbl sock_stats[] = {
+	__ADD(NL_SOCK_STAT_RX_MSGS, rx_msgs),
+	__ADD(NL_SOCK_STAT_RX_BYTES, rx_bytes),
+	__ADD(NL_SOCK_STAT_RX_CALLS, rx_calls),
+	__ADD(NL_SOCK_STAT_TX_MSGS, tx_msgs),
+	__ADD(NL_SOCK_STAT_TX_BYTES, tx_bytes),
+	__ADD(NL_SOCK_STAT_TX_CALLS, tx_calls),
+	__ADD(NL_SOCK_STAT_ACKS, acks),
+	__ADD(NL_SOCK_STAT_ERRORS, errors),
+	__ADD(NL_SOCK_STAT_OVERRUNS, overruns),
+	__ADD(NL_SOCK_STAT_REPLIES, replies),
+	__ADD(NL_SOCK_STAT_REPLY_TIME, reply_time),
+	__ADD(NL_SOCK_STAT_REPLY_TIME_MAX, reply_time_max),
+};
+
+char *nl_socket_stat2str(int st, char *buf, size_t len)
+{
+	return __type2str(st, buf, len, sock_stats, ARRAY_SIZE(sock_stats));
+}
+
+int nl_socket_str2stat(const char *name)
+{
+	return __str2type(name, sock_stats, ARRAY_SIZE(sock_stats));
+}
+
+/** @} */
+
 /** @} */
@@ -0,0 +1,558 @@
+/*
+ * lib/txn.c		Pipelined Transactions
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+/**
+ * @ingroup send_recv
+ * @defgroup txn Transactions
+ * @brief Pipelined requests with deferred acknowledgement collection
+ *
+ * Sending a request and waiting for its acknowledgement before sending
+ * the next one costs a full round trip per request. A transaction
+ * instead queues requests and transmits as many of them as fit into the
+ * socket send buffer with a single sendmsg() call, one IO vector per
+ * message, without copying them. Acknowledgements are collected in the
+ * background while more requests are being queued.
+ *
+ * Each request is sent with NLM_F_ACK and a sequence number of its own.
+ * A request remains referenced by the transaction until its
+ * acknowledgement has been received, so errors reported by the kernel
+ * can be mapped back to the request which caused them and passed to the
+ * error callback.
+ *
+ * The number of requests in flight is bounded by a window. By default
+ * the window is derived from the size of the socket receive buffer so
+ * that the acknowledgements of all outstanding requests fit into it.
+ * Increase the buffer with nl_socket_set_buffer_size() before
+ * allocating the transaction to allow for a larger window.
+ *
+ * @code
+ * struct nl_txn *txn;
+ *
+ * nl_txn_alloc(sk, &txn);
+ * nl_txn_set_error_cb(txn, my_error_cb, NULL);
+ *
+ * for (i = 0; i < nroutes; i++) {
+ *         rtnl_route_build_add_request(route[i], NLM_F_CREATE, &msg);
+ *         nl_txn_add(txn, msg);
+ *         nlmsg_free(msg);
+ * }
+ *
+ * err = nl_txn_commit(txn);
+ * nl_txn_free(txn);
+ * @endcode
+ *
+ * A transaction takes exclusive use of the socket while requests are
+ * outstanding, replies other than acknowledgements are discarded.
+ * @{
+ *
+ * Header
+ * ------
+ * ~~~~{.c}
+ * #include <netlink/txn.h>
+ * ~~~~
+ */
+
+#include <netlink-private/netlink.h>
+#include <netlink-private/socket.h>
+#include <netlink-private/utils.h>
+#include <netlink/netlink.h>
+#include <netlink/handlers.h>
+#include <netlink/msg.h>
+#include <netlink/txn.h>
+#include <poll.h>
+
+/** @cond SKIP */
+#define NL_TXN_IOV_MAX		1024
+#define NL_TXN_RECV_BATCH	64
+/* Only the header of an acknowledgement is of interest */
+#define NL_TXN_ACK_SIZE		64
+/* Receive buffer space charged for a single acknowledgement */
+#define NL_TXN_ACK_TRUESIZE	1024
+
+struct nl_txn {
+	struct nl_sock *	t_sk;
+
+	/* Ring of requests: t_nsent in flight followed by t_nqueued */
+	struct nl_msg **	t_ring;
+	unsigned int		t_mask;
+	unsigned int		t_head;
+	unsigned int		t_nsent;
+	unsigned int		t_nqueued;
+	size_t			t_qbytes;
+
+	unsigned int		t_window;
+	unsigned int		t_auto_window;
+	size_t			t_maxbytes;
+	int			t_overrun;
+
+	void		      (*t_error_cb)(struct nl_msg *, int, void *);
+	void *			t_error_arg;
+	int			t_error;
+	unsigned int		t_nerrors;
+
+	struct iovec		t_iov[NL_TXN_IOV_MAX];
+	struct mmsghdr		t_rmsg[NL_TXN_RECV_BATCH];
+	struct iovec		t_riov[NL_TXN_RECV_BATCH];
+	char			t_rbuf[NL_TXN_RECV_BATCH][NL_TXN_ACK_SIZE];
+};
+/** @endcond */
+
+static int txn_resize(struct nl_txn *txn, unsigned int window)
+{
+	struct nl_msg **ring;
+	unsigned int i, size = 1, n = txn->t_nsent + txn->t_nqueued;
+
+	while (size < window)
+		size <<= 1;
+
+	if (txn->t_ring && size <= txn->t_mask + 1)
+		return 0;
+
+	if (!(ring = calloc(size, sizeof(*ring))))
+		return -NLE_NOMEM;
+
+	for (i = 0; i < n; i++)
+		ring[i] = txn->t_ring[(txn->t_head + i) & txn->t_mask];
+
+	free(txn->t_ring);
+	txn->t_ring = ring;
+	txn->t_mask = size - 1;
+	txn->t_head = 0;
+
+	return 0;
+}
+
+/**
+ * Allocate a transaction
+ * @arg sk		Netlink socket (connected)
+ * @arg result		Result pointer
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nl_txn_alloc(struct nl_sock *sk, struct nl_txn **result)
+{
+	struct nl_txn *txn;
+	socklen_t optlen;
+	int i, rcvbuf = 0, sndbuf = 0, err;
+
+	if (sk->s_fd < 0)
+		return -NLE_BAD_SOCK;
+
+	optlen = sizeof(rcvbuf);
+	if (getsockopt(sk->s_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen) < 0)
+		return -nl_syserr2nlerr(errno);
+
+	optlen = sizeof(sndbuf);
+	if (getsockopt(sk->s_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &optlen) < 0)
+		return -nl_syserr2nlerr(errno);
+
+	if (!(txn = calloc(1, sizeof(*txn))))
+		return -NLE_NOMEM;
+
+	txn->t_sk = sk;
+	/* The kernel refuses messages exceeding the send buffer */
+	txn->t_maxbytes = sndbuf > 64 ? sndbuf - 64 : getpagesize();
+	txn->t_auto_window = rcvbuf / NL_TXN_ACK_TRUESIZE;
+	if (txn->t_auto_window < 1)
+		txn->t_auto_window = 1;
+
+	for (i = 0; i < NL_TXN_RECV_BATCH; i++) {
+		txn->t_riov[i].iov_base = txn->t_rbuf[i];
+		txn->t_riov[i].iov_len = NL_TXN_ACK_SIZE;
+		txn->t_rmsg[i].msg_hdr.msg_iov = &txn->t_riov[i];
+		txn->t_rmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	txn->t_window = txn->t_auto_window;
+	if ((err = txn_resize(txn, txn->t_window)) < 0) {
+		free(txn);
+		return err;
+	}
+
+	NL_DBG(2, "Allocated transaction %p, window %u, max %zu bytes per send\n",
+	       txn, txn->t_window, txn->t_maxbytes);
+
+	*result = txn;
+	return 0;
+}
+
+/**
+ * Free a transaction
+ * @arg txn		Transaction
+ *
+ * Requests which have not been sent yet are discarded, outstanding
+ * acknowledgements are no longer waited for. Call nl_txn_commit()
+ * first to complete the transaction.
+ */
+void nl_txn_free(struct nl_txn *txn)
+{
+	unsigned int i;
+
+	if (!txn)
+		return;
+
+	for (i = 0; i < txn->t_nsent + txn->t_nqueued; i++)
+		nlmsg_free(txn->t_ring[(txn->t_head + i) & txn->t_mask]);
+
+	free(txn->t_ring);
+	free(txn);
+}
+
+/**
+ * Set maximum number of requests in flight
+ * @arg txn		Transaction
+ * @arg window		Maximum number of requests or 0 for automatic
+ *
+ * Queuing a request blocks until an acknowledgement has been received
+ * once this number of requests has been queued or sent but not yet
+ * acknowledged. A window exceeding the capacity of the socket receive
+ * buffer leads to lost acknowledgements.
+ */
+void nl_txn_set_window(struct nl_txn *txn, unsigned int window)
+{
+	if (!window)
+		window = txn->t_auto_window;
+
+	/* On allocation failure keep the current ring and its capacity */
+	if (txn_resize(txn, window) < 0)
+		window = txn->t_mask + 1;
+
+	txn->t_window = window;
+}
+
+/**
+ * Return maximum number of requests in flight
+ * @arg txn		Transaction
+ */
+unsigned int nl_txn_get_window(struct nl_txn *txn)
+{
+	return txn->t_window;
+}
+
+/**
+ * Set callback for failed requests
+ * @arg txn		Transaction
+ * @arg cb		Callback function
+ * @arg arg		Argument passed to the callback
+ *
+ * The callback is invoked with the original request and the error code
+ * for every request which has been refused by the kernel. Requests
+ * whose acknowledgement was lost due to a receive buffer overrun are
+ * reported with -NLE_NOMEM.
+ */
+void nl_txn_set_error_cb(struct nl_txn *txn,
+			 void (*cb)(struct nl_msg *, int, void *), void *arg)
+{
+	txn->t_error_cb = cb;
+	txn->t_error_arg = arg;
+}
+
+static void txn_complete(struct nl_txn *txn, int err)
+{
+	struct nl_msg *msg = txn->t_ring[txn->t_head];
+
+	if (err < 0) {
+		NL_DBG(3, "Transaction %p, request seq %u failed: %s\n",
+		       txn, nlmsg_hdr(msg)->nlmsg_seq, nl_geterror(err));
+
+		if (!txn->t_error)
+			txn->t_error = err;
+		txn->t_nerrors++;
+
+		if (txn->t_error_cb)
+			txn->t_error_cb(msg, err, txn->t_error_arg);
+	}
+
+	nlmsg_free(msg);
+	txn->t_ring[txn->t_head] = NULL;
+	txn->t_head = (txn->t_head + 1) & txn->t_mask;
+	txn->t_nsent--;
+}
+
+static void txn_ack(struct nl_txn *txn, uint32_t seq, int err)
+{
+	struct nl_msg *last;
+
+	if (!txn->t_nsent)
+		return;
+
+	last = txn->t_ring[(txn->t_head + txn->t_nsent - 1) & txn->t_mask];
+	if ((int32_t) (seq - nlmsg_hdr(last)->nlmsg_seq) > 0)
+		return;
+
+	/*
+	 * Requests are processed and acknowledged in order, any request
+	 * before the one being acknowledged lost its acknowledgement.
+	 */
+	while (txn->t_nsent) {
+		uint32_t head = nlmsg_hdr(txn->t_ring[txn->t_head])->nlmsg_seq;
+
+		if ((int32_t) (seq - head) < 0)
+			return;
+
+		if (seq == head) {
+			txn_complete(txn, err);
+			return;
+		}
+
+		txn_complete(txn, -NLE_NOMEM);
+	}
+}
+
+static int txn_recv(struct nl_txn *txn)
+{
+	int i, n;
+
+	n = recvmmsg(txn->t_sk->s_fd, txn->t_rmsg, NL_TXN_RECV_BATCH,
+		     MSG_DONTWAIT, NULL);
+	if (n < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return -NLE_AGAIN;
+		if (errno == EINTR)
+			return 0;
+		if (errno == ENOBUFS) {
+			__nl_sock_stat_add(txn->t_sk, NL_SOCK_STAT_OVERRUNS, 1);
+			NL_DBG(1, "Transaction %p, receive buffer overrun, "
+			       "acknowledgements lost\n", txn);
+			txn->t_overrun = 1;
+			return 0;
+		}
+		return -nl_syserr2nlerr(errno);
+	}
+
+	__nl_sock_stat_add(txn->t_sk, NL_SOCK_STAT_RX_CALLS, 1);
+
+	for (i = 0; i < n; i++) {
+		struct nlmsghdr *nlh = (struct nlmsghdr *) txn->t_rbuf[i];
+		struct nlmsgerr *e = nlmsg_data(nlh);
+
+		__nl_sock_stat_add(txn->t_sk, NL_SOCK_STAT_RX_BYTES,
+				   txn->t_rmsg[i].msg_len);
+
+		if (txn->t_rmsg[i].msg_len < NLMSG_LENGTH(sizeof(e->error)))
+			continue;
+
+		__nl_sock_stat_recvd(txn->t_sk, nlh);
+
+		if (nlh->nlmsg_type != NLMSG_ERROR)
+			continue;
+
+		txn_ack(txn, nlh->nlmsg_seq,
+			e->error ? -nl_syserr2nlerr(-e->error) : 0);
+	}
+
+	return n;
+}
+
+/*
+ * Collect acknowledgements until no more than limit requests are in
+ * flight. Does not block if limit is UINT_MAX.
+ */
+static int txn_collect(struct nl_txn *txn, unsigned int limit)
+{
+	struct pollfd pfd = { .fd = txn->t_sk->s_fd, .events = POLLIN };
+	int err;
+
+	while (txn->t_nsent) {
+		err = txn_recv(txn);
+		if (err >= 0)
+			continue;
+		if (err != -NLE_AGAIN)
+			return err;
+		if (txn->t_nsent <= limit)
+			return 0;
+
+		/*
+		 * The kernel processes requests synchronously while they
+		 * are being sent, after an overrun nothing more is going
+		 * to arrive for the requests still outstanding.
+		 */
+		if (txn->t_overrun) {
+			while (txn->t_nsent)
+				txn_complete(txn, -NLE_NOMEM);
+			break;
+		}
+
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			return -nl_syserr2nlerr(errno);
+	}
+
+	txn->t_overrun = 0;
+
+	return 0;
+}
+
+/**
+ * Transmit queued requests
+ * @arg txn		Transaction
+ *
+ * Sends all requests queued so far with a single system call and
+ * collects acknowledgements already available without blocking.
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nl_txn_flush(struct nl_txn *txn)
+{
+	struct nl_sock *sk = txn->t_sk;
+	struct msghdr hdr = {
+		.msg_name = (void *) &sk->s_peer,
+		.msg_namelen = sizeof(struct sockaddr_nl),
+		.msg_iov = txn->t_iov,
+		.msg_iovlen = txn->t_nqueued,
+	};
+	unsigned int i, first = txn->t_head + txn->t_nsent;
+	int ret;
+
+	if (!txn->t_nqueued)
+		return 0;
+
+	for (i = 0; i < txn->t_nqueued; i++) {
+		struct nlmsghdr *nlh;
+
+		nlh = nlmsg_hdr(txn->t_ring[(first + i) & txn->t_mask]);
+		txn->t_iov[i].iov_base = nlh;
+		txn->t_iov[i].iov_len = nlh->nlmsg_len;
+	}
+
+	ret = sendmsg(sk->s_fd, &hdr, 0);
+	if (ret < 0) {
+		NL_DBG(4, "nl_txn_flush(%p): sendmsg() failed with %d (%s)\n",
+		       txn, errno, nl_strerror_l(errno));
+		return -nl_syserr2nlerr(errno);
+	}
+
+	NL_DBG(4, "Transaction %p, sent %u requests, %d bytes\n",
+	       txn, txn->t_nqueued, ret);
+
+	__nl_sock_stat_add(sk, NL_SOCK_STAT_TX_CALLS, 1);
+	__nl_sock_stat_add(sk, NL_SOCK_STAT_TX_BYTES, ret);
+	for (i = 0; i < txn->t_nqueued; i++)
+		__nl_sock_stat_sent(sk, txn->t_iov[i].iov_base);
+
+	txn->t_nsent += txn->t_nqueued;
+	txn->t_nqueued = 0;
+	txn->t_qbytes = 0;
+
+	return txn_collect(txn, UINT_MAX);
+}
+
+/**
+ * Queue a request
+ * @arg txn		Transaction
+ * @arg msg		Netlink message
+ *
+ * Completes the message with nl_complete_msg(), requests an
+ * acknowledgement and queues it for transmission. The transaction
+ * takes its own reference to the message, the caller may free or
+ * reuse the message object once this function returns but must not
+ * modify its contents.
+ *
+ * Queued requests are transmitted when the send buffer is full, when
+ * nl_txn_flush() or nl_txn_commit() are called, or when the window is
+ * reached, in which case this function blocks until acknowledgements
+ * have been received.
+ *
+ * @callback This function triggers the `NL_CB_MSG_OUT` callback.
+ *
+ * @return 0 on success or a negative error code. Errors reported by the
+ *         kernel for individual requests are not returned here, see
+ *         nl_txn_set_error_cb() and nl_txn_commit().
+ */
+int nl_txn_add(struct nl_txn *txn, struct nl_msg *msg)
+{
+	struct nl_sock *sk = txn->t_sk;
+	struct nlmsghdr *nlh = nlmsg_hdr(msg);
+	int err;
+
+	nl_complete_msg(sk, msg);
+	nlh->nlmsg_flags |= NLM_F_ACK;
+
+	if (NLMSG_ALIGN(nlh->nlmsg_len) > txn->t_maxbytes)
+		return -NLE_MSGSIZE;
+
+	nlmsg_set_src(msg, &sk->s_local);
+
+	if (sk->s_cb->cb_set[NL_CB_MSG_OUT] &&
+	    nl_cb_call(sk->s_cb, NL_CB_MSG_OUT, msg) != NL_OK)
+		return 0;
+
+	if (txn->t_nsent + txn->t_nqueued >= txn->t_window) {
+		if ((err = nl_txn_flush(txn)) < 0 ||
+		    (err = txn_collect(txn, txn->t_window - 1)) < 0)
+			return err;
+	}
+
+	if (txn->t_nqueued == NL_TXN_IOV_MAX ||
+	    txn->t_qbytes + NLMSG_ALIGN(nlh->nlmsg_len) > txn->t_maxbytes) {
+		if ((err = nl_txn_flush(txn)) < 0)
+			return err;
+	}
+
+	nlmsg_get(msg);
+	txn->t_ring[(txn->t_head + txn->t_nsent + txn->t_nqueued) &
+		    txn->t_mask] = msg;
+	txn->t_nqueued++;
+	txn->t_qbytes += NLMSG_ALIGN(nlh->nlmsg_len);
+
+	return 0;
+}
+
+/**
+ * Complete a transaction
+ * @arg txn		Transaction
+ *
+ * Transmits all queued requests and waits until all of them have been
+ * acknowledged. The transaction may be reused afterwards.
+ *
+ * @return 0 if all requests succeeded, the error of the first failed
+ *         request since the last commit, or a negative error code if
+ *         the transaction could not be completed.
+ */
+int nl_txn_commit(struct nl_txn *txn)
+{
+	int err;
+
+	if ((err = nl_txn_flush(txn)) >= 0)
+		err = txn_collect(txn, 0);
+
+	/* Acknowledgements are consumed here, never by the socket, let it
+	 * expect the reply to its next request whatever happened */
+	txn->t_sk->s_seq_expect = txn->t_sk->s_seq_next;
+
+	if (err < 0)
+		return err;
+
+	err = txn->t_error;
+	txn->t_error = 0;
+
+	return err;
+}
+
+/**
+ * Return number of requests not acknowledged yet
+ * @arg txn		Transaction
+ */
+unsigned int nl_txn_get_pending(struct nl_txn *txn)
+{
+	return txn->t_nsent + txn->t_nqueued;
+}
+
+/**
+ * Return number of failed requests
+ * @arg txn		Transaction
+ *
+ * Counts all requests refused by the kernel or whose acknowledgement
+ * was lost since the transaction was allocated.
+ */
+unsigned int nl_txn_get_errors(struct nl_txn *txn)
+{
+	return txn->t_nerrors;
+}
+
+/** @} */
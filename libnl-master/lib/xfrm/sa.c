@@ -42,6 +42,7 @@
 #include <netlink/netlink.h>
 #include <netlink/cache.h>
 #include <netlink/object.h>
+#include <netlink/hashtable.h>
 #include <netlink/xfrm/sa.h>
 #include <netlink/xfrm/selector.h>
 #include <netlink/xfrm/lifetime.h>
@@ -264,7 +265,8 @@ static uint64_t xfrm_sa_compare(struct nl_object *_a, struct nl_object *_b,
 	diff |= XFRM_SA_DIFF(EXPIRE,a->hard != b->hard);
 
 	/* Compare replay states */
-	found = AVAILABLE_MISMATCH (a, b, XFRM_SA_ATTR_REPLAY_STATE);
+	found = !(attrs & XFRM_SA_ATTR_REPLAY_STATE) ||
+	        AVAILABLE_MISMATCH (a, b, XFRM_SA_ATTR_REPLAY_STATE);
 	if (found == 0) // attribute exists in both objects
 	{
 		if (((a->replay_state_esn != NULL) && (b->replay_state_esn == NULL)) ||
@@ -298,6 +300,36 @@ static uint64_t xfrm_sa_compare(struct nl_object *_a, struct nl_object *_b,
 	return diff;
 }
 
+/*
+ * A SA is identified by its destination address, SPI and protocol, which
+ * is what the kernel uses to look up inbound SAs.
+ */
+static void xfrm_sa_keygen(struct nl_object *obj, uint32_t *hashkey,
+                           uint32_t table_sz)
+{
+	struct xfrmnl_sa* sa = (struct xfrmnl_sa *) obj;
+	struct xfrm_sa_hash_key {
+		uint32_t        spi;
+		uint8_t         proto;
+		uint8_t         family;
+		uint8_t         daddr[16];
+	} __attribute__((packed)) key;
+	struct nl_addr* daddr = sa->id.daddr;
+
+	memset(&key, 0, sizeof(key));
+
+	key.spi = sa->id.spi;
+	key.proto = sa->id.proto;
+	if (daddr) {
+		key.family = nl_addr_get_family(daddr);
+		memcpy(key.daddr, nl_addr_get_binary_addr(daddr),
+		       min_t(unsigned int, nl_addr_get_len(daddr),
+		             sizeof(key.daddr)));
+	}
+
+	*hashkey = nl_hash(&key, sizeof(key), 0) % table_sz;
+}
+
 /**
  * @name XFRM SA Attribute Translations
  * @{
@@ -595,29 +627,29 @@ int xfrmnl_sa_alloc_cache(struct nl_sock *sock, struct nl_cache **result)
  * @arg daddr		destination address of the SA
  * @arg spi         SPI
  * @arg proto       protocol
+ *
+ * The lookup is served from the hash table of the cache and does not
+ * depend on the number of SAs in the cache.
+ *
  * @return sa handle or NULL if no match was found.
  */
 struct xfrmnl_sa* xfrmnl_sa_get(struct nl_cache* cache, struct nl_addr* daddr,
                                 unsigned int spi, unsigned int proto)
 {
-	struct xfrmnl_sa *sa;
+	struct xfrmnl_sa needle;
 
-	//nl_list_for_each_entry(sa, &cache->c_items, ce_list) {
-	for (sa = (struct xfrmnl_sa*)nl_cache_get_first (cache);
-		 sa != NULL;
-		 sa = (struct xfrmnl_sa*)nl_cache_get_next ((struct nl_object*)sa))
-	{
-		if (sa->id.proto == proto &&
-		    sa->id.spi == spi &&
-			!nl_addr_cmp(sa->id.daddr, daddr))
-		{
-			nl_object_get((struct nl_object *) sa);
-			return sa;
-		}
+	if (!daddr)
+		return NULL;
 
-	}
+	memset(&needle, 0, sizeof(needle));
+	needle.ce_ops = &xfrm_sa_obj_ops;
+	needle.ce_mask = XFRM_SA_ATTR_DADDR | XFRM_SA_ATTR_SPI | XFRM_SA_ATTR_PROTO;
+	needle.id.daddr = daddr;
+	needle.id.spi = spi;
+	needle.id.proto = proto;
 
-	return NULL;
+	return (struct xfrmnl_sa *) nl_cache_search(cache,
+	                                            (struct nl_object *) &needle);
 }
 
 
@@ -2181,6 +2213,7 @@ static struct nl_object_ops xfrm_sa_obj_ops = {
 	                        [NL_DUMP_STATS]     =   xfrm_sa_dump_stats,
 	                    },
 	.oo_compare     =   xfrm_sa_compare,
+	.oo_keygen      =   xfrm_sa_keygen,
 	.oo_attrs2str   =   xfrm_sa_attrs2str,
 	.oo_id_attrs    =   (XFRM_SA_ATTR_DADDR | XFRM_SA_ATTR_SPI | XFRM_SA_ATTR_PROTO),
 };
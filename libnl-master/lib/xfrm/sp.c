@@ -42,6 +42,7 @@
 #include <netlink/netlink.h>
 #include <netlink/cache.h>
 #include <netlink/object.h>
+#include <netlink/hashtable.h>
 #include <netlink/xfrm/selector.h>
 #include <netlink/xfrm/lifetime.h>
 #include <netlink/xfrm/template.h>
@@ -166,15 +167,48 @@ static uint64_t xfrm_sp_compare(struct nl_object *_a, struct nl_object *_b,
 	diff |= XFRM_SP_DIFF(MARK,(a->mark.m != b->mark.m) ||
 	                          (a->mark.v != b->mark.v));
 
-	/* Compare the templates */
-	nl_list_for_each_entry(tmpl_b, &b->usertmpl_list, utmpl_list)
-	nl_list_for_each_entry(tmpl_a, &a->usertmpl_list, utmpl_list)
-	diff |= xfrmnl_user_tmpl_cmp (tmpl_a, tmpl_b);
+	/* Compare the templates pairwise, in order */
+	if ((attrs & XFRM_SP_ATTR_TMPL) && !diff &&
+	    a->nr_user_tmpl == b->nr_user_tmpl)
+	{
+		tmpl_b = nl_list_entry(b->usertmpl_list.next,
+		                       struct xfrmnl_user_tmpl, utmpl_list);
+		nl_list_for_each_entry(tmpl_a, &a->usertmpl_list, utmpl_list)
+		{
+			if (xfrmnl_user_tmpl_cmp (tmpl_a, tmpl_b))
+			{
+				diff |= XFRM_SP_ATTR_TMPL;
+				break;
+			}
+			tmpl_b = nl_list_entry(tmpl_b->utmpl_list.next,
+			                       struct xfrmnl_user_tmpl, utmpl_list);
+		}
+	}
 #undef XFRM_SP_DIFF
 
 	return diff;
 }
 
+/*
+ * The kernel identifies a policy by its index and direction. Hashing
+ * on these alone is consistent with the identity attributes since
+ * identical policies always share them.
+ */
+static void xfrm_sp_keygen(struct nl_object *obj, uint32_t *hashkey,
+                           uint32_t table_sz)
+{
+	struct xfrmnl_sp* sp = (struct xfrmnl_sp *) obj;
+	struct xfrm_sp_hash_key {
+		uint32_t        index;
+		uint8_t         dir;
+	} __attribute__((packed)) key;
+
+	key.index = sp->index;
+	key.dir = sp->dir;
+
+	*hashkey = nl_hash(&key, sizeof(key), 0) % table_sz;
+}
+
 /**
  * @name XFRM SP Attribute Translations
  * @{
@@ -472,17 +506,29 @@ int xfrmnl_sp_alloc_cache(struct nl_sock *sock, struct nl_cache **result)
  * @arg cache		SP cache
  * @arg index		Policy Id
  * @arg dir         direction
+ *
+ * The lookup is served from the hash table of the cache and does not
+ * depend on the number of policies in the cache.
+ *
  * @return sp handle or NULL if no match was found.
  */
 struct xfrmnl_sp* xfrmnl_sp_get(struct nl_cache* cache, unsigned int index, unsigned int dir)
 {
-	struct xfrmnl_sp *sp;
+	struct xfrmnl_sp needle, *sp;
+	nl_hash_node_t *node;
+	uint32_t key;
+
+	if (!cache->hashtable)
+		return NULL;
+
+	needle.index = index;
+	needle.dir = dir;
+	xfrm_sp_keygen((struct nl_object *) &needle, &key,
+	               cache->hashtable->size);
 
-	//nl_list_for_each_entry(sp, &cache->c_items, ce_list) {
-	for (sp = (struct xfrmnl_sp*)nl_cache_get_first (cache);
-	     sp != NULL;
-	     sp = (struct xfrmnl_sp*)nl_cache_get_next ((struct nl_object*)sp))
+	for (node = cache->hashtable->nodes[key]; node; node = node->next)
 	{
+		sp = (struct xfrmnl_sp *) node->obj;
 		if (sp->index == index && sp->dir == dir)
 		{
 			nl_object_get((struct nl_object *) sp);
@@ -1391,6 +1437,7 @@ static struct nl_object_ops xfrm_sp_obj_ops = {
 	                        [NL_DUMP_STATS]     =   xfrm_sp_dump_stats,
 	                    },
 	.oo_compare     =   xfrm_sp_compare,
+	.oo_keygen      =   xfrm_sp_keygen,
 	.oo_attrs2str   =   xfrm_sp_attrs2str,
 	.oo_id_attrs    =   (XFRM_SP_ATTR_SEL | XFRM_SP_ATTR_INDEX | XFRM_SP_ATTR_DIR),
 };
@@ -1415,6 +1462,8 @@ static struct nl_cache_ops xfrmnl_sp_ops = {
 	.co_request_update  = xfrm_sp_request_update,
 	.co_msg_parser      = xfrm_sp_msg_parser,
 	.co_obj_ops         = &xfrm_sp_obj_ops,
+	.co_free_index      = xfrm_sp_index_free,
+	.co_index_update    = xfrm_sp_index_update,
 };
 
 /**
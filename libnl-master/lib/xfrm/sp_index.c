@@ -0,0 +1,472 @@
+/*
+ * lib/xfrm/sp_index.c	Security Policy Lookup Index
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+/**
+ * @ingroup sp
+ * @defgroup sp_lookup Policy Lookup
+ *
+ * Resolves a flow against the security policies held in a SP cache
+ * without asking the kernel.
+ *
+ * The first lookup builds an index over the selectors of all policies in
+ * the cache. Policies are grouped by direction, address family and the
+ * pair of source and destination prefix lengths of their selector. Each
+ * group keeps its policies in a hash table keyed by the masked addresses,
+ * so a lookup costs one hash probe per distinct prefix length pair in
+ * use. Groups are visited in order of the best priority they contain and
+ * the search stops as soon as no remaining group can beat the best match
+ * found so far.
+ *
+ * Once built, the index is kept up to date as policies are added to or
+ * removed from the cache, e.g. by a cache manager applying notifications,
+ * without rebuilding it.
+ *
+ * Only policies of the main policy type and of the in, out and forward
+ * directions are considered. If several policies match, the one with the
+ * lowest priority value wins, ties are resolved in favour of the policy
+ * which was added to the cache first.
+ *
+ * @note Lookups may build the index and thus modify the cache's private
+ *       state. Lookups on the same cache must not run concurrently with
+ *       each other nor with modifications of the cache.
+ *
+ * @{
+ */
+
+#include <netlink-private/netlink.h>
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/addr.h>
+#include <netlink/hashtable.h>
+#include <netlink/xfrm/selector.h>
+#include <netlink/xfrm/sp.h>
+
+/** @cond SKIP */
+#define SP_KEYLEN	32
+
+struct sp_entry
+{
+	struct sp_entry *	se_next;
+	struct xfrmnl_sp *	se_sp;
+	uint32_t		se_hash;
+	uint32_t		se_prio;
+	uint32_t		se_seq;
+	uint8_t			se_key[SP_KEYLEN];
+};
+
+struct sp_tuple
+{
+	struct sp_tuple *	st_next;
+	uint8_t			st_plen_d;
+	uint8_t			st_plen_s;
+	uint32_t		st_min_prio;
+	unsigned int		st_nentries;
+	unsigned int		st_size;
+	struct sp_entry **	st_buckets;
+};
+
+struct sp_index
+{
+	/* Indexed by address family (IPv4, IPv6) and direction, each list
+	 * is sorted by st_min_prio */
+	struct sp_tuple *	si_tuples[2][XFRM_POLICY_MAX];
+	uint32_t		si_seq;
+};
+/** @endcond */
+
+static int sp_family_idx(int family)
+{
+	switch (family) {
+	case AF_INET:
+		return 0;
+	case AF_INET6:
+		return 1;
+	default:
+		return -1;
+	}
+}
+
+static void sp_mask(uint8_t *dst, const void *src, unsigned int len,
+		    unsigned int plen)
+{
+	unsigned int i;
+
+	memcpy(dst, src, len);
+
+	for (i = 0; i < len; i++) {
+		if (plen >= 8)
+			plen -= 8;
+		else {
+			dst[i] &= 0xff << (8 - plen);
+			plen = 0;
+		}
+	}
+}
+
+static uint32_t sp_key(uint8_t *key, struct nl_addr *daddr,
+		       struct nl_addr *saddr, unsigned int alen,
+		       unsigned int plen_d, unsigned int plen_s)
+{
+	memset(key, 0, SP_KEYLEN);
+	sp_mask(key, nl_addr_get_binary_addr(daddr), alen, plen_d);
+	sp_mask(key + 16, nl_addr_get_binary_addr(saddr), alen, plen_s);
+
+	return nl_hash(key, SP_KEYLEN, 0);
+}
+
+/*
+ * Returns the list of groups a policy belongs to or NULL if the policy
+ * cannot be indexed.
+ */
+static struct sp_tuple **sp_tuple_list(struct sp_index *si,
+				       struct xfrmnl_sp *sp)
+{
+	struct xfrmnl_sel *sel = xfrmnl_sp_get_sel(sp);
+	int fi;
+
+	if (!sel || xfrmnl_sp_get_dir(sp) < 0 ||
+	    xfrmnl_sp_get_dir(sp) >= XFRM_POLICY_MAX ||
+	    xfrmnl_sp_get_userpolicy_type(sp) == XFRM_POLICY_TYPE_SUB)
+		return NULL;
+
+	if ((fi = sp_family_idx(xfrmnl_sel_get_family(sel))) < 0 ||
+	    !xfrmnl_sel_get_daddr(sel) || !xfrmnl_sel_get_saddr(sel) ||
+	    nl_addr_get_len(xfrmnl_sel_get_daddr(sel)) != (fi ? 16 : 4) ||
+	    nl_addr_get_len(xfrmnl_sel_get_saddr(sel)) != (fi ? 16 : 4))
+		return NULL;
+
+	return &si->si_tuples[fi][xfrmnl_sp_get_dir(sp)];
+}
+
+/* Keep the list sorted after the priority bound of a group dropped */
+static void sp_tuple_sort(struct sp_tuple **list, struct sp_tuple *t)
+{
+	struct sp_tuple **pp;
+
+	for (pp = list; *pp != t; pp = &(*pp)->st_next)
+		;
+	*pp = t->st_next;
+
+	for (pp = list; *pp && (*pp)->st_min_prio <= t->st_min_prio;
+	     pp = &(*pp)->st_next)
+		;
+	t->st_next = *pp;
+	*pp = t;
+}
+
+/*
+ * Chains are kept sorted by priority and insertion order so that the
+ * first match found in a chain is the best one of its group.
+ */
+static void sp_chain_insert(struct sp_entry **pp, struct sp_entry *e)
+{
+	for (; *pp; pp = &(*pp)->se_next)
+		if ((*pp)->se_prio > e->se_prio ||
+		    ((*pp)->se_prio == e->se_prio &&
+		     (*pp)->se_seq > e->se_seq))
+			break;
+
+	e->se_next = *pp;
+	*pp = e;
+}
+
+static int sp_tuple_grow(struct sp_tuple *t)
+{
+	unsigned int size = t->st_size ? 2 * t->st_size : 8, i;
+	struct sp_entry **buckets, *e, *next;
+
+	if (!(buckets = calloc(size, sizeof(*buckets))))
+		return -NLE_NOMEM;
+
+	for (i = 0; i < t->st_size; i++) {
+		for (e = t->st_buckets[i]; e; e = next) {
+			next = e->se_next;
+			sp_chain_insert(&buckets[e->se_hash & (size - 1)], e);
+		}
+	}
+
+	free(t->st_buckets);
+	t->st_buckets = buckets;
+	t->st_size = size;
+
+	return 0;
+}
+
+static int sp_index_add(struct sp_index *si, struct xfrmnl_sp *sp)
+{
+	struct xfrmnl_sel *sel = xfrmnl_sp_get_sel(sp);
+	struct sp_tuple **list, *t;
+	struct sp_entry *e;
+	unsigned int plen_d, plen_s, alen;
+	uint32_t prio = xfrmnl_sp_get_priority(sp);
+
+	if (!(list = sp_tuple_list(si, sp)))
+		return 0;
+
+	alen = nl_addr_get_len(xfrmnl_sel_get_daddr(sel));
+	plen_d = min_t(unsigned int, xfrmnl_sel_get_prefixlen_d(sel), alen * 8);
+	plen_s = min_t(unsigned int, xfrmnl_sel_get_prefixlen_s(sel), alen * 8);
+
+	for (t = *list; t; t = t->st_next)
+		if (t->st_plen_d == plen_d && t->st_plen_s == plen_s)
+			break;
+
+	if (!t) {
+		if (!(t = calloc(1, sizeof(*t))))
+			return -NLE_NOMEM;
+
+		if (sp_tuple_grow(t) < 0) {
+			free(t);
+			return -NLE_NOMEM;
+		}
+
+		t->st_plen_d = plen_d;
+		t->st_plen_s = plen_s;
+		t->st_min_prio = prio;
+		t->st_next = *list;
+		*list = t;
+		sp_tuple_sort(list, t);
+	}
+
+	if (t->st_nentries >= t->st_size && sp_tuple_grow(t) < 0)
+		return -NLE_NOMEM;
+
+	if (!(e = calloc(1, sizeof(*e))))
+		return -NLE_NOMEM;
+
+	e->se_sp = sp;
+	e->se_prio = prio;
+	e->se_seq = si->si_seq++;
+	e->se_hash = sp_key(e->se_key, xfrmnl_sel_get_daddr(sel),
+			    xfrmnl_sel_get_saddr(sel), alen, plen_d, plen_s);
+	sp_chain_insert(&t->st_buckets[e->se_hash & (t->st_size - 1)], e);
+	t->st_nentries++;
+
+	if (prio < t->st_min_prio) {
+		t->st_min_prio = prio;
+		sp_tuple_sort(list, t);
+	}
+
+	return 0;
+}
+
+static void sp_index_del(struct sp_index *si, struct xfrmnl_sp *sp)
+{
+	struct xfrmnl_sel *sel = xfrmnl_sp_get_sel(sp);
+	struct sp_tuple **list, **tp, *t;
+	struct sp_entry **pp, *e;
+	uint8_t key[SP_KEYLEN];
+	uint32_t hash;
+
+	if (!(list = sp_tuple_list(si, sp)))
+		return;
+
+	for (tp = list; (t = *tp); tp = &t->st_next) {
+		unsigned int alen = nl_addr_get_len(xfrmnl_sel_get_daddr(sel));
+
+		if (t->st_plen_d != min_t(unsigned int,
+					  xfrmnl_sel_get_prefixlen_d(sel),
+					  alen * 8) ||
+		    t->st_plen_s != min_t(unsigned int,
+					  xfrmnl_sel_get_prefixlen_s(sel),
+					  alen * 8))
+			continue;
+
+		hash = sp_key(key, xfrmnl_sel_get_daddr(sel),
+			      xfrmnl_sel_get_saddr(sel), alen,
+			      t->st_plen_d, t->st_plen_s);
+
+		for (pp = &t->st_buckets[hash & (t->st_size - 1)]; (e = *pp);
+		     pp = &e->se_next) {
+			if (e->se_sp != sp)
+				continue;
+
+			*pp = e->se_next;
+			free(e);
+
+			/* The priority bound of the group is left as is, it
+			 * remains a valid lower bound */
+			if (--t->st_nentries == 0) {
+				*tp = t->st_next;
+				free(t->st_buckets);
+				free(t);
+			}
+			return;
+		}
+	}
+}
+
+/** @cond SKIP */
+void xfrm_sp_index_free(struct nl_cache *cache)
+{
+	struct sp_index *si = cache->c_index;
+	struct sp_tuple *t, *next;
+	struct sp_entry *e, *enext;
+	unsigned int f, d, i;
+
+	if (!si)
+		return;
+
+	for (f = 0; f < 2; f++) {
+		for (d = 0; d < XFRM_POLICY_MAX; d++) {
+			for (t = si->si_tuples[f][d]; t; t = next) {
+				next = t->st_next;
+				for (i = 0; i < t->st_size; i++) {
+					for (e = t->st_buckets[i]; e; e = enext) {
+						enext = e->se_next;
+						free(e);
+					}
+				}
+				free(t->st_buckets);
+				free(t);
+			}
+		}
+	}
+
+	free(si);
+	cache->c_index = NULL;
+}
+
+void xfrm_sp_index_update(struct nl_cache *cache, struct nl_object *obj,
+			  int add)
+{
+	struct sp_index *si = cache->c_index;
+
+	if (!add)
+		sp_index_del(si, (struct xfrmnl_sp *) obj);
+	else if (sp_index_add(si, (struct xfrmnl_sp *) obj) < 0) {
+		/* Drop the index, the next lookup rebuilds it */
+		NL_DBG(2, "Dropping policy index of cache %p\n", cache);
+		xfrm_sp_index_free(cache);
+	}
+}
+/** @endcond */
+
+static struct sp_index *sp_index_get(struct nl_cache *cache)
+{
+	struct sp_index *si = cache->c_index;
+	struct nl_object *obj;
+
+	if (si)
+		return si;
+
+	if (!(si = calloc(1, sizeof(*si))))
+		return NULL;
+
+	cache->c_index = si;
+
+	nl_list_for_each_entry(obj, &cache->c_items, ce_list) {
+		if (sp_index_add(si, (struct xfrmnl_sp *) obj) < 0) {
+			xfrm_sp_index_free(cache);
+			return NULL;
+		}
+	}
+
+	return si;
+}
+
+static int sp_match(struct xfrmnl_sp *sp, struct xfrmnl_sel *flow,
+		    unsigned int mark)
+{
+	struct xfrmnl_sel *sel = xfrmnl_sp_get_sel(sp);
+	unsigned int m = 0, v = 0;
+
+	if ((xfrmnl_sel_get_dport(flow) ^ xfrmnl_sel_get_dport(sel)) &
+	    xfrmnl_sel_get_dportmask(sel))
+		return 0;
+
+	if ((xfrmnl_sel_get_sport(flow) ^ xfrmnl_sel_get_sport(sel)) &
+	    xfrmnl_sel_get_sportmask(sel))
+		return 0;
+
+	if (xfrmnl_sel_get_proto(sel) &&
+	    xfrmnl_sel_get_proto(sel) != xfrmnl_sel_get_proto(flow))
+		return 0;
+
+	if (xfrmnl_sel_get_ifindex(sel) &&
+	    xfrmnl_sel_get_ifindex(sel) != xfrmnl_sel_get_ifindex(flow))
+		return 0;
+
+	xfrmnl_sp_get_mark(sp, &m, &v);
+
+	return (mark & m) == v;
+}
+
+/**
+ * Find the policy applying to a flow
+ * @arg cache		SP cache
+ * @arg dir		Policy direction (XFRM_POLICY_IN, _OUT or _FWD)
+ * @arg flow		Selector describing the flow
+ * @arg mark		Mark of the flow
+ *
+ * The flow is described by a selector carrying the destination and
+ * source address, the ports, the protocol and optionally the interface
+ * index of the packet. The address family is taken from the destination
+ * address; prefix lengths and port masks of \c flow are ignored.
+ *
+ * @return Matching policy with its reference counter incremented or NULL
+ *         if no policy matches or the index could not be built.
+ */
+struct xfrmnl_sp *xfrmnl_sp_lookup(struct nl_cache *cache, unsigned int dir,
+				   struct xfrmnl_sel *flow, unsigned int mark)
+{
+	struct nl_addr *daddr = xfrmnl_sel_get_daddr(flow);
+	struct nl_addr *saddr = xfrmnl_sel_get_saddr(flow);
+	struct sp_entry *e, *best = NULL;
+	struct sp_index *si;
+	struct sp_tuple *t;
+	uint8_t key[SP_KEYLEN];
+	unsigned int alen;
+	uint32_t hash;
+	int fi;
+
+	if (dir >= XFRM_POLICY_MAX || !daddr || !saddr ||
+	    (fi = sp_family_idx(nl_addr_get_family(daddr))) < 0 ||
+	    nl_addr_get_family(saddr) != nl_addr_get_family(daddr))
+		return NULL;
+
+	alen = nl_addr_get_len(daddr);
+	if (alen != (fi ? 16 : 4) || nl_addr_get_len(saddr) != alen)
+		return NULL;
+
+	if (!(si = sp_index_get(cache)))
+		return NULL;
+
+	for (t = si->si_tuples[fi][dir]; t; t = t->st_next) {
+		if (best && t->st_min_prio > best->se_prio)
+			break;
+
+		hash = sp_key(key, daddr, saddr, alen, t->st_plen_d,
+			      t->st_plen_s);
+
+		for (e = t->st_buckets[hash & (t->st_size - 1)]; e;
+		     e = e->se_next) {
+			if (best && (e->se_prio > best->se_prio ||
+				     (e->se_prio == best->se_prio &&
+				      e->se_seq > best->se_seq)))
+				break;
+
+			if (e->se_hash == hash &&
+			    !memcmp(e->se_key, key, SP_KEYLEN) &&
+			    sp_match(e->se_sp, flow, mark)) {
+				best = e;
+				break;
+			}
+		}
+	}
+
+	if (!best)
+		return NULL;
+
+	nl_object_get((struct nl_object *) best->se_sp);
+
+	return best->se_sp;
+}
+
+/** @} */
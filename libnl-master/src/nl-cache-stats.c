@@ -0,0 +1,153 @@
+/*
+ * src/nl-cache-stats.c     Cache and socket statistics
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#include <netlink-private/netlink.h>
+#include <netlink/cli/utils.h>
+
+static void print_usage(void)
+{
+	printf(
+	"Usage: nl-cache-stats [OPTION]... [CACHE]...\n"
+	"\n"
+	"Fills the given caches, route/link, route/addr, route/route and\n"
+	"route/neigh by default, and prints the cache and socket statistics.\n"
+	"\n"
+	"Options\n"
+	" -l, --list            List available statistic names\n"
+	" -r, --resync=NUM      Resync each cache NUM times after filling it\n"
+	" -h, --help            Show this help\n"
+	" -v, --version         Show versioning information\n"
+	);
+	exit(0);
+}
+
+static void list_stat_names(void)
+{
+	char buf[64];
+	int i;
+
+	for (i = 0; i <= NL_CACHE_STAT_MAX; i++)
+		printf("%s\n", nl_cache_stat2str(i, buf, sizeof(buf)));
+	for (i = 0; i <= NL_SOCK_STAT_MAX; i++)
+		printf("socket.%s\n", nl_socket_stat2str(i, buf, sizeof(buf)));
+
+	exit(0);
+}
+
+static void dump_cache_stats(struct nl_cache *cache)
+{
+	char buf[64];
+	int i;
+
+	for (i = 0; i <= NL_CACHE_STAT_MAX; i++)
+		printf("%s.%s %" PRIu64 "\n", nl_cache_name(cache),
+		       nl_cache_stat2str(i, buf, sizeof(buf)),
+		       nl_cache_get_stat(cache, i));
+}
+
+static void dump_socket_stats(struct nl_sock *sk, const char *prefix)
+{
+	uint64_t hist[NL_SOCK_REPLY_HIST_SIZE];
+	char buf[64];
+	int i, n;
+
+	for (i = 0; i <= NL_SOCK_STAT_MAX; i++)
+		printf("%s.%s %" PRIu64 "\n", prefix,
+		       nl_socket_stat2str(i, buf, sizeof(buf)),
+		       nl_socket_get_stat(sk, i));
+
+	n = nl_socket_get_reply_hist(sk, hist, NL_SOCK_REPLY_HIST_SIZE);
+	for (i = 0; i < n; i++) {
+		if (!hist[i])
+			continue;
+
+		if (i == 0)
+			printf("%s.reply_hist.<1us %" PRIu64 "\n",
+			       prefix, hist[i]);
+		else
+			printf("%s.reply_hist.<%luus %" PRIu64 "\n",
+			       prefix, 1UL << i, hist[i]);
+	}
+}
+
+static void cache_stats(const char *name, int resyncs)
+{
+	struct nl_cache_ops *ops;
+	struct nl_cache *cache;
+	struct nl_sock *sk;
+	char prefix[64];
+	int err, i;
+
+	if (!(ops = nl_cache_ops_lookup_safe(name)))
+		nl_cli_fatal(ENOENT, "Unknown cache type \"%s\"", name);
+
+	if ((err = nl_cache_alloc_name(name, &cache)) < 0)
+		nl_cli_fatal(err, "Unable to allocate %s cache: %s",
+			     name, nl_geterror(err));
+
+	sk = nl_cli_alloc_socket();
+	nl_cli_connect(sk, ops->co_protocol);
+
+	if ((err = nl_cache_refill(sk, cache)) < 0)
+		nl_cli_fatal(err, "Unable to fill %s cache: %s",
+			     name, nl_geterror(err));
+
+	for (i = 0; i < resyncs; i++)
+		if ((err = nl_cache_resync(sk, cache, NULL, NULL)) < 0)
+			nl_cli_fatal(err, "Unable to resync %s cache: %s",
+				     name, nl_geterror(err));
+
+	dump_cache_stats(cache);
+	snprintf(prefix, sizeof(prefix), "%s.socket", name);
+	dump_socket_stats(sk, prefix);
+
+	nl_socket_free(sk);
+	nl_cache_free(cache);
+	nl_cache_ops_put(ops);
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *defaults[] = {
+		"route/link", "route/addr", "route/route", "route/neigh",
+	};
+	int resyncs = 0, i;
+
+	for (;;) {
+		int c, optidx = 0;
+		static struct option long_opts[] = {
+			{ "list", 0, 0, 'l' },
+			{ "resync", 1, 0, 'r' },
+			{ "help", 0, 0, 'h' },
+			{ "version", 0, 0, 'v' },
+			{ 0, 0, 0, 0 }
+		};
+
+		c = getopt_long(argc, argv, "lr:hv", long_opts, &optidx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'l': list_stat_names(); break;
+		case 'r': resyncs = nl_cli_parse_u32(optarg); break;
+		case 'h': print_usage(); break;
+		case 'v': nl_cli_print_version(); break;
+		}
+	}
+
+	if (optind >= argc) {
+		for (i = 0; i < ARRAY_SIZE(defaults); i++)
+			cache_stats(defaults[i], resyncs);
+	} else {
+		for (i = optind; i < argc; i++)
+			cache_stats(argv[i], resyncs);
+	}
+
+	return 0;
+}
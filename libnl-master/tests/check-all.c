@@ -31,6 +31,13 @@ int main(int argc, char *argv[])
 
 	srunner_add_suite(runner, make_nl_addr_suite());
 	srunner_add_suite(runner, make_nl_attr_suite());
+	srunner_add_suite(runner, make_nl_cache_suite());
+	srunner_add_suite(runner, make_nl_cache_mngr_suite());
+	srunner_add_suite(runner, make_nl_ct_suite());
+	srunner_add_suite(runner, make_nl_genl_suite());
+	srunner_add_suite(runner, make_nl_queue_suite());
+	srunner_add_suite(runner, make_nl_route_suite());
+	srunner_add_suite(runner, make_nl_stats_suite());
 
 	/* Do not add testsuites below this line */
 
@@ -77,6 +77,69 @@ START_TEST(msg_construct)
 }
 END_TEST
 
+static struct nla_policy schema_policy[4] = {
+	[1]	= { .type = NLA_U32 },
+	[2]	= { .type = NLA_STRING, .maxlen = 4 },
+	[3]	= { .minlen = 2, .maxlen = 3 },
+};
+
+START_TEST(schema_compile)
+{
+	struct nla_policy bad[2] = {
+		[1]	= { .type = NLA_TYPE_MAX + 1 },
+	};
+	struct nla_schema *schema;
+
+	fail_if(nla_schema_compile(bad, 1, &schema) != -NLE_INVAL,
+		"Policy with unknown type should be refused");
+	fail_if(nla_schema_compile(schema_policy, -1, &schema) != -NLE_INVAL,
+		"Negative maximum type should be refused");
+
+	fail_if(nla_schema_compile(schema_policy, 3, &schema) != 0,
+		"Unable to compile policy");
+	fail_if(nla_schema_get_maxtype(schema) != 3,
+		"Schema should keep the maximum type");
+	nla_schema_free(schema);
+}
+END_TEST
+
+START_TEST(schema_parse)
+{
+	struct nla_schema *schema;
+	struct nlattr *tb[4], *tb2[4];
+	char buf[64] __attribute__((aligned(NLA_ALIGNTO)));
+	struct nlattr *nla = (struct nlattr *) buf;
+	int type, len, err, err2;
+
+	fail_if(nla_schema_compile(schema_policy, 3, &schema) != 0,
+		"Unable to compile policy");
+
+	/* Short, long and unterminated attributes, known or not */
+	for (type = 0; type < 6; type++) {
+		for (len = 0; len < 8; len++) {
+			memset(buf, 'x', sizeof(buf));
+			nla->nla_type = type;
+			nla->nla_len = NLA_HDRLEN + len;
+			if (len)
+				buf[NLA_HDRLEN + len - 1] = len & 1 ? '\0' : 'x';
+
+			err = nla_parse(tb, 3, nla, NLA_ALIGN(nla->nla_len),
+					schema_policy);
+			err2 = nla_parse_schema(tb2, nla,
+						NLA_ALIGN(nla->nla_len), schema);
+			fail_if(err != err2,
+				"Type %d of length %d: nla_parse() returned %d, "
+				"nla_parse_schema() %d", type, len, err, err2);
+			fail_if(!err && memcmp(tb, tb2, sizeof(tb)),
+				"Type %d of length %d parsed differently",
+				type, len);
+		}
+	}
+
+	nla_schema_free(schema);
+}
+END_TEST
+
 Suite *make_nl_attr_suite(void)
 {
 	Suite *suite = suite_create("Netlink attributes");
@@ -84,6 +147,8 @@ Suite *make_nl_attr_suite(void)
 	TCase *nl_attr = tcase_create("Core");
 	tcase_add_test(nl_attr, attr_size);
 	tcase_add_test(nl_attr, msg_construct);
+	tcase_add_test(nl_attr, schema_compile);
+	tcase_add_test(nl_attr, schema_parse);
 	suite_add_tcase(suite, nl_attr);
 
 	return suite;
@@ -0,0 +1,199 @@
+/*
+ * tests/check-cache-mngr.c	cache manager unit tests
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#include <check.h>
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/route/addr.h>
+#include <net/if.h>
+#include <netinet/in.h>
+
+#include "util.h"
+
+/*
+ * Host addresses 127.42.0.1 and up on the loopback device. Far more
+ * notifications than fit into the smallest receive buffer possible.
+ */
+#define MNGR_NADDRS		128
+#define MNGR_ADDR		0x7f2a0000
+
+static struct nl_sock *sk;
+static struct nl_cache_mngr *mngr;
+static struct nl_cache *addrs;
+static int lo;
+
+static struct rtnl_addr *mngr_addr(int i)
+{
+	struct rtnl_addr *addr;
+	struct nl_addr *local;
+	uint32_t a = htonl(MNGR_ADDR + i + 1);
+
+	addr = rtnl_addr_alloc();
+	fail_if(!addr, "Unable to allocate address");
+	local = nl_addr_build(AF_INET, &a, sizeof(a));
+	fail_if(!local, "Unable to allocate address");
+	nl_addr_set_prefixlen(local, 32);
+	rtnl_addr_set_local(addr, local);
+	rtnl_addr_set_ifindex(addr, lo);
+	nl_addr_put(local);
+
+	return addr;
+}
+
+static void mngr_setup(void)
+{
+	int err;
+
+	lo = if_nametoindex("lo");
+	fail_if(!lo, "Loopback device missing");
+
+	sk = nl_socket_alloc();
+	fail_if(!sk, "Unable to allocate socket");
+	err = nl_connect(sk, NETLINK_ROUTE);
+	nl_fail_if(err < 0, err, "Unable to connect socket");
+
+	err = nl_cache_mngr_alloc(NULL, NETLINK_ROUTE, 0, &mngr);
+	nl_fail_if(err < 0, err, "Unable to allocate cache manager");
+	err = nl_cache_mngr_add(mngr, "route/addr", NULL, NULL, &addrs);
+	nl_fail_if(err < 0, err, "Unable to add cache");
+
+	/* Forced down to the kernel's minimum */
+	err = nl_cache_mngr_set_bufsize(mngr, 1);
+	nl_fail_if(err < 0, err, "Unable to set receive buffer size");
+}
+
+static void mngr_teardown(void)
+{
+	struct rtnl_addr *addr;
+	int i;
+
+	for (i = 0; i < MNGR_NADDRS; i++) {
+		addr = mngr_addr(i);
+		rtnl_addr_delete(sk, addr, 0);
+		rtnl_addr_put(addr);
+	}
+
+	nl_cache_mngr_free(mngr);
+	nl_socket_free(sk);
+}
+
+/* Adds or deletes all test addresses without reading notifications */
+static int mngr_burst(int add)
+{
+	struct rtnl_addr *addr;
+	int i, err;
+
+	for (i = 0; i < MNGR_NADDRS; i++) {
+		addr = mngr_addr(i);
+		if (add)
+			err = rtnl_addr_add(sk, addr, 0);
+		else
+			err = rtnl_addr_delete(sk, addr, 0);
+		rtnl_addr_put(addr);
+
+		if (err == -NLE_PERM)
+			return err;
+		nl_fail_if(err < 0, err, "Unable to change address");
+	}
+
+	return 0;
+}
+
+/* The managed cache must hold exactly what the kernel dumps */
+static void check_synced(int present)
+{
+	struct nl_cache *dump;
+	struct nl_object *obj, *found;
+	struct rtnl_addr *addr;
+	int i, err;
+
+	err = rtnl_addr_alloc_cache(sk, &dump);
+	nl_fail_if(err < 0, err, "Unable to dump addresses");
+
+	ck_assert_int_eq(nl_cache_nitems(addrs), nl_cache_nitems(dump));
+
+	for (obj = nl_cache_get_first(dump); obj;
+	     obj = nl_cache_get_next(obj)) {
+		found = nl_cache_search(addrs, obj);
+		fail_if(!found, "Address of the kernel missing in the cache");
+		nl_object_put(found);
+	}
+
+	for (i = 0; i < MNGR_NADDRS; i++) {
+		addr = mngr_addr(i);
+		found = nl_cache_search(addrs, (struct nl_object *) addr);
+		fail_if(!found != !present, "Address %d %s the cache", i,
+			present ? "missing in" : "left in");
+		nl_object_put(found);
+		rtnl_addr_put(addr);
+	}
+
+	nl_cache_free(dump);
+}
+
+/*
+ * Overruns the notification socket by adding and then deleting many
+ * addresses at once and checks that the cache recovers each time.
+ */
+static void check_overrun(void)
+{
+	uint64_t overruns;
+	int err;
+
+	if (mngr_burst(1) == -NLE_PERM)
+		return;
+
+	while ((err = nl_cache_mngr_data_ready(mngr)) > 0)
+		;
+	nl_fail_if(err < 0, err, "Unable to process notifications");
+
+	overruns = nl_cache_mngr_get_overruns(mngr);
+	fail_if(overruns == 0, "Notification socket was not overrun");
+	fail_if(nl_cache_mngr_get_resyncs(mngr) == 0, "Cache not resynced");
+	check_synced(1);
+
+	mngr_burst(0);
+	while ((err = nl_cache_mngr_data_ready(mngr)) > 0)
+		;
+	nl_fail_if(err < 0, err, "Unable to process notifications");
+
+	fail_if(nl_cache_mngr_get_overruns(mngr) == overruns,
+		"Notification socket was not overrun");
+	check_synced(0);
+}
+
+START_TEST(overrun_plain)
+{
+	check_overrun();
+}
+END_TEST
+
+START_TEST(overrun_batched)
+{
+	int err;
+
+	err = nl_cache_mngr_set_batch(mngr, 4);
+	nl_fail_if(err < 0, err, "Unable to enable batched mode");
+
+	check_overrun();
+}
+END_TEST
+
+Suite *make_nl_cache_mngr_suite(void)
+{
+	Suite *suite = suite_create("Cache manager");
+
+	TCase *overrun = tcase_create("Overrun");
+	tcase_add_checked_fixture(overrun, mngr_setup, mngr_teardown);
+	tcase_add_test(overrun, overrun_plain);
+	tcase_add_test(overrun, overrun_batched);
+	suite_add_tcase(suite, overrun);
+
+	return suite;
+}
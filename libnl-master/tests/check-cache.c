@@ -0,0 +1,427 @@
+/*
+ * tests/check-cache.c		cache unit tests
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#include <check.h>
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/msg.h>
+#include <netlink/route/link.h>
+#include <netlink/route/route.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+
+static struct nl_sock *sk;
+static struct nl_cache *links, *loaded;
+static char path[] = "/tmp/check-cache.XXXXXX";
+
+/* Snapshot of the link cache, readable without privileges */
+static void snapshot_setup(void)
+{
+	int fd, err;
+
+	fd = mkstemp(path);
+	fail_if(fd < 0, "Unable to create snapshot file");
+	close(fd);
+
+	sk = nl_socket_alloc();
+	fail_if(!sk, "Unable to allocate socket");
+	err = nl_connect(sk, NETLINK_ROUTE);
+	nl_fail_if(err < 0, err, "Unable to connect socket");
+
+	err = rtnl_link_alloc_cache(sk, AF_UNSPEC, &links);
+	nl_fail_if(err < 0, err, "Unable to allocate cache");
+	err = nl_cache_snapshot_save(sk, links, path);
+	nl_fail_if(err < 0, err, "Unable to save snapshot");
+
+	err = nl_cache_alloc_name("route/link", &loaded);
+	nl_fail_if(err < 0, err, "Unable to allocate cache");
+	err = nl_cache_snapshot_load(loaded, path, NULL);
+	nl_fail_if(err < 0, err, "Unable to load snapshot");
+}
+
+static void snapshot_teardown(void)
+{
+	nl_cache_free(loaded);
+	nl_cache_free(links);
+	nl_socket_free(sk);
+	unlink(path);
+	strcpy(path, "/tmp/check-cache.XXXXXX");
+}
+
+/* Every object of a must be present in b with identical attributes */
+static int cache_differs(struct nl_cache *a, struct nl_cache *b)
+{
+	struct nl_object *obj, *match;
+	int diff = 0;
+
+	if (nl_cache_nitems(a) != nl_cache_nitems(b))
+		return 1;
+
+	for (obj = nl_cache_get_first(a); obj; obj = nl_cache_get_next(obj)) {
+		if (!(match = nl_cache_search(b, obj)))
+			diff++;
+		else {
+			if (!nl_object_identical(obj, match))
+				diff++;
+			nl_object_put(match);
+		}
+	}
+
+	return diff;
+}
+
+START_TEST(snapshot_load)
+{
+	struct nl_cache *cache;
+	time_t saved;
+	int err;
+
+	fail_if(nl_cache_nitems(links) == 0,
+		"Link cache should hold at least the loopback device");
+	fail_if(cache_differs(links, loaded),
+		"Loaded cache should match the saved one");
+
+	/* Loading again replaces the content */
+	err = nl_cache_snapshot_load(loaded, path, &saved);
+	nl_fail_if(err < 0, err, "Unable to load snapshot again");
+	fail_if(cache_differs(links, loaded),
+		"Loaded cache should match the saved one");
+	fail_if(saved > time(NULL), "Snapshot should not be from the future");
+
+	/* Snapshots only fit caches of the same type */
+	err = nl_cache_alloc_name("route/addr", &cache);
+	nl_fail_if(err < 0, err, "Unable to allocate cache");
+	fail_if(nl_cache_snapshot_load(cache, path, NULL) != -NLE_OBJ_MISMATCH,
+		"Snapshot of another cache type should be refused");
+	nl_cache_free(cache);
+}
+END_TEST
+
+START_TEST(snapshot_truncated)
+{
+	struct stat st;
+
+	fail_if(stat(path, &st) < 0, "Unable to stat snapshot");
+	fail_if(truncate(path, st.st_size - 1) < 0,
+		"Unable to truncate snapshot");
+
+	fail_if(nl_cache_snapshot_load(loaded, path, NULL) != -NLE_MSG_TRUNC,
+		"Truncated snapshot should be refused");
+	fail_if(cache_differs(links, loaded),
+		"Failed load should leave the cache unchanged");
+}
+END_TEST
+
+START_TEST(snapshot_unparsable)
+{
+	struct nlmsghdr *nlh, *last = NULL;
+	struct stat st;
+	uint16_t hdrlen;
+	char *buf;
+	int fd, len;
+
+	fd = open(path, O_RDWR);
+	fail_if(fd < 0 || fstat(fd, &st) < 0, "Unable to open snapshot");
+	buf = malloc(st.st_size);
+	fail_if(!buf || read(fd, buf, st.st_size) != st.st_size,
+		"Unable to read snapshot");
+
+	/* The messages follow the header, whose length is at offset 6 */
+	memcpy(&hdrlen, buf + 6, sizeof(hdrlen));
+	nlh = (struct nlmsghdr *) (buf + hdrlen);
+	len = st.st_size - hdrlen;
+	for (; nlmsg_ok(nlh, len); nlh = nlmsg_next(nlh, &len))
+		last = nlh;
+	fail_if(!last || len, "Snapshot should hold link messages");
+
+	/* Turn the last message into one no link parser knows */
+	last->nlmsg_type = NLMSG_MIN_TYPE - 1;
+	fail_if(pwrite(fd, buf, st.st_size, 0) != st.st_size,
+		"Unable to write snapshot");
+	close(fd);
+	free(buf);
+
+	fail_if(nl_cache_snapshot_load(loaded, path, NULL) >= 0,
+		"Snapshot with an unknown message should be refused");
+	fail_if(cache_differs(links, loaded),
+		"Failed load should leave the cache unchanged");
+}
+END_TEST
+
+static void resync_setup(void)
+{
+	int err;
+
+	sk = nl_socket_alloc();
+	fail_if(!sk, "Unable to allocate socket");
+	err = nl_connect(sk, NETLINK_ROUTE);
+	nl_fail_if(err < 0, err, "Unable to connect socket");
+
+	err = rtnl_link_alloc_cache(sk, AF_UNSPEC, &links);
+	nl_fail_if(err < 0, err, "Unable to allocate cache");
+}
+
+static void resync_teardown(void)
+{
+	nl_cache_free(links);
+	nl_socket_free(sk);
+}
+
+static void count_loopback_change(struct nl_cache *cache,
+				  struct nl_object *obj, int action, void *arg)
+{
+	if (rtnl_link_get_flags((struct rtnl_link *) obj) & IFF_LOOPBACK)
+		(*(int *) arg)++;
+}
+
+static uint64_t loopback_tx_packets(void)
+{
+	struct rtnl_link *lo;
+	uint64_t packets;
+
+	lo = rtnl_link_get_by_name(links, "lo");
+	fail_if(!lo, "Link cache should hold the loopback device");
+	packets = rtnl_link_get_stat(lo, RTNL_LINK_TX_PACKETS);
+	rtnl_link_put(lo);
+
+	return packets;
+}
+
+START_TEST(resync_stats)
+{
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_port = htons(9),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	uint64_t before;
+	int fd, err, changes = 0;
+
+	before = loopback_tx_packets();
+
+	/* Statistics are not compared, the link itself stays unchanged */
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	fail_if(fd < 0, "Unable to create socket");
+	if (sendto(fd, "", 1, 0, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+		close(fd);
+		return;		/* loopback device is down */
+	}
+	close(fd);
+
+	err = nl_cache_resync(sk, links, count_loopback_change, &changes);
+	nl_fail_if(err < 0, err, "Unable to resync cache");
+	ck_assert_int_eq(changes, 0);
+	fail_if(loopback_tx_packets() <= before,
+		"Resync should refresh the statistics of unchanged links");
+}
+END_TEST
+
+#define RCU_NROUTES		1024
+#define RCU_NREADERS		4
+#define RCU_NROUNDS		20000
+
+static struct rtnl_route *needles[RCU_NROUTES];
+static int rcu_stop, rcu_bad;
+
+/*
+ * Route 10.<i / 256>.<i % 256>.0/24 carrying i and a version in its MTU,
+ * so that a reader can tell whether an object it holds is still intact.
+ */
+static struct rtnl_route *rcu_route(int i, uint32_t version)
+{
+	struct rtnl_route *route;
+	struct nl_addr *dst;
+	uint32_t a = htonl(0x0a000000 | (i << 8));
+
+	route = rtnl_route_alloc();
+	fail_if(!route, "Unable to allocate route");
+	dst = nl_addr_build(AF_INET, &a, sizeof(a));
+	fail_if(!dst, "Unable to allocate address");
+	nl_addr_set_prefixlen(dst, 24);
+	rtnl_route_set_dst(route, dst);
+	rtnl_route_set_table(route, RT_TABLE_MAIN);
+	rtnl_route_set_metric(route, RTAX_MTU, (i << 16) | (version & 0xffff));
+	nl_addr_put(dst);
+
+	return route;
+}
+
+static int rcu_intact(struct nl_object *obj)
+{
+	struct rtnl_route *route = (struct rtnl_route *) obj;
+	uint8_t *a = nl_addr_get_binary_addr(rtnl_route_get_dst(route));
+	uint32_t mtu = 0;
+
+	rtnl_route_get_metric(route, RTAX_MTU, &mtu);
+
+	return nl_object_get_refcnt(obj) > 0 &&
+	       (mtu >> 16) == (uint32_t) ((a[1] << 8) | a[2]);
+}
+
+static void rcu_check_cb(struct nl_object *obj, void *arg)
+{
+	if (!rcu_intact(obj))
+		(*(int *) arg)++;
+}
+
+static void *rcu_reader(void *arg)
+{
+	struct nl_cache_reader *r = arg;
+	unsigned int seed = (uintptr_t) arg, n = 0;
+	struct nl_object *obj;
+	uint32_t mtu, again;
+	int i, k, bad = 0;
+
+	while (!__atomic_load_n(&rcu_stop, __ATOMIC_ACQUIRE)) {
+		i = rand_r(&seed) % RCU_NROUTES;
+
+		nl_cache_read_lock(r);
+		obj = nl_cache_search_rcu(r, (struct nl_object *) needles[i]);
+		if (obj) {
+			rtnl_route_get_metric((struct rtnl_route *) obj,
+					      RTAX_MTU, &mtu);
+			if (!rcu_intact(obj))
+				bad++;
+
+			/* Hold on to it while the writer retires copies */
+			for (k = 0; k < 1000; k++)
+				__asm__ __volatile__("" ::: "memory");
+
+			again = 0;
+			rtnl_route_get_metric((struct rtnl_route *) obj,
+					      RTAX_MTU, &again);
+			if (again != mtu || !rcu_intact(obj))
+				bad++;
+		}
+		if (++n % 64 == 0)
+			nl_cache_foreach_rcu(r, NULL, rcu_check_cb, &bad);
+		nl_cache_read_unlock(r);
+	}
+
+	__atomic_add_fetch(&rcu_bad, bad, __ATOMIC_RELAXED);
+
+	return NULL;
+}
+
+/*
+ * Readers search and walk the cache while the writer replaces, removes
+ * and adds routes, growing the index on the way. Any object a reader
+ * can reach must be intact until it leaves its critical section.
+ */
+START_TEST(concurrent_readers)
+{
+	struct nl_cache_reader *readers[RCU_NREADERS];
+	pthread_t threads[RCU_NREADERS];
+	struct nl_cache *cache;
+	struct nl_object *obj, *found;
+	uint32_t version[RCU_NROUTES] = { 0 };
+	int i, err;
+
+	err = nl_cache_alloc_name("route/route", &cache);
+	nl_fail_if(err < 0, err, "Unable to allocate cache");
+
+	for (i = 0; i < RCU_NROUTES; i++) {
+		needles[i] = rcu_route(i, 0);
+		if (i < RCU_NROUTES / 16)
+			nl_cache_add(cache, (struct nl_object *) needles[i]);
+	}
+
+	err = nl_cache_set_concurrent(cache);
+	if (err == -NLE_OPNOTSUPP)
+		goto out;
+	nl_fail_if(err < 0, err, "Unable to enable concurrent readers");
+
+	rcu_stop = rcu_bad = 0;
+	for (i = 0; i < RCU_NREADERS; i++) {
+		readers[i] = nl_cache_reader_alloc(cache);
+		fail_if(!readers[i], "Unable to allocate reader");
+		fail_if(pthread_create(&threads[i], NULL, rcu_reader,
+				       readers[i]), "Unable to start reader");
+	}
+
+	for (i = 0; i < RCU_NROUNDS; i++) {
+		int n = random() % RCU_NROUTES;
+		struct rtnl_route *route;
+
+		found = nl_cache_search(cache, (struct nl_object *) needles[n]);
+		if (found) {
+			nl_cache_remove(found);
+			nl_object_put(found);
+			if (random() % 4 == 0)
+				continue;
+		}
+
+		route = rcu_route(n, ++version[n]);
+		err = nl_cache_add(cache, (struct nl_object *) route);
+		rtnl_route_put(route);
+		nl_fail_if(err < 0, err, "Unable to add route");
+	}
+
+	__atomic_store_n(&rcu_stop, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < RCU_NREADERS; i++) {
+		pthread_join(threads[i], NULL);
+		if (i)
+			nl_cache_reader_free(readers[i]);
+	}
+
+	ck_assert_int_eq(rcu_bad, 0);
+
+	/* Both sides agree once the writer is done */
+	nl_cache_read_lock(readers[0]);
+	for (i = 0; i < RCU_NROUTES; i++) {
+		obj = nl_cache_search(cache, (struct nl_object *) needles[i]);
+		found = nl_cache_search_rcu(readers[0],
+					    (struct nl_object *) needles[i]);
+		fail_if(!obj != !found, "Concurrent index out of sync");
+		if (obj)
+			fail_if(nl_object_diff(obj, found),
+				"Concurrent copy differs from the cached object");
+		nl_object_put(obj);
+	}
+	nl_cache_read_unlock(readers[0]);
+	nl_cache_reader_free(readers[0]);
+
+out:
+	nl_cache_free(cache);
+	for (i = 0; i < RCU_NROUTES; i++)
+		rtnl_route_put(needles[i]);
+}
+END_TEST
+
+Suite *make_nl_cache_suite(void)
+{
+	Suite *suite = suite_create("Caches");
+
+	TCase *snapshot = tcase_create("Snapshots");
+	tcase_add_checked_fixture(snapshot, snapshot_setup, snapshot_teardown);
+	tcase_add_test(snapshot, snapshot_load);
+	tcase_add_test(snapshot, snapshot_truncated);
+	tcase_add_test(snapshot, snapshot_unparsable);
+	suite_add_tcase(suite, snapshot);
+
+	TCase *resync = tcase_create("Resync");
+	tcase_add_checked_fixture(resync, resync_setup, resync_teardown);
+	tcase_add_test(resync, resync_stats);
+	suite_add_tcase(suite, resync);
+
+	TCase *concurrent = tcase_create("Concurrent");
+	tcase_set_timeout(concurrent, 60);
+	tcase_add_test(concurrent, concurrent_readers);
+	suite_add_tcase(suite, concurrent);
+
+	return suite;
+}
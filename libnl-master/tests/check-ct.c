@@ -0,0 +1,251 @@
+/*
+ * tests/check-ct.c		conntrack lookup and dump unit tests
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#include <check.h>
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/netfilter/nfnl.h>
+#include <netlink/netfilter/ct.h>
+#include <netinet/in.h>
+
+#include "util.h"
+
+/* Zone keeping the test's conntracks apart from real connections */
+#define CT_ZONE			0x4242
+#define CT_NHASHED		5000
+#define CT_NKERNEL		200
+
+static struct nl_sock *sk;
+
+/*
+ * UDP conntrack 10.42.<i / 256>.<i % 256>:<1024 + i> -> 10.43.0.1:53
+ * marked with i. A bare entry only carries the original tuple and zone,
+ * all a lookup needs.
+ */
+static struct nfnl_ct *ct_entry(int i, uint16_t zone, int bare)
+{
+	struct nfnl_ct *ct;
+	struct nl_addr *src, *dst;
+	uint32_t s = htonl(0x0a2a0000 | i), d = htonl(0x0a2b0001);
+
+	ct = nfnl_ct_alloc();
+	fail_if(!ct, "Unable to allocate conntrack");
+	src = nl_addr_build(AF_INET, &s, sizeof(s));
+	dst = nl_addr_build(AF_INET, &d, sizeof(d));
+	fail_if(!src || !dst, "Unable to allocate address");
+
+	nfnl_ct_set_family(ct, AF_INET);
+	nfnl_ct_set_proto(ct, IPPROTO_UDP);
+	nfnl_ct_set_zone(ct, zone);
+	nfnl_ct_set_src(ct, 0, src);
+	nfnl_ct_set_dst(ct, 0, dst);
+	nfnl_ct_set_src_port(ct, 0, 1024 + i);
+	nfnl_ct_set_dst_port(ct, 0, 53);
+
+	if (!bare) {
+		nfnl_ct_set_src(ct, 1, dst);
+		nfnl_ct_set_dst(ct, 1, src);
+		nfnl_ct_set_src_port(ct, 1, 53);
+		nfnl_ct_set_dst_port(ct, 1, 1024 + i);
+		nfnl_ct_set_timeout(ct, 120);
+		nfnl_ct_set_mark(ct, i);
+	}
+
+	nl_addr_put(src);
+	nl_addr_put(dst);
+
+	return ct;
+}
+
+static void ct_setup(void)
+{
+	int err;
+
+	sk = nl_socket_alloc();
+	fail_if(!sk, "Unable to allocate socket");
+	err = nfnl_connect(sk);
+	nl_fail_if(err < 0, err, "Unable to connect socket");
+}
+
+static void ct_teardown(void)
+{
+	struct nfnl_ct *ct;
+	int i;
+
+	for (i = 0; i < CT_NKERNEL; i++) {
+		ct = ct_entry(i, CT_ZONE, 1);
+		nfnl_ct_del(sk, ct, 0);
+		nfnl_ct_put(ct);
+	}
+
+	nl_socket_free(sk);
+}
+
+/*
+ * Fills a cache past the point where its hash table grows, with each
+ * tuple in two zones, and checks that the hashed lookup finds what a
+ * scan over the whole cache finds.
+ */
+START_TEST(ct_hashed_lookup)
+{
+	struct nl_cache *cache;
+	struct nl_object *obj, *found, *scanned;
+	struct nfnl_ct *ct;
+	int i, zone, err;
+
+	err = nl_cache_alloc_name("netfilter/ct", &cache);
+	nl_fail_if(err < 0, err, "Unable to allocate cache");
+
+	for (i = 0; i < CT_NHASHED; i++) {
+		for (zone = 0; zone < 2; zone++) {
+			ct = ct_entry(i, zone ? CT_ZONE : 0, 0);
+			nfnl_ct_set_mark(ct, zone ? i : ~i);
+			err = nl_cache_add(cache, (struct nl_object *) ct);
+			nl_fail_if(err < 0, err, "Unable to add conntrack");
+			nfnl_ct_put(ct);
+		}
+	}
+
+	ck_assert_int_eq(nl_cache_nitems(cache), 2 * CT_NHASHED);
+
+	for (i = 0; i < CT_NHASHED + 100; i++) {
+		ct = ct_entry(i, CT_ZONE, 1);
+		found = nl_cache_search(cache, (struct nl_object *) ct);
+
+		if (i >= CT_NHASHED)
+			fail_if(found, "Found conntrack %d never added", i);
+		else {
+			fail_if(!found, "Conntrack %d not found", i);
+			ck_assert_int_eq(nfnl_ct_get_mark(
+				(struct nfnl_ct *) found), i);
+		}
+
+		/* A full scan is slow, spot check every few entries */
+		if (i % 97 == 0) {
+			scanned = NULL;
+			for (obj = nl_cache_get_first(cache); obj;
+			     obj = nl_cache_get_next(obj))
+				if (nl_object_identical(obj,
+						(struct nl_object *) ct))
+					scanned = obj;
+			fail_if(found != scanned,
+				"Lookup of %d differs from the scan", i);
+		}
+
+		nl_object_put(found);
+		nfnl_ct_put(ct);
+	}
+
+	nl_cache_free(cache);
+}
+END_TEST
+
+struct ct_walk {
+	struct nl_cache *	cache;
+	int			seen;
+	int			stop_after;
+};
+
+static int ct_walk_cb(struct nfnl_ct *ct, void *arg)
+{
+	struct ct_walk *w = arg;
+	struct nl_object *found;
+
+	if (nfnl_ct_get_zone(ct) != CT_ZONE)
+		return NL_OK;
+
+	found = nl_cache_search(w->cache, (struct nl_object *) ct);
+	fail_if(!found, "Walked conntrack missing in the cache dump");
+	ck_assert_int_eq(nfnl_ct_get_id((struct nfnl_ct *) found),
+			 nfnl_ct_get_id(ct));
+	ck_assert_int_eq(nfnl_ct_get_mark((struct nfnl_ct *) found),
+			 nfnl_ct_get_mark(ct));
+	ck_assert_int_eq(nfnl_ct_get_dst_port((struct nfnl_ct *) found, 1),
+			 nfnl_ct_get_dst_port(ct, 1));
+	nl_object_put(found);
+
+	if (++w->seen == w->stop_after)
+		return NL_STOP;
+
+	return NL_OK;
+}
+
+/*
+ * Creates conntracks in the kernel and checks that the streaming walk,
+ * the cache dump and lookups in it agree on them. Skipped without the
+ * privileges to create conntracks.
+ */
+START_TEST(ct_dump_walk)
+{
+	struct ct_walk w = { 0 };
+	struct nl_object *found;
+	struct nfnl_ct *ct;
+	int i, n = 0, err;
+
+	for (i = 0; i < CT_NKERNEL; i++) {
+		ct = ct_entry(i, CT_ZONE, 0);
+		err = nfnl_ct_add(sk, ct, NLM_F_CREATE);
+		nfnl_ct_put(ct);
+
+		if (err == -NLE_PERM || err == -NLE_OPNOTSUPP)
+			return;
+		nl_fail_if(err < 0, err, "Unable to create conntrack");
+	}
+
+	err = nfnl_ct_alloc_cache(sk, &w.cache);
+	nl_fail_if(err < 0, err, "Unable to dump conntracks");
+
+	for (i = 0; i < CT_NKERNEL + 10; i++) {
+		ct = ct_entry(i, CT_ZONE, 1);
+		found = nl_cache_search(w.cache, (struct nl_object *) ct);
+		fail_if(!found != (i >= CT_NKERNEL),
+			"Lookup of conntrack %d failed", i);
+		if (found) {
+			ck_assert_int_eq(nfnl_ct_get_mark(
+				(struct nfnl_ct *) found), i);
+			n++;
+		}
+		nl_object_put(found);
+		nfnl_ct_put(ct);
+	}
+	ck_assert_int_eq(n, CT_NKERNEL);
+
+	err = nfnl_ct_dump_foreach(sk, ct_walk_cb, &w);
+	nl_fail_if(err < 0, err, "Unable to walk conntracks");
+	ck_assert_int_eq(w.seen, CT_NKERNEL);
+
+	/* A stopped walk leaves the socket ready for the next one */
+	w.seen = 0;
+	w.stop_after = 10;
+	err = nfnl_ct_dump_foreach(sk, ct_walk_cb, &w);
+	nl_fail_if(err < 0, err, "Unable to walk conntracks");
+	ck_assert_int_eq(w.seen, 10);
+
+	w.seen = 0;
+	w.stop_after = 0;
+	err = nfnl_ct_dump_foreach(sk, ct_walk_cb, &w);
+	nl_fail_if(err < 0, err, "Unable to walk conntracks");
+	ck_assert_int_eq(w.seen, CT_NKERNEL);
+
+	nl_cache_free(w.cache);
+}
+END_TEST
+
+Suite *make_nl_ct_suite(void)
+{
+	Suite *suite = suite_create("Conntrack");
+
+	TCase *tc = tcase_create("Lookup");
+	tcase_add_checked_fixture(tc, ct_setup, ct_teardown);
+	tcase_add_test(tc, ct_hashed_lookup);
+	tcase_add_test(tc, ct_dump_walk);
+	suite_add_tcase(suite, tc);
+
+	return suite;
+}
@@ -0,0 +1,158 @@
+/*
+ * tests/check-genl.c		Generic Netlink resolver unit tests
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#include <check.h>
+#include <netlink/netlink.h>
+#include <netlink/genl/genl.h>
+#include <netlink/genl/ctrl.h>
+#include <netlink/genl/mngt.h>
+#include <linux/genetlink.h>
+
+#include "util.h"
+
+/* Never seen by the kernel, the notifications below are forged */
+#define CHECK_FAMILY		"check-genl"
+#define CHECK_FAMILY_ID		0xfff0
+#define CHECK_GRP		"check-grp"
+#define CHECK_GRP_ID		0xfff1
+
+static struct nl_sock *sk, *tx;
+
+static void resolver_setup(void)
+{
+	int err;
+
+	sk = nl_socket_alloc();
+	tx = nl_socket_alloc();
+	fail_if(!sk || !tx, "Unable to allocate socket");
+	err = genl_connect(sk);
+	nl_fail_if(err < 0, err, "Unable to connect socket");
+	err = genl_connect(tx);
+	nl_fail_if(err < 0, err, "Unable to connect socket");
+
+	/* Fills the resolver cache, which then follows notifications */
+	err = genl_ctrl_resolve(sk, "nlctrl");
+	nl_fail_if(err < 0, err, "Unable to resolve nlctrl");
+	fail_if(err != GENL_ID_CTRL, "nlctrl should resolve to GENL_ID_CTRL");
+
+	nl_socket_set_peer_groups(tx, 1 << (GENL_ID_CTRL - 1));
+}
+
+static void resolver_teardown(void)
+{
+	genl_ctrl_resolver_flush();
+	nl_socket_free(tx);
+	nl_socket_free(sk);
+}
+
+/*
+ * Sends a notification to the group of the controller as the kernel
+ * would. Returns 0 when lacking the privileges to do so.
+ */
+static int notify(int cmd, const char *name, int id, const char *grp,
+		  int grp_id)
+{
+	struct nlattr *grps, *nest;
+	struct nl_msg *msg;
+	int err;
+
+	msg = nlmsg_alloc();
+	fail_if(!msg, "Unable to allocate message");
+	fail_if(!genlmsg_put(msg, NL_AUTO_PORT, NL_AUTO_SEQ, GENL_ID_CTRL,
+			     0, 0, cmd, 1), "Unable to add header");
+	fail_if(nla_put_string(msg, CTRL_ATTR_FAMILY_NAME, name) < 0 ||
+		nla_put_u16(msg, CTRL_ATTR_FAMILY_ID, id) < 0,
+		"Unable to add attributes");
+	if (grp) {
+		grps = nla_nest_start(msg, CTRL_ATTR_MCAST_GROUPS);
+		nest = nla_nest_start(msg, 1);
+		fail_if(!grps || !nest ||
+			nla_put_string(msg, CTRL_ATTR_MCAST_GRP_NAME, grp) < 0 ||
+			nla_put_u32(msg, CTRL_ATTR_MCAST_GRP_ID, grp_id) < 0,
+			"Unable to add group");
+		nla_nest_end(msg, nest);
+		nla_nest_end(msg, grps);
+	}
+
+	err = nl_send_auto(tx, msg);
+	nlmsg_free(msg);
+	if (err == -NLE_PERM)
+		return 0;
+	nl_fail_if(err < 0, err, "Unable to send notification");
+
+	return 1;
+}
+
+START_TEST(resolver_groups)
+{
+	struct genl_ops ops = {
+		.o_name = CHECK_FAMILY,
+	};
+	int err;
+
+	/* As sent by genl_register_family() for a family with a group */
+	if (!notify(CTRL_CMD_NEWFAMILY, CHECK_FAMILY, CHECK_FAMILY_ID,
+		    NULL, 0))
+		return;
+	notify(CTRL_CMD_NEWMCAST_GRP, CHECK_FAMILY, CHECK_FAMILY_ID,
+	       CHECK_GRP, CHECK_GRP_ID);
+
+	err = genl_ctrl_resolve(sk, CHECK_FAMILY);
+	fail_if(err != CHECK_FAMILY_ID,
+		"Family should remain cached after a group is added: %d", err);
+	err = genl_ops_resolve(sk, &ops);
+	nl_fail_if(err < 0, err, "Unable to resolve family ops");
+	fail_if(ops.o_id != CHECK_FAMILY_ID, "Family ops resolved wrongly");
+	err = genl_ctrl_resolve_grp(sk, CHECK_FAMILY, CHECK_GRP);
+	fail_if(err != CHECK_GRP_ID, "Group should resolve: %d", err);
+
+	notify(CTRL_CMD_DELMCAST_GRP, CHECK_FAMILY, CHECK_FAMILY_ID,
+	       CHECK_GRP, CHECK_GRP_ID);
+	err = genl_ctrl_resolve_grp(sk, CHECK_FAMILY, CHECK_GRP);
+	fail_if(err != -NLE_OBJ_NOTFOUND, "Removed group should not resolve");
+	err = genl_ctrl_resolve(sk, CHECK_FAMILY);
+	fail_if(err != CHECK_FAMILY_ID,
+		"Family should remain cached after a group is removed");
+
+	notify(CTRL_CMD_DELFAMILY, CHECK_FAMILY, CHECK_FAMILY_ID, NULL, 0);
+	err = genl_ctrl_resolve(sk, CHECK_FAMILY);
+	fail_if(err != -NLE_OBJ_NOTFOUND, "Removed family should not resolve");
+}
+END_TEST
+
+START_TEST(resolver_probe)
+{
+	struct genl_ops ops = {
+		.o_name = "nlctrl",
+	};
+	int err;
+
+	/* Evicts nlctrl from the cache, the kernel still knows it */
+	if (!notify(CTRL_CMD_DELFAMILY, "nlctrl", GENL_ID_CTRL, NULL, 0))
+		return;
+
+	err = genl_ops_resolve(sk, &ops);
+	nl_fail_if(err < 0, err, "Families missing in the cache should be "
+		   "queried from the kernel");
+	fail_if(ops.o_id != GENL_ID_CTRL, "nlctrl resolved wrongly");
+}
+END_TEST
+
+Suite *make_nl_genl_suite(void)
+{
+	Suite *suite = suite_create("Generic Netlink");
+
+	TCase *resolver = tcase_create("Resolver");
+	tcase_add_checked_fixture(resolver, resolver_setup, resolver_teardown);
+	tcase_add_test(resolver, resolver_groups);
+	tcase_add_test(resolver, resolver_probe);
+	suite_add_tcase(suite, resolver);
+
+	return suite;
+}
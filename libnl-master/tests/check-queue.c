@@ -0,0 +1,262 @@
+/*
+ * tests/check-queue.c		Netfilter queue consumer unit tests
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#include <check.h>
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+#include <netlink/attr.h>
+#include <netlink/netfilter/nfnl.h>
+#include <netlink/netfilter/queue.h>
+#include <netlink/netfilter/queue_msg.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink_queue.h>
+
+#include "util.h"
+
+/* Bound for real, but no packets are ever queued to it */
+#define CHECK_QUEUE		0xfff0
+#define CHECK_MAX_PACKETS	16
+
+static struct nfnl_queue_consumer *consumer;
+static struct nl_sock *kernel;
+
+/* Verdict and mark the callback assigns to each packet id */
+static int verdicts[CHECK_MAX_PACKETS];
+static uint32_t marks[CHECK_MAX_PACKETS];
+static int payload_checked;
+
+static const char payload[] = "borrowed from the receive buffer";
+
+struct verdict {
+	int		type;
+	uint32_t	id;
+	uint32_t	verdict;
+	int		has_mark;
+	uint32_t	mark;
+};
+
+static int consumer_cb(struct nfnl_queue_msg *msg, void *arg)
+{
+	uint32_t id = nfnl_queue_msg_get_packetid(msg);
+	const void *data;
+	int len;
+
+	data = nfnl_queue_msg_get_payload(msg, &len);
+	if (data && len == sizeof(payload) && !memcmp(data, payload, len)) {
+		/* Replacing a borrowed payload must leave the buffer be */
+		fail_if(nfnl_queue_msg_set_payload(msg, (uint8_t *) "x", 1) < 0,
+			"Unable to replace payload");
+		payload_checked++;
+	}
+
+	if (marks[id])
+		nfnl_queue_msg_set_mark(msg, marks[id]);
+
+	return verdicts[id];
+}
+
+/*
+ * Points the consumer's verdicts at a second socket which then plays the
+ * kernel's part. Leaves the consumer unset when lacking the privileges
+ * to bind a queue.
+ */
+static void consumer_setup(void)
+{
+	struct nfnl_queue *queue;
+	int err;
+
+	memset(verdicts, 0, sizeof(verdicts));
+	memset(marks, 0, sizeof(marks));
+	payload_checked = 0;
+
+	queue = nfnl_queue_alloc();
+	fail_if(!queue, "Unable to allocate queue");
+	nfnl_queue_set_group(queue, CHECK_QUEUE);
+	nfnl_queue_set_copy_mode(queue, NFNL_QUEUE_COPY_PACKET);
+
+	err = nfnl_queue_consumer_alloc(queue, consumer_cb, NULL, &consumer);
+	nfnl_queue_put(queue);
+	if (err == -NLE_PERM) {
+		consumer = NULL;
+		return;
+	}
+	nl_fail_if(err < 0, err, "Unable to allocate consumer");
+
+	kernel = nl_socket_alloc();
+	fail_if(!kernel, "Unable to allocate socket");
+	err = nfnl_connect(kernel);
+	nl_fail_if(err < 0, err, "Unable to connect socket");
+	nl_socket_disable_auto_ack(kernel);
+
+	nl_socket_set_peer_port(kernel, nl_socket_get_local_port(
+				nfnl_queue_consumer_get_sock(consumer)));
+	nl_socket_set_peer_port(nfnl_queue_consumer_get_sock(consumer),
+				nl_socket_get_local_port(kernel));
+}
+
+static void consumer_teardown(void)
+{
+	nfnl_queue_consumer_free(consumer);
+	nl_socket_free(kernel);
+	kernel = NULL;
+}
+
+static void send_packet(uint32_t id, int with_payload)
+{
+	struct nfqnl_msg_packet_hdr hdr = {
+		.packet_id = htonl(id),
+		.hw_protocol = htons(0x0800),
+		.hook = NF_INET_LOCAL_OUT,
+	};
+	struct nl_msg *msg;
+	int err;
+
+	msg = nfnlmsg_alloc_simple(NFNL_SUBSYS_QUEUE, NFQNL_MSG_PACKET, 0,
+				   AF_INET, CHECK_QUEUE);
+	fail_if(!msg, "Unable to allocate message");
+	fail_if(nla_put(msg, NFQA_PACKET_HDR, sizeof(hdr), &hdr) < 0,
+		"Unable to add packet header");
+	if (with_payload)
+		fail_if(nla_put(msg, NFQA_PAYLOAD, sizeof(payload),
+				payload) < 0, "Unable to add payload");
+
+	err = nl_send_auto(kernel, msg);
+	nl_fail_if(err < 0, err, "Unable to send packet");
+	nlmsg_free(msg);
+}
+
+/* Receives the verdicts of one dispatch, which go out in one datagram */
+static int recv_verdicts(struct verdict *v, int max)
+{
+	struct sockaddr_nl nla;
+	struct nlmsghdr *nlh;
+	unsigned char *buf;
+	int len, n = 0;
+
+	len = nl_recv(kernel, &nla, &buf, NULL);
+	nl_fail_if(len < 0, len, "Unable to receive verdicts");
+
+	for (nlh = (struct nlmsghdr *) buf; nlmsg_ok(nlh, len);
+	     nlh = nlmsg_next(nlh, &len)) {
+		struct nlattr *tb[NFQA_MAX + 1];
+		struct nfqnl_msg_verdict_hdr *hdr;
+		int err;
+
+		fail_if(n == max, "Too many verdicts");
+		fail_if(NFNL_SUBSYS_ID(nlh->nlmsg_type) != NFNL_SUBSYS_QUEUE,
+			"Verdict for another subsystem");
+
+		err = nlmsg_parse(nlh, sizeof(struct nfgenmsg), tb, NFQA_MAX,
+				  NULL);
+		nl_fail_if(err < 0, err, "Unable to parse verdict");
+		fail_if(!tb[NFQA_VERDICT_HDR], "Verdict header missing");
+
+		hdr = nla_data(tb[NFQA_VERDICT_HDR]);
+		v[n].type = NFNL_MSG_TYPE(nlh->nlmsg_type);
+		v[n].id = ntohl(hdr->id);
+		v[n].verdict = ntohl(hdr->verdict);
+		v[n].has_mark = !!tb[NFQA_MARK];
+		v[n].mark = tb[NFQA_MARK] ? ntohl(nla_get_u32(tb[NFQA_MARK])) : 0;
+		n++;
+	}
+
+	free(buf);
+	return n;
+}
+
+static void check_verdict(struct verdict *v, int type, uint32_t id,
+			  uint32_t verdict)
+{
+	ck_assert_int_eq(v->type, type);
+	ck_assert_int_eq(v->id, id);
+	ck_assert_int_eq(v->verdict, verdict);
+}
+
+START_TEST(consumer_runs)
+{
+	struct verdict v[CHECK_MAX_PACKETS];
+	uint32_t id;
+	int n;
+
+	if (!consumer)
+		return;
+
+	verdicts[1] = verdicts[2] = verdicts[3] = NF_ACCEPT;
+	verdicts[4] = verdicts[5] = NF_DROP;
+	verdicts[6] = NF_ACCEPT;
+	marks[5] = 0x42;
+
+	for (id = 1; id <= 6; id++)
+		send_packet(id, id == 2);
+
+	ck_assert_int_eq(nfnl_queue_consumer_dispatch(consumer), 6);
+	ck_assert_int_eq(payload_checked, 1);
+
+	/* Runs of equal verdicts are batched, a new mark ends a run */
+	n = recv_verdicts(v, CHECK_MAX_PACKETS);
+	ck_assert_int_eq(n, 4);
+	check_verdict(&v[0], NFQNL_MSG_VERDICT_BATCH, 3, NF_ACCEPT);
+	fail_if(v[0].has_mark, "Batch verdict should carry no mark");
+	check_verdict(&v[1], NFQNL_MSG_VERDICT, 4, NF_DROP);
+	check_verdict(&v[2], NFQNL_MSG_VERDICT, 5, NF_DROP);
+	fail_if(!v[2].has_mark || v[2].mark != 0x42,
+		"Verdict should carry the new mark");
+	check_verdict(&v[3], NFQNL_MSG_VERDICT, 6, NF_ACCEPT);
+}
+END_TEST
+
+START_TEST(consumer_gap)
+{
+	struct verdict v[CHECK_MAX_PACKETS];
+	int n;
+
+	if (!consumer)
+		return;
+
+	verdicts[1] = verdicts[2] = verdicts[5] = verdicts[6] = NF_ACCEPT;
+	verdicts[8] = NF_DROP;
+
+	send_packet(1, 0);
+	send_packet(2, 0);
+	ck_assert_int_eq(nfnl_queue_consumer_dispatch(consumer), 2);
+	n = recv_verdicts(v, CHECK_MAX_PACKETS);
+	ck_assert_int_eq(n, 1);
+	check_verdict(&v[0], NFQNL_MSG_VERDICT_BATCH, 2, NF_ACCEPT);
+
+	/*
+	 * Packets 3, 4 and 7 were lost to an overrun. The queue is not
+	 * fail-open, so they are dropped, each gap ending the current run.
+	 */
+	send_packet(5, 0);
+	send_packet(6, 0);
+	send_packet(8, 1);
+	ck_assert_int_eq(nfnl_queue_consumer_dispatch(consumer), 3);
+	ck_assert_int_eq(payload_checked, 1);
+
+	n = recv_verdicts(v, CHECK_MAX_PACKETS);
+	ck_assert_int_eq(n, 4);
+	check_verdict(&v[0], NFQNL_MSG_VERDICT_BATCH, 4, NF_DROP);
+	check_verdict(&v[1], NFQNL_MSG_VERDICT_BATCH, 6, NF_ACCEPT);
+	check_verdict(&v[2], NFQNL_MSG_VERDICT_BATCH, 7, NF_DROP);
+	check_verdict(&v[3], NFQNL_MSG_VERDICT, 8, NF_DROP);
+}
+END_TEST
+
+Suite *make_nl_queue_suite(void)
+{
+	Suite *suite = suite_create("Netfilter queues");
+
+	TCase *tc = tcase_create("Consumer");
+	tcase_add_checked_fixture(tc, consumer_setup, consumer_teardown);
+	tcase_add_test(tc, consumer_runs);
+	tcase_add_test(tc, consumer_gap);
+	suite_add_tcase(suite, tc);
+
+	return suite;
+}
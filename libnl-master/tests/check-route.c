@@ -0,0 +1,175 @@
+/*
+ * tests/check-route.c		route lookup unit tests
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#include <check.h>
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/route/route.h>
+
+#include "util.h"
+
+#define LOOKUP_NROUTES		400
+#define LOOKUP_NROUNDS		2000
+#define LOOKUP_NADDRS		50
+
+static struct nl_cache *routes;
+static struct rtnl_route *pool[LOOKUP_NROUTES];
+
+static void lookup_setup(void)
+{
+	int err;
+
+	err = nl_cache_alloc_name("route/route", &routes);
+	nl_fail_if(err < 0, err, "Unable to allocate cache");
+	srandom(1);
+}
+
+static void lookup_teardown(void)
+{
+	int i;
+
+	nl_cache_free(routes);
+	for (i = 0; i < LOOKUP_NROUTES; i++)
+		rtnl_route_put(pool[i]);
+}
+
+/*
+ * Random address of which only the bits first to last - 1 vary, so that
+ * the prefixes built from it nest into each other.
+ */
+static struct nl_addr *random_addr(int family, int first, int last)
+{
+	uint8_t buf[16] = { 0x20, 0x01, 0x0d, 0xb8, 0x0a };
+	int len = family == AF_INET ? 4 : 16, i;
+
+	if (family == AF_INET)
+		buf[0] = 10;
+
+	for (i = first; i < last; i++)
+		if (random() & 1)
+			buf[i / 8] |= 0x80 >> (i % 8);
+
+	return nl_addr_build(family, buf, len);
+}
+
+/* Longest prefix match by a walk over the whole cache */
+static struct rtnl_route *scan(struct nl_addr *addr)
+{
+	struct rtnl_route *r, *best = NULL;
+	struct nl_object *obj;
+
+	for (obj = nl_cache_get_first(routes); obj;
+	     obj = nl_cache_get_next(obj)) {
+		struct nl_addr *dst;
+
+		r = (struct rtnl_route *) obj;
+		dst = rtnl_route_get_dst(r);
+
+		if (nl_addr_cmp_prefix(dst, addr))
+			continue;
+
+		if (!best ||
+		    nl_addr_get_prefixlen(dst) >
+		    nl_addr_get_prefixlen(rtnl_route_get_dst(best)) ||
+		    (nl_addr_get_prefixlen(dst) ==
+		     nl_addr_get_prefixlen(rtnl_route_get_dst(best)) &&
+		     rtnl_route_get_priority(r) <
+		     rtnl_route_get_priority(best)))
+			best = r;
+	}
+
+	return best;
+}
+
+/*
+ * Toggles random routes in and out of the cache after the index has been
+ * built and checks every round that lookups agree with a full scan.
+ */
+static void lookup_family(int family, int first, int last)
+{
+	struct rtnl_route *r;
+	struct nl_addr *addr;
+	int i, j, alen = family == AF_INET ? 32 : 128;
+
+	for (i = 0; i < LOOKUP_NROUTES; i++) {
+		pool[i] = rtnl_route_alloc();
+		fail_if(!pool[i], "Unable to allocate route");
+
+		addr = random_addr(family, first, last);
+		nl_addr_set_prefixlen(addr, random() % (alen + 1));
+		rtnl_route_set_dst(pool[i], addr);
+		nl_addr_put(addr);
+
+		rtnl_route_set_table(pool[i], RT_TABLE_MAIN);
+		rtnl_route_set_priority(pool[i], random() % 4);
+
+		if (i % 2)
+			nl_cache_add(routes, (struct nl_object *) pool[i]);
+	}
+
+	addr = random_addr(family, first, last);
+	r = rtnl_route_lookup(routes, addr, RT_TABLE_MAIN);
+	fail_if(r != scan(addr), "Lookup should match the scan");
+	if (r)
+		rtnl_route_put(r);
+	nl_addr_put(addr);
+
+	for (i = 0; i < LOOKUP_NROUNDS; i++) {
+		struct nl_object *obj;
+
+		obj = (struct nl_object *) pool[random() % LOOKUP_NROUTES];
+		if (nl_object_get_cache(obj))
+			nl_cache_remove(obj);
+		else
+			nl_cache_add(routes, obj);
+
+		for (j = 0; j < LOOKUP_NADDRS; j++) {
+			addr = random_addr(family, first, last);
+			r = rtnl_route_lookup(routes, addr, RT_TABLE_MAIN);
+			fail_if(r != scan(addr),
+				"Lookup should match the scan after %d updates",
+				i + 1);
+			if (r)
+				rtnl_route_put(r);
+			nl_addr_put(addr);
+		}
+	}
+
+	/* Routes of another table are not considered */
+	addr = random_addr(family, first, last);
+	fail_if(rtnl_route_lookup(routes, addr, RT_TABLE_LOCAL) != NULL,
+		"Lookup in an empty table should fail");
+	nl_addr_put(addr);
+}
+
+START_TEST(lookup_inet)
+{
+	lookup_family(AF_INET, 14, 32);
+}
+END_TEST
+
+START_TEST(lookup_inet6)
+{
+	/* Crosses the boundary of the 64 bit key words */
+	lookup_family(AF_INET6, 40, 80);
+}
+END_TEST
+
+Suite *make_nl_route_suite(void)
+{
+	Suite *suite = suite_create("Routes");
+
+	TCase *lookup = tcase_create("Lookup");
+	tcase_add_checked_fixture(lookup, lookup_setup, lookup_teardown);
+	tcase_add_test(lookup, lookup_inet);
+	tcase_add_test(lookup, lookup_inet6);
+	suite_add_tcase(suite, lookup);
+
+	return suite;
+}
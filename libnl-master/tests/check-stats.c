@@ -0,0 +1,153 @@
+/*
+ * tests/check-stats.c		socket and cache statistics unit tests
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#include <check.h>
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/txn.h>
+#include <netlink/route/link.h>
+#include <netlink/route/route.h>
+
+#include "util.h"
+
+/* Table no routes are expected in, every request below fails */
+#define STATS_TABLE		0x7ffffff0
+#define STATS_NREQ		200
+
+static struct nl_sock *sk;
+
+static void stats_setup(void)
+{
+	int err;
+
+	sk = nl_socket_alloc();
+	fail_if(!sk, "Unable to allocate socket");
+	err = nl_connect(sk, NETLINK_ROUTE);
+	nl_fail_if(err < 0, err, "Unable to connect socket");
+}
+
+static void stats_teardown(void)
+{
+	nl_socket_free(sk);
+}
+
+START_TEST(socket_txn)
+{
+	uint64_t hist[NL_SOCK_REPLY_HIST_SIZE], replies = 0;
+	struct nl_txn *txn;
+	struct nl_msg *msg;
+	int i, err;
+
+	err = nl_txn_alloc(sk, &txn);
+	nl_fail_if(err < 0, err, "Unable to allocate transaction");
+
+	for (i = 0; i < STATS_NREQ; i++) {
+		struct rtnl_route *route = rtnl_route_alloc();
+		struct rtnl_nexthop *nh = rtnl_route_nh_alloc();
+		uint32_t a = htonl(0x0a000000 | (i << 8));
+		struct nl_addr *dst = nl_addr_build(AF_INET, &a, sizeof(a));
+
+		nl_addr_set_prefixlen(dst, 24);
+		rtnl_route_set_dst(route, dst);
+		rtnl_route_set_table(route, STATS_TABLE);
+		rtnl_route_nh_set_ifindex(nh, 1);
+		rtnl_route_add_nexthop(route, nh);
+
+		err = rtnl_route_build_del_request(route, 0, &msg);
+		nl_fail_if(err < 0, err, "Unable to build request");
+		err = nl_txn_add(txn, msg);
+		nl_fail_if(err < 0, err, "Unable to queue request");
+
+		nlmsg_free(msg);
+		rtnl_route_put(route);
+		nl_addr_put(dst);
+	}
+
+	fail_if(nl_txn_commit(txn) >= 0,
+		"Deleting routes which do not exist should fail");
+	nl_txn_free(txn);
+
+	ck_assert_int_eq(nl_socket_get_stat(sk, NL_SOCK_STAT_TX_MSGS),
+			 STATS_NREQ);
+	ck_assert_int_eq(nl_socket_get_stat(sk, NL_SOCK_STAT_RX_MSGS),
+			 STATS_NREQ);
+	ck_assert_int_eq(nl_socket_get_stat(sk, NL_SOCK_STAT_ERRORS),
+			 STATS_NREQ);
+	ck_assert_int_eq(nl_socket_get_stat(sk, NL_SOCK_STAT_ACKS), 0);
+
+	/* Only the most recent requests in flight are timed */
+	ck_assert_int_ge(nl_socket_get_stat(sk, NL_SOCK_STAT_REPLIES), 1);
+	ck_assert_int_le(nl_socket_get_stat(sk, NL_SOCK_STAT_REPLIES),
+			 STATS_NREQ);
+
+	nl_socket_get_reply_hist(sk, hist, NL_SOCK_REPLY_HIST_SIZE);
+	for (i = 0; i < NL_SOCK_REPLY_HIST_SIZE; i++)
+		replies += hist[i];
+	ck_assert_int_eq(replies, nl_socket_get_stat(sk, NL_SOCK_STAT_REPLIES));
+
+	nl_socket_reset_stats(sk);
+	for (i = 0; i <= NL_SOCK_STAT_MAX; i++)
+		ck_assert_int_eq(nl_socket_get_stat(sk, i), 0);
+}
+END_TEST
+
+START_TEST(cache_refill)
+{
+	struct nl_cache *cache;
+	uint64_t parsed, objects;
+	int err;
+
+	err = nl_cache_alloc_name("route/link", &cache);
+	nl_fail_if(err < 0, err, "Unable to allocate cache");
+
+	parsed = nl_cache_get_stat(cache, NL_CACHE_STAT_MSGS_PARSED);
+	err = nl_cache_refill(sk, cache);
+	nl_fail_if(err < 0, err, "Unable to fill cache");
+	parsed = nl_cache_get_stat(cache, NL_CACHE_STAT_MSGS_PARSED) - parsed;
+	objects = nl_cache_get_stat(cache, NL_CACHE_STAT_OBJECTS);
+
+	ck_assert_int_ge(objects, 1);
+	ck_assert_int_eq(objects, nl_cache_nitems(cache));
+	ck_assert_int_ge(parsed, objects);
+	ck_assert_int_ge(nl_cache_get_stat(cache, NL_CACHE_STAT_OBJ_LIVE),
+			 objects);
+	ck_assert_int_ge(nl_cache_get_stat(cache, NL_CACHE_STAT_HASH_MAX_CHAIN),
+			 1);
+	ck_assert_int_le(nl_cache_get_stat(cache, NL_CACHE_STAT_HASH_MAX_CHAIN),
+			 objects);
+
+	/* One dump request, answered by the objects and NLMSG_DONE */
+	ck_assert_int_eq(nl_socket_get_stat(sk, NL_SOCK_STAT_TX_MSGS), 1);
+	ck_assert_int_eq(nl_socket_get_stat(sk, NL_SOCK_STAT_REPLIES), 1);
+	ck_assert_int_eq(nl_socket_get_stat(sk, NL_SOCK_STAT_RX_MSGS),
+			 parsed + 1);
+
+	err = nl_cache_resync(sk, cache, NULL, NULL);
+	nl_fail_if(err < 0, err, "Unable to resync cache");
+	ck_assert_int_eq(nl_cache_get_stat(cache, NL_CACHE_STAT_RESYNCS), 1);
+	ck_assert_int_ge(nl_cache_get_stat(cache, NL_CACHE_STAT_ADDED),
+			 objects);
+	ck_assert_int_eq(nl_cache_get_stat(cache, NL_CACHE_STAT_REMOVED), 0);
+
+	nl_cache_free(cache);
+}
+END_TEST
+
+Suite *make_nl_stats_suite(void)
+{
+	Suite *suite = suite_create("Statistics");
+
+	TCase *tc = tcase_create("Counters");
+	tcase_add_checked_fixture(tc, stats_setup, stats_teardown);
+	tcase_add_test(tc, socket_txn);
+	tcase_add_test(tc, cache_refill);
+	suite_add_tcase(suite, tc);
+
+	return suite;
+}
@@ -0,0 +1,143 @@
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+#include <netlink/txn.h>
+#include <netlink/cli/utils.h>
+#include <netlink/route/route.h>
+#include <time.h>
+
+#include <linux/rtnetlink.h>
+
+#include "test-util.h"
+
+/* Same as the policy of the route message parser */
+static struct nla_policy route_policy[RTA_MAX+1] = {
+	[RTA_IIF]	= { .type = NLA_U32 },
+	[RTA_OIF]	= { .type = NLA_U32 },
+	[RTA_PRIORITY]	= { .type = NLA_U32 },
+	[RTA_FLOW]	= { .type = NLA_U32 },
+	[RTA_CACHEINFO]	= { .minlen = sizeof(struct rta_cacheinfo) },
+	[RTA_METRICS]	= { .type = NLA_NESTED },
+	[RTA_MULTIPATH]	= { .type = NLA_NESTED },
+	[RTA_TTL_PROPAGATE] = { .type = NLA_U8 },
+	[RTA_ENCAP]	= { .type = NLA_NESTED },
+	[RTA_ENCAP_TYPE] = { .type = NLA_U16 },
+};
+
+static struct nl_msg **msgs;
+static int nmsgs, msgs_size;
+
+static int record_cb(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *nlh = nlmsg_hdr(msg);
+
+	if (nmsgs == msgs_size) {
+		msgs_size = msgs_size ? 2 * msgs_size : 1024;
+		if (!(msgs = realloc(msgs, msgs_size * sizeof(*msgs))))
+			nl_cli_fatal(ENOMEM, "Unable to record messages");
+	}
+
+	msgs[nmsgs] = nlmsg_convert(nlh);
+	nlmsg_set_proto(msgs[nmsgs++], NETLINK_ROUTE);
+
+	return NL_OK;
+}
+
+static void count_cb(struct nl_object *obj, void *arg)
+{
+	(*(int *) arg)++;
+}
+
+/*
+ * Records a dump of the routing tables, including a number of routes
+ * installed into a separate table for the purpose, and parses the
+ * recorded messages repeatedly, once with nlmsg_parse() and the policy
+ * of the route parser and once with the compiled policy. Both must find
+ * the same attributes. The time needed to parse the messages into route
+ * objects is reported as well.
+ *
+ * Usage: test-attr-parse [<routes> [<rounds>]]
+ */
+int main(int argc, char *argv[])
+{
+	struct nl_sock *sk;
+	struct nla_schema *schema;
+	struct nlattr *tb[RTA_MAX+1], *tb2[RTA_MAX+1];
+	struct rtmsg rtm = { .rtm_family = AF_UNSPEC };
+	int n = 10000, rounds = 100, i, r, err, ret = 0, nobjs = 0;
+	uint32_t table = 100;
+	double t;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		rounds = strtoul(argv[2], NULL, 0);
+	if (n > 65000)
+		n = 65000;
+
+	sk = nl_cli_alloc_socket();
+	nl_cli_connect(sk, NETLINK_ROUTE);
+	nl_socket_set_buffer_size(sk, 1 << 20, 1 << 20);
+
+	txn_routes(sk, table, 0, n, 1);
+
+	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM, record_cb, NULL);
+	if ((err = nl_send_simple(sk, RTM_GETROUTE, NLM_F_DUMP, &rtm,
+				  sizeof(rtm))) < 0 ||
+	    (err = nl_recvmsgs_default(sk)) < 0)
+		nl_cli_fatal(err, "Unable to dump routes: %s",
+			     nl_geterror(err));
+
+	txn_routes(sk, table, 0, n, 0);
+	nl_socket_free(sk);
+
+	if ((err = nla_schema_compile(route_policy, RTA_MAX, &schema)) < 0)
+		nl_cli_fatal(err, "Unable to compile policy: %s",
+			     nl_geterror(err));
+
+	printf("recorded %d messages\n", nmsgs);
+
+	t = now();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < nmsgs; i++)
+			nlmsg_parse(nlmsg_hdr(msgs[i]), sizeof(struct rtmsg),
+				    tb, RTA_MAX, route_policy);
+	t = now() - t;
+	printf("nlmsg_parse: %.1f ns/msg\n", t * 1e9 / rounds / nmsgs);
+
+	t = now();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < nmsgs; i++)
+			nlmsg_parse_schema(nlmsg_hdr(msgs[i]),
+					   sizeof(struct rtmsg), tb2, schema);
+	t = now() - t;
+	printf("nlmsg_parse_schema: %.1f ns/msg\n", t * 1e9 / rounds / nmsgs);
+
+	for (i = 0; i < nmsgs; i++) {
+		if (nlmsg_parse(nlmsg_hdr(msgs[i]), sizeof(struct rtmsg),
+				tb, RTA_MAX, route_policy) !=
+		    nlmsg_parse_schema(nlmsg_hdr(msgs[i]),
+				       sizeof(struct rtmsg), tb2, schema) ||
+		    memcmp(tb, tb2, sizeof(tb))) {
+			fprintf(stderr, "message %d parsed differently\n", i);
+			ret = 1;
+		}
+	}
+
+	t = now();
+	for (r = 0; r < rounds / 10 + 1; r++)
+		for (i = 0; i < nmsgs; i++)
+			nl_msg_parse(msgs[i], count_cb, &nobjs);
+	t = now() - t;
+	printf("nl_msg_parse: %d routes, %.1f ns/msg\n", nobjs / (r ? r : 1),
+	       t * 1e9 / r / nmsgs);
+
+	if (nobjs / r != nmsgs)
+		ret = 1;
+
+	nla_schema_free(schema);
+	for (i = 0; i < nmsgs; i++)
+		nlmsg_free(msgs[i]);
+	free(msgs);
+
+	return ret;
+}
@@ -0,0 +1,144 @@
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/txn.h>
+#include <netlink/cli/utils.h>
+#include <netlink/route/route.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test-util.h"
+
+static void change_cb(struct nl_cache *cache, struct nl_object *obj,
+		      int action, void *arg)
+{
+	(*(int *) arg)++;
+}
+
+static struct nl_cache *alloc_cache(const char *name)
+{
+	struct nl_cache *cache;
+	int err;
+
+	if ((err = nl_cache_alloc_name(name, &cache)) < 0)
+		nl_cli_fatal(err, "Unable to allocate %s cache: %s", name,
+			     nl_geterror(err));
+
+	return cache;
+}
+
+/* Every object of a must be present in b with identical attributes */
+static int compare_caches(struct nl_cache *a, struct nl_cache *b)
+{
+	struct nl_object *obj, *match;
+	int diff = 0;
+
+	if (nl_cache_nitems(a) != nl_cache_nitems(b))
+		return 1;
+
+	for (obj = nl_cache_get_first(a); obj; obj = nl_cache_get_next(obj)) {
+		if (!(match = nl_cache_search(b, obj)))
+			diff++;
+		else {
+			if (!nl_object_identical(obj, match))
+				diff++;
+			nl_object_put(match);
+		}
+	}
+
+	return diff;
+}
+
+/*
+ * Installs a number of routes into a separate table, saves a snapshot of
+ * the route cache and loads it into a new cache, as a daemon would on
+ * startup. Half of the routes are then replaced and the loaded cache is
+ * resynced, which must report exactly the changes and end up identical
+ * to a freshly filled cache. Refused snapshots are covered by the
+ * unit tests in check-cache.c.
+ *
+ * Usage: test-cache-snapshot [<routes>]
+ */
+int main(int argc, char *argv[])
+{
+	struct nl_sock *sk;
+	struct nl_cache *cache, *loaded;
+	char path[] = "/tmp/test-cache-snapshot.XXXXXX";
+	int n = 20000, k, fd, err, ret = 0, changes = 0;
+	uint32_t table = 100;
+	time_t saved;
+	double t;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 0);
+	if (n > 65000)
+		n = 65000;
+	k = n / 2;
+
+	if ((fd = mkstemp(path)) < 0)
+		nl_cli_fatal(errno, "Unable to create file: %s",
+			     strerror(errno));
+	close(fd);
+
+	sk = nl_cli_alloc_socket();
+	nl_cli_connect(sk, NETLINK_ROUTE);
+	nl_socket_set_buffer_size(sk, 1 << 20, 1 << 20);
+
+	txn_routes(sk, table, 0, n, 1);
+
+	cache = alloc_cache("route/route");
+	t = now();
+	if ((err = nl_cache_refill(sk, cache)) < 0)
+		nl_cli_fatal(err, "Unable to fill cache: %s", nl_geterror(err));
+	t = now() - t;
+	printf("nl_cache_refill: %d routes, %.3f ms\n",
+	       nl_cache_nitems(cache), t * 1e3);
+
+	t = now();
+	if ((err = nl_cache_snapshot_save(sk, cache, path)) < 0)
+		nl_cli_fatal(err, "Unable to save snapshot: %s",
+			     nl_geterror(err));
+	t = now() - t;
+	printf("nl_cache_snapshot_save: %d routes, %.3f ms\n",
+	       nl_cache_nitems(cache), t * 1e3);
+
+	loaded = alloc_cache("route/route");
+	t = now();
+	if ((err = nl_cache_snapshot_load(loaded, path, &saved)) < 0)
+		nl_cli_fatal(err, "Unable to load snapshot: %s",
+			     nl_geterror(err));
+	t = now() - t;
+	printf("nl_cache_snapshot_load: %d routes, %.3f ms\n",
+	       nl_cache_nitems(loaded), t * 1e3);
+
+	if (compare_caches(cache, loaded) || saved > time(NULL))
+		ret = 1;
+
+	/* Replace the first k routes with k new ones */
+	txn_routes(sk, table, 0, k, 0);
+	txn_routes(sk, table, n, k, 1);
+
+	t = now();
+	if ((err = nl_cache_resync(sk, loaded, change_cb, &changes)) < 0)
+		nl_cli_fatal(err, "Unable to resync cache: %s",
+			     nl_geterror(err));
+	t = now() - t;
+	printf("nl_cache_resync: %d changes, %.3f ms\n", changes, t * 1e3);
+
+	if (changes != 2 * k)
+		ret = 1;
+
+	nl_cache_refill(sk, cache);
+	if (compare_caches(cache, loaded)) {
+		fprintf(stderr, "Resynced cache differs from the kernel\n");
+		ret = 1;
+	}
+
+	txn_routes(sk, table, k, n, 0);
+
+	nl_cache_free(loaded);
+	nl_cache_free(cache);
+	nl_socket_free(sk);
+	unlink(path);
+
+	return ret;
+}
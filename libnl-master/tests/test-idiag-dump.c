@@ -0,0 +1,192 @@
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/cli/utils.h>
+#include <netlink/idiag/idiagnl.h>
+#include <netlink/idiag/msg.h>
+#include <netlink/idiag/filter.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test-util.h"
+
+static long rss_kb(void)
+{
+	long pages = 0;
+	FILE *fd;
+
+	if ((fd = fopen("/proc/self/statm", "r"))) {
+		if (fscanf(fd, "%*d %ld", &pages) != 1)
+			pages = 0;
+		fclose(fd);
+	}
+
+	return pages * (getpagesize() / 1024);
+}
+
+static int count_cb(struct idiagnl_msg *msg, void *arg)
+{
+	int *n = arg;
+
+	/* Touch the addresses like a real scan would */
+	if (nl_addr_get_len(idiagnl_msg_get_src(msg)) &&
+	    nl_addr_get_len(idiagnl_msg_get_dst(msg)))
+		(*n)++;
+
+	return NL_OK;
+}
+
+static int walk(struct nl_sock *sk, struct idiagnl_filter *filter,
+		const char *name)
+{
+	double t;
+	long rss;
+	int n = 0, err;
+
+	rss = rss_kb();
+	t = now();
+	if ((err = idiagnl_msg_dump_foreach(sk, AF_INET, IDIAGNL_SS_ALL, 0,
+					    filter, count_cb, &n)) < 0)
+		nl_cli_fatal(err, "Unable to walk sockets: %s",
+			     nl_geterror(err));
+	t = now() - t;
+	printf("%s: %d sockets, %.3f ms, %+ld kB\n",
+	       name, n, t * 1e3, rss_kb() - rss);
+
+	return n;
+}
+
+static int listener(uint16_t *port)
+{
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(sin);
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+	    bind(fd, (struct sockaddr *) &sin, sizeof(sin)) < 0 ||
+	    listen(fd, 4096) < 0 ||
+	    getsockname(fd, (struct sockaddr *) &sin, &len) < 0)
+		nl_cli_fatal(errno, "Unable to create listener: %s",
+			     strerror(errno));
+
+	*port = ntohs(sin.sin_port);
+
+	return fd;
+}
+
+/*
+ * Opens a number of TCP connections over the loopback device and lists
+ * all IPv4 sockets, once by building a cache and once by walking the
+ * dump without allocating objects. The walk is then repeated with
+ * filters on the listening port to verify that the kernel only reports
+ * the matching sockets.
+ *
+ * Usage: test-idiag-dump [<connections>]
+ */
+int main(int argc, char *argv[])
+{
+	struct nl_sock *sk;
+	struct nl_cache *cache;
+	struct idiagnl_filter *filter;
+	struct nl_addr *lo;
+	struct rlimit rl;
+	int n = 10000, i, lfd, *fds, err, ret = 0, cnt;
+	uint16_t port;
+	long rss;
+	double t;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 0);
+
+	/* Two descriptors per connection */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < 2 * n + 64) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		getrlimit(RLIMIT_NOFILE, &rl);
+		if (rl.rlim_cur < 2 * n + 64)
+			n = (rl.rlim_cur - 64) / 2;
+	}
+
+	if (!(fds = calloc(2 * n, sizeof(int))))
+		nl_cli_fatal(ENOMEM, "Unable to allocate descriptors");
+
+	lfd = listener(&port);
+	for (i = 0; i < n; i++) {
+		struct sockaddr_in sin = {
+			.sin_family = AF_INET,
+			.sin_port = htons(port),
+			.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+		};
+
+		if ((fds[2 * i] = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+		    connect(fds[2 * i], (struct sockaddr *) &sin,
+			    sizeof(sin)) < 0 ||
+		    (fds[2 * i + 1] = accept(lfd, NULL, NULL)) < 0)
+			nl_cli_fatal(errno, "Unable to connect: %s",
+				     strerror(errno));
+	}
+
+	sk = nl_cli_alloc_socket();
+	if ((err = idiagnl_connect(sk)) < 0)
+		nl_cli_fatal(err, "Unable to connect netlink socket: %s",
+			     nl_geterror(err));
+
+	/* Larger buffers let the kernel fit more sockets into each read */
+	nl_socket_set_msg_buf_size(sk, 32768);
+
+	rss = rss_kb();
+	t = now();
+	if ((err = idiagnl_msg_alloc_cache(sk, AF_INET, IDIAGNL_SS_ALL,
+					   &cache)) < 0)
+		nl_cli_fatal(err, "Unable to allocate cache: %s",
+			     nl_geterror(err));
+	t = now() - t;
+	printf("idiagnl_msg_alloc_cache: %d sockets, %.3f ms, %+ld kB\n",
+	       nl_cache_nitems(cache), t * 1e3, rss_kb() - rss);
+	nl_cache_free(cache);
+
+	cnt = walk(sk, NULL, "idiagnl_msg_dump_foreach");
+	if (cnt < 2 * n + 1)
+		ret = 1;
+
+	/* Listener and accepted sockets */
+	filter = idiagnl_filter_alloc();
+	idiagnl_filter_add_sport(filter, port, port, 0);
+	if (walk(sk, filter, "sport filter") != n + 1)
+		ret = 1;
+	idiagnl_filter_free(filter);
+
+	/* Connecting sockets only */
+	lo = nl_addr_build(AF_INET, &(uint32_t) { htonl(INADDR_LOOPBACK) }, 4);
+	filter = idiagnl_filter_alloc();
+	idiagnl_filter_add_dst(filter, lo, port, 0);
+	idiagnl_filter_add_sport(filter, port, port, 1);
+	if (walk(sk, filter, "dst filter") != n)
+		ret = 1;
+	idiagnl_filter_free(filter);
+
+	/* Only the listener */
+	filter = idiagnl_filter_alloc();
+	idiagnl_filter_set_states(filter, 1 << TCP_LISTEN);
+	idiagnl_filter_add_src(filter, lo, port, 0);
+	if (walk(sk, filter, "listen filter") != 1)
+		ret = 1;
+	idiagnl_filter_free(filter);
+	nl_addr_put(lo);
+
+	nl_socket_free(sk);
+
+	for (i = 0; i < 2 * n; i++)
+		close(fds[i]);
+	close(lfd);
+	free(fds);
+
+	return ret;
+}
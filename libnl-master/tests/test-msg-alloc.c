@@ -0,0 +1,136 @@
+#include <netlink/netlink.h>
+#include <netlink/msg.h>
+#include <netlink/cli/utils.h>
+#include <netlink/route/route.h>
+#include <time.h>
+
+#include <linux/rtnetlink.h>
+
+#include "test-util.h"
+
+/* Count heap allocations by interposing the glibc allocator */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+static unsigned long nallocs;
+
+void *malloc(size_t size)
+{
+	nallocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	nallocs++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	nallocs++;
+	return __libc_realloc(ptr, size);
+}
+
+static struct rtnl_route *build_route(int i)
+{
+	struct rtnl_route *route;
+	struct rtnl_nexthop *nh;
+	struct nl_addr *dst;
+	uint32_t a = htonl(0x0a000000 | (i << 8));
+	int j;
+
+	route = rtnl_route_alloc();
+	dst = nl_addr_build(AF_INET, &a, sizeof(a));
+	nl_addr_set_prefixlen(dst, 24);
+	rtnl_route_set_dst(route, dst);
+	rtnl_route_set_table(route, 100);
+	for (j = 0; j < 4; j++) {
+		nh = rtnl_route_nh_alloc();
+		rtnl_route_nh_set_ifindex(nh, 1 + j);
+		rtnl_route_nh_set_weight(nh, j);
+		rtnl_route_add_nexthop(route, nh);
+	}
+	nl_addr_put(dst);
+
+	return route;
+}
+
+/*
+ * Builds route requests in a loop, once the usual way through
+ * rtnl_route_build_add_request() and once into a single message backed
+ * by a stack buffer, and reports the heap allocations per message. Both
+ * ways must produce identical messages and the second one must not
+ * allocate at all.
+ *
+ * Usage: test-msg-alloc [<messages>]
+ */
+int main(int argc, char *argv[])
+{
+	struct rtnl_route *route;
+	struct nl_msg *msg, *ref;
+	struct nlmsghdr hdr = {
+		.nlmsg_type = RTM_NEWROUTE,
+		.nlmsg_flags = NLM_F_CREATE,
+	};
+	char buf[1024] __attribute__((aligned(NLMSG_ALIGNTO)));
+	unsigned long n = 1000000, i, a;
+	int err, ret = 0;
+	double t;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 0);
+
+	route = build_route(1);
+
+	/* Warm up, the first message populates the pool */
+	if ((err = rtnl_route_build_add_request(route, 0, &ref)) < 0)
+		nl_cli_fatal(err, "Unable to build message: %s",
+			     nl_geterror(err));
+
+	a = nallocs;
+	t = now();
+	for (i = 0; i < n; i++) {
+		if (rtnl_route_build_add_request(route, 0, &msg) < 0)
+			ret = 1;
+		nlmsg_free(msg);
+	}
+	t = now() - t;
+	printf("rtnl_route_build_add_request: %.1f ns/msg, %.2f allocs/msg\n",
+	       t * 1e9 / n, (double) (nallocs - a) / n);
+
+	a = nallocs;
+	t = now();
+	msg = nlmsg_alloc_buf(buf, sizeof(buf));
+	for (i = 0; i < n; i++) {
+		nlmsg_reset(msg);
+		if (!nlmsg_put(msg, 0, 0, hdr.nlmsg_type, 0, hdr.nlmsg_flags) ||
+		    rtnl_route_build_msg(msg, route) < 0)
+			ret = 1;
+	}
+	t = now() - t;
+	printf("nlmsg_alloc_buf + nlmsg_reset: %.1f ns/msg, %.2f allocs/msg\n",
+	       t * 1e9 / n, (double) (nallocs - a) / n);
+
+	if (nallocs - a > 0)
+		ret = 1;
+
+	if (nlmsg_hdr(msg)->nlmsg_len != nlmsg_hdr(ref)->nlmsg_len ||
+	    memcmp(nlmsg_hdr(msg), nlmsg_hdr(ref), nlmsg_hdr(ref)->nlmsg_len)) {
+		fprintf(stderr, "Messages differ\n");
+		ret = 1;
+	}
+
+	/* Growing a message moves it off the caller's buffer */
+	if (nlmsg_expand(msg, 2 * sizeof(buf)) < 0 ||
+	    (void *) nlmsg_hdr(msg) == (void *) buf ||
+	    memcmp(nlmsg_hdr(msg), nlmsg_hdr(ref), nlmsg_hdr(ref)->nlmsg_len))
+		ret = 1;
+
+	nlmsg_free(msg);
+	nlmsg_free(ref);
+	rtnl_route_put(route);
+
+	return ret;
+}
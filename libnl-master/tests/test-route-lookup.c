@@ -0,0 +1,279 @@
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/msg.h>
+#include <netlink/cli/utils.h>
+#include <netlink/route/route.h>
+#include <netlink/fib_lookup/request.h>
+#include <netlink/fib_lookup/lookup.h>
+#include <time.h>
+
+#include <linux/rtnetlink.h>
+
+#include "test-util.h"
+
+/*
+ * Resolves random IPv4 and IPv6 addresses against a routing table, once
+ * through the route cache index and once through the kernel, and reports
+ * the lookup rate of both along with the number of addresses for which
+ * they disagree on the prefix length. IPv4 addresses are resolved by the
+ * kernel's fib_lookup interface, IPv6 addresses by RTM_GETROUTE requests
+ * asking for the matching FIB entry.
+ *
+ * Half of the addresses are drawn from the prefixes of the table so that
+ * more than the default route gets exercised.
+ *
+ * Only unicast answers are compared: the kernel looks IPv4 addresses up
+ * in the local table merged into the main table and IPv6 addresses
+ * through the routing rules, so local and broadcast routes of another
+ * table may shadow the answer of the cache.
+ *
+ * Usage: test-route-lookup [<lookups> [<kernel lookups> [<table>]]]
+ */
+
+static void parse_cb(struct nl_object *obj, void *arg)
+{
+	nl_object_get(obj);
+	*(struct nl_object **) arg = obj;
+}
+
+static int valid_cb(struct nl_msg *msg, void *arg)
+{
+	return nl_msg_parse(msg, &parse_cb, arg);
+}
+
+/*
+ * Asks the kernel for the route an address resolves to. Returns its
+ * prefix length, -1 if no route covers the address or -2 if the answer
+ * is not to be compared.
+ */
+static int kernel_lookup(struct nl_sock *sk, struct nl_cache *results,
+			 struct nl_addr *addr, uint32_t table)
+{
+	struct rtnl_route *route = NULL;
+	struct nl_msg *msg;
+	int err, plen;
+
+	if (nl_addr_get_family(addr) == AF_INET) {
+		struct flnl_request *req;
+		struct flnl_result *res;
+
+		if (!(req = flnl_request_alloc()))
+			nl_cli_fatal(ENOMEM, "Unable to allocate request");
+
+		flnl_request_set_table(req, table);
+		flnl_request_set_addr(req, addr);
+
+		if ((err = flnl_lookup(sk, req, results)) < 0)
+			nl_cli_fatal(err, "Unable to lookup: %s",
+				     nl_geterror(err));
+
+		res = (struct flnl_result *) nl_cache_get_first(results);
+		if (flnl_result_get_error(res))
+			plen = -1;
+		else if (flnl_result_get_type(res) != RTN_UNICAST)
+			plen = -2;
+		else
+			plen = flnl_result_get_prefixlen(res);
+
+		nl_cache_clear(results);
+		nl_object_put((struct nl_object *) req);
+
+		return plen;
+	} else {
+		struct rtmsg rtm = {
+			.rtm_family = AF_INET6,
+			.rtm_dst_len = 128,
+			.rtm_flags = RTM_F_FIB_MATCH,
+		};
+
+		if (!(msg = nlmsg_alloc_simple(RTM_GETROUTE, 0)))
+			nl_cli_fatal(ENOMEM, "Unable to allocate message");
+		if (nlmsg_append(msg, &rtm, sizeof(rtm), NLMSG_ALIGNTO) < 0 ||
+		    nla_put_addr(msg, RTA_DST, addr) < 0)
+			nl_cli_fatal(ENOMEM, "Unable to build message");
+
+		err = nl_send_auto(sk, msg);
+		nlmsg_free(msg);
+		if (err < 0)
+			nl_cli_fatal(err, "Unable to send request: %s",
+				     nl_geterror(err));
+
+		nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM, valid_cb,
+				    &route);
+		if (nl_recvmsgs_default(sk) < 0 || !route)
+			plen = -1;
+		else if (rtnl_route_get_table(route) != table ||
+			 rtnl_route_get_type(route) != RTN_UNICAST)
+			plen = -2;
+		else
+			plen = nl_addr_get_prefixlen(rtnl_route_get_dst(route));
+
+		if (route)
+			rtnl_route_put(route);
+
+		return plen;
+	}
+}
+
+/*
+ * Random address, copying the prefix of a random entry of prefixes
+ * every other time.
+ */
+static struct nl_addr *random_addr(int family, struct nl_addr **prefixes,
+				   int nprefixes)
+{
+	uint8_t buf[16];
+	int len = family == AF_INET ? 4 : 16, i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = random();
+
+	if (nprefixes && (random() & 1)) {
+		struct nl_addr *p = prefixes[random() % nprefixes];
+		uint8_t *pb = nl_addr_get_binary_addr(p);
+		int plen = nl_addr_get_prefixlen(p);
+
+		for (i = 0; i < plen / 8; i++)
+			buf[i] = pb[i];
+		if (plen % 8) {
+			uint8_t mask = 0xff << (8 - plen % 8);
+
+			buf[i] = (pb[i] & mask) | (buf[i] & ~mask);
+		}
+	}
+
+	return nl_addr_build(family, buf, len);
+}
+
+static int lookup_family(struct nl_sock *sk, int family, int n, int nk,
+			 uint32_t table)
+{
+	struct nl_sock *ksk;
+	struct nl_cache *routes, *results = NULL;
+	struct nl_addr **addrs, **prefixes;
+	struct nl_object *obj;
+	struct rtnl_route *route;
+	int i, err, hits = 0, mismatch = 0, skipped = 0, nprefixes = 0;
+	double t;
+
+	if ((err = rtnl_route_alloc_cache(sk, family, 0, &routes)) < 0)
+		nl_cli_fatal(err, "Unable to allocate route cache: %s",
+			     nl_geterror(err));
+
+	if (!(addrs = calloc(n, sizeof(*addrs))) ||
+	    !(prefixes = calloc(nl_cache_nitems(routes) + 1,
+				sizeof(*prefixes))))
+		nl_cli_fatal(ENOMEM, "Unable to allocate addresses");
+
+	for (obj = nl_cache_get_first(routes); obj;
+	     obj = nl_cache_get_next(obj)) {
+		route = (struct rtnl_route *) obj;
+		if (rtnl_route_get_table(route) == table &&
+		    rtnl_route_get_type(route) == RTN_UNICAST)
+			prefixes[nprefixes++] = rtnl_route_get_dst(route);
+	}
+
+	for (i = 0; i < n; i++)
+		if (!(addrs[i] = random_addr(family, prefixes, nprefixes)))
+			nl_cli_fatal(ENOMEM, "Unable to allocate address");
+
+	/* First lookup compiles the index, keep it out of the measurement */
+	t = now();
+	route = rtnl_route_lookup(routes, addrs[0], table);
+	if (route)
+		rtnl_route_put(route);
+	printf("%s index build: %d routes in %.3f ms\n",
+	       family == AF_INET ? "inet" : "inet6",
+	       nl_cache_nitems(routes), (now() - t) * 1e3);
+
+	t = now();
+	for (i = 0; i < n; i++) {
+		route = rtnl_route_lookup(routes, addrs[i], table);
+		if (route) {
+			hits++;
+			rtnl_route_put(route);
+		}
+	}
+	t = now() - t;
+	printf("rtnl_route_lookup: %d lookups, %d hits, %.1f ns/lookup\n",
+	       n, hits, t * 1e9 / n);
+
+	ksk = nl_cli_alloc_socket();
+	if (family == AF_INET) {
+		nl_cli_connect(ksk, NETLINK_FIB_LOOKUP);
+
+		/* Replies to fib_lookup requests carry no sequence number */
+		nl_socket_disable_seq_check(ksk);
+
+		if (!(results = flnl_result_alloc_cache()))
+			nl_cli_fatal(ENOMEM, "Unable to allocate result cache");
+	} else {
+		nl_cli_connect(ksk, NETLINK_ROUTE);
+
+		/* The reply is the answer, an ack would only trail it */
+		nl_socket_disable_auto_ack(ksk);
+	}
+
+	t = now();
+	for (i = 0; i < nk; i++) {
+		int plen, cplen;
+
+		plen = kernel_lookup(ksk, results, addrs[i], table);
+
+		route = rtnl_route_lookup(routes, addrs[i], table);
+		cplen = route ? (int) nl_addr_get_prefixlen(
+					rtnl_route_get_dst(route)) : -1;
+		if (route && rtnl_route_get_type(route) != RTN_UNICAST)
+			cplen = -2;
+		if (route)
+			rtnl_route_put(route);
+
+		if (plen == -2 || cplen == -2)
+			skipped++;
+		else if (plen != cplen)
+			mismatch++;
+	}
+	t = now() - t;
+	printf("%s: %d lookups, %.1f ns/lookup, %d skipped, %d mismatches\n",
+	       family == AF_INET ? "flnl_lookup" : "RTM_GETROUTE",
+	       nk, t * 1e9 / (nk ? nk : 1), skipped, mismatch);
+
+	for (i = 0; i < n; i++)
+		nl_addr_put(addrs[i]);
+	free(addrs);
+	free(prefixes);
+
+	if (results)
+		nl_cache_free(results);
+	nl_cache_free(routes);
+	nl_socket_free(ksk);
+
+	return mismatch;
+}
+
+int main(int argc, char *argv[])
+{
+	struct nl_sock *sk;
+	int n = 1000000, nk = 10000, mismatch;
+	uint32_t table = RT_TABLE_MAIN;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		nk = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		table = strtoul(argv[3], NULL, 0);
+	if (nk > n)
+		nk = n;
+
+	sk = nl_cli_alloc_socket();
+	nl_cli_connect(sk, NETLINK_ROUTE);
+
+	srandom(time(NULL));
+	mismatch = lookup_family(sk, AF_INET, n, nk, table);
+	mismatch += lookup_family(sk, AF_INET6, n, nk, table);
+
+	nl_socket_free(sk);
+
+	return mismatch ? 1 : 0;
+}
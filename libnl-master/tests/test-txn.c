@@ -0,0 +1,149 @@
+#include <netlink/netlink.h>
+#include <netlink/txn.h>
+#include <netlink/cli/utils.h>
+#include <netlink/route/route.h>
+#include <time.h>
+
+#include <linux/rtnetlink.h>
+
+#include "test-util.h"
+
+static struct rtnl_route *build_route(uint32_t table, int ifindex, int i)
+{
+	struct rtnl_route *route;
+	struct rtnl_nexthop *nh;
+	struct nl_addr *dst;
+	uint32_t a = htonl(0x0a000000 | (i << 8));
+
+	route = rtnl_route_alloc();
+	dst = nl_addr_build(AF_INET, &a, sizeof(a));
+	nl_addr_set_prefixlen(dst, 24);
+	rtnl_route_set_dst(route, dst);
+	rtnl_route_set_table(route, table);
+	nh = rtnl_route_nh_alloc();
+	rtnl_route_nh_set_ifindex(nh, ifindex);
+	rtnl_route_add_nexthop(route, nh);
+	nl_addr_put(dst);
+
+	return route;
+}
+
+static void error_cb(struct nl_msg *msg, int err, void *arg)
+{
+	int *nerr = arg;
+
+	if ((*nerr)++ < 3)
+		fprintf(stderr, "request seq %u failed: %s\n",
+			nlmsg_hdr(msg)->nlmsg_seq, nl_geterror(err));
+}
+
+static int txn_range(struct nl_sock *sk, uint32_t table, int ifindex,
+		     int first, int n, int add, int *nerr)
+{
+	struct nl_txn *txn;
+	struct nl_msg *msg;
+	int i, err;
+
+	if ((err = nl_txn_alloc(sk, &txn)) < 0)
+		nl_cli_fatal(err, "Unable to allocate transaction: %s",
+			     nl_geterror(err));
+
+	nl_txn_set_error_cb(txn, error_cb, nerr);
+
+	for (i = first; i < first + n; i++) {
+		struct rtnl_route *route = build_route(table, ifindex, i);
+
+		if (add)
+			err = rtnl_route_build_add_request(route,
+						NLM_F_CREATE | NLM_F_EXCL, &msg);
+		else
+			err = rtnl_route_build_del_request(route, 0, &msg);
+		if (err < 0)
+			nl_cli_fatal(err, "Unable to build request: %s",
+				     nl_geterror(err));
+
+		if ((err = nl_txn_add(txn, msg)) < 0)
+			nl_cli_fatal(err, "Unable to queue request: %s",
+				     nl_geterror(err));
+
+		nlmsg_free(msg);
+		rtnl_route_put(route);
+	}
+
+	err = nl_txn_commit(txn);
+	nl_txn_free(txn);
+
+	return err;
+}
+
+/*
+ * Installs and removes routes pointing to the loopback device in a
+ * separate routing table, once with one round trip per route and once
+ * through a pipelined transaction. Also verifies that failed requests
+ * are reported by re-adding a range of routes which already exist.
+ *
+ * Usage: test-txn [<routes> [<table>]]
+ */
+int main(int argc, char *argv[])
+{
+	struct nl_sock *sk;
+	int n = 20000, i, err, nerr = 0, ret = 0;
+	uint32_t table = 100;
+	double t;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		table = strtoul(argv[2], NULL, 0);
+	if (n > 65000)
+		n = 65000;
+
+	sk = nl_cli_alloc_socket();
+	nl_cli_connect(sk, NETLINK_ROUTE);
+
+	/* A larger receive buffer allows for a larger window */
+	nl_socket_set_buffer_size(sk, 1 << 20, 1 << 20);
+
+	t = now();
+	for (i = 0; i < n; i++) {
+		struct rtnl_route *route = build_route(table, 1, i);
+
+		if ((err = rtnl_route_add(sk, route, NLM_F_EXCL)) < 0)
+			nl_cli_fatal(err, "Unable to add route: %s",
+				     nl_geterror(err));
+		rtnl_route_put(route);
+	}
+	t = now() - t;
+	printf("rtnl_route_add: %d routes, %.2f us/route\n", n, t * 1e6 / n);
+
+	t = now();
+	err = txn_range(sk, table, 1, 0, n, 0, &nerr);
+	t = now() - t;
+	printf("transaction delete: %d routes, %.2f us/route, err=%d\n",
+	       n, t * 1e6 / n, err);
+
+	t = now();
+	err = txn_range(sk, table, 1, 0, n, 1, &nerr);
+	t = now() - t;
+	printf("transaction add: %d routes, %.2f us/route, err=%d\n",
+	       n, t * 1e6 / n, err);
+
+	if (nerr)
+		ret = 1;
+
+	/* Half of these already exist and must be reported as such */
+	err = txn_range(sk, table, 1, n / 2, n / 2 + 10, 1, &nerr);
+	printf("overlapping add: %d failures, first error: %s\n",
+	       nerr, nl_geterror(err));
+	if (nerr != n / 2 || err != -NLE_EXIST)
+		ret = 1;
+
+	nerr = 0;
+	txn_range(sk, table, 1, 0, n + 10, 0, &nerr);
+	if (nerr)
+		ret = 1;
+
+	nl_socket_free(sk);
+
+	return ret;
+}
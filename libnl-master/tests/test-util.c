@@ -0,0 +1,63 @@
+#include <netlink/netlink.h>
+#include <netlink/txn.h>
+#include <netlink/cli/utils.h>
+#include <netlink/route/route.h>
+#include <time.h>
+
+#include "test-util.h"
+
+/* Monotonic time in seconds */
+double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Adds or deletes routes 10.0.<i>.0/24 with metric <i> pointing to the
+ * loopback device for first <= i < first + n in the given table, all
+ * through one transaction. Exits if any request fails.
+ */
+void txn_routes(struct nl_sock *sk, uint32_t table, int first, int n, int add)
+{
+	struct nl_txn *txn;
+	struct nl_msg *msg;
+	int i, err;
+
+	if ((err = nl_txn_alloc(sk, &txn)) < 0)
+		nl_cli_fatal(err, "Unable to allocate transaction: %s",
+			     nl_geterror(err));
+
+	for (i = first; i < first + n; i++) {
+		struct rtnl_route *route = rtnl_route_alloc();
+		struct rtnl_nexthop *nh = rtnl_route_nh_alloc();
+		uint32_t a = htonl(0x0a000000 | (i << 8));
+		struct nl_addr *dst = nl_addr_build(AF_INET, &a, sizeof(a));
+
+		nl_addr_set_prefixlen(dst, 24);
+		rtnl_route_set_dst(route, dst);
+		rtnl_route_set_table(route, table);
+		rtnl_route_set_priority(route, i);
+		rtnl_route_nh_set_ifindex(nh, 1);
+		rtnl_route_add_nexthop(route, nh);
+
+		if (add)
+			err = rtnl_route_build_add_request(route, NLM_F_CREATE,
+							   &msg);
+		else
+			err = rtnl_route_build_del_request(route, 0, &msg);
+		if (err < 0 || (err = nl_txn_add(txn, msg)) < 0)
+			nl_cli_fatal(err, "Unable to queue request: %s",
+				     nl_geterror(err));
+
+		nlmsg_free(msg);
+		rtnl_route_put(route);
+		nl_addr_put(dst);
+	}
+
+	if ((err = nl_txn_commit(txn)) < 0)
+		nl_cli_fatal(err, "Transaction failed: %s", nl_geterror(err));
+	nl_txn_free(txn);
+}
@@ -0,0 +1,11 @@
+#ifndef NETLINK_TEST_UTIL_H_
+#define NETLINK_TEST_UTIL_H_
+
+#include <netlink/netlink.h>
+
+/* Helpers shared by the test programs, see test-util.c */
+
+extern double	now(void);
+extern void	txn_routes(struct nl_sock *, uint32_t, int, int, int);
+
+#endif
@@ -0,0 +1,331 @@
+#include <netlink/netlink.h>
+#include <netlink/cache.h>
+#include <netlink/cli/utils.h>
+#include <netlink/xfrm/sa.h>
+#include <netlink/xfrm/sp.h>
+#include <netlink/xfrm/selector.h>
+#include <linux/xfrm.h>
+#include <time.h>
+
+#include "test-util.h"
+
+static struct nl_cache *alloc_cache(const char *name)
+{
+	struct nl_cache *cache;
+	int err;
+
+	if ((err = nl_cache_alloc_name(name, &cache)) < 0)
+		nl_cli_fatal(err, "Unable to allocate %s cache: %s", name,
+			     nl_geterror(err));
+
+	return cache;
+}
+
+static struct nl_addr *ip4(uint32_t a)
+{
+	a = htonl(a);
+	return nl_addr_build(AF_INET, &a, sizeof(a));
+}
+
+static struct xfrmnl_sa *build_sa(int i)
+{
+	struct xfrmnl_sa *sa = xfrmnl_sa_alloc();
+	struct nl_addr *daddr = ip4(0x0a000000 | (i & 0xff));
+
+	xfrmnl_sa_set_daddr(sa, daddr);
+	xfrmnl_sa_set_spi(sa, 0x1000 + i);
+	xfrmnl_sa_set_proto(sa, IPPROTO_ESP);
+	nl_addr_put(daddr);
+
+	return sa;
+}
+
+static int test_sa(int n)
+{
+	struct nl_cache *cache = alloc_cache("xfrm/sa");
+	struct xfrmnl_sa *sa;
+	struct nl_object *obj;
+	struct nl_addr *daddr;
+	int i, found = 0, ret = 0, nscan = n < 1000 ? n : 1000;
+	double t;
+
+	t = now();
+	for (i = 0; i < n; i++) {
+		sa = build_sa(i);
+		nl_cache_add(cache, (struct nl_object *) sa);
+		xfrmnl_sa_put(sa);
+	}
+	t = now() - t;
+	printf("nl_cache_add: %d SAs, %.2f us/SA\n", n, t * 1e6 / n);
+
+	t = now();
+	for (i = 0; i < n; i++) {
+		daddr = ip4(0x0a000000 | (i & 0xff));
+		if ((sa = xfrmnl_sa_get(cache, daddr, 0x1000 + i,
+					IPPROTO_ESP))) {
+			found++;
+			xfrmnl_sa_put(sa);
+		}
+		nl_addr_put(daddr);
+	}
+	t = now() - t;
+	printf("xfrmnl_sa_get: %d/%d found, %.3f us/lookup\n",
+	       found, n, t * 1e6 / n);
+	if (found != n)
+		ret = 1;
+
+	/* What a lookup used to cost */
+	t = now();
+	for (i = n - nscan; i < n; i++) {
+		for (obj = nl_cache_get_first(cache); obj;
+		     obj = nl_cache_get_next(obj)) {
+			sa = (struct xfrmnl_sa *) obj;
+			if (xfrmnl_sa_get_spi(sa) == 0x1000 + i &&
+			    xfrmnl_sa_get_proto(sa) == IPPROTO_ESP)
+				break;
+		}
+	}
+	t = now() - t;
+	printf("linear scan: %.3f us/lookup\n", t * 1e6 / nscan);
+
+	daddr = ip4(0x0b000000);
+	if ((sa = xfrmnl_sa_get(cache, daddr, 0x1000, IPPROTO_ESP))) {
+		xfrmnl_sa_put(sa);
+		ret = 1;
+	}
+	nl_addr_put(daddr);
+
+	nl_cache_free(cache);
+
+	return ret;
+}
+
+struct policy {
+	uint32_t	daddr, saddr;
+	int		plen_d, plen_s;
+	int		dir, prio, seq;
+	int		dport, proto;
+	unsigned int	mark, mark_mask;
+	struct xfrmnl_sp *sp;
+};
+
+static const int plens[][2] = {
+	{ 32, 32 }, { 24, 32 }, { 24, 24 }, { 16, 0 }, { 8, 0 }, { 0, 0 },
+};
+
+static struct xfrmnl_sp *build_sp(struct policy *p, unsigned int index)
+{
+	struct xfrmnl_sp *sp = xfrmnl_sp_alloc();
+	struct xfrmnl_sel *sel = xfrmnl_sel_alloc();
+	struct nl_addr *a;
+
+	a = ip4(p->daddr);
+	xfrmnl_sel_set_daddr(sel, a);
+	nl_addr_put(a);
+	a = ip4(p->saddr);
+	xfrmnl_sel_set_saddr(sel, a);
+	nl_addr_put(a);
+	xfrmnl_sel_set_family(sel, AF_INET);
+	xfrmnl_sel_set_prefixlen_d(sel, p->plen_d);
+	xfrmnl_sel_set_prefixlen_s(sel, p->plen_s);
+	xfrmnl_sel_set_dport(sel, p->dport);
+	xfrmnl_sel_set_dportmask(sel, p->dport ? 0xffff : 0);
+	xfrmnl_sel_set_proto(sel, p->proto);
+
+	xfrmnl_sp_set_sel(sp, sel);
+	xfrmnl_sp_set_index(sp, index);
+	xfrmnl_sp_set_dir(sp, p->dir);
+	xfrmnl_sp_set_priority(sp, p->prio);
+	if (p->mark_mask)
+		xfrmnl_sp_set_mark(sp, p->mark, p->mark_mask);
+	xfrmnl_sel_put(sel);
+
+	return sp;
+}
+
+static void random_policy(struct policy *p)
+{
+	const int *plen = plens[rand() % 6];
+
+	p->plen_d = plen[0];
+	p->plen_s = plen[1];
+	p->daddr = 0x0a000000 | (rand() & 0xffffff);
+	p->saddr = 0xac100000 | (rand() & 0xfffff);
+	p->dir = rand() % 3;
+	p->prio = rand() % 64;
+	p->dport = rand() % 4 ? 0 : 500 + rand() % 4;
+	p->proto = rand() % 4 ? 0 : IPPROTO_UDP;
+	p->mark_mask = rand() % 8 ? 0 : 0xff;
+	p->mark = p->mark_mask ? rand() % 2 : 0;
+}
+
+static int prefix_match(uint32_t a, uint32_t b, int plen)
+{
+	return !plen || !((a ^ b) >> (32 - plen));
+}
+
+/* The policy with the lowest priority wins, the first one on ties */
+static struct policy *brute_force(struct policy *pol, int n, int dir,
+				  uint32_t daddr, uint32_t saddr, int dport,
+				  int proto, unsigned int mark)
+{
+	struct policy *best = NULL;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		struct policy *p = &pol[i];
+
+		if (!p->sp || p->dir != dir ||
+		    !prefix_match(daddr, p->daddr, p->plen_d) ||
+		    !prefix_match(saddr, p->saddr, p->plen_s) ||
+		    (p->dport && p->dport != dport) ||
+		    (p->proto && p->proto != proto) ||
+		    (mark & p->mark_mask) != p->mark)
+			continue;
+
+		if (!best || p->prio < best->prio ||
+		    (p->prio == best->prio && p->seq < best->seq))
+			best = p;
+	}
+
+	return best;
+}
+
+static int check_lookups(struct nl_cache *cache, struct policy *pol, int n,
+			 int nlookups, const char *name)
+{
+	struct xfrmnl_sel *flow;
+	int i, hits = 0, errors = 0;
+	double t_idx = 0, t_lin = 0, t;
+
+	for (i = 0; i < nlookups; i++) {
+		struct policy *p = &pol[rand() % n], *exp;
+		struct xfrmnl_sp *sp;
+		struct nl_addr *daddr, *saddr;
+		uint32_t d = p->daddr ^ (rand() & 0xff);
+		uint32_t s = p->saddr ^ (rand() & 0x3);
+		int dport = 500 + rand() % 4, dir = rand() % 3;
+		int proto = rand() % 2 ? IPPROTO_UDP : IPPROTO_TCP;
+		unsigned int mark = rand() % 2;
+
+		flow = xfrmnl_sel_alloc();
+		daddr = ip4(d);
+		saddr = ip4(s);
+		xfrmnl_sel_set_daddr(flow, daddr);
+		xfrmnl_sel_set_saddr(flow, saddr);
+		xfrmnl_sel_set_dport(flow, dport);
+		xfrmnl_sel_set_proto(flow, proto);
+
+		t = now();
+		sp = xfrmnl_sp_lookup(cache, dir, flow, mark);
+		t_idx += now() - t;
+
+		t = now();
+		exp = brute_force(pol, n, dir, d, s, dport, proto, mark);
+		t_lin += now() - t;
+
+		if ((exp ? exp->sp : NULL) != sp) {
+			if (errors++ < 3)
+				fprintf(stderr, "%s: lookup %d: expected %p, "
+					"got %p\n", name, i,
+					exp ? exp->sp : NULL, sp);
+		}
+		if (sp) {
+			hits++;
+			xfrmnl_sp_put(sp);
+		}
+
+		xfrmnl_sel_put(flow);
+		nl_addr_put(daddr);
+		nl_addr_put(saddr);
+	}
+
+	printf("%s: %d lookups, %d hits, %d mismatches, "
+	       "%.3f us/lookup (brute force %.3f us/lookup)\n",
+	       name, nlookups, hits, errors, t_idx * 1e6 / nlookups,
+	       t_lin * 1e6 / nlookups);
+
+	return errors;
+}
+
+static int test_sp(int n)
+{
+	struct nl_cache *cache = alloc_cache("xfrm/sp");
+	struct policy *pol;
+	struct xfrmnl_sp *sp;
+	int i, ret = 0, seq = 0, nlookups = 20000;
+
+	if (!(pol = calloc(n, sizeof(*pol))))
+		nl_cli_fatal(ENOMEM, "Unable to allocate policies");
+
+	srand(1);
+	for (i = 0; i < n; i++) {
+		random_policy(&pol[i]);
+		pol[i].seq = seq++;
+		pol[i].sp = build_sp(&pol[i], 8 * i + pol[i].dir);
+		nl_cache_add(cache, (struct nl_object *) pol[i].sp);
+	}
+
+	if (check_lookups(cache, pol, n, nlookups, "initial"))
+		ret = 1;
+
+	/* Replace half of the policies, the index is updated in place */
+	for (i = 0; i < n; i += 2) {
+		nl_cache_remove((struct nl_object *) pol[i].sp);
+		xfrmnl_sp_put(pol[i].sp);
+		pol[i].sp = NULL;
+	}
+
+	if (check_lookups(cache, pol, n, nlookups, "after removal"))
+		ret = 1;
+
+	/* Re-added policies come last and thus lose ties */
+	for (i = 0; i < n; i += 2) {
+		random_policy(&pol[i]);
+		pol[i].seq = seq++;
+		pol[i].sp = build_sp(&pol[i], 8 * i + pol[i].dir);
+		nl_cache_add(cache, (struct nl_object *) pol[i].sp);
+	}
+	if (check_lookups(cache, pol, n, nlookups, "after re-adding"))
+		ret = 1;
+
+	for (i = 0; i < n; i++) {
+		if (!(sp = xfrmnl_sp_get(cache, 8 * i + pol[i].dir,
+					 pol[i].dir)) || sp != pol[i].sp)
+			ret = 1;
+		if (sp)
+			xfrmnl_sp_put(sp);
+	}
+
+	for (i = 0; i < n; i++)
+		xfrmnl_sp_put(pol[i].sp);
+	nl_cache_free(cache);
+	free(pol);
+
+	return ret;
+}
+
+/*
+ * Fills SA and SP caches with synthetic entries, as an IPsec gateway
+ * with many tunnels would see them, and measures the lookup cost. Policy
+ * lookups are verified against a brute force search, before and after
+ * policies have been removed and added incrementally.
+ *
+ * Usage: test-xfrm-lookup [<SAs> [<policies>]]
+ */
+int main(int argc, char *argv[])
+{
+	int nsa = 200000, nsp = 20000, ret = 0;
+
+	if (argc > 1)
+		nsa = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		nsp = strtoul(argv[2], NULL, 0);
+
+	if (test_sa(nsa))
+		ret = 1;
+	if (test_sp(nsp))
+		ret = 1;
+
+	return ret;
+}
@@ -6,4 +6,11 @@
 
 Suite *make_nl_attr_suite(void);
 Suite *make_nl_addr_suite(void);
+Suite *make_nl_cache_suite(void);
+Suite *make_nl_cache_mngr_suite(void);
+Suite *make_nl_ct_suite(void);
+Suite *make_nl_genl_suite(void);
+Suite *make_nl_queue_suite(void);
+Suite *make_nl_route_suite(void);
+Suite *make_nl_stats_suite(void);
 